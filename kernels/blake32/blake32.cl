@@ -7,6 +7,11 @@
  * any later version. See LICENSE for more details.
  */
 
+// Work-group size. Set by the host with -DWORKSIZE=N, see "LocalWorkSize".
+#ifndef WORKSIZE
+#define WORKSIZE 256
+#endif
+
 #define rotr32(a, w, c) \
 { \
     a = ( w >> c ) | ( w << ( 32 - c ) ); \
@@ -40,7 +45,7 @@ typedef union {
   ulong4 h8;
 } hash_t;
 
-__attribute__((reqd_work_group_size(256, 1, 1)))
+__attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
 __kernel void blake32(__global uint* hashes,
                       const uint uH0, const uint uH1, const uint uH2, const uint uH3,
                       const uint uH4, const uint uH5, const uint uH6, const uint uH7,
@@ -1,3 +1,8 @@
+// Work-group size. Set by the host with -DWORKSIZE=N, see "LocalWorkSize".
+#ifndef WORKSIZE
+#define WORKSIZE 256
+#endif
+
 #define shl(x, n)            ((x) << (n))
 #define shr(x, n)            ((x) >> (n))
 
@@ -130,7 +135,7 @@ typedef union {
     ulong4 h8;
 } hash_t;
 
-__attribute__((reqd_work_group_size(256, 1, 1)))
+__attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
 __kernel void bmw(__global uint* hashes)
 {
     uint gid = get_global_id(0);
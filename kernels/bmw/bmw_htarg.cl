@@ -1,3 +1,8 @@
+// Work-group size. Set by the host with -DWORKSIZE=N, see "LocalWorkSize".
+#ifndef WORKSIZE
+#define WORKSIZE 256
+#endif
+
 #define shl(x, n)            ((x) << (n))
 #define shr(x, n)            ((x) >> (n))
 
@@ -128,8 +133,10 @@ typedef union {
     ulong4 h8;
 } hash_t;
 
-__attribute__((reqd_work_group_size(256, 1, 1)))
-__kernel void bmw(__global uint* hashes, __global uint* output, const uint target)
+__attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
+// target: ptarget[7], targetLow: ptarget[6]. Comparing top 64 bits of the target
+// removes almost all candidates which would fail a full test on the host.
+__kernel void bmw(__global uint* hashes, __global uint* output, const uint target, const uint targetLow)
 {
     uint gid = get_global_id(0);
     
@@ -171,7 +178,7 @@ __kernel void bmw(__global uint* hashes, __global uint* output, const uint targe
     Compression256(message, dh);
     Compression256(dh, final_s);
     
-    if(final_s[15] <= target)
+    if((final_s[15] < target) || ((final_s[15] == target) && (final_s[14] <= targetLow)))
     {
         //atomic_xchg(output, gid);
         uint ai = atomic_inc(output);
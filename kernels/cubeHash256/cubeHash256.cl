@@ -7,6 +7,11 @@
  * any later version. See LICENSE for more details.
  */
 
+// Work-group size. Set by the host with -DWORKSIZE=N, see "LocalWorkSize".
+#ifndef WORKSIZE
+#define WORKSIZE 256
+#endif
+// Optional unroll factor of the round loops: -DCUBEHASH_UNROLL=N.
 
 #define SWAP(a,b) { uint u = a; a = b; b = u; }
 #define SWAP2(a,b) { uint2 u = a; a = b; b = u; }
@@ -175,7 +180,7 @@ typedef union {
     ulong4 h8;
 } hash_t;
 
-__attribute__((reqd_work_group_size(256, 1, 1)))
+__attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
 __kernel void cubeHash256(__global uint* hashes)
 {
     int gid = get_global_id(0);
@@ -202,6 +207,9 @@ __kernel void cubeHash256(__global uint* hashes)
     
     x[15].y ^= 1U;
     
+#ifdef CUBEHASH_UNROLL
+#pragma unroll CUBEHASH_UNROLL
+#endif
     for (int i = 0; i < 10; ++i)
     {
         roundsX2(x);
@@ -0,0 +1,27 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+// Work-group size. Set by the host with -DWORKSIZE=N, see "LocalWorkSize".
+#ifndef WORKSIZE
+#define WORKSIZE 64
+#endif
+
+// Copies hashes at (indices) into a compact buffer, so only a few bytes are read back.
+__attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
+__kernel void gather(__global const uint4* hashes, __global const uint* indices,
+                     __global uint4* output, const uint numIndices)
+{
+    uint gid = get_global_id(0);
+    if (gid >= numIndices)
+        return;
+
+    uint index = indices[gid];
+    output[gid*2]     = hashes[index*2];
+    output[gid*2 + 1] = hashes[index*2 + 1];
+}
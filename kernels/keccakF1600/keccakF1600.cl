@@ -7,6 +7,11 @@
  * any later version. See LICENSE for more details.
  */
 
+// Work-group size. Set by the host with -DWORKSIZE=N, see "LocalWorkSize".
+#ifndef WORKSIZE
+#define WORKSIZE 256
+#endif
+
 
 #define rotr64(x, n) ((n) < 32 ? (amd_bitalign((uint)((x) >> 32), (uint)(x), (uint)(n)) | ((ulong)amd_bitalign((uint)(x), (uint)((x) >> 32), (uint)(n)) << 32)) : (amd_bitalign((uint)(x), (uint)((x) >> 32), (uint)(n) - 32) | ((ulong)amd_bitalign((uint)((x) >> 32), (uint)(x), (uint)(n) - 32) << 32)))
 
@@ -93,7 +98,7 @@ __constant static const ulong RC[24] = {
   0x0000000080000001, 0x8000000080008008
 };
 
-__attribute__((reqd_work_group_size(256, 1, 1)))
+__attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
 __kernel void keccakF1600(__global uint* hashes)
 {
     int gid = get_global_id(0);
@@ -7,6 +7,23 @@
  * any later version. See LICENSE for more details.
  */
 
+// Work-group size. Set by the host with -DWORKSIZE=N, see "LocalWorkSize".
+#ifndef WORKSIZE
+#define WORKSIZE 64
+#endif
+
+// Optional fast path: -DLYRA_WAVEFRONT_SYNC. Lanes of a work-group run in lockstep
+// (WORKSIZE <= wavefront size), so local memory barriers can be replaced by fences.
+// The host drops the option for work-group sizes above the device wavefront size.
+#if defined(LYRA_WAVEFRONT_SYNC) && WORKSIZE > 64
+#error "LYRA_WAVEFRONT_SYNC requires WORKSIZE <= 64"
+#endif
+#ifdef LYRA_WAVEFRONT_SYNC
+#define lyraSync() mem_fence(CLK_LOCAL_MEM_FENCE)
+#else
+#define lyraSync() barrier(CLK_LOCAL_MEM_FENCE)
+#endif
+
 #define rotr64(x, n) ((n) < 32 ? (amd_bitalign((uint)((x) >> 32), (uint)(x), (uint)(n)) | ((ulong)amd_bitalign((uint)(x), (uint)((x) >> 32), (uint)(n)) << 32)) : (amd_bitalign((uint)(x), (uint)((x) >> 32), (uint)(n) - 32) | ((ulong)amd_bitalign((uint)((x) >> 32), (uint)(x), (uint)(n) - 32) << 32)))
 
 #define Gfunc(a,b,c,d) \
@@ -38,7 +55,7 @@
     smState[lIdx].s0 = state[1]; \
     smState[lIdx].s1 = state[2]; \
     smState[lIdx].s2 = state[3]; \
-    barrier(CLK_LOCAL_MEM_FENCE); \
+    lyraSync(); \
     state[1] = smState[gr4 + ((lIdx+1) & 3)].s0; \
     state[2] = smState[gr4 + ((lIdx+2) & 3)].s1; \
     state[3] = smState[gr4 + ((lIdx+3) & 3)].s2; \
@@ -48,7 +65,7 @@
     smState[lIdx].s0 = state[1]; \
     smState[lIdx].s1 = state[2]; \
     smState[lIdx].s2 = state[3]; \
-    barrier(CLK_LOCAL_MEM_FENCE); \
+    lyraSync(); \
     state[1] = smState[gr4 + ((lIdx+3) & 3)].s0; \
     state[2] = smState[gr4 + ((lIdx+2) & 3)].s1; \
     state[3] = smState[gr4 + ((lIdx+1) & 3)].s2; \
@@ -292,7 +309,7 @@ struct SharedState
     smState[lIdx].s0 = state[0]; \
     smState[lIdx].s1 = state[1]; \
     smState[lIdx].s2 = state[2]; \
-    barrier(CLK_LOCAL_MEM_FENCE); \
+    lyraSync(); \
     a_state1_0 = smState[gr4 + ((lIdx-1) & 3)].s0; \
     a_state1_1 = smState[gr4 + ((lIdx-1) & 3)].s1; \
     a_state1_2 = smState[gr4 + ((lIdx-1) & 3)].s2; \
@@ -367,10 +384,10 @@ struct SharedState
 }
 
 
-__attribute__((reqd_work_group_size(64, 1, 1)))
+__attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
 __kernel void lyra441p2(__global uint* lyraStates)
 {
-     __local struct SharedState smState[64];
+     __local struct SharedState smState[WORKSIZE];
 
     int gid = get_global_id(0) >> 2;
     __global lyraState_t *lyraState = (__global lyraState_t *)(lyraStates + (32* (gid)));
@@ -482,7 +499,7 @@ __kernel void lyra441p2(__global uint* lyraStates)
     ulong b0,b1;
 
     smState[lIdx].s0 = state[0];
-    barrier(CLK_LOCAL_MEM_FENCE);
+    lyraSync();
     uint rowa = (uint)smState[gr4].s0 & 3;
     wanderIteration(36,37,38, 0, 1, 2, 12,13,14, 24,25,26, 36,37,38, 0, 1, 2);
     wanderIteration(39,40,41, 3, 4, 5, 15,16,17, 27,28,29, 39,40,41, 3, 4, 5);
@@ -490,7 +507,7 @@ __kernel void lyra441p2(__global uint* lyraStates)
     wanderIteration(45,46,47, 9,10,11, 21,22,23, 33,34,35, 45,46,47, 9,10,11);
 
     smState[lIdx].s0 = state[0];
-    barrier(CLK_LOCAL_MEM_FENCE);
+    lyraSync();
     rowa = (uint)smState[gr4].s0 & 3;
     wanderIteration(0, 1, 2, 0, 1, 2, 12,13,14, 24,25,26, 36,37,38, 12,13,14);
     wanderIteration(3, 4, 5, 3, 4, 5, 15,16,17, 27,28,29, 39,40,41, 15,16,17);
@@ -498,7 +515,7 @@ __kernel void lyra441p2(__global uint* lyraStates)
     wanderIteration(9,10,11, 9,10,11, 21,22,23, 33,34,35, 45,46,47, 21,22,23);
 
     smState[lIdx].s0 = state[0];
-    barrier(CLK_LOCAL_MEM_FENCE);
+    lyraSync();
     rowa = (uint)smState[gr4].s0 & 3;
     wanderIteration(12,13,14, 0, 1, 2, 12,13,14, 24,25,26, 36,37,38, 24,25,26);
     wanderIteration(15,16,17, 3, 4, 5, 15,16,17, 27,28,29, 39,40,41, 27,28,29);
@@ -509,7 +526,7 @@ __kernel void lyra441p2(__global uint* lyraStates)
     //------------------------------------
     // Wandering phase part2 (last iteration)
     smState[lIdx].s0 = state[0];
-    barrier(CLK_LOCAL_MEM_FENCE);
+    lyraSync();
     rowa = (uint)smState[gr4].s0 & 3;
 
     int i, j;
@@ -547,7 +564,7 @@ __kernel void lyra441p2(__global uint* lyraStates)
     smState[lIdx].s0 = state[0];
     smState[lIdx].s1 = state[1];
     smState[lIdx].s2 = state[2];
-    barrier(CLK_LOCAL_MEM_FENCE);
+    lyraSync();
     ulong Data0 = smState[gr4 + ((lIdx-1) & 3)].s0;
     ulong Data1 = smState[gr4 + ((lIdx-1) & 3)].s1;
     ulong Data2 = smState[gr4 + ((lIdx-1) & 3)].s2;  
@@ -7,6 +7,23 @@
  * any later version. See LICENSE for more details.
  */
 
+// Work-group size. Set by the host with -DWORKSIZE=N, see "LocalWorkSize".
+#ifndef WORKSIZE
+#define WORKSIZE 64
+#endif
+
+// Optional fast path: -DLYRA_WAVEFRONT_SYNC. Lanes of a work-group run in lockstep
+// (WORKSIZE <= wavefront size), so local memory barriers can be replaced by fences.
+// The host drops the option for work-group sizes above the device wavefront size.
+#if defined(LYRA_WAVEFRONT_SYNC) && WORKSIZE > 64
+#error "LYRA_WAVEFRONT_SYNC requires WORKSIZE <= 64"
+#endif
+#ifdef LYRA_WAVEFRONT_SYNC
+#define lyraSync() mem_fence(CLK_LOCAL_MEM_FENCE)
+#else
+#define lyraSync() barrier(CLK_LOCAL_MEM_FENCE)
+#endif
+
 #define rotr64(x, n) ((n) < 32 ? (amd_bitalign((uint)((x) >> 32), (uint)(x), (uint)(n)) | ((ulong)amd_bitalign((uint)(x), (uint)((x) >> 32), (uint)(n)) << 32)) : (amd_bitalign((uint)(x), (uint)((x) >> 32), (uint)(n) - 32) | ((ulong)amd_bitalign((uint)((x) >> 32), (uint)(x), (uint)(n) - 32) << 32)))
 
 #define Gfunc(a,b,c,d) \
@@ -34,7 +51,7 @@
     smState[gr4 + ((lIdx+3) & 3)].s[1] = state[1]; \
     smState[gr4 + ((lIdx+2) & 3)].s[2] = state[2]; \
     smState[gr4 + ((lIdx+1) & 3)].s[3] = state[3]; \
-    barrier(CLK_LOCAL_MEM_FENCE); \
+    lyraSync(); \
     state[1] = smState[lIdx].s[1]; \
     state[2] = smState[lIdx].s[2]; \
     state[3] = smState[lIdx].s[3]; \
@@ -44,7 +61,7 @@
     smState[gr4 + ((lIdx+1) & 3)].s[1] = state[1]; \
     smState[gr4 + ((lIdx+2) & 3)].s[2] = state[2]; \
     smState[gr4 + ((lIdx+3) & 3)].s[3] = state[3]; \
-    barrier(CLK_LOCAL_MEM_FENCE); \
+    lyraSync(); \
     state[1] = smState[lIdx].s[1]; \
     state[2] = smState[lIdx].s[2]; \
     state[3] = smState[lIdx].s[3]; \
@@ -56,7 +73,7 @@
     smState[gr4 + ((lIdx+3) & 3)].s[1] = state[1]; \
     smState[gr4 + ((lIdx+2) & 3)].s[2] = state[2]; \
     smState[gr4 + ((lIdx+1) & 3)].s[3] = state[3]; \
-    barrier(CLK_LOCAL_MEM_FENCE); \
+    lyraSync(); \
     state[1] = smState[lIdx].s[1]; \
     state[2] = smState[lIdx].s[2]; \
     state[3] = smState[lIdx].s[3]; \
@@ -67,7 +84,7 @@
     smState[gr4 + ((lIdx+1) & 3)].s[1] = state[1]; \
     smState[gr4 + ((lIdx+2) & 3)].s[2] = state[2]; \
     smState[gr4 + ((lIdx+3) & 3)].s[3] = state[3]; \
-    barrier(CLK_LOCAL_MEM_FENCE); \
+    lyraSync(); \
     state[1] = smState[lIdx].s[1]; \
     state[2] = smState[lIdx].s[2]; \
     state[3] = smState[lIdx].s[3]; \
@@ -289,10 +306,10 @@ struct SharedState
 };
 
 
-__attribute__((reqd_work_group_size(64, 1, 1)))
+__attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
 __kernel void lyra441p2(__global uint* lyraStates)
 {
-    __local struct SharedState smState[64];
+    __local struct SharedState smState[WORKSIZE];
 
     int gid = get_global_id(0) >> 2;
     __global LyraState *lyraState = (__global LyraState *)(lyraStates + (32* (gid)));
@@ -7,6 +7,12 @@
  * any later version. See LICENSE for more details.
  */
 
+// Work-group size. Set by the host with -DWORKSIZE=N, see "LocalWorkSize".
+#ifndef WORKSIZE
+#define WORKSIZE 256
+#endif
+// Optional unroll factor of the round loops: -DLYRA_UNROLL=N.
+
 #define rotr64(x, n) ((n) < 32 ? (amd_bitalign((uint)((x) >> 32), (uint)(x), (uint)(n)) | ((ulong)amd_bitalign((uint)(x), (uint)((x) >> 32), (uint)(n)) << 32)) : (amd_bitalign((uint)(x), (uint)((x) >> 32), (uint)(n) - 32) | ((ulong)amd_bitalign((uint)((x) >> 32), (uint)(x), (uint)(n) - 32) << 32)))
 
 #define Gfunc(a,b,c,d) \
@@ -59,7 +65,7 @@ typedef union {
     ulong4 h8[4];
 } lyraState_t;
 
-__attribute__((reqd_work_group_size(256, 1, 1)))
+__attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
 __kernel void lyra441p3(__global uint* hashes, __global uint* lyraStates)
 {
     int gid = get_global_id(0);
@@ -81,6 +87,9 @@ __kernel void lyra441p3(__global uint* hashes, __global uint* lyraStates)
     state[7] = lyraState->hl4[7];
 
     // 2. rounds
+#ifdef LYRA_UNROLL
+#pragma unroll LYRA_UNROLL
+#endif
     for (int i = 0; i < 12; ++i)
     {
         roundLyra(state);
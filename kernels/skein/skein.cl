@@ -7,6 +7,11 @@
  * any later version. See LICENSE for more details.
  */
 
+// Work-group size. Set by the host with -DWORKSIZE=N, see "LocalWorkSize".
+#ifndef WORKSIZE
+#define WORKSIZE 256
+#endif
+
 // skein256 kernel
 // Based on cuda implementation from the ccminer project(Provos Alexis, Tanguy Pruvot and others).
 // OpenCL port and AMDGCN specific optimizations were done by CryptoGraphics.
@@ -36,7 +41,7 @@ typedef union {
 } hash_t;
 
 
-__attribute__((reqd_work_group_size(256, 1, 1)))
+__attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
 __kernel void skein(__global uint* hashes)
 {
     int gid = get_global_id(0);
@@ -24,6 +24,53 @@ function setupOpenCL()
     links "OpenCL"
 end
 -- ----------------------------------------------------------------------------
+-- Embeds all files from "kernels" directory(sources, asm programs, manifest)
+-- into the executable. See src/lyclCore/EmbeddedKernels.hpp
+function embedKernels(out_file_name)
+    local kernelFiles = os.matchfiles("kernels/**")
+    table.sort(kernelFiles)
+
+    local text = { "// Generated by premake5.lua. Do not edit.\n",
+                   "#include <lyclCore/EmbeddedKernels.hpp>\n\n",
+                   "namespace lycl\n{\n" }
+    for i, fileName in ipairs(kernelFiles) do
+        local f = assert(io.open(fileName, "rb"))
+        local data = f:read("*all")
+        f:close()
+
+        local bytes = {}
+        for j = 1, #data do
+            bytes[j] = string.format("%d,", data:byte(j))
+            if (j % 32) == 0 then
+                bytes[j] = bytes[j] .. "\n"
+            end
+        end
+        -- zero terminated, so empty files are valid arrays too.
+        table.insert(text, "    static const unsigned char s_file" .. i .. "[] = {\n" .. table.concat(bytes) .. "0 };\n")
+        kernelFiles[i] = { name = fileName, size = #data }
+    end
+
+    table.insert(text, "\n    const EmbeddedFile g_embeddedKernelFiles[] =\n    {\n")
+    for i, file in ipairs(kernelFiles) do
+        table.insert(text, "        { \"" .. file.name .. "\", s_file" .. i .. ", " .. file.size .. " },\n")
+    end
+    table.insert(text, "        { nullptr, nullptr, 0 }\n    };\n")
+    table.insert(text, "    const size_t g_numEmbeddedKernelFiles = " .. #kernelFiles .. ";\n}\n")
+
+    os.mkdir(path.getdirectory(out_file_name))
+    os.writefile_ifnotequal(table.concat(text), out_file_name)
+end
+-- ----------------------------------------------------------------------------
+-- Short git revision, or "unknown".
+function getRevision()
+    local revision, errorCode = os.outputof("git rev-parse --short HEAD")
+    if (errorCode ~= 0) or (revision == nil) or (revision == "") then
+        return "unknown"
+    end
+    revision = revision:gsub("%s+", "")
+    return revision
+end
+-- ----------------------------------------------------------------------------
 
 
 workspace "lyclMinerWorkspace"
@@ -40,6 +87,9 @@ workspace "lyclMinerWorkspace"
         symbols "On"
     filter { }
 
+    -- kernels
+    embedKernels("build/generated/EmbeddedKernels.cpp")
+
     -- dependencies
     setupOpenCL()
     setupJansson()
@@ -73,4 +123,85 @@ workspace "lyclMinerWorkspace"
                 "src/lyclCore/*.cpp",
                 "src/lyclHostValidators/*.hpp",
                 "src/lyclHostValidators/*.cpp",
-                "src/main.cpp" }
+                "src/main.cpp",
+                "build/generated/EmbeddedKernels.cpp" }
+
+    -- kernel benchmark. No pool connection, any OpenCL device.
+    project "lyclBench"
+        kind "ConsoleApp"
+        language "C++"
+        location "build/lyclBench"
+        
+        targetdir "bin"
+        
+        cppdialect "C++11"
+        
+        includedirs { "src", "." }
+        defines { "LYCL_REVISION=" .. getRevision() }
+
+        filter { "system:Windows" }
+            system "windows"
+        filter { "system:Linux" }
+            system "linux"
+            links { "pthread" }
+        filter { }
+
+        files { "src/lyclApplets/*.hpp",
+                "src/lyclCore/ConfigFile.cpp",
+                "src/lyclBench/*.hpp",
+                "src/lyclBench/main.cpp",
+                "build/generated/EmbeddedKernels.cpp" }
+
+    -- stratum host-side benchmark. No pool connection, no OpenCL.
+    project "lyclNetBench"
+        kind "ConsoleApp"
+        language "C++"
+        location "build/lyclNetBench"
+        
+        targetdir "bin"
+        
+        cppdialect "C++11"
+        
+        includedirs { "src", "." }
+
+        filter { "system:Windows" }
+            system "windows"
+        filter { "system:Linux" }
+            system "linux"
+        filter { }
+
+        files { "src/lyclCore/HexCodec.hpp",
+                "src/lyclCore/LineBuffer.hpp",
+                "src/lyclCore/StratumCapture.hpp",
+                "src/lyclCore/StratumParser.hpp",
+                "src/lyclNetBench/main.cpp" }
+
+    -- local stratum server: capture replay and synthetic job storms. No OpenCL.
+    project "lyclMockPool"
+        kind "ConsoleApp"
+        language "C++"
+        location "build/lyclMockPool"
+        
+        targetdir "bin"
+        
+        cppdialect "C++11"
+        
+        includedirs { "src", "." }
+
+        filter { "system:Windows" }
+            system "windows"
+            -- mingw-w64
+            links { "Ws2_32" }
+        filter { "system:Linux" }
+            system "linux"
+        filter { }
+
+        files { "src/lyclCore/Blake256.hpp",
+                "src/lyclCore/HexCodec.hpp",
+                "src/lyclCore/LineBuffer.hpp",
+                "src/lyclCore/Network.hpp",
+                "src/lyclCore/Sha256.hpp",
+                "src/lyclCore/StratumCapture.hpp",
+                "src/lyclCore/StratumParser.hpp",
+                "src/lyclHostValidators/*.hpp",
+                "src/lyclMockPool/main.cpp" }
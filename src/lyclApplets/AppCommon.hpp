@@ -12,6 +12,7 @@
 
 #include <lyclCore/CLUtils.hpp>
 #include <lyclCore/Global.hpp>
+#include <lyclHostValidators/HashTypes.hpp>
 
 namespace lycl
 {
@@ -31,10 +32,113 @@ namespace lycl
         uint32_t in17;
         uint32_t in18;
 
+        //! top 64 bits of the target: ptarget[7], ptarget[6]
         uint32_t htArg;
+        uint32_t htArgLow;
     };
     //-----------------------------------------------------------------------------
-    struct uint32x8 { uint32_t h[8]; };
+    //! Host version of the bmwHtarg kernel test. (bmw_hash) is a bmwHash() output.
+    inline bool htArgTest(const uint32x8& bmw_hash, uint32_t ht_arg, uint32_t ht_arg_low)
+    {
+        return (bmw_hash.h[7] < ht_arg) || ((bmw_hash.h[7] == ht_arg) && (bmw_hash.h[6] <= ht_arg_low));
+    }
+
+
+    //-----------------------------------------------------------------------------
+    // Device memory budget.
+    //-----------------------------------------------------------------------------
+    // Buffers allocated per hash by both applets:
+    // hash storage(32 bytes), lyra states(128 bytes), hTarg result(4 bytes).
+    const size_t c_hashStorageBytesPerHash = sizeof(uint32x8);
+    const size_t c_lyraStatesBytesPerHash  = sizeof(uint32x8)*4;
+    const size_t c_htArgResultBytesPerHash = sizeof(uint32_t);
+    //! Part of global memory which can be used for work buffers. The rest is left for the driver/programs/display.
+    const double c_globalMemoryBudget = 0.9;
+    //! WorkSize granularity(local work size of all kernels).
+    const size_t c_workSizeGranularity = 256;
+    //! Max number of hashes copied by a single gather kernel launch.
+    //! Gather buffers have a fixed size and are not part of the per-hash budget.
+    const size_t c_maxGatherSize = 4096;
+    //-----------------------------------------------------------------------------
+    //! Computes the largest WorkSize which fits into device memory.
+    //! Global memory budget is shared by (num_streams) pipelines.
+    //! Returns false if device memory info is not available. (out_max_work_size) is 0 if
+    //! not even one WorkSize granule fits.
+    inline bool getMaxWorkSizeForDevice(cl_device_id device_id, size_t& out_max_work_size, std::string* out_limit_reason = nullptr,
+                                        size_t num_streams = 1)
+    {
+        out_max_work_size = 0;
+        cl_ulong globalMemSize = 0;
+        cl_ulong maxMemAllocSize = 0;
+        if ((clGetDeviceInfo(device_id, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &globalMemSize, nullptr) != CL_SUCCESS) ||
+            (clGetDeviceInfo(device_id, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &maxMemAllocSize, nullptr) != CL_SUCCESS))
+        {
+            return false;
+        }
+
+        // the largest single allocation is a lyra state buffer.
+        const cl_ulong byAllocSize = maxMemAllocSize / c_lyraStatesBytesPerHash;
+        // all buffers must fit into global memory budget.
+        const size_t bytesPerHash = c_hashStorageBytesPerHash + c_lyraStatesBytesPerHash + c_htArgResultBytesPerHash;
+        if (!num_streams)
+            num_streams = 1;
+        const cl_ulong byGlobalSize = (cl_ulong)((double)globalMemSize * c_globalMemoryBudget) / bytesPerHash / num_streams;
+
+        cl_ulong result;
+        if (byAllocSize < byGlobalSize)
+        {
+            result = byAllocSize;
+            if (out_limit_reason)
+                *out_limit_reason = "max memory allocation size(" + std::to_string(maxMemAllocSize >> 20) + " MB)";
+        }
+        else
+        {
+            result = byGlobalSize;
+            if (out_limit_reason)
+            {
+                *out_limit_reason = "global memory size(" + std::to_string(globalMemSize >> 20) + " MB)";
+                if (num_streams > 1)
+                    *out_limit_reason += " shared by " + std::to_string(num_streams) + " streams";
+            }
+        }
+
+        // hTarg result buffer holds (WorkSize + 1) elements. Keep one granule as a reserve.
+        // Less than two granules leave no room for it.
+        result = (result >= 2 * c_workSizeGranularity) ? (result - result % c_workSizeGranularity - c_workSizeGranularity) : 0;
+
+        out_max_work_size = (size_t)result;
+        return true;
+    }
+    //-----------------------------------------------------------------------------
+    //! Clamps requested WorkSize to the device memory budget. Logs the reason if it was changed.
+    //! Returns 0 if the device can't fit a single WorkSize granule.
+    inline size_t clampWorkSizeToDeviceMemory(cl_device_id device_id, size_t work_size, const std::string& device_name,
+                                              size_t num_streams = 1)
+    {
+        std::string limitReason;
+        size_t maxWorkSize = 0;
+        if (!getMaxWorkSizeForDevice(device_id, maxWorkSize, &limitReason, num_streams))
+        {
+            std::cerr << "Warning: failed to query memory info. Using requested WorkSize(" << work_size << "). Device(" << device_name << ")" << std::endl;
+            return work_size;
+        }
+
+        if (!maxWorkSize)
+        {
+            std::cerr << "Error: " << limitReason << " is too small for the minimal WorkSize(" << c_workSizeGranularity
+                      << "). Device(" << device_name << ")" << std::endl;
+            return 0;
+        }
+
+        if (work_size > maxWorkSize)
+        {
+            std::cerr << "Warning: WorkSize(" << work_size << ") does not fit into " << limitReason
+                      << ". Clamped to " << maxWorkSize << ". Device(" << device_name << ")" << std::endl;
+            return maxWorkSize;
+        }
+
+        return work_size;
+    }
 
 
     //-----------------------------------------------------------------------------
@@ -14,9 +14,12 @@
 #include <string>
 #include <cstring> // memset
 #include <chrono>
+#include <algorithm>
 
 #include <lyclCore/CLUtils.hpp>
 #include <lyclApplets/AppCommon.hpp>
+#include <lyclApplets/KernelVariants.hpp>
+#include <lyclApplets/StageProfiler.hpp>
 
 namespace lycl
 {
@@ -33,55 +36,75 @@ namespace lycl
         //! compute (work_size) hashes, starting from the (first_nonce) and checks hTarg.
         //! NOTE: hash results are not saved from the latest pass. Only hTarg result.
         inline void onRun(uint32_t first_nonce, size_t work_size);
+        //! runs only the first (num_launches) kernels of the pipeline. Used for validation.
+        inline void onRunPartial(uint32_t first_nonce, size_t work_size, size_t num_launches);
+        //! enqueues a batch and the hTarg result readback without waiting. The queue is flushed.
+        //! (callback) is called by the OpenCL runtime thread when the batch is finished, may be nullptr.
+        inline bool onRunAsync(uint32_t first_nonce, size_t work_size, void (CL_CALLBACK* callback)(cl_event, cl_int, void*), void* user_data);
+        //! true if the batch started by (onRunAsync()) is finished.
+        inline bool isRunComplete() const;
+        //! finishes the batch started by (onRunAsync()). Same results as (getHtArgTestResultAndSize()).
+        inline void finishRunAsync(uint32_t& out_nonce, uint32_t& out_dbgCount);
         //! destroy context and free resources.
         inline void onDestroy();
         //! must be called at least once, before (onRun())
         inline void setKernelData(const KernelData& kernel_data);
         //! returns all hashes. Very slow. Used for validation
         inline void getHashes(std::vector<uint32x8>& lyra_hashes);
+        //! returns all lyra states(4 per hash). Very slow. Used for validation
+        inline void getLyraStates(std::vector<uint32x8>& lyra_states);
         //! get result based on Htarg test.
         inline void getHtArgTestResultAndSize(uint32_t& out_nonce, uint32_t& out_dbgCount);
         //! get Htarg test result buffer content
         inline void getHtArgTestResults(std::vector<uint32_t>& out_htargs, size_t num_elements, size_t offset_elem);
         //! returns hash at specific index, useful for host side validation.
         inline void getLatestHashResultForIndex(uint32_t index, uint32x8& out_hash);
+        //! returns hashes at (indices) from the latest pass. Only (num_indices) hashes are read back.
+        inline bool gatherHashes(const uint32_t* indices, size_t num_indices, std::vector<uint32x8>& out_hashes);
         //! clear hTarg result buffer.
         inline void clearResult(size_t num_elements);
+        //! returns WorkSize used for buffer allocation. May be lower than requested, if it doesn't fit into device memory.
+        inline size_t getMaxWorkSize() const { return m_maxWorkSize; }
+        //! per-stage GPU time. Enabled by (device::profiling).
+        inline StageProfiler& getProfiler() { return m_profiler; }
+        //! algorithm name of the kernel manifest and the host chain(lyclHostValidators/Lyra2RE.hpp).
+        static const char* getAlgorithmName() { return "Lyra2REv3"; }
+        //! kernel launch order of onRun().
+        inline const std::vector<KernelStage*>& getPipeline() const { return m_pipeline; }
 
     private:
+        //! enqueues the first (num_launches) kernels. Returns the number of hashes.
+        inline size_t enqueuePipeline(uint32_t first_nonce, size_t num_hashes, size_t num_launches);
+
         size_t m_maxWorkSize;
         cl_context m_clContext;
         cl_command_queue m_clCommandQueue;
-        // blake32
-        cl_program m_clProgramBlake32;
-        cl_kernel m_clKernelBlake32;
-        // cubeHash256
-        cl_program m_clProgramCubeHash256;
-        cl_kernel m_clKernelCubeHash256;
-        // lyra441p1
-        cl_program m_clProgramLyra441p1;
-        cl_kernel m_clKernelLyra441p1;
-        // lyra441p2
-        cl_program m_clProgramLyra441p2;
-        cl_kernel m_clKernelLyra441p2;
-        // lyra441p3
-        cl_program m_clProgramLyra441p3;
-        cl_kernel m_clKernelLyra441p3;
-        // bmwHtarg
-        cl_program m_clProgramBmwHtarg;
-        cl_kernel m_clKernelBmwHtarg;
-        // bmw
-        cl_program m_clProgramBmw;
-        cl_kernel m_clKernelBmw;
+        StageProfiler m_profiler;
+        // pipeline stages
+        KernelStage m_stageBlake32;
+        KernelStage m_stageCubeHash256;
+        KernelStage m_stageLyra441p1;
+        KernelStage m_stageLyra441p2;
+        KernelStage m_stageLyra441p3;
+        KernelStage m_stageBmwHtarg;
+        KernelStage m_stageBmw;
+        KernelStage m_stageGather;
+        std::vector<KernelStage*> m_pipeline;
         // buffers
         cl_mem m_clMemHashStorage;
         cl_mem m_clMemLyraStates;
         cl_mem m_clMemHtArgResult;
+        cl_mem m_clMemGatherIndices;
+        cl_mem m_clMemGatherOutput;
+        // async run
+        cl_event m_runEvent;
+        size_t m_runNumHashes;
+        uint32_t m_runResult[2];
     };
     //-----------------------------------------------------------------------------
     // AppLyra2REv3 class inline methods implementation.
     //-----------------------------------------------------------------------------
-    inline AppLyra2REv3::AppLyra2REv3() { }
+    inline AppLyra2REv3::AppLyra2REv3() : m_runEvent(NULL), m_runNumHashes(0) { }
     //-----------------------------------------------------------------------------
     inline bool AppLyra2REv3::onInit(const device& in_device)
     {
@@ -98,6 +121,12 @@ namespace lycl
         clGetDeviceInfo(in_device.clId, CL_DEVICE_NAME, infoSize, (void *)deviceName.data(), NULL);
         deviceName.pop_back();
 
+        //-------------------------------------
+        // Check if requested WorkSize fits into device memory
+        m_maxWorkSize = clampWorkSizeToDeviceMemory(in_device.clId, m_maxWorkSize, deviceName, in_device.numStreams);
+        if (!m_maxWorkSize)
+            return false;
+
         //-------------------------------------
         // Create an OpenCL context
         cl_context_properties contextProperties[] =
@@ -116,11 +145,14 @@ namespace lycl
 
         //-------------------------------------
         // Create an OpenCL command queue
+        m_profiler.setEnabled(in_device.profiling);
+        const cl_command_queue_properties queueProperties = in_device.profiling ? CL_QUEUE_PROFILING_ENABLE : 0;
 #ifndef CL_API_SUFFIX__VERSION_2_0
         //clCreateCommandQueue() // deprecated in 2.0
-        m_clCommandQueue = clCreateCommandQueue(m_clContext, in_device.clId, 0, &errorCode);  
+        m_clCommandQueue = clCreateCommandQueue(m_clContext, in_device.clId, queueProperties, &errorCode);  
 #else  
-        m_clCommandQueue = clCreateCommandQueueWithProperties(m_clContext, in_device.clId, nullptr, &errorCode);
+        const cl_queue_properties queuePropertiesList[] = { CL_QUEUE_PROPERTIES, (cl_queue_properties)queueProperties, 0 };
+        m_clCommandQueue = clCreateCommandQueueWithProperties(m_clContext, in_device.clId, queuePropertiesList, &errorCode);
 #endif
         if (errorCode != CL_SUCCESS)
         {
@@ -148,265 +180,112 @@ namespace lycl
             std::cerr << "Failed to create an HTarg result buffer. Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
             return false;
         }
-        // Result counter must be initialized to 0.
-        clearResult(1);
-
-        //-------------------------------------
-        // Create an OpenCL blake32 kernel
-        m_clProgramBlake32 = cluCreateProgramFromFile(m_clContext, in_device.clId, "kernels/blake32/blake32.cl");
-        if (m_clProgramBlake32 == NULL)
-        {
-            std::cerr << "Failed to create CL program from source(blake32). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
-
-        m_clKernelBlake32 = clCreateKernel(m_clProgramBlake32, "blake32", &errorCode);
+        m_clMemGatherIndices = clCreateBuffer(m_clContext, CL_MEM_READ_ONLY, sizeof(uint32_t) * c_maxGatherSize, nullptr, &errorCode);
         if (errorCode != CL_SUCCESS)
         {
-            std::cerr << "Failed to create kernel(blake32). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
+            std::cerr << "Failed to create a gather index buffer. Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
             return false;
         }
-        errorCode = clSetKernelArg(m_clKernelBlake32, 0, sizeof(cl_mem), &m_clMemHashStorage);
+        m_clMemGatherOutput = clCreateBuffer(m_clContext, CL_MEM_WRITE_ONLY, sizeof(uint32x8) * c_maxGatherSize, nullptr, &errorCode);
         if (errorCode != CL_SUCCESS)
         {
-            std::cerr << "Error setting kernel argument(0) inside kernel(blake32). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
+            std::cerr << "Failed to create a gather output buffer. Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
             return false;
         }
+        // Result counter must be initialized to 0.
+        clearResult(1);
 
         //-------------------------------------
-        // Create an OpenCL cubeHash kernel
-        m_clProgramCubeHash256 = cluCreateProgramFromFile(m_clContext, in_device.clId, "kernels/cubeHash256/cubeHash256.cl");
-        if (m_clProgramCubeHash256 == NULL)
-        {
-            std::cerr << "Failed to create CL program from source(cubeHash256). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
+        // Create pipeline stages. Programs are selected from the kernel manifest(kernels/manifest.conf).
+        const StageBuffers stageBuffers = { m_clMemHashStorage, m_clMemLyraStates, m_clMemHtArgResult,
+                                            m_clMemGatherIndices, m_clMemGatherOutput };
+        const char* stageNames[] = { "blake32", "cubeHash256", "lyra441p1", "lyra441p2", "lyra441p3", "bmwHtarg", "bmw", "gather" };
+        KernelStage* stages[] = { &m_stageBlake32, &m_stageCubeHash256, &m_stageLyra441p1, &m_stageLyra441p2, &m_stageLyra441p3, &m_stageBmwHtarg, &m_stageBmw, &m_stageGather };
+        for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); ++i)
+        {
+            if (!createKernelStage(m_clContext, m_clCommandQueue, in_device, deviceName, getAlgorithmName(), stageNames[i],
+                                   stageBuffers, m_maxWorkSize, *stages[i]))
+            {
+                std::cerr << "Failed to create pipeline stage(" << stageNames[i] << "). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
+                return false;
+            }
         }
 
-        m_clKernelCubeHash256 = clCreateKernel(m_clProgramCubeHash256, "cubeHash256", &errorCode);
-        if (errorCode != CL_SUCCESS)
-        {
-            std::cerr << "Failed to create kernel(cubeHash256). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
-        errorCode = clSetKernelArg(m_clKernelCubeHash256, 0, sizeof(cl_mem), &m_clMemHashStorage);
-        if (errorCode != CL_SUCCESS)
-        {
-            std::cerr << "Error setting kernel argument(0) inside kernel(cubeHash256). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
+        // launch order
+        KernelStage* pipeline[] = { &m_stageBlake32, &m_stageLyra441p1, &m_stageLyra441p2, &m_stageLyra441p3, &m_stageCubeHash256, &m_stageLyra441p1, &m_stageLyra441p2, &m_stageLyra441p3, &m_stageBmwHtarg };
+        m_pipeline.assign(pipeline, pipeline + sizeof(pipeline) / sizeof(pipeline[0]));
 
-        //-------------------------------------
-        // Create an OpenCL lyra441p1 kernel
-        m_clProgramLyra441p1 = cluCreateProgramFromFile(m_clContext, in_device.clId, "kernels/lyra441p1/lyra441p1.cl");
-        if (m_clProgramLyra441p1 == NULL)
-        {
-            std::cerr << "Failed to create CL program from source(lyra441p1). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
+        return true;
+    }
+    //-----------------------------------------------------------------------------
+    inline void AppLyra2REv3::onRun(uint32_t first_nonce, size_t num_hashes)
+    {
+        onRunPartial(first_nonce, num_hashes, m_pipeline.size());
+    }
+    //-----------------------------------------------------------------------------
+    inline void AppLyra2REv3::onRunPartial(uint32_t first_nonce, size_t num_hashes, size_t num_launches)
+    {
+        num_hashes = enqueuePipeline(first_nonce, num_hashes, num_launches);
 
-        m_clKernelLyra441p1 = clCreateKernel(m_clProgramLyra441p1, "lyra441p1", &errorCode);
-        if (errorCode != CL_SUCCESS)
-        {
-            std::cerr << "Failed to create kernel(lyra441p1). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
-        errorCode = clSetKernelArg(m_clKernelLyra441p1, 0, sizeof(cl_mem), &m_clMemHashStorage);
-        if (errorCode != CL_SUCCESS)
-        {
-            std::cerr << "Error setting kernel argument(0) inside kernel(lyra441p1). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
-        errorCode = clSetKernelArg(m_clKernelLyra441p1, 1, sizeof(cl_mem), &m_clMemLyraStates);
+        clFinish(m_clCommandQueue);
+        m_profiler.collect(num_hashes);
+    }
+    //-----------------------------------------------------------------------------
+    inline bool AppLyra2REv3::onRunAsync(uint32_t first_nonce, size_t num_hashes, void (CL_CALLBACK* callback)(cl_event, cl_int, void*), void* user_data)
+    {
+        m_runNumHashes = enqueuePipeline(first_nonce, num_hashes, m_pipeline.size());
+
+        // in-order queue, the readback event completes after the whole pipeline.
+        cl_int errorCode = clEnqueueReadBuffer(m_clCommandQueue, m_clMemHtArgResult, CL_FALSE, 0, 2 * sizeof(uint32_t),
+                                               &m_runResult[0], 0, nullptr, &m_runEvent);
         if (errorCode != CL_SUCCESS)
         {
-            std::cerr << "Error setting kernel argument(1) inside kernel(lyra441p1). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
+            std::cerr << "Failed to enqueue hTarg result readback. error code: " << errorCode << std::endl;
+            m_runEvent = NULL;
+            clFinish(m_clCommandQueue);
+            m_profiler.collect(m_runNumHashes);
             return false;
         }
 
-        //-------------------------------------
-        // Create an OpenCL lyra441p2 kernel
-
-        bool asmSuccess = false;
-
-        // try to load an asm program first.
-        if (in_device.asmProgram == AP_GFX6)
-        {
-            std::string asmProgramFileName;
-
-            if (in_device.binaryFormat == BF_AMDCL2)
-                asmProgramFileName = "kernels/lyra441p2/rev3/lyra441p2_gfx6_amdcl2.bin";
-
-            m_clProgramLyra441p2 = cluCreateProgramWithBinaryFromFile(m_clContext, in_device.clId, asmProgramFileName);
-            if (m_clProgramLyra441p2 == NULL)
-                std::cerr << "Failed to create ASM program(lyra441p2(rev3)). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            else
-                asmSuccess = true;
-        }
-        else if (in_device.asmProgram == AP_GFX7)
-        {
-            std::string asmProgramFileName;
+        if (callback)
+            clSetEventCallback(m_runEvent, CL_COMPLETE, callback, user_data);
 
-            if (in_device.binaryFormat == BF_AMDCL2)
-                asmProgramFileName = "kernels/lyra441p2/rev3/lyra441p2_gfx7_amdcl2.bin";
-
-            m_clProgramLyra441p2 = cluCreateProgramWithBinaryFromFile(m_clContext, in_device.clId, asmProgramFileName);
-            if (m_clProgramLyra441p2 == NULL)
-                std::cerr << "Failed to create ASM program(lyra441p2(rev3)). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            else
-                asmSuccess = true;
-        }
-        else if (in_device.asmProgram == AP_GFX8)
-        {
-            std::string asmProgramFileName;
-            if (in_device.binaryFormat == BF_AMDCL2)
-                asmProgramFileName = "kernels/lyra441p2/rev3/lyra441p2_gfx8_amdcl2.bin";
-            else if (in_device.binaryFormat == BF_ROCm)
-                asmProgramFileName = "kernels/lyra441p2/rev3/lyra441p2_gfx8_rocm.bin";
-
-            m_clProgramLyra441p2 = cluCreateProgramWithBinaryFromFile(m_clContext, in_device.clId, asmProgramFileName);
-            if (m_clProgramLyra441p2 == NULL)
-                std::cerr << "Failed to create ASM program(lyra441p2(rev3)). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            else
-                asmSuccess = true;
-        }
-        else if (in_device.asmProgram == AP_GFX9)
-        {
-            std::string asmProgramFileName;
-
-            if (in_device.binaryFormat == BF_AMDCL2)
-                asmProgramFileName = "kernels/lyra441p2/rev3/lyra441p2_gfx9_amdcl2.bin";
-            if (in_device.binaryFormat == BF_ROCm)
-                asmProgramFileName = "kernels/lyra441p2/rev3/lyra441p2_gfx9_rocm.bin";
-
-            m_clProgramLyra441p2 = cluCreateProgramWithBinaryFromFile(m_clContext, in_device.clId, asmProgramFileName);
-            if (m_clProgramLyra441p2 == NULL)
-                std::cerr << "Failed to create ASM program(lyra441p2(rev3)). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            else
-                asmSuccess = true;
-        }
-        else if (in_device.asmProgram == AP_GFX906)
-        {
-            std::string asmProgramFileName;
-
-            if (in_device.binaryFormat == BF_AMDCL2)
-                std::cerr << "gfx906 kernel is not available for AMDCL2 platform" << std::endl;
-            if (in_device.binaryFormat == BF_ROCm)
-                asmProgramFileName = "kernels/lyra441p2/rev3/lyra441p2_gfx906_rocm.bin";
-
-            m_clProgramLyra441p2 = cluCreateProgramWithBinaryFromFile(m_clContext, in_device.clId, asmProgramFileName);
-            if (m_clProgramLyra441p2 == NULL)
-                std::cerr << "Failed to create ASM program(lyra441p2(rev3)). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            else
-                asmSuccess = true;
-        }
-        else
-        {
-            std::cout << "Debug: Asm kernel is not available or disabled. Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-        }
-
-        if (!asmSuccess)
-        {
-            // Fallback to the OpenCL kernel.
-            m_clProgramLyra441p2 = cluCreateProgramFromFile(m_clContext, in_device.clId, "kernels/lyra441p2/rev3/lyra441p2.cl");
-            if (m_clProgramLyra441p2 == NULL)
-            {
-                std::cerr << "Failed to create CL program from source(lyra441p2(rev3)). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-                return false;
-            }
-        }
+        clFlush(m_clCommandQueue);
+        return true;
+    }
+    //-----------------------------------------------------------------------------
+    inline bool AppLyra2REv3::isRunComplete() const
+    {
+        if (!m_runEvent)
+            return true;
 
-        m_clKernelLyra441p2 = clCreateKernel(m_clProgramLyra441p2, "lyra441p2", &errorCode);
-        if (errorCode != CL_SUCCESS)
-        {
-            std::cerr << "Failed to create kernel(lyra441p2(rev3)). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
-        errorCode = clSetKernelArg(m_clKernelLyra441p2, 0, sizeof(cl_mem), &m_clMemLyraStates);
-        if (errorCode != CL_SUCCESS)
-        {
-            std::cerr << "Error setting kernel argument(0) inside kernel(lyra441p2(rev3)). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
+        cl_int status = CL_QUEUED;
+        if (clGetEventInfo(m_runEvent, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, nullptr) != CL_SUCCESS)
+            return true;
 
-        //-------------------------------------
-        // Create an OpenCL lyra441p3 kernel
-        m_clProgramLyra441p3 = cluCreateProgramFromFile(m_clContext, in_device.clId, "kernels/lyra441p3/lyra441p3.cl");
-        if (m_clProgramLyra441p3 == NULL)
-        {
-            std::cerr << "Failed to create a CL program from source(lyra441p3). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
-        m_clKernelLyra441p3 = clCreateKernel(m_clProgramLyra441p3, "lyra441p3", &errorCode);
-        if (errorCode != CL_SUCCESS)
-        {
-            std::cerr << "Failed to create a kernel(lyra441p3). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
-        errorCode = clSetKernelArg(m_clKernelLyra441p3, 0, sizeof(cl_mem), &m_clMemHashStorage);
-        if (errorCode != CL_SUCCESS)
-        {
-            std::cerr << "Error setting kernel argument(0) inside kernel(lyra441p3). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
-        errorCode = clSetKernelArg(m_clKernelLyra441p3, 1, sizeof(cl_mem), &m_clMemLyraStates);
-        if (errorCode != CL_SUCCESS)
+        // negative values are errors, the event will never complete.
+        return status <= CL_COMPLETE;
+    }
+    //-----------------------------------------------------------------------------
+    inline void AppLyra2REv3::finishRunAsync(uint32_t& out_nonce, uint32_t& out_dbgCount)
+    {
+        if (!m_runEvent)
         {
-            std::cerr << "Error setting kernel argument(1) inside kernel(lyra441p3). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
+            out_nonce = 0;
+            out_dbgCount = 0;
+            return;
         }
 
-        //-------------------------------------
-        // Create an OpenCL bmw(htarg) kernel
-        m_clProgramBmwHtarg = cluCreateProgramFromFile(m_clContext, in_device.clId, "kernels/bmw/bmw_htarg.cl");
-        if (m_clProgramBmwHtarg == NULL)
-        {
-            std::cerr << "Failed to create CL program from source(bmwHtarg). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
-        m_clKernelBmwHtarg = clCreateKernel(m_clProgramBmwHtarg, "bmw", &errorCode);
-        if (errorCode != CL_SUCCESS)
-        {
-            std::cerr << "Failed to create kernel(bmwHtarg). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
-        errorCode = clSetKernelArg(m_clKernelBmwHtarg, 0, sizeof(cl_mem), &m_clMemHashStorage);
-        if (errorCode != CL_SUCCESS)
-        {
-            std::cerr << "Error setting kernel argument(0) inside kernel(bmwHtarg). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
-        errorCode = clSetKernelArg(m_clKernelBmwHtarg, 1, sizeof(cl_mem), &m_clMemHtArgResult); 
-        if (errorCode != CL_SUCCESS)
-        {
-            std::cerr << "Error setting kernel argument(1) inside kernel(BMWHtarg). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
+        clWaitForEvents(1, &m_runEvent);
+        clReleaseEvent(m_runEvent);
+        m_runEvent = NULL;
+        m_profiler.collect(m_runNumHashes);
 
-        //-------------------------------------
-        // Create an OpenCL bmw(full) kernel. Used for validation.
-        m_clProgramBmw = cluCreateProgramFromFile(m_clContext, in_device.clId, "kernels/bmw/bmw.cl");
-        if (m_clProgramBmw == NULL)
-        {
-            std::cerr << "Failed to create CL program from source(bmw). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
-        m_clKernelBmw = clCreateKernel(m_clProgramBmw, "bmw", &errorCode);
-        if (errorCode != CL_SUCCESS)
-        {
-            std::cerr << "Failed to create kernel(bmw). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
-        errorCode = clSetKernelArg(m_clKernelBmw, 0, sizeof(cl_mem), &m_clMemHashStorage);
-        if (errorCode != CL_SUCCESS)
-        {
-            std::cerr << "Error setting kernel argument(0) inside kernel(bmw). Device(" << deviceName << ") Platform index(" << in_device.platformIndex << ")" << std::endl;
-            return false;
-        }
-        
-        return true;
+        out_nonce = m_runResult[1];
+        out_dbgCount = m_runResult[0];
     }
     //-----------------------------------------------------------------------------
-    inline void AppLyra2REv3::onRun(uint32_t first_nonce, size_t num_hashes)
+    inline size_t AppLyra2REv3::enqueuePipeline(uint32_t first_nonce, size_t num_hashes, size_t num_launches)
     {
         if (num_hashes > m_maxWorkSize)
         {
@@ -414,41 +293,12 @@ namespace lycl
             num_hashes = m_maxWorkSize;
         }
 
-        clSetKernelArg(m_clKernelBlake32, 12, sizeof(uint32_t), &first_nonce);
+        clSetKernelArg(m_stageBlake32.kernel, 12, sizeof(uint32_t), &first_nonce);
 
-        const size_t globalWorkSize1x = num_hashes;
-        const size_t globalWorkSize4x = num_hashes*4;
-        const size_t localWorkSize256 = 256;
-        const size_t localWorkSize64  = 64;
-        // blake32
-        clEnqueueNDRangeKernel(m_clCommandQueue, m_clKernelBlake32, 1, nullptr,
-                               &globalWorkSize1x, &localWorkSize256, 0, nullptr, nullptr);
-        // lyra441p1
-        clEnqueueNDRangeKernel(m_clCommandQueue, m_clKernelLyra441p1, 1, nullptr,
-                               &globalWorkSize1x, &localWorkSize256, 0, nullptr, nullptr);
-        // lyra441p2(rev3)
-        clEnqueueNDRangeKernel(m_clCommandQueue, m_clKernelLyra441p2, 1, nullptr,
-                               &globalWorkSize4x, &localWorkSize64, 0, nullptr, nullptr);
-        // lyra441p3
-        clEnqueueNDRangeKernel(m_clCommandQueue, m_clKernelLyra441p3, 1, nullptr,
-                               &globalWorkSize1x, &localWorkSize256, 0, nullptr, nullptr);
-        // cubeHash256
-        clEnqueueNDRangeKernel(m_clCommandQueue, m_clKernelCubeHash256, 1, nullptr,
-                               &globalWorkSize1x, &localWorkSize256, 0, nullptr, nullptr);
-        // lyra441p1
-        clEnqueueNDRangeKernel(m_clCommandQueue, m_clKernelLyra441p1, 1, nullptr,
-                               &globalWorkSize1x, &localWorkSize256, 0, nullptr, nullptr);
-        // lyra441p2(rev3)
-        clEnqueueNDRangeKernel(m_clCommandQueue, m_clKernelLyra441p2, 1, nullptr,
-                               &globalWorkSize4x, &localWorkSize64, 0, nullptr, nullptr);
-        // lyra441p3
-        clEnqueueNDRangeKernel(m_clCommandQueue, m_clKernelLyra441p3, 1, nullptr,
-                               &globalWorkSize1x, &localWorkSize256, 0, nullptr, nullptr);
-        // bmwHtarg
-        clEnqueueNDRangeKernel(m_clCommandQueue, m_clKernelBmwHtarg, 1, nullptr,
-                               &globalWorkSize1x, &localWorkSize256, 0, nullptr, nullptr);
+        for (size_t i = 0; (i < num_launches) && (i < m_pipeline.size()); ++i)
+            enqueueKernelStage(m_clCommandQueue, *m_pipeline[i], num_hashes, m_profiler.record(*m_pipeline[i]));
 
-        clFinish(m_clCommandQueue);
+        return num_hashes;
     }
     //-----------------------------------------------------------------------------
     inline void AppLyra2REv3::getHashes(std::vector<uint32x8>& lyra_hashes)
@@ -458,6 +308,13 @@ namespace lycl
         clEnqueueReadBuffer(m_clCommandQueue, m_clMemHashStorage, CL_TRUE, 0, m_maxWorkSize * sizeof(uint32x8), lyra_hashes.data(), 0, nullptr, nullptr);
     }
     //-----------------------------------------------------------------------------
+    inline void AppLyra2REv3::getLyraStates(std::vector<uint32x8>& lyra_states)
+    {
+        if(lyra_states.size() < m_maxWorkSize * 4)
+            lyra_states.resize(m_maxWorkSize * 4);
+        clEnqueueReadBuffer(m_clCommandQueue, m_clMemLyraStates, CL_TRUE, 0, m_maxWorkSize * 4 * sizeof(uint32x8), lyra_states.data(), 0, nullptr, nullptr);
+    }
+    //-----------------------------------------------------------------------------
     //inline void AppLyra2REv3::clearResult()
     inline void AppLyra2REv3::clearResult(size_t num_elements)
     {
@@ -479,19 +336,20 @@ namespace lycl
     //-----------------------------------------------------------------------------
     inline void AppLyra2REv3::setKernelData(const KernelData& kernel_data)
     {
-        clSetKernelArg(m_clKernelBlake32, 1, sizeof(uint32_t), &kernel_data.uH0);
-        clSetKernelArg(m_clKernelBlake32, 2, sizeof(uint32_t), &kernel_data.uH1);
-        clSetKernelArg(m_clKernelBlake32, 3, sizeof(uint32_t), &kernel_data.uH2);
-        clSetKernelArg(m_clKernelBlake32, 4, sizeof(uint32_t), &kernel_data.uH3);
-        clSetKernelArg(m_clKernelBlake32, 5, sizeof(uint32_t), &kernel_data.uH4);
-        clSetKernelArg(m_clKernelBlake32, 6, sizeof(uint32_t), &kernel_data.uH5);
-        clSetKernelArg(m_clKernelBlake32, 7, sizeof(uint32_t), &kernel_data.uH6);
-        clSetKernelArg(m_clKernelBlake32, 8, sizeof(uint32_t), &kernel_data.uH7);
-        clSetKernelArg(m_clKernelBlake32, 9, sizeof(uint32_t), &kernel_data.in16);
-        clSetKernelArg(m_clKernelBlake32, 10, sizeof(uint32_t), &kernel_data.in17);
-        clSetKernelArg(m_clKernelBlake32, 11, sizeof(uint32_t), &kernel_data.in18);
+        clSetKernelArg(m_stageBlake32.kernel, 1, sizeof(uint32_t), &kernel_data.uH0);
+        clSetKernelArg(m_stageBlake32.kernel, 2, sizeof(uint32_t), &kernel_data.uH1);
+        clSetKernelArg(m_stageBlake32.kernel, 3, sizeof(uint32_t), &kernel_data.uH2);
+        clSetKernelArg(m_stageBlake32.kernel, 4, sizeof(uint32_t), &kernel_data.uH3);
+        clSetKernelArg(m_stageBlake32.kernel, 5, sizeof(uint32_t), &kernel_data.uH4);
+        clSetKernelArg(m_stageBlake32.kernel, 6, sizeof(uint32_t), &kernel_data.uH5);
+        clSetKernelArg(m_stageBlake32.kernel, 7, sizeof(uint32_t), &kernel_data.uH6);
+        clSetKernelArg(m_stageBlake32.kernel, 8, sizeof(uint32_t), &kernel_data.uH7);
+        clSetKernelArg(m_stageBlake32.kernel, 9, sizeof(uint32_t), &kernel_data.in16);
+        clSetKernelArg(m_stageBlake32.kernel, 10, sizeof(uint32_t), &kernel_data.in17);
+        clSetKernelArg(m_stageBlake32.kernel, 11, sizeof(uint32_t), &kernel_data.in18);
         // set htarg for bmwHTarg kernel
-        clSetKernelArg(m_clKernelBmwHtarg, 2, sizeof(uint32_t), &kernel_data.htArg);
+        clSetKernelArg(m_stageBmwHtarg.kernel, 2, sizeof(uint32_t), &kernel_data.htArg);
+        clSetKernelArg(m_stageBmwHtarg.kernel, 3, sizeof(uint32_t), &kernel_data.htArgLow);
     }
     //-----------------------------------------------------------------------------
     inline void AppLyra2REv3::getHtArgTestResultAndSize(uint32_t &out_nonce, uint32_t &out_dbgCount)
@@ -516,33 +374,66 @@ namespace lycl
         clEnqueueReadBuffer(m_clCommandQueue, m_clMemHashStorage, CL_TRUE, (size_t)sizeof(uint32x8)*index, sizeof(uint32x8), &out_hash, 0, nullptr, nullptr);
     }
     //-----------------------------------------------------------------------------
+    inline bool AppLyra2REv3::gatherHashes(const uint32_t* indices, size_t num_indices, std::vector<uint32x8>& out_hashes)
+    {
+        for (size_t i = 0; i < num_indices; ++i)
+        {
+            if (indices[i] >= m_maxWorkSize)
+            {
+                std::cerr << "Gather index(" << indices[i] << ") is out of range." << std::endl;
+                return false;
+            }
+        }
+
+        out_hashes.resize(num_indices);
+        for (size_t first = 0; first < num_indices; first += c_maxGatherSize)
+        {
+            const cl_uint numGathered = (cl_uint)std::min(num_indices - first, c_maxGatherSize);
+            // round up to the work-group size. Kernel skips the rest.
+            const size_t numWorkItems = ((numGathered + m_stageGather.workGroupSize - 1) / m_stageGather.workGroupSize) * m_stageGather.workGroupSize;
+
+            clEnqueueWriteBuffer(m_clCommandQueue, m_clMemGatherIndices, CL_FALSE, 0, numGathered * sizeof(uint32_t), indices + first, 0, nullptr, nullptr);
+            clSetKernelArg(m_stageGather.kernel, 3, sizeof(cl_uint), &numGathered);
+            enqueueKernelStage(m_clCommandQueue, m_stageGather, numWorkItems);
+            if (clEnqueueReadBuffer(m_clCommandQueue, m_clMemGatherOutput, CL_TRUE, 0, numGathered * sizeof(uint32x8), &out_hashes[first], 0, nullptr, nullptr) != CL_SUCCESS)
+            {
+                std::cerr << "Failed to read a gather output buffer." << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+    //-----------------------------------------------------------------------------
     inline void AppLyra2REv3::onDestroy()
     {
+        if (m_runEvent)
+        {
+            clWaitForEvents(1, &m_runEvent);
+            clReleaseEvent(m_runEvent);
+            m_runEvent = NULL;
+        }
         // memory objects
         clReleaseMemObject(m_clMemHashStorage);
         clReleaseMemObject(m_clMemLyraStates);
         clReleaseMemObject(m_clMemHtArgResult);
+        clReleaseMemObject(m_clMemGatherIndices);
+        clReleaseMemObject(m_clMemGatherOutput);
         // bmw
-        clReleaseKernel(m_clKernelBmw);
-        clReleaseProgram(m_clProgramBmw);
+        releaseKernelStage(m_stageBmw);
+        releaseKernelStage(m_stageGather);
         // bmwHtarg
-        clReleaseKernel(m_clKernelBmwHtarg);
-        clReleaseProgram(m_clProgramBmwHtarg);
+        releaseKernelStage(m_stageBmwHtarg);
         // lyra441p3
-        clReleaseKernel(m_clKernelLyra441p3);
-        clReleaseProgram(m_clProgramLyra441p3);
+        releaseKernelStage(m_stageLyra441p3);
         // lyra441p2(rev3)
-        clReleaseKernel(m_clKernelLyra441p2);
-        clReleaseProgram(m_clProgramLyra441p2);
+        releaseKernelStage(m_stageLyra441p2);
         // lyra441p1
-        clReleaseKernel(m_clKernelLyra441p1);
-        clReleaseProgram(m_clProgramLyra441p1);
+        releaseKernelStage(m_stageLyra441p1);
         // cubeHash256
-        clReleaseKernel(m_clKernelCubeHash256);
-        clReleaseProgram(m_clProgramCubeHash256);
+        releaseKernelStage(m_stageCubeHash256);
         // blake32
-        clReleaseKernel(m_clKernelBlake32);
-        clReleaseProgram(m_clProgramBlake32);
+        releaseKernelStage(m_stageBlake32);
         // misc
         clReleaseCommandQueue(m_clCommandQueue);
         clReleaseContext(m_clContext);
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef BatchSizeController_INCLUDE_ONCE
+#define BatchSizeController_INCLUDE_ONCE
+
+#include <algorithm>
+
+#include <lyclApplets/AppCommon.hpp>
+
+namespace lycl
+{
+    //-----------------------------------------------------------------------------
+    //! Smallest adaptive batch. Smaller dispatches do not fill a GPU.
+    const size_t c_minAdaptiveBatchSize = 65536;
+    //! Weight of the latest batch in the measured time per hash.
+    const double c_batchSizePredictionWeight = 0.25;
+    //-----------------------------------------------------------------------------
+    // BatchSizeController class.
+    // Tunes the number of hashes per dispatch to reach a target batch latency.
+    // WorkSize(buffer allocation) is the upper bound. The size changes at most 2x per
+    // batch, so a single slow batch(e.g. a display update) does not collapse it.
+    // Not thread safe, one per worker.
+    //-----------------------------------------------------------------------------
+    class BatchSizeController
+    {
+    public:
+        inline BatchSizeController()
+            : m_targetMs(0)
+            , m_maxBatchSize(0)
+            , m_batchSize(0)
+            , m_nsPerHash(0.0)
+        { }
+
+        //! (target_ms): 0 disables tuning, every batch uses (max_batch_size).
+        inline void setup(uint32_t target_ms, size_t max_batch_size)
+        {
+            m_targetMs = target_ms;
+            m_nsPerHash = 0.0;
+            m_maxBatchSize = max_batch_size;
+            m_batchSize = std::min(max_batch_size, c_minAdaptiveBatchSize);
+        }
+        //! WorkSize was reduced.
+        inline void setMaxBatchSize(size_t max_batch_size)
+        {
+            m_maxBatchSize = max_batch_size;
+            m_batchSize = std::min(m_batchSize, max_batch_size);
+        }
+
+        inline bool isEnabled() const { return m_targetMs != 0; }
+        inline uint32_t getTargetMs() const { return m_targetMs; }
+        //! number of hashes for the next dispatch. Multiple of c_workSizeGranularity.
+        inline size_t getBatchSize() const { return isEnabled() ? m_batchSize : m_maxBatchSize; }
+
+        //! (batch_ms): wall time of a finished batch of (batch_size) hashes.
+        inline void update(size_t batch_size, double batch_ms)
+        {
+            if (!isEnabled() || !batch_size || (batch_ms <= 0.0))
+                return;
+
+            const double nsPerHash = (batch_ms * 1000000.0) / (double)batch_size;
+            if (m_nsPerHash > 0.0)
+                m_nsPerHash += (nsPerHash - m_nsPerHash) * c_batchSizePredictionWeight;
+            else
+                m_nsPerHash = nsPerHash;
+
+            double batchSize = ((double)m_targetMs * 1000000.0) / m_nsPerHash;
+            batchSize = std::min(batchSize, (double)m_batchSize * 2.0);
+            batchSize = std::max(batchSize, (double)m_batchSize * 0.5);
+            batchSize = std::min(batchSize, (double)m_maxBatchSize);
+
+            m_batchSize = ((size_t)batchSize / c_workSizeGranularity) * c_workSizeGranularity;
+            m_batchSize = std::max(m_batchSize, std::min(c_minAdaptiveBatchSize, m_maxBatchSize));
+        }
+
+    private:
+        uint32_t m_targetMs;
+        size_t m_maxBatchSize;
+        size_t m_batchSize;
+        double m_nsPerHash;
+    };
+    //-----------------------------------------------------------------------------
+}
+
+#endif // !BatchSizeController_INCLUDE_ONCE
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef BatchWaiter_INCLUDE_ONCE
+#define BatchWaiter_INCLUDE_ONCE
+
+#include <chrono>
+#include <thread>
+#include <time.h>
+
+#include <lyclCore/CLUtils.hpp>
+
+namespace lycl
+{
+    //-----------------------------------------------------------------------------
+    //! Part of the predicted batch time spent sleeping. The rest is polled.
+    const double c_waitSleepFraction = 0.9;
+    //! Sleep between event polls, after the predicted part.
+    const uint32_t c_waitPollIntervalUs = 200;
+    //! Weight of the latest batch in the predicted time per hash.
+    const double c_waitPredictionWeight = 0.25;
+    //-----------------------------------------------------------------------------
+    //! CPU time consumed by the calling thread.
+    inline uint64_t getThreadCpuTimeNs()
+    {
+        timespec ts;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+            return 0;
+
+        return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    }
+    //-----------------------------------------------------------------------------
+    // BatchWaiter class.
+    // Low-CPU replacement for clFinish(), which spin-waits on some drivers.
+    // Learns the batch time per hash, sleeps for most of the predicted batch time,
+    // then polls the batch event with short sleeps. Prediction is per hash, so
+    // WorkSize changes do not require a reset. Not thread safe, one per worker.
+    //-----------------------------------------------------------------------------
+    class BatchWaiter
+    {
+    public:
+        inline BatchWaiter() : m_predictedNsPerHash(0.0) { }
+
+        //! Same as onRun() + getHtArgTestResultAndSize().
+        template <typename TApplet>
+        void runBatch(TApplet& app, uint32_t first_nonce, size_t work_size, uint32_t& out_nonce, uint32_t& out_dbgCount)
+        {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (!app.onRunAsync(first_nonce, work_size, nullptr, nullptr))
+            {
+                app.getHtArgTestResultAndSize(out_nonce, out_dbgCount);
+                return;
+            }
+
+            if (m_predictedNsPerHash > 0.0)
+            {
+                const std::chrono::nanoseconds sleepTime((int64_t)(m_predictedNsPerHash * (double)work_size * c_waitSleepFraction));
+                std::this_thread::sleep_until(start + sleepTime);
+            }
+
+            while (!app.isRunComplete())
+                std::this_thread::sleep_for(std::chrono::microseconds(c_waitPollIntervalUs));
+
+            const double batchNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            app.finishRunAsync(out_nonce, out_dbgCount);
+
+            const double nsPerHash = batchNs / (double)work_size;
+            if (m_predictedNsPerHash > 0.0)
+                m_predictedNsPerHash += (nsPerHash - m_predictedNsPerHash) * c_waitPredictionWeight;
+            else
+                m_predictedNsPerHash = nsPerHash;
+        }
+
+        //! predicted batch time of (work_size) hashes in milliseconds. 0 until the first batch.
+        inline double getPredictedBatchMs(size_t work_size) const { return m_predictedNsPerHash * (double)work_size * 0.000001; }
+
+    private:
+        double m_predictedNsPerHash;
+    };
+    //-----------------------------------------------------------------------------
+}
+
+#endif // !BatchWaiter_INCLUDE_ONCE
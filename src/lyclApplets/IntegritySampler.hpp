@@ -0,0 +1,232 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef IntegritySampler_INCLUDE_ONCE
+#define IntegritySampler_INCLUDE_ONCE
+
+#include <vector>
+#include <cstring>
+#include <pthread.h>
+
+#include <lyclCore/CLUtils.hpp>
+#include <lyclApplets/AppCommon.hpp>
+#include <lyclHostValidators/Lyra2RE.hpp>
+
+namespace lycl
+{
+    //-----------------------------------------------------------------------------
+    //! Number of hashes re-computed per sample. Must be multiple of 256.
+    const size_t c_integritySampleSize = 256;
+    //! Hashes of a sample window re-computed by the host chain.
+    const size_t c_integrityHostSamples = 4;
+    //! Error rate is not acted upon until this many hashes were checked.
+    const uint64_t c_integrityMinCheckedHashes = 16 * c_integritySampleSize;
+    //-----------------------------------------------------------------------------
+    //! Mismatches of a sample window.
+    struct IntegritySample
+    {
+        //! against the host chain, out of c_integrityHostSamples
+        size_t numHostErrors;
+        //! against a device re-run, out of c_integritySampleSize
+        size_t numRerunErrors;
+    };
+    //-----------------------------------------------------------------------------
+    // IntegritySampler class.
+    // Detects hardware errors(e.g. overclocked or undervolted GPUs) during mining.
+    // 1. A few nonces of a random window of a completed batch are hashed by the host
+    //    chain, the reference. The whole window is also re-computed on the device:
+    //    cheap, but it only catches errors a marginal card does not reproduce.
+    // 2. Every hTarg candidate is re-hashed by the host chain.
+    // Not thread safe, owned by a single worker. Counters are merged into the
+    // DeviceIntegrity of its physical device.
+    //-----------------------------------------------------------------------------
+    class IntegritySampler
+    {
+    public:
+        inline IntegritySampler()
+            : m_numChecked(0)
+            , m_numErrors(0)
+            , m_random(0x9E3779B9)
+        { }
+
+        inline void setSeed(uint32_t seed) { m_random = seed ? seed : 0x9E3779B9; }
+
+        //! Re-computes a random window of the latest batch, started from (first_nonce).
+        //! (header): work data(20 words) of the batch. TApplet::getAlgorithmName() selects the host chain.
+        //! Must be called after all candidates of the batch were processed, hash buffer is overwritten.
+        template <typename TApplet>
+        IntegritySample sampleBatch(TApplet& app, const uint32_t* header, uint32_t first_nonce, size_t work_size)
+        {
+            IntegritySample sample = { 0, 0 };
+            if (work_size < c_integritySampleSize)
+                return sample;
+
+            const size_t numWindows = work_size / c_integritySampleSize;
+            const uint32_t windowStart = (uint32_t)((nextRandom() % numWindows) * c_integritySampleSize);
+
+            m_indices.resize(c_integritySampleSize);
+            for (size_t i = 0; i < c_integritySampleSize; ++i)
+                m_indices[i] = windowStart + (uint32_t)i;
+            if (!app.gatherHashes(m_indices.data(), m_indices.size(), m_original))
+                return sample;
+
+            // host reference
+            uint32_t midstate[8];
+            lyra2REMidstate(header, midstate);
+            for (size_t i = 0; i < c_integrityHostSamples; ++i)
+            {
+                const uint32_t index = nextRandom() % c_integritySampleSize;
+                uint32x8 bmwInput;
+                uint32x8 hash;
+                lyra2REHash(TApplet::getAlgorithmName(), midstate, header[16], header[17], header[18],
+                            first_nonce + windowStart + index, bmwInput, hash);
+                if (memcmp(&bmwInput, &m_original[index], sizeof(uint32x8)))
+                    ++sample.numHostErrors;
+            }
+            m_numChecked += c_integrityHostSamples;
+            m_numErrors += sample.numHostErrors;
+
+            // device re-run: everything except the hTarg test. Candidates are already processed.
+            app.onRunPartial(first_nonce + windowStart, c_integritySampleSize, app.getPipeline().size() - 1);
+
+            for (size_t i = 0; i < c_integritySampleSize; ++i)
+                m_indices[i] = (uint32_t)i;
+            if (!app.gatherHashes(m_indices.data(), m_indices.size(), m_recomputed))
+                return sample;
+
+            for (size_t i = 0; i < c_integritySampleSize; ++i)
+            {
+                if (memcmp(&m_original[i], &m_recomputed[i], sizeof(uint32x8)))
+                    ++sample.numRerunErrors;
+            }
+            m_numChecked += c_integritySampleSize;
+            m_numErrors += sample.numRerunErrors;
+
+            return sample;
+        }
+        //! Host check of an hTarg candidate. (device_hash): hash buffer content of (nonce), input of bmw.
+        //! Returns false if the host chain computes a different hash.
+        inline bool recordCandidate(const char* algorithm, const uint32_t* header, uint32_t nonce, const uint32x8& device_hash)
+        {
+            uint32_t midstate[8];
+            lyra2REMidstate(header, midstate);
+            uint32x8 bmwInput;
+            uint32x8 hash;
+            lyra2REHash(algorithm, midstate, header[16], header[17], header[18], nonce, bmwInput, hash);
+
+            const bool passed = !memcmp(&bmwInput, &device_hash, sizeof(uint32x8));
+            ++m_numChecked;
+            if (!passed)
+                ++m_numErrors;
+            return passed;
+        }
+
+        inline uint64_t getNumChecked() const { return m_numChecked; }
+        inline uint64_t getNumErrors() const { return m_numErrors; }
+        inline void reset()
+        {
+            m_numChecked = 0;
+            m_numErrors = 0;
+        }
+
+    private:
+        inline uint32_t nextRandom()
+        {
+            // xorshift32
+            m_random ^= m_random << 13;
+            m_random ^= m_random >> 17;
+            m_random ^= m_random << 5;
+            return m_random;
+        }
+
+        uint64_t m_numChecked;
+        uint64_t m_numErrors;
+        uint32_t m_random;
+        std::vector<uint32_t> m_indices;
+        std::vector<uint32x8> m_original;
+        std::vector<uint32x8> m_recomputed;
+    };
+    //-----------------------------------------------------------------------------
+    // DeviceIntegrity class.
+    // Error counters of a physical device, shared by all of its streams.
+    // A marginal card fails in every stream, so the error rate and IntegrityAction
+    // belong to the device. Each stream applies every triggered action once.
+    // Thread safe.
+    //-----------------------------------------------------------------------------
+    class DeviceIntegrity
+    {
+    public:
+        inline DeviceIntegrity()
+            : m_numChecked(0)
+            , m_numErrors(0)
+            , m_numActions(0)
+        {
+            pthread_mutex_init(&m_lock, NULL);
+        }
+        inline ~DeviceIntegrity() { pthread_mutex_destroy(&m_lock); }
+
+        //! Moves the counters of a stream to the device.
+        inline void merge(IntegritySampler& sampler)
+        {
+            pthread_mutex_lock(&m_lock);
+            m_numChecked += sampler.getNumChecked();
+            m_numErrors += sampler.getNumErrors();
+            pthread_mutex_unlock(&m_lock);
+            sampler.reset();
+        }
+        inline double getErrorRate()
+        {
+            pthread_mutex_lock(&m_lock);
+            const double errorRate = computeErrorRate();
+            pthread_mutex_unlock(&m_lock);
+            return errorRate;
+        }
+        //! Returns true if enough hashes were checked and the error rate is above (max_error_rate).
+        //! In this case, a new action is triggered and counters start over.
+        //! (out_num_checked) and (out_num_errors) are the counters which triggered the action.
+        inline bool triggerAction(double max_error_rate, uint64_t& out_num_checked, uint64_t& out_num_errors)
+        {
+            pthread_mutex_lock(&m_lock);
+            const bool triggered = (m_numChecked >= c_integrityMinCheckedHashes) && (m_numErrors > 0) &&
+                                   (computeErrorRate() > max_error_rate);
+            if (triggered)
+            {
+                out_num_checked = m_numChecked;
+                out_num_errors = m_numErrors;
+                m_numChecked = 0;
+                m_numErrors = 0;
+                ++m_numActions;
+            }
+            pthread_mutex_unlock(&m_lock);
+            return triggered;
+        }
+        //! Number of actions triggered so far. A stream compares it with the number it has applied.
+        inline uint32_t getNumActions()
+        {
+            pthread_mutex_lock(&m_lock);
+            const uint32_t numActions = m_numActions;
+            pthread_mutex_unlock(&m_lock);
+            return numActions;
+        }
+
+    private:
+        DeviceIntegrity(const DeviceIntegrity&);
+        DeviceIntegrity& operator=(const DeviceIntegrity&);
+
+        inline double computeErrorRate() const { return m_numChecked ? (double)m_numErrors / (double)m_numChecked : 0.0; }
+
+        pthread_mutex_t m_lock;
+        uint64_t m_numChecked;
+        uint64_t m_numErrors;
+        uint32_t m_numActions;
+    };
+    //-----------------------------------------------------------------------------
+}
+
+#endif // !IntegritySampler_INCLUDE_ONCE
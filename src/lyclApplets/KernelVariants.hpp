@@ -0,0 +1,1026 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef KernelVariants_INCLUDE_ONCE
+#define KernelVariants_INCLUDE_ONCE
+
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#ifdef _WIN32
+#include <direct.h> // _mkdir
+#else
+#include <sys/stat.h> // mkdir
+#endif
+
+#include <lyclCore/CLUtils.hpp>
+#include <lyclCore/ConfigFile.hpp>
+#include <lyclCore/EmbeddedKernels.hpp>
+#include <lyclApplets/AppCommon.hpp>
+#include <lyclHostValidators/Lyra2RE.hpp>
+
+namespace lycl
+{
+    //-----------------------------------------------------------------------------
+    //! Describes all kernel variants. Loaded once on the first device init.
+    const char* const c_kernelManifestFileName = "kernels/manifest.conf";
+    //! Stores the fastest kernel variant for each device/driver combination.
+    const char* const c_kernelCacheFileName = "lyclMiner.kcache";
+    //! Directory with compiled OpenCL source programs. One file per device/driver/source/options combination.
+    const char* const c_programCacheDirName = "kcache";
+    //! Upper bound for LocalWorkSize. Must divide c_workSizeGranularity.
+    const size_t c_maxLocalWorkSize = 256;
+    //! Number of timed batches per variant.
+    const size_t c_kernelRaceNumBatches = 4;
+    //! Upper bound for the race WorkSize. Keeps initialization time low.
+    const size_t c_kernelRaceMaxWorkSize = 262144;
+    //-----------------------------------------------------------------------------
+    //! Program which can be used for a pipeline stage. See kernels/manifest.conf
+    struct KernelVariant
+    {
+        //! "Lyra2REv2", "Lyra2REv3" or "any"
+        std::string algorithm;
+        //! pipeline stage, e.g. "lyra441p2"
+        std::string stage;
+        //! unique name inside a stage, e.g. "gfx9_amdcl2" or "opencl"
+        std::string name;
+        std::string fileName;
+        //! "gfx6" ... "gfx906" for asm programs, "any" for OpenCL source
+        std::string isa;
+        //! BF_None for OpenCL source
+        EBinaryFormat binaryFormat;
+        std::string kernelName;
+        size_t workGroupSize;
+        //! number of work items per hash
+        size_t globalScale;
+        //! buffer arguments in order: "hashes", "lyraStates", "htArgResult", "gatherIndices", "gatherOutput"
+        std::vector<std::string> args;
+        //! OpenCL source only. -DWORKSIZE=(workGroupSize) is always added.
+        std::string buildOptions;
+        //! OpenCL source only. Work-group sizes raced in addition to (workGroupSize).
+        std::vector<size_t> tuneWorkGroupSizes;
+        //! OpenCL source only. Hardware wavefront size, set by applyDeviceBuildSettings(). 0 if unknown.
+        size_t wavefrontSize;
+
+        bool isBinary() const { return binaryFormat != BF_None; }
+    };
+    //-----------------------------------------------------------------------------
+    //! Pipeline stage created from a kernel variant.
+    struct KernelStage
+    {
+        std::string stageName;
+        cl_program program;
+        cl_kernel kernel;
+        size_t workGroupSize;
+        size_t globalScale;
+        std::string variantName;
+    };
+    //-----------------------------------------------------------------------------
+    //! Buffers which can be bound to stage arguments by name.
+    struct StageBuffers
+    {
+        cl_mem hashes;
+        cl_mem lyraStates;
+        cl_mem htArgResult;
+        cl_mem gatherIndices;
+        cl_mem gatherOutput;
+    };
+    //-----------------------------------------------------------------------------
+    inline const char* getAsmProgramIsaName(EAsmProgram asm_program)
+    {
+        switch (asm_program)
+        {
+        case AP_GFX6:   return "gfx6";
+        case AP_GFX7:   return "gfx7";
+        case AP_GFX8:   return "gfx8";
+        case AP_GFX9:   return "gfx9";
+        case AP_GFX906: return "gfx906";
+        default:        return "";
+        }
+    }
+    //-----------------------------------------------------------------------------
+    //! Splits "a,b,c" into tokens. Spaces are ignored.
+    inline void splitList(const std::string& list, char separator, std::vector<std::string>& out_tokens)
+    {
+        out_tokens.clear();
+        std::string token;
+        for (size_t i = 0; i <= list.size(); ++i)
+        {
+            if (i == list.size() || list[i] == separator)
+            {
+                if (token.size())
+                    out_tokens.push_back(token);
+                token.clear();
+            }
+            else if (list[i] != ' ' && list[i] != '\t')
+                token += list[i];
+        }
+    }
+    //-----------------------------------------------------------------------------
+    //! Work-group sizes of OpenCL source kernels: power of 2, up to c_maxLocalWorkSize.
+    inline bool isValidLocalWorkSize(size_t work_group_size)
+    {
+        return work_group_size && (work_group_size <= c_maxLocalWorkSize) && !(work_group_size & (work_group_size - 1));
+    }
+    //-----------------------------------------------------------------------------
+    // KernelManifest class.
+    //-----------------------------------------------------------------------------
+    class KernelManifest
+    {
+    public:
+        //! parses <Variant0>...<VariantN> blocks.
+        inline bool load(const char* file_name)
+        {
+            std::string manifestText;
+            if (!loadKernelFile(file_name, manifestText))
+                return false;
+
+            ConfigFile cf;
+            if (!cf.setSourceFromMemory(manifestText.data(), manifestText.size()))
+                return false;
+
+            m_variants.clear();
+            ConfigSetting* csetting = nullptr;
+            for (size_t i = 0; ; ++i)
+            {
+                const std::string block = "Variant" + std::to_string(i);
+                if (!(csetting = cf.getSetting(block.c_str(), "Stage")))
+                    break;
+
+                KernelVariant variant;
+                variant.stage = csetting->AsString;
+                variant.algorithm = cf.getStringDefault(block.c_str(), "Algorithm", "any");
+                variant.name = cf.getStringDefault(block.c_str(), "Name", "opencl");
+                variant.fileName = cf.getStringDefault(block.c_str(), "File", "");
+                variant.isa = cf.getStringDefault(block.c_str(), "Isa", "any");
+                variant.binaryFormat = getBinaryFormatFromName(cf.getStringDefault(block.c_str(), "BinaryFormat", "source"));
+                variant.kernelName = cf.getStringDefault(block.c_str(), "KernelName", variant.stage.c_str());
+                variant.workGroupSize = (size_t)cf.getIntDefault(block.c_str(), "WorkGroupSize", 256);
+                variant.globalScale = (size_t)cf.getIntDefault(block.c_str(), "GlobalScale", 1);
+                splitList(cf.getStringDefault(block.c_str(), "Args", ""), ',', variant.args);
+                variant.buildOptions = cf.getStringDefault(block.c_str(), "BuildOptions", "");
+                variant.wavefrontSize = 0;
+
+                std::vector<std::string> tuneWorkGroupSizes;
+                splitList(cf.getStringDefault(block.c_str(), "TuneWorkGroupSizes", ""), ',', tuneWorkGroupSizes);
+                for (size_t j = 0; j < tuneWorkGroupSizes.size(); ++j)
+                {
+                    const size_t workGroupSize = (size_t)atoi(tuneWorkGroupSizes[j].c_str());
+                    if (isValidLocalWorkSize(workGroupSize) && workGroupSize != variant.workGroupSize)
+                        variant.tuneWorkGroupSizes.push_back(workGroupSize);
+                }
+
+                if (variant.fileName.empty() || !variant.workGroupSize || !variant.globalScale)
+                {
+                    std::cerr << "Kernel manifest: invalid variant(" << block << ")" << std::endl;
+                    continue;
+                }
+
+                m_variants.push_back(variant);
+            }
+
+            return m_variants.size() != 0;
+        }
+        //! Lists stage variants viable for the device. OpenCL source variants are listed first.
+        //! (all_formats == true) lists asm programs in all binary formats, otherwise only in the configured one.
+        inline void getStageVariants(const std::string& algorithm, const std::string& stage, const device& in_device,
+                                     bool all_formats, std::vector<KernelVariant>& out_variants) const
+        {
+            out_variants.clear();
+            const std::string isa = getAsmProgramIsaName(in_device.asmProgram);
+            const bool asmEnabled = (in_device.asmProgram != AP_None) && (in_device.binaryFormat != BF_None);
+
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                for (size_t i = 0; i < m_variants.size(); ++i)
+                {
+                    const KernelVariant& v = m_variants[i];
+                    if (v.stage != stage || (v.algorithm != "any" && !strIEqual(v.algorithm, algorithm)))
+                        continue;
+
+                    if (pass == 0)
+                    {
+                        if (!v.isBinary())
+                            out_variants.push_back(v);
+                    }
+                    else if (v.isBinary() && asmEnabled && (v.isa == isa) &&
+                             (all_formats || v.binaryFormat == in_device.binaryFormat))
+                    {
+                        out_variants.push_back(v);
+                    }
+                }
+            }
+        }
+
+    private:
+        std::vector<KernelVariant> m_variants;
+    };
+    //-----------------------------------------------------------------------------
+    //! Returns a manifest shared by all devices. Loaded on the first call.
+    inline const KernelManifest& getKernelManifest()
+    {
+        static pthread_mutex_t manifestLock = PTHREAD_MUTEX_INITIALIZER;
+        static KernelManifest manifest;
+        static bool loaded = false;
+
+        pthread_mutex_lock(&manifestLock);
+        if (!loaded)
+        {
+            if (!manifest.load(c_kernelManifestFileName))
+                std::cerr << "Failed to load a kernel manifest(" << c_kernelManifestFileName << ")" << std::endl;
+            loaded = true;
+        }
+        pthread_mutex_unlock(&manifestLock);
+
+        return manifest;
+    }
+    //-----------------------------------------------------------------------------
+    //! Returns variant name from "stage:name,stage:name" list, or empty string.
+    inline std::string getVariantOverride(const char* overrides, const std::string& stage)
+    {
+        std::vector<std::string> entries;
+        splitList(overrides, ',', entries);
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            size_t separator = entries[i].find(':');
+            if (separator != std::string::npos && entries[i].compare(0, separator, stage) == 0)
+                return entries[i].substr(separator + 1);
+        }
+        return std::string();
+    }
+    //-----------------------------------------------------------------------------
+    //! Returns build options for (stage) from "-DA=1; stage:-DB=2" list. Entries without a stage prefix apply to all stages.
+    inline std::string getStageBuildOptions(const char* options, const std::string& stage)
+    {
+        const std::string list(options);
+        std::string result;
+        for (size_t start = 0; start < list.size(); )
+        {
+            size_t end = list.find(';', start);
+            if (end == std::string::npos)
+                end = list.size();
+            std::string entry = list.substr(start, end - start);
+            start = end + 1;
+
+            const size_t first = entry.find_first_not_of(" \t");
+            if (first == std::string::npos)
+                continue;
+            entry = entry.substr(first, entry.find_last_not_of(" \t") - first + 1);
+
+            // "stage:" prefix. Options may contain ':' too(e.g. paths), stage names do not contain spaces or '-'.
+            const size_t separator = entry.find(':');
+            if (separator != std::string::npos && entry.find_first_of(" \t-") > separator)
+            {
+                if (entry.compare(0, separator, stage) != 0)
+                    continue;
+                entry.erase(0, separator + 1);
+            }
+
+            if (entry.size())
+                result += " " + entry;
+        }
+        return result;
+    }
+    //-----------------------------------------------------------------------------
+    //! Returns the hardware wavefront/warp size, or 0 if the device does not report it.
+    inline size_t getDeviceWavefrontSize(cl_device_id cldevice)
+    {
+        cl_uint wavefrontSize = 0;
+        if (clGetDeviceInfo(cldevice, CL_DEVICE_WAVEFRONT_WIDTH_AMD, sizeof(cl_uint), &wavefrontSize, nullptr) == CL_SUCCESS && wavefrontSize)
+            return wavefrontSize;
+        wavefrontSize = 0;
+        if (clGetDeviceInfo(cldevice, CL_DEVICE_WARP_SIZE_NV, sizeof(cl_uint), &wavefrontSize, nullptr) == CL_SUCCESS && wavefrontSize)
+            return wavefrontSize;
+        return 0;
+    }
+    //-----------------------------------------------------------------------------
+    //! Build option which is valid only while a work-group fits into a single wavefront.
+    const char* const c_wavefrontSyncOption = "-DLYRA_WAVEFRONT_SYNC";
+    //-----------------------------------------------------------------------------
+    //! Build options of an OpenCL source variant, without -DWORKSIZE.
+    //! c_wavefrontSyncOption is dropped if the work-group size is above the wavefront size, or the size is unknown.
+    inline std::string getVariantBuildOptions(const KernelVariant& variant)
+    {
+        std::string buildOptions = variant.buildOptions;
+        if (variant.wavefrontSize && variant.workGroupSize <= variant.wavefrontSize)
+            return buildOptions;
+
+        for (size_t pos; (pos = buildOptions.find(c_wavefrontSyncOption)) != std::string::npos; )
+        {
+            // "-DLYRA_WAVEFRONT_SYNC" or "-DLYRA_WAVEFRONT_SYNC=1"
+            size_t end = buildOptions.find_first_of(" \t", pos);
+            if (end == std::string::npos)
+                end = buildOptions.size();
+            buildOptions.erase(pos, end - pos);
+        }
+        return buildOptions;
+    }
+    //-----------------------------------------------------------------------------
+    //! Applies LocalWorkSize and BuildOptions of the device to OpenCL source variants.
+    //! A configured LocalWorkSize disables work-group size tuning of the stage.
+    //! c_wavefrontSyncOption is dropped for work-group sizes above the device wavefront size(including tuned sizes),
+    //! see getVariantBuildOptions().
+    inline void applyDeviceBuildSettings(const device& in_device, const std::string& device_name, const std::string& stage,
+                                         std::vector<KernelVariant>& variants)
+    {
+        const std::string localWorkSizeText = getVariantOverride(in_device.localWorkSizes, stage);
+        size_t localWorkSize = (size_t)atoi(localWorkSizeText.c_str());
+        if (localWorkSizeText.size() && !isValidLocalWorkSize(localWorkSize))
+        {
+            std::cerr << "Invalid LocalWorkSize(" << stage << ":" << localWorkSizeText << "). Must be a power of 2 up to "
+                      << c_maxLocalWorkSize << ". Device(" << device_name << ")" << std::endl;
+            localWorkSize = 0;
+        }
+        const std::string buildOptions = getStageBuildOptions(in_device.buildOptions, stage);
+        const size_t wavefrontSize = getDeviceWavefrontSize(in_device.clId);
+
+        for (size_t i = 0; i < variants.size(); ++i)
+        {
+            KernelVariant& variant = variants[i];
+            if (variant.isBinary())
+                continue;
+
+            if (localWorkSize)
+            {
+                variant.workGroupSize = localWorkSize;
+                variant.tuneWorkGroupSizes.clear();
+            }
+            variant.buildOptions += buildOptions;
+            variant.wavefrontSize = wavefrontSize;
+
+            if (variant.buildOptions.find(c_wavefrontSyncOption) == std::string::npos)
+                continue;
+            size_t maxWorkGroupSize = variant.workGroupSize;
+            for (size_t j = 0; j < variant.tuneWorkGroupSizes.size(); ++j)
+                maxWorkGroupSize = std::max(maxWorkGroupSize, variant.tuneWorkGroupSizes[j]);
+            if (!wavefrontSize || maxWorkGroupSize > wavefrontSize)
+            {
+                std::cerr << c_wavefrontSyncOption << " is ignored for work-group sizes above the wavefront size("
+                          << (wavefrontSize ? std::to_string(wavefrontSize) : std::string("unknown")) << "). Stage("
+                          << stage << ":" << variant.name << "), Device(" << device_name << ")" << std::endl;
+            }
+        }
+    }
+    //-----------------------------------------------------------------------------
+    //! Adds a "name@size" copy of OpenCL source variants for each tuned work-group size.
+    inline void expandTunedVariants(const std::vector<KernelVariant>& variants, std::vector<KernelVariant>& out_variants)
+    {
+        out_variants.clear();
+        for (size_t i = 0; i < variants.size(); ++i)
+        {
+            out_variants.push_back(variants[i]);
+            out_variants.back().tuneWorkGroupSizes.clear();
+
+            for (size_t j = 0; j < variants[i].tuneWorkGroupSizes.size(); ++j)
+            {
+                KernelVariant tuned = out_variants.back();
+                tuned.workGroupSize = variants[i].tuneWorkGroupSizes[j];
+                tuned.name += "@" + std::to_string(tuned.workGroupSize);
+                out_variants.push_back(tuned);
+            }
+        }
+    }
+    //-----------------------------------------------------------------------------
+    inline std::string getDeviceInfoString(cl_device_id cldevice, cl_device_info param_name)
+    {
+        std::string info;
+        size_t infoSize = 0;
+        clGetDeviceInfo(cldevice, param_name, 0, NULL, &infoSize);
+        info.resize(infoSize);
+        clGetDeviceInfo(cldevice, param_name, infoSize, (void *)info.data(), NULL);
+        if (info.size())
+            info.pop_back();
+
+        return info;
+    }
+    //-----------------------------------------------------------------------------
+    // Kernel cache. One "key=variant" entry per line.
+    // Program cache. Compiled OpenCL source programs, one file per program.
+    //-----------------------------------------------------------------------------
+    inline pthread_mutex_t& getKernelCacheLock()
+    {
+        static pthread_mutex_t kernelCacheLock = PTHREAD_MUTEX_INITIALIZER;
+        return kernelCacheLock;
+    }
+    //-----------------------------------------------------------------------------
+    //! FNV-1a 64
+    inline uint64_t hashFnv1a64(const std::string& data, uint64_t hash = 0xCBF29CE484222325ULL)
+    {
+        for (size_t i = 0; i < data.size(); ++i)
+        {
+            hash ^= (unsigned char)data[i];
+            hash *= 0x100000001B3ULL;
+        }
+        return hash;
+    }
+    //-----------------------------------------------------------------------------
+    //! Program is valid only for the same device, driver, source and build options.
+    inline std::string getProgramCacheFileName(cl_device_id cldevice, const std::string& source, const std::string& build_options)
+    {
+        uint64_t hash = hashFnv1a64(getDeviceInfoString(cldevice, CL_DEVICE_NAME));
+        hash = hashFnv1a64("|" + getDeviceInfoString(cldevice, CL_DRIVER_VERSION), hash);
+        hash = hashFnv1a64("|" + build_options + "|", hash);
+        hash = hashFnv1a64(source, hash);
+
+        char fileName[64];
+        snprintf(fileName, sizeof(fileName), "%s/%016llx.bin", c_programCacheDirName, (unsigned long long)hash);
+        return fileName;
+    }
+    //-----------------------------------------------------------------------------
+    inline bool loadCachedProgram(const std::string& file_name, std::string& out_binary)
+    {
+        pthread_mutex_lock(&getKernelCacheLock());
+        std::ifstream cacheFile(file_name, std::ios::binary);
+        std::ostringstream binary;
+        binary << cacheFile.rdbuf();
+        pthread_mutex_unlock(&getKernelCacheLock());
+
+        out_binary = binary.str();
+        return !out_binary.empty();
+    }
+    //-----------------------------------------------------------------------------
+    inline void saveCachedProgram(const std::string& file_name, cl_program program)
+    {
+        size_t binarySize = 0;
+        if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binarySize, nullptr) != CL_SUCCESS || !binarySize)
+            return;
+
+        std::vector<unsigned char> binary(binarySize);
+        unsigned char* binaries[1] = { binary.data() };
+        if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binaries), binaries, nullptr) != CL_SUCCESS)
+            return;
+
+        pthread_mutex_lock(&getKernelCacheLock());
+#ifdef _WIN32
+        _mkdir(c_programCacheDirName);
+#else
+        mkdir(c_programCacheDirName, 0755);
+#endif
+        std::ofstream cacheFile(file_name, std::ios::binary | std::ios::trunc);
+        cacheFile.write((const char*)binary.data(), binary.size());
+        pthread_mutex_unlock(&getKernelCacheLock());
+    }
+    //-----------------------------------------------------------------------------
+    //! Program files are taken from the override directory or embedded into the executable. See EmbeddedKernels.hpp
+    //! OpenCL source programs are loaded from the program cache if possible, otherwise built and cached.
+    inline cl_program createProgramFromVariant(cl_context context, cl_device_id cldevice, const KernelVariant& variant)
+    {
+        std::string programData;
+        if (!loadKernelFile(variant.fileName, programData))
+            return NULL;
+
+        if (variant.isBinary())
+            return cluCreateProgramWithBinary(context, cldevice, (const unsigned char*)programData.data(), programData.size());
+
+        const std::string buildOptions = "-DWORKSIZE=" + std::to_string(variant.workGroupSize) + getVariantBuildOptions(variant);
+        const std::string cacheFileName = getProgramCacheFileName(cldevice, programData, buildOptions);
+
+        std::string binary;
+        if (loadCachedProgram(cacheFileName, binary))
+        {
+            cl_program program = cluCreateProgramWithBinary(context, cldevice, (const unsigned char*)binary.data(), binary.size());
+            if (program != NULL)
+                return program;
+        }
+
+        cl_program program = cluCreateProgramFromSource(context, cldevice, programData, buildOptions.c_str());
+        if (program != NULL)
+            saveCachedProgram(cacheFileName, program);
+
+        return program;
+    }
+    //-----------------------------------------------------------------------------
+    //! Creates a kernel and binds buffer arguments listed in the manifest.
+    //! Fails if the kernel can not be launched with the work-group size of the variant.
+    inline cl_kernel createKernelFromVariant(cl_program program, cl_device_id cldevice, const KernelVariant& variant,
+                                             const StageBuffers& buffers, const std::string& device_name)
+    {
+        cl_int errorCode = CL_SUCCESS;
+        cl_kernel kernel = clCreateKernel(program, variant.kernelName.c_str(), &errorCode);
+        if (errorCode != CL_SUCCESS)
+        {
+            std::cerr << "Failed to create kernel(" << variant.stage << ":" << variant.name << "). Device(" << device_name << ")" << std::endl;
+            return NULL;
+        }
+
+        size_t maxWorkGroupSize = 0;
+        if (clGetKernelWorkGroupInfo(kernel, cldevice, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxWorkGroupSize, nullptr) == CL_SUCCESS &&
+            variant.workGroupSize > maxWorkGroupSize)
+        {
+            std::cerr << "Work-group size(" << variant.workGroupSize << ") is not supported by kernel(" << variant.stage << ":" << variant.name
+                      << "), max(" << maxWorkGroupSize << "). Device(" << device_name << ")" << std::endl;
+            clReleaseKernel(kernel);
+            return NULL;
+        }
+
+        for (size_t i = 0; i < variant.args.size(); ++i)
+        {
+            const cl_mem* buffer = nullptr;
+            if (variant.args[i] == "hashes")
+                buffer = &buffers.hashes;
+            else if (variant.args[i] == "lyraStates")
+                buffer = &buffers.lyraStates;
+            else if (variant.args[i] == "htArgResult")
+                buffer = &buffers.htArgResult;
+            else if (variant.args[i] == "gatherIndices")
+                buffer = &buffers.gatherIndices;
+            else if (variant.args[i] == "gatherOutput")
+                buffer = &buffers.gatherOutput;
+
+            if (!buffer || clSetKernelArg(kernel, (cl_uint)i, sizeof(cl_mem), buffer) != CL_SUCCESS)
+            {
+                std::cerr << "Error setting kernel argument(" << i << ") inside kernel(" << variant.stage << ":" << variant.name
+                          << "). Device(" << device_name << ")" << std::endl;
+                clReleaseKernel(kernel);
+                return NULL;
+            }
+        }
+
+        return kernel;
+    }
+    //-----------------------------------------------------------------------------
+    inline void readKernelCache(std::map<std::string, std::string>& out_entries)
+    {
+        std::ifstream cacheFile(c_kernelCacheFileName);
+        std::string line;
+        while (std::getline(cacheFile, line))
+        {
+            size_t separator = line.rfind('=');
+            if (separator != std::string::npos)
+                out_entries[line.substr(0, separator)] = line.substr(separator + 1);
+        }
+    }
+    //-----------------------------------------------------------------------------
+    inline bool loadCachedKernelVariant(const std::string& key, std::string& out_variant_name)
+    {
+        std::map<std::string, std::string> entries;
+
+        pthread_mutex_lock(&getKernelCacheLock());
+        readKernelCache(entries);
+        pthread_mutex_unlock(&getKernelCacheLock());
+
+        auto it = entries.find(key);
+        if (it == entries.end())
+            return false;
+
+        out_variant_name = it->second;
+        return true;
+    }
+    //-----------------------------------------------------------------------------
+    inline void saveCachedKernelVariant(const std::string& key, const std::string& variant_name)
+    {
+        std::map<std::string, std::string> entries;
+
+        pthread_mutex_lock(&getKernelCacheLock());
+        readKernelCache(entries);
+        entries[key] = variant_name;
+
+        std::ofstream cacheFile(c_kernelCacheFileName, std::ios::trunc);
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+            cacheFile << it->first << "=" << it->second << "\n";
+        pthread_mutex_unlock(&getKernelCacheLock());
+    }
+    //-----------------------------------------------------------------------------
+    //! Cache key. Decision is valid only for the same device, driver, kernel set and build settings.
+    inline std::string getKernelCacheKey(cl_device_id cldevice, const std::string& device_name, const std::string& algorithm,
+                                         const std::string& stage, const std::vector<KernelVariant>& variants)
+    {
+        const std::string driverVersion = getDeviceInfoString(cldevice, CL_DRIVER_VERSION);
+
+        std::string key = device_name + "|" + driverVersion + "|" + algorithm + "|" + stage;
+        for (size_t i = 0; i < variants.size(); ++i)
+        {
+            key += "|" + variants[i].name;
+            if (!variants[i].isBinary())
+                key += "(" + std::to_string(variants[i].workGroupSize) + getVariantBuildOptions(variants[i]) + ")";
+        }
+
+        return key;
+    }
+    //-----------------------------------------------------------------------------
+    // Variant race.
+    // Every variant is first run on a deterministic input(xorshift32 seeded with
+    // 0x6A09E667, written buffer by buffer in argument order) of
+    // c_kernelRaceKnownAnswerHashes hashes. FNV-1a 64 of its output buffers must match
+    // the digest of the host version of the stage(runHostStage) on the same input.
+    //-----------------------------------------------------------------------------
+    //! Number of hashes in the known answer pass. Must be a multiple of c_maxLocalWorkSize.
+    const size_t c_kernelRaceKnownAnswerHashes = 256;
+    //-----------------------------------------------------------------------------
+    //! Known answer input of a stage with (args), one buffer per argument.
+    //! Only "hashes" and "lyraStates" arguments are supported.
+    inline bool makeKnownAnswerInput(const std::vector<std::string>& args, std::vector<std::vector<uint32_t> >& out_inputs,
+                                     std::string& out_reason)
+    {
+        out_inputs.resize(args.size());
+        uint32_t x = 0x6A09E667;
+        for (size_t i = 0; i < args.size(); ++i)
+        {
+            size_t bytesPerHash;
+            if (args[i] == "hashes")
+                bytesPerHash = c_hashStorageBytesPerHash;
+            else if (args[i] == "lyraStates")
+                bytesPerHash = c_lyraStatesBytesPerHash;
+            else
+            {
+                out_reason = "unsupported argument(" + args[i] + ")";
+                return false;
+            }
+
+            out_inputs[i].resize(c_kernelRaceKnownAnswerHashes * (bytesPerHash / sizeof(uint32_t)));
+            for (size_t j = 0; j < out_inputs[i].size(); ++j)
+            {
+                x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+                out_inputs[i][j] = x;
+            }
+        }
+        return true;
+    }
+    //-----------------------------------------------------------------------------
+    //! Runs the host version of (stage) on the known answer input and returns the digest of its buffers.
+    //! Stages without a host version have no known answer and are not raced.
+    inline bool computeKernelKnownAnswer(const std::string& algorithm, const std::string& stage, const std::vector<std::string>& args,
+                                         const std::vector<std::vector<uint32_t> >& inputs, uint64_t& out_digest)
+    {
+        std::vector<std::vector<uint32_t> > outputs(inputs);
+        for (size_t h = 0; h < c_kernelRaceKnownAnswerHashes; ++h)
+        {
+            uint32x8 hash;
+            LyraState lyraState;
+            memset(&hash, 0, sizeof(hash));
+            memset(&lyraState, 0, sizeof(lyraState));
+            for (size_t i = 0; i < args.size(); ++i)
+            {
+                if (args[i] == "hashes")
+                    memcpy(&hash, &outputs[i][h * 8], sizeof(hash));
+                else
+                    memcpy(&lyraState, &outputs[i][h * 32], sizeof(lyraState));
+            }
+
+            if (!runHostStage(algorithm, stage, hash, lyraState))
+                return false;
+
+            for (size_t i = 0; i < args.size(); ++i)
+            {
+                if (args[i] == "hashes")
+                    memcpy(&outputs[i][h * 8], &hash, sizeof(hash));
+                else
+                    memcpy(&outputs[i][h * 32], &lyraState, sizeof(lyraState));
+            }
+        }
+
+        out_digest = hashFnv1a64(std::string());
+        for (size_t i = 0; i < outputs.size(); ++i)
+            out_digest = hashFnv1a64(std::string((const char*)outputs[i].data(), outputs[i].size() * sizeof(uint32_t)), out_digest);
+        return true;
+    }
+    //-----------------------------------------------------------------------------
+    //! Input/output buffer of a raced stage.
+    struct RaceBuffer
+    {
+        cl_mem mem;
+        std::vector<uint32_t> input;
+    };
+    //-----------------------------------------------------------------------------
+    //! Runs a stage on the known answer input and returns the digest of all its buffers.
+    //! Then times it on (work_size) hashes.
+    //! Returns negative time on failure, otherwise average batch time in ms.
+    inline double runStageVariant(cl_command_queue queue, cl_kernel kernel, const KernelVariant& variant,
+                                  const std::vector<RaceBuffer>& buffers, size_t work_size, uint64_t& out_digest)
+    {
+        const size_t localWorkSize = variant.workGroupSize;
+
+        // known answer pass
+        for (size_t i = 0; i < buffers.size(); ++i)
+        {
+            if (clEnqueueWriteBuffer(queue, buffers[i].mem, CL_TRUE, 0, buffers[i].input.size() * sizeof(uint32_t),
+                                     buffers[i].input.data(), 0, nullptr, nullptr) != CL_SUCCESS)
+                return -1.0;
+        }
+        const size_t knownAnswerWorkSize = c_kernelRaceKnownAnswerHashes * variant.globalScale;
+        if (clEnqueueNDRangeKernel(queue, kernel, 1, nullptr, &knownAnswerWorkSize, &localWorkSize, 0, nullptr, nullptr) != CL_SUCCESS)
+            return -1.0;
+
+        std::string result;
+        out_digest = hashFnv1a64(result);
+        for (size_t i = 0; i < buffers.size(); ++i)
+        {
+            result.resize(buffers[i].input.size() * sizeof(uint32_t));
+            if (clEnqueueReadBuffer(queue, buffers[i].mem, CL_TRUE, 0, result.size(), &result[0], 0, nullptr, nullptr) != CL_SUCCESS)
+                return -1.0;
+            out_digest = hashFnv1a64(result, out_digest);
+        }
+
+        // timed passes
+        const size_t globalWorkSize = work_size * variant.globalScale;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < c_kernelRaceNumBatches; ++i)
+        {
+            if (clEnqueueNDRangeKernel(queue, kernel, 1, nullptr, &globalWorkSize, &localWorkSize, 0, nullptr, nullptr) != CL_SUCCESS)
+            {
+                // drain the batches already queued before the next variant
+                clFinish(queue);
+                return -1.0;
+            }
+        }
+        if (clFinish(queue) != CL_SUCCESS)
+            return -1.0;
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        return std::chrono::duration<double, std::milli>(end - start).count() / (double)c_kernelRaceNumBatches;
+    }
+    //-----------------------------------------------------------------------------
+    //! Builds all variants, checks each against the known answer of the stage and keeps the fastest one.
+    //! Only "hashes" and "lyraStates" arguments are supported.
+    //! Returns false with (out_reason) if the stage can't be raced or none of the variants are usable.
+    inline bool raceStageVariants(cl_context context, cl_command_queue queue, cl_device_id cldevice,
+                                  const std::string& device_name, const std::string& algorithm, const StageBuffers& stage_buffers,
+                                  size_t work_size, const std::vector<KernelVariant>& variants, KernelStage& out_stage,
+                                  size_t& out_variant_index, std::string& out_reason)
+    {
+        if (work_size < c_kernelRaceKnownAnswerHashes)
+        {
+            out_reason = "WorkSize is smaller than the known answer input";
+            return false;
+        }
+        const size_t raceWorkSize = (work_size < c_kernelRaceMaxWorkSize) ? work_size : c_kernelRaceMaxWorkSize;
+
+        // deterministic input(xorshift32)
+        const std::vector<std::string>& args = variants[0].args;
+        std::vector<std::vector<uint32_t> > inputs;
+        if (!makeKnownAnswerInput(args, inputs, out_reason))
+            return false;
+        uint64_t knownAnswer = 0;
+        if (!computeKernelKnownAnswer(algorithm, variants[0].stage, args, inputs, knownAnswer))
+        {
+            out_reason = "no host version of the stage";
+            return false;
+        }
+
+        std::vector<RaceBuffer> buffers(args.size());
+        for (size_t i = 0; i < args.size(); ++i)
+        {
+            buffers[i].mem = (args[i] == "hashes") ? stage_buffers.hashes : stage_buffers.lyraStates;
+            buffers[i].input.swap(inputs[i]);
+        }
+
+        bool found = false;
+        double bestTime = 0.0;
+
+        for (size_t i = 0; i < variants.size(); ++i)
+        {
+            const KernelVariant& variant = variants[i];
+            if (variant.args != args)
+            {
+                std::cerr << "Kernel race: variant(" << variant.stage << ":" << variant.name << ") has different arguments. Skipping..." << std::endl;
+                continue;
+            }
+
+            cl_program program = createProgramFromVariant(context, cldevice, variant);
+            if (program == NULL)
+            {
+                std::cerr << "Kernel race: failed to create program(" << variant.stage << ":" << variant.name << "). Device(" << device_name << ")" << std::endl;
+                continue;
+            }
+
+            cl_kernel kernel = createKernelFromVariant(program, cldevice, variant, stage_buffers, device_name);
+            if (kernel == NULL)
+            {
+                clReleaseProgram(program);
+                continue;
+            }
+
+            uint64_t digest = 0;
+            double batchTime = runStageVariant(queue, kernel, variant, buffers, raceWorkSize, digest);
+            bool valid = (batchTime >= 0.0);
+            if (valid && digest != knownAnswer)
+            {
+                std::cerr << "Kernel race: variant(" << variant.stage << ":" << variant.name << ") failed known answer test. Device(" << device_name << ")" << std::endl;
+                valid = false;
+            }
+
+            if (valid)
+            {
+                std::cout << "Kernel race: " << variant.stage << ":" << variant.name << " " << batchTime << " ms/batch(" << raceWorkSize
+                          << " hashes). Device(" << device_name << ")" << std::endl;
+            }
+
+            if (valid && (!found || batchTime < bestTime))
+            {
+                if (found)
+                {
+                    clReleaseKernel(out_stage.kernel);
+                    clReleaseProgram(out_stage.program);
+                }
+                out_stage.program = program;
+                out_stage.kernel = kernel;
+                out_stage.workGroupSize = variant.workGroupSize;
+                out_stage.globalScale = variant.globalScale;
+                out_stage.variantName = variant.name;
+                out_variant_index = i;
+                bestTime = batchTime;
+                found = true;
+            }
+            else
+            {
+                clReleaseKernel(kernel);
+                clReleaseProgram(program);
+            }
+        }
+
+        if (!found)
+            out_reason = "no variant passed the known answer test";
+        return found;
+    }
+    //-----------------------------------------------------------------------------
+    //! Creates a program and a kernel from one of the variants. Variants are tried in order.
+    inline bool createStageFromVariants(cl_context context, cl_device_id cldevice, const std::string& device_name,
+                                        const StageBuffers& stage_buffers, const std::vector<KernelVariant>& variants,
+                                        KernelStage& out_stage)
+    {
+        for (size_t i = 0; i < variants.size(); ++i)
+        {
+            const KernelVariant& variant = variants[i];
+            cl_program program = createProgramFromVariant(context, cldevice, variant);
+            if (program == NULL)
+            {
+                std::cerr << "Failed to create CL program(" << variant.stage << ":" << variant.name << "). Device(" << device_name << ")" << std::endl;
+                continue;
+            }
+
+            cl_kernel kernel = createKernelFromVariant(program, cldevice, variant, stage_buffers, device_name);
+            if (kernel == NULL)
+            {
+                clReleaseProgram(program);
+                continue;
+            }
+
+            out_stage.program = program;
+            out_stage.kernel = kernel;
+            out_stage.workGroupSize = variant.workGroupSize;
+            out_stage.globalScale = variant.globalScale;
+            out_stage.variantName = variant.name;
+            return true;
+        }
+
+        return false;
+    }
+    //-----------------------------------------------------------------------------
+    //! Streams of one physical device share a lock, so each stage is raced once per device
+    //! and the other streams use the cached decision. Races would also disturb each other's timings.
+    inline pthread_mutex_t& getKernelRaceLock(int32_t device_index)
+    {
+        static pthread_mutex_t raceLocksLock = PTHREAD_MUTEX_INITIALIZER;
+        static std::map<int32_t, pthread_mutex_t*> raceLocks;
+
+        pthread_mutex_lock(&raceLocksLock);
+        pthread_mutex_t*& raceLock = raceLocks[device_index];
+        if (raceLock == nullptr)
+        {
+            raceLock = new pthread_mutex_t;
+            pthread_mutex_init(raceLock, nullptr);
+        }
+        pthread_mutex_unlock(&raceLocksLock);
+
+        return *raceLock;
+    }
+    //-----------------------------------------------------------------------------
+    //! Uses a cached decision or races (candidates). Called with the race lock of the device held.
+    inline bool createRacedKernelStage(cl_context context, cl_command_queue queue, const device& in_device,
+                                       const std::string& device_name, const std::string& algorithm, const std::string& stage,
+                                       const StageBuffers& stage_buffers, size_t work_size, const std::vector<KernelVariant>& ordered,
+                                       const std::vector<KernelVariant>& candidates, KernelStage& out_stage)
+    {
+        // use cached decision
+        const std::string cacheKey = getKernelCacheKey(in_device.clId, device_name, algorithm, stage, candidates);
+        std::string cachedName;
+        if (loadCachedKernelVariant(cacheKey, cachedName))
+        {
+            for (size_t i = 0; i < candidates.size(); ++i)
+            {
+                if (candidates[i].name == cachedName)
+                {
+                    std::vector<KernelVariant> selected(1, candidates[i]);
+                    if (createStageFromVariants(context, in_device.clId, device_name, stage_buffers, selected, out_stage))
+                    {
+                        std::cout << "Using cached kernel variant(" << stage << ":" << cachedName << "). Device(" << device_name << ")" << std::endl;
+                        return true;
+                    }
+                    break;
+                }
+            }
+        }
+
+        size_t bestIndex = 0;
+        std::string raceFailure;
+        if (!raceStageVariants(context, queue, in_device.clId, device_name, algorithm, stage_buffers, work_size, candidates,
+                               out_stage, bestIndex, raceFailure))
+        {
+            std::cerr << "Kernel race skipped for stage(" << stage << "): " << raceFailure << ". Using the configured binary format. Device("
+                      << device_name << ")" << std::endl;
+            return createStageFromVariants(context, in_device.clId, device_name, stage_buffers, ordered, out_stage);
+        }
+
+        std::cout << "Kernel race winner: " << stage << ":" << candidates[bestIndex].name << ". Device(" << device_name << ")" << std::endl;
+        saveCachedKernelVariant(cacheKey, candidates[bestIndex].name);
+
+        return true;
+    }
+    //-----------------------------------------------------------------------------
+    //! Creates a pipeline stage from the kernel manifest.
+    //! Per-device override: uses the selected variant, with a fallback to OpenCL source.
+    //! Race enabled: uses a cached decision or races all variants and tuned work-group sizes of OpenCL source variants,
+    //! once per physical device.
+    //! Stages which can't be raced fall back to the race disabled order.
+    //! Race disabled: uses an asm program in the configured format, with a fallback to OpenCL source.
+    inline bool createKernelStage(cl_context context, cl_command_queue queue, const device& in_device,
+                                  const std::string& device_name, const std::string& algorithm, const std::string& stage,
+                                  const StageBuffers& stage_buffers, size_t work_size, KernelStage& out_stage)
+    {
+        out_stage.stageName = stage;
+        out_stage.program = NULL;
+        out_stage.kernel = NULL;
+
+        std::vector<KernelVariant> variants;
+        getKernelManifest().getStageVariants(algorithm, stage, in_device, true, variants);
+        if (variants.empty())
+        {
+            std::cerr << "No kernel variants found for stage(" << stage << "). Device(" << device_name << ")" << std::endl;
+            return false;
+        }
+        applyDeviceBuildSettings(in_device, device_name, stage, variants);
+
+        // per-device override. Tuned variants("opencl@128") can be selected too.
+        const std::string overrideName = getVariantOverride(in_device.kernelVariants, stage);
+        if (overrideName.size())
+        {
+            std::vector<KernelVariant> candidates;
+            expandTunedVariants(variants, candidates);
+
+            std::vector<KernelVariant> selected;
+            for (size_t i = 0; i < candidates.size(); ++i)
+            {
+                if (candidates[i].name == overrideName)
+                    selected.push_back(candidates[i]);
+            }
+            if (selected.empty())
+                std::cerr << "Kernel variant(" << stage << ":" << overrideName << ") is not available. Device(" << device_name << ")" << std::endl;
+            selected.push_back(variants[0]);
+
+            return createStageFromVariants(context, in_device.clId, device_name, stage_buffers, selected, out_stage);
+        }
+
+        // asm program in the configured binary format first, then OpenCL source.
+        std::vector<KernelVariant> ordered;
+        for (size_t i = variants.size(); i-- > 0; )
+        {
+            if (!variants[i].isBinary() || variants[i].binaryFormat == in_device.binaryFormat)
+                ordered.push_back(variants[i]);
+        }
+
+        std::vector<KernelVariant> candidates;
+        expandTunedVariants(variants, candidates);
+
+        if (!in_device.kernelRace || candidates.size() == 1)
+            return createStageFromVariants(context, in_device.clId, device_name, stage_buffers, ordered, out_stage);
+
+        pthread_mutex_t& raceLock = getKernelRaceLock(in_device.deviceIndex);
+        pthread_mutex_lock(&raceLock);
+        const bool created = createRacedKernelStage(context, queue, in_device, device_name, algorithm, stage, stage_buffers,
+                                                    work_size, ordered, candidates, out_stage);
+        pthread_mutex_unlock(&raceLock);
+
+        return created;
+    }
+    //-----------------------------------------------------------------------------
+    inline cl_int enqueueKernelStage(cl_command_queue queue, const KernelStage& stage, size_t num_hashes, cl_event* event = nullptr)
+    {
+        const size_t globalWorkSize = num_hashes * stage.globalScale;
+        return clEnqueueNDRangeKernel(queue, stage.kernel, 1, nullptr, &globalWorkSize, &stage.workGroupSize, 0, nullptr, event);
+    }
+    //-----------------------------------------------------------------------------
+    inline void releaseKernelStage(KernelStage& stage)
+    {
+        if (stage.kernel)
+            clReleaseKernel(stage.kernel);
+        if (stage.program)
+            clReleaseProgram(stage.program);
+        stage.kernel = NULL;
+        stage.program = NULL;
+    }
+    //-----------------------------------------------------------------------------
+}
+
+#endif // !KernelVariants_INCLUDE_ONCE
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef StageProfiler_INCLUDE_ONCE
+#define StageProfiler_INCLUDE_ONCE
+
+#include <vector>
+#include <string>
+
+#include <lyclCore/CLUtils.hpp>
+#include <lyclApplets/KernelVariants.hpp>
+
+namespace lycl
+{
+    //-----------------------------------------------------------------------------
+    //! Accumulated GPU time of a pipeline stage.
+    struct StageProfile
+    {
+        std::string name;
+        std::string variantName;
+        uint64_t timeNs;
+        //! number of kernel launches. Some stages run more than once per batch.
+        uint64_t numCalls;
+    };
+    //-----------------------------------------------------------------------------
+    // StageProfiler class.
+    // Collects kernel execution time from events. Requires a command queue created
+    // with CL_QUEUE_PROFILING_ENABLE. Not thread safe, owned by a single applet.
+    //-----------------------------------------------------------------------------
+    class StageProfiler
+    {
+    public:
+        inline StageProfiler() : m_enabled(false), m_numHashes(0) { }
+
+        inline void setEnabled(bool enabled) { m_enabled = enabled; }
+        inline bool isEnabled() const { return m_enabled; }
+
+        //! returns an event for the next clEnqueueNDRangeKernel(), or nullptr if profiling is disabled.
+        inline cl_event* record(const KernelStage& stage)
+        {
+            if (!m_enabled)
+                return nullptr;
+
+            size_t profileIndex = 0;
+            for (; profileIndex < m_profiles.size(); ++profileIndex)
+            {
+                if (m_profiles[profileIndex].name == stage.stageName)
+                    break;
+            }
+            if (profileIndex == m_profiles.size())
+            {
+                StageProfile profile = { stage.stageName, stage.variantName, 0, 0 };
+                m_profiles.push_back(profile);
+            }
+
+            PendingEvent pendingEvent = { profileIndex, NULL };
+            m_pending.push_back(pendingEvent);
+            return &m_pending.back().event;
+        }
+        //! must be called after the batch(num_hashes) is finished.
+        inline void collect(size_t num_hashes)
+        {
+            if (!m_enabled)
+                return;
+
+            for (size_t i = 0; i < m_pending.size(); ++i)
+            {
+                cl_event event = m_pending[i].event;
+                if (!event)
+                    continue;
+
+                cl_ulong start = 0;
+                cl_ulong end = 0;
+                if ((clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, nullptr) == CL_SUCCESS) &&
+                    (clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, nullptr) == CL_SUCCESS) &&
+                    (end > start))
+                {
+                    StageProfile& profile = m_profiles[m_pending[i].profileIndex];
+                    profile.timeNs += end - start;
+                    ++profile.numCalls;
+                }
+                clReleaseEvent(event);
+            }
+            m_pending.clear();
+            m_numHashes += num_hashes;
+        }
+        //! returns accumulated profiles in pipeline order and resets them.
+        inline void takeProfiles(std::vector<StageProfile>& out_profiles, uint64_t& out_num_hashes)
+        {
+            out_profiles = m_profiles;
+            out_num_hashes = m_numHashes;
+
+            for (size_t i = 0; i < m_profiles.size(); ++i)
+            {
+                m_profiles[i].timeNs = 0;
+                m_profiles[i].numCalls = 0;
+            }
+            m_numHashes = 0;
+        }
+
+    private:
+        struct PendingEvent
+        {
+            size_t profileIndex;
+            cl_event event;
+        };
+
+        bool m_enabled;
+        uint64_t m_numHashes;
+        std::vector<StageProfile> m_profiles;
+        std::vector<PendingEvent> m_pending;
+    };
+    //-----------------------------------------------------------------------------
+    //! Formats "stage ns/H, ..., total ns/H". ns/H is a stage time per hash of the whole chain.
+    inline std::string formatStageProfiles(const std::vector<StageProfile>& profiles, uint64_t num_hashes)
+    {
+        std::string result;
+        if (!num_hashes)
+            return result;
+
+        char buffer[64];
+        uint64_t totalNs = 0;
+        for (size_t i = 0; i < profiles.size(); ++i)
+        {
+            snprintf(buffer, sizeof(buffer), "%s %.3f, ", profiles[i].name.c_str(), (double)profiles[i].timeNs / (double)num_hashes);
+            result += buffer;
+            totalNs += profiles[i].timeNs;
+        }
+        snprintf(buffer, sizeof(buffer), "total %.3f ns/H", (double)totalNs / (double)num_hashes);
+        result += buffer;
+
+        return result;
+    }
+    //-----------------------------------------------------------------------------
+}
+
+#endif // !StageProfiler_INCLUDE_ONCE
@@ -0,0 +1,398 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef Validation_INCLUDE_ONCE
+#define Validation_INCLUDE_ONCE
+
+//-----------------------------------------------------------------------------
+// Known-answer tests for kernel variants.
+// The reference pipeline uses OpenCL source variants only. Its first(blake32) and
+// last(bmwHtarg) stages are checked against host implementations, and its buffers
+// after each launch are compared with the host Lyra2REv2/v3 chain. Every other
+// variant from the kernel manifest is swapped into the reference pipeline one
+// stage at a time and its buffers are compared bit-for-bit after each launch.
+//-----------------------------------------------------------------------------
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+
+#include <lyclCore/Blake256.hpp>
+#include <lyclHostValidators/Lyra2RE.hpp>
+#include <lyclApplets/KernelVariants.hpp>
+
+namespace lycl
+{
+    //-----------------------------------------------------------------------------
+    //! Keeps reference buffers of all launch prefixes in memory.
+    const size_t c_validationMaxWorkSize = 65536;
+    //! Roughly 1/256 hashes become candidates. Must not overflow the hTarg result buffer.
+    const uint32_t c_validationHtArg = 0x00FFFFFF;
+    //-----------------------------------------------------------------------------
+    //! Result of a host check.
+    struct HostCheckResult
+    {
+        size_t numChecked;
+        size_t numMismatches;
+    };
+    //-----------------------------------------------------------------------------
+    //! Result of the reference pipeline compared against the host chain after each launch.
+    struct HostChainResult
+    {
+        size_t numChecked;
+        //! index into the pipeline of the first launch with an output different from the host. -1 if all launches match.
+        int firstDivergentLaunch;
+        std::string firstDivergentStage;
+        //! hash index of the first difference
+        size_t firstDivergentIndex;
+    };
+    //-----------------------------------------------------------------------------
+    //! Result of a kernel variant compared against the reference pipeline.
+    struct VariantCheckResult
+    {
+        std::string stage;
+        std::string variant;
+        //! "match", "mismatch" or "unavailable"
+        std::string status;
+        //! index into the pipeline of the first launch with a different output. -1 if all launches match.
+        int firstDivergentLaunch;
+        std::string firstDivergentStage;
+        //! hash index of the first difference
+        size_t firstDivergentIndex;
+    };
+    //-----------------------------------------------------------------------------
+    struct ValidationReport
+    {
+        size_t workSize;
+        std::vector<std::string> referenceVariants;
+        HostCheckResult blake32;
+        HostCheckResult bmwHtarg;
+        HostChainResult hostChain;
+        std::vector<VariantCheckResult> variants;
+
+        bool passed() const
+        {
+            if (blake32.numMismatches || bmwHtarg.numMismatches || hostChain.firstDivergentLaunch >= 0)
+                return false;
+            for (size_t i = 0; i < variants.size(); ++i)
+            {
+                if (variants[i].status == "mismatch")
+                    return false;
+            }
+            return true;
+        }
+    };
+    //-----------------------------------------------------------------------------
+    //! Buffers after the first N launches of the pipeline.
+    struct PipelineSnapshot
+    {
+        std::vector<uint32x8> hashes;
+        std::vector<uint32x8> lyraStates;
+        //! lyra states are garbage until the first lyra441p1 launch.
+        bool lyraStatesValid;
+        //! sorted candidate indices. Only filled after the full pipeline.
+        std::vector<uint32_t> candidates;
+    };
+    //-----------------------------------------------------------------------------
+    //! Runs the first (num_launches) kernels and reads back all buffers.
+    template <typename TApplet>
+    void takePipelineSnapshot(TApplet& app, uint32_t first_nonce, size_t work_size, size_t num_launches,
+                              PipelineSnapshot& out_snapshot)
+    {
+        const std::vector<KernelStage*>& pipeline = app.getPipeline();
+
+        app.onRunPartial(first_nonce, work_size, num_launches);
+        app.getHashes(out_snapshot.hashes);
+        app.getLyraStates(out_snapshot.lyraStates);
+        out_snapshot.hashes.resize(work_size);
+        out_snapshot.lyraStates.resize(work_size * 4);
+
+        out_snapshot.lyraStatesValid = false;
+        for (size_t i = 0; i < num_launches; ++i)
+        {
+            if (pipeline[i]->stageName == "lyra441p1")
+                out_snapshot.lyraStatesValid = true;
+        }
+
+        out_snapshot.candidates.clear();
+        if (num_launches == pipeline.size())
+        {
+            uint32_t firstCandidate = 0;
+            uint32_t numCandidates = 0;
+            app.getHtArgTestResultAndSize(firstCandidate, numCandidates);
+            numCandidates = std::min(numCandidates, (uint32_t)work_size);
+            if (numCandidates)
+            {
+                app.getHtArgTestResults(out_snapshot.candidates, numCandidates, 1);
+                out_snapshot.candidates.resize(numCandidates);
+                std::sort(out_snapshot.candidates.begin(), out_snapshot.candidates.end());
+            }
+            app.clearResult(numCandidates ? numCandidates : 1);
+        }
+    }
+    //-----------------------------------------------------------------------------
+    //! returns index of the first different element or (size_t)-1.
+    inline size_t findFirstDifference(const std::vector<uint32x8>& a, const std::vector<uint32x8>& b, size_t elems_per_hash)
+    {
+        for (size_t i = 0; i < a.size() && i < b.size(); ++i)
+        {
+            if (memcmp(&a[i], &b[i], sizeof(uint32x8)))
+                return i / elems_per_hash;
+        }
+        return (size_t)-1;
+    }
+    //-----------------------------------------------------------------------------
+    //! Runs the host chain along the reference snapshots and finds the first launch which diverges from it.
+    //! Later launches are not compared, their input already differs.
+    inline void checkHostChain(const char* algorithm, const std::vector<std::string>& stages, const KernelData& kernel_data,
+                               uint32_t first_nonce, size_t work_size, const std::vector<PipelineSnapshot>& reference,
+                               HostChainResult& out_result)
+    {
+        const uint32_t midstate[8] =
+        {
+            kernel_data.uH0, kernel_data.uH1, kernel_data.uH2, kernel_data.uH3,
+            kernel_data.uH4, kernel_data.uH5, kernel_data.uH6, kernel_data.uH7
+        };
+
+        out_result.numChecked = work_size;
+        out_result.firstDivergentLaunch = -1;
+        out_result.firstDivergentIndex = 0;
+
+        std::vector<uint32x8> hashes(work_size);
+        std::vector<LyraState> lyraStates(work_size);
+        for (size_t l = 0; l < stages.size() && l < reference.size(); ++l)
+        {
+            const std::string& stage = stages[l];
+            const PipelineSnapshot& snapshot = reference[l];
+            size_t firstDifference = (size_t)-1;
+
+            if (stage == "bmwHtarg")
+            {
+                // only the candidates are an output of the last launch.
+                std::vector<uint32_t> expectedCandidates;
+                for (size_t i = 0; i < work_size; ++i)
+                {
+                    uint32x8 bmwHashOutput;
+                    bmwHash(hashes[i], bmwHashOutput);
+                    if (htArgTest(bmwHashOutput, kernel_data.htArg, kernel_data.htArgLow))
+                        expectedCandidates.push_back((uint32_t)i);
+                }
+                std::vector<uint32_t> difference;
+                std::set_symmetric_difference(expectedCandidates.begin(), expectedCandidates.end(),
+                                              snapshot.candidates.begin(), snapshot.candidates.end(), std::back_inserter(difference));
+                if (difference.size())
+                    firstDifference = difference[0];
+            }
+            else
+            {
+                for (size_t i = 0; i < work_size; ++i)
+                {
+                    if (stage == "blake32")
+                        blake256_final80(midstate, kernel_data.in16, kernel_data.in17, kernel_data.in18, first_nonce + (uint32_t)i, hashes[i].h);
+                    else if (!runHostStage(algorithm, stage, hashes[i], lyraStates[i]))
+                    {
+                        // no host version, nothing to compare against.
+                        out_result.firstDivergentLaunch = (int)l;
+                        out_result.firstDivergentStage = stage;
+                        return;
+                    }
+
+                    if (memcmp(&hashes[i], &snapshot.hashes[i], sizeof(uint32x8)) ||
+                        (snapshot.lyraStatesValid && memcmp(&lyraStates[i], &snapshot.lyraStates[i * 4], sizeof(LyraState))))
+                    {
+                        firstDifference = i;
+                        break;
+                    }
+                }
+            }
+
+            if (firstDifference != (size_t)-1)
+            {
+                out_result.firstDivergentLaunch = (int)l;
+                out_result.firstDivergentStage = stage;
+                out_result.firstDivergentIndex = firstDifference;
+                return;
+            }
+        }
+    }
+    //-----------------------------------------------------------------------------
+    //! Runs known-answer tests. (in_device) selects the ISA and binary format of tested asm variants.
+    template <typename TApplet>
+    bool validateKernelVariants(const device& in_device, const char* algorithm, const KernelData& kernel_data,
+                                size_t work_size, ValidationReport& out_report)
+    {
+        // reference: OpenCL source only.
+        device referenceDevice = in_device;
+        referenceDevice.asmProgram = AP_None;
+        referenceDevice.binaryFormat = BF_None;
+        referenceDevice.kernelRace = false;
+        referenceDevice.kernelVariants[0] = '\0';
+        referenceDevice.profiling = false;
+        referenceDevice.workSize = std::min(work_size, c_validationMaxWorkSize);
+
+        KernelData kernelData = kernel_data;
+        kernelData.htArg = c_validationHtArg;
+        kernelData.htArgLow = 0xFFFFFFFF;
+        const uint32_t firstNonce = 0;
+
+        std::vector<PipelineSnapshot> reference;
+        {
+            TApplet app;
+            if (!app.onInit(referenceDevice))
+            {
+                app.onDestroy();
+                return false;
+            }
+            work_size = app.getMaxWorkSize();
+            app.setKernelData(kernelData);
+
+            const std::vector<KernelStage*>& pipeline = app.getPipeline();
+            for (size_t i = 0; i < pipeline.size(); ++i)
+                out_report.referenceVariants.push_back(pipeline[i]->stageName + ":" + pipeline[i]->variantName);
+
+            reference.resize(pipeline.size());
+            for (size_t i = 0; i < pipeline.size(); ++i)
+                takePipelineSnapshot(app, firstNonce, work_size, i + 1, reference[i]);
+
+            app.onDestroy();
+        }
+        out_report.workSize = work_size;
+
+        //-------------------------------------
+        // host blake32(first launch)
+        const uint32_t midstate[8] =
+        {
+            kernelData.uH0, kernelData.uH1, kernelData.uH2, kernelData.uH3,
+            kernelData.uH4, kernelData.uH5, kernelData.uH6, kernelData.uH7
+        };
+        out_report.blake32.numChecked = work_size;
+        out_report.blake32.numMismatches = 0;
+        for (size_t i = 0; i < work_size; ++i)
+        {
+            uint32x8 expected;
+            blake256_final80(midstate, kernelData.in16, kernelData.in17, kernelData.in18, firstNonce + (uint32_t)i, expected.h);
+            if (memcmp(&expected, &reference[0].hashes[i], sizeof(uint32x8)))
+                ++out_report.blake32.numMismatches;
+        }
+
+        //-------------------------------------
+        // host bmw(last launch). Input is the hash buffer before the last launch.
+        const std::vector<uint32x8>& bmwInput = reference[reference.size() - 2].hashes;
+        std::vector<uint32_t> expectedCandidates;
+        for (size_t i = 0; i < work_size; ++i)
+        {
+            uint32x8 bmwHashOutput;
+            bmwHash(bmwInput[i], bmwHashOutput);
+            if (htArgTest(bmwHashOutput, kernelData.htArg, kernelData.htArgLow))
+                expectedCandidates.push_back((uint32_t)i);
+        }
+        const std::vector<uint32_t>& foundCandidates = reference.back().candidates;
+        std::vector<uint32_t> difference;
+        std::set_symmetric_difference(expectedCandidates.begin(), expectedCandidates.end(),
+                                      foundCandidates.begin(), foundCandidates.end(), std::back_inserter(difference));
+        out_report.bmwHtarg.numChecked = work_size;
+        out_report.bmwHtarg.numMismatches = difference.size();
+
+        //-------------------------------------
+        // host chain(every launch)
+        std::vector<std::string> launchStages;
+        for (size_t i = 0; i < out_report.referenceVariants.size(); ++i)
+            launchStages.push_back(out_report.referenceVariants[i].substr(0, out_report.referenceVariants[i].find(':')));
+        checkHostChain(algorithm, launchStages, kernelData, firstNonce, work_size, reference, out_report.hostChain);
+
+        //-------------------------------------
+        // kernel variants against the reference pipeline
+        std::vector<std::string> stageNames;
+        for (size_t i = 0; i < launchStages.size(); ++i)
+        {
+            if (std::find(stageNames.begin(), stageNames.end(), launchStages[i]) == stageNames.end())
+                stageNames.push_back(launchStages[i]);
+        }
+
+        for (size_t s = 0; s < stageNames.size(); ++s)
+        {
+            std::vector<KernelVariant> variants;
+            getKernelManifest().getStageVariants(algorithm, stageNames[s], in_device, false, variants);
+
+            for (size_t v = 1; v < variants.size(); ++v)
+            {
+                VariantCheckResult result;
+                result.stage = stageNames[s];
+                result.variant = variants[v].name;
+                result.status = "match";
+                result.firstDivergentLaunch = -1;
+                result.firstDivergentIndex = 0;
+
+                device variantDevice = referenceDevice;
+                variantDevice.asmProgram = in_device.asmProgram;
+                variantDevice.binaryFormat = in_device.binaryFormat;
+                variantDevice.workSize = work_size;
+                const std::string variantOverride = stageNames[s] + ":" + variants[v].name;
+                strncpy(variantDevice.kernelVariants, variantOverride.c_str(), sizeof(variantDevice.kernelVariants) - 1);
+
+                TApplet app;
+                if (!app.onInit(variantDevice) || app.getMaxWorkSize() != work_size)
+                {
+                    result.status = "unavailable";
+                    app.onDestroy();
+                    out_report.variants.push_back(result);
+                    continue;
+                }
+                app.setKernelData(kernelData);
+
+                const std::vector<KernelStage*>& pipeline = app.getPipeline();
+                bool selected = false;
+                for (size_t i = 0; i < pipeline.size(); ++i)
+                {
+                    if (pipeline[i]->stageName == stageNames[s] && pipeline[i]->variantName == variants[v].name)
+                        selected = true;
+                }
+                if (!selected)
+                {
+                    // build failed, fallback to OpenCL source.
+                    result.status = "unavailable";
+                    app.onDestroy();
+                    out_report.variants.push_back(result);
+                    continue;
+                }
+
+                PipelineSnapshot snapshot;
+                for (size_t i = 0; i < pipeline.size(); ++i)
+                {
+                    takePipelineSnapshot(app, firstNonce, work_size, i + 1, snapshot);
+
+                    size_t firstDifference = findFirstDifference(snapshot.hashes, reference[i].hashes, 1);
+                    if (firstDifference == (size_t)-1 && reference[i].lyraStatesValid)
+                        firstDifference = findFirstDifference(snapshot.lyraStates, reference[i].lyraStates, 4);
+                    if (firstDifference == (size_t)-1 && snapshot.candidates != reference[i].candidates)
+                        firstDifference = 0;
+
+                    if (firstDifference != (size_t)-1)
+                    {
+                        result.status = "mismatch";
+                        result.firstDivergentLaunch = (int)i;
+                        result.firstDivergentStage = pipeline[i]->stageName;
+                        result.firstDivergentIndex = firstDifference;
+                        break;
+                    }
+                }
+
+                app.onDestroy();
+                out_report.variants.push_back(result);
+            }
+        }
+
+        return true;
+    }
+    //-----------------------------------------------------------------------------
+}
+
+#endif // !Validation_INCLUDE_ONCE
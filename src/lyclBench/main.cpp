@@ -0,0 +1,539 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+//-----------------------------------------------------------------------------
+// lyclBench. Measures kernel throughput without a pool connection.
+// Runs the whole pipeline on a fixed synthetic header and prints results in JSON.
+//-----------------------------------------------------------------------------
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#include <lyclCore/Blake256.hpp>
+
+// Applets
+#include <lyclApplets/AppLyra2REv2.hpp>
+#include <lyclApplets/AppLyra2REv3.hpp>
+#include <lyclApplets/BatchWaiter.hpp>
+#include <lyclApplets/BatchSizeController.hpp>
+
+#include <lyclBench/Validation.hpp>
+
+// Set by premake5.lua(git revision). Used to compare results across commits.
+#ifndef LYCL_REVISION
+#define LYCL_REVISION unknown
+#endif
+#define LYCL_STRINGIFY_IMPL(x) #x
+#define LYCL_STRINGIFY(x) LYCL_STRINGIFY_IMPL(x)
+
+//! untimed batches for TargetBatchLatency to converge. Batch size changes at most 2x per batch.
+const size_t c_adaptiveWarmupBatches = 16;
+//-----------------------------------------------------------------------------
+struct BenchOptions
+{
+    std::string algorithm;
+    size_t platformIndex;
+    size_t deviceIndex;
+    size_t workSize;
+    size_t numBatches;
+    uint32_t targetBatchLatency;
+    std::string asmProgram;
+    std::string binaryFormat;
+    std::string waitMode;
+    std::string localWorkSizes;
+    std::string buildOptions;
+    bool kernelRace;
+    bool listDevices;
+    bool validate;
+};
+//-----------------------------------------------------------------------------
+struct BenchResult
+{
+    size_t workSize;
+    //! hashes per batch of the latest batch. Lower than (workSize) with TargetBatchLatency.
+    size_t batchSize;
+    uint64_t numHashes;
+    std::vector<double> batchTimesMs;
+    std::vector<lycl::StageProfile> stages;
+    uint64_t profiledHashes;
+    //! host CPU time of all timed batches.
+    uint64_t hostCpuNs;
+};
+//-----------------------------------------------------------------------------
+std::string getDeviceInfoString(cl_device_id device_id, cl_device_info param)
+{
+    size_t infoSize = 0;
+    clGetDeviceInfo(device_id, param, 0, nullptr, &infoSize);
+    std::string result(infoSize, '\0');
+    clGetDeviceInfo(device_id, param, infoSize, (void*)result.data(), nullptr);
+    if (result.size())
+        result.pop_back();
+
+    return result;
+}
+//-----------------------------------------------------------------------------
+std::string getPlatformInfoString(cl_platform_id platform_id, cl_platform_info param)
+{
+    size_t infoSize = 0;
+    clGetPlatformInfo(platform_id, param, 0, nullptr, &infoSize);
+    std::string result(infoSize, '\0');
+    clGetPlatformInfo(platform_id, param, infoSize, (void*)result.data(), nullptr);
+    if (result.size())
+        result.pop_back();
+
+    return result;
+}
+//-----------------------------------------------------------------------------
+//! Escapes a string for JSON output.
+std::string jsonString(const std::string& str)
+{
+    std::string result("\"");
+    for (size_t i = 0; i < str.size(); ++i)
+    {
+        const char c = str[i];
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+            result += c;
+        }
+        else if ((unsigned char)c < 0x20)
+            result += ' ';
+        else
+            result += c;
+    }
+    result += '"';
+
+    return result;
+}
+//-----------------------------------------------------------------------------
+//! Fixed header and midstate. Same input on every run, so results are comparable.
+void getSyntheticKernelData(lycl::KernelData& out_kernel_data)
+{
+    uint32_t header[20];
+    for (uint32_t i = 0; i < 20; ++i)
+        header[i] = 0x9E3779B9u * (i + 1);
+
+    uint32_t h[8] =
+    {
+        0x6A09E667, 0xBB67AE85,
+        0x3C6EF372, 0xA54FF53A,
+        0x510E527F, 0x9B05688C,
+        0x1F83D9AB, 0x5BE0CD19
+    };
+    blake256_compress(h, header);
+
+    memset(&out_kernel_data, 0, sizeof(out_kernel_data));
+    out_kernel_data.uH0 = h[0];
+    out_kernel_data.uH1 = h[1];
+    out_kernel_data.uH2 = h[2];
+    out_kernel_data.uH3 = h[3];
+    out_kernel_data.uH4 = h[4];
+    out_kernel_data.uH5 = h[5];
+    out_kernel_data.uH6 = h[6];
+    out_kernel_data.uH7 = h[7];
+    out_kernel_data.in16 = header[16];
+    out_kernel_data.in17 = header[17];
+    out_kernel_data.in18 = header[18];
+    // no candidates, only hashing is measured.
+    out_kernel_data.htArg = 0;
+    out_kernel_data.htArgLow = 0;
+}
+//-----------------------------------------------------------------------------
+template <typename TApplet>
+bool runBench(const lycl::device& in_device, size_t num_batches, BenchResult& out_result)
+{
+    TApplet app;
+    if (!app.onInit(in_device))
+    {
+        app.onDestroy();
+        return false;
+    }
+
+    const size_t workSize = app.getMaxWorkSize();
+    out_result.workSize = workSize;
+
+    lycl::KernelData kernelData;
+    getSyntheticKernelData(kernelData);
+    app.setKernelData(kernelData);
+
+    // warm-up. Not included in results.
+    app.onRun(0, workSize);
+    app.getProfiler().takeProfiles(out_result.stages, out_result.profiledHashes);
+
+    // WaitMode = "sleep". The warm-up batch gives the first prediction.
+    lycl::BatchWaiter batchWaiter;
+    uint32_t firstCandidate = 0;
+    uint32_t numCandidates = 0;
+    if (in_device.waitMode == lycl::WM_Sleep)
+        batchWaiter.runBatch(app, 0, workSize, firstCandidate, numCandidates);
+
+    // TargetBatchLatency. Batch size converges during untimed batches.
+    lycl::BatchSizeController batchSizeController;
+    batchSizeController.setup(in_device.targetBatchLatency, workSize);
+    uint32_t nonce = (uint32_t)workSize;
+    for (size_t i = 0; batchSizeController.isEnabled() && (i < c_adaptiveWarmupBatches); ++i)
+    {
+        const size_t batchSize = batchSizeController.getBatchSize();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        app.onRun(nonce, batchSize);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        batchSizeController.update(batchSize, std::chrono::duration<double, std::milli>(end - start).count());
+        nonce += (uint32_t)batchSize;
+    }
+    app.getProfiler().takeProfiles(out_result.stages, out_result.profiledHashes);
+
+    out_result.batchTimesMs.clear();
+    out_result.numHashes = 0;
+    const uint64_t cpuStart = lycl::getThreadCpuTimeNs();
+    for (size_t i = 0; i < num_batches; ++i)
+    {
+        const size_t batchSize = batchSizeController.getBatchSize();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (in_device.waitMode == lycl::WM_Sleep)
+            batchWaiter.runBatch(app, nonce, batchSize, firstCandidate, numCandidates);
+        else
+            app.onRun(nonce, batchSize);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        const double batchMs = std::chrono::duration<double, std::milli>(end - start).count();
+        batchSizeController.update(batchSize, batchMs);
+        out_result.batchTimesMs.push_back(batchMs);
+        out_result.numHashes += batchSize;
+        out_result.batchSize = batchSize;
+        nonce += (uint32_t)batchSize;
+    }
+    out_result.hostCpuNs = lycl::getThreadCpuTimeNs() - cpuStart;
+
+    app.getProfiler().takeProfiles(out_result.stages, out_result.profiledHashes);
+    app.onDestroy();
+
+    return true;
+}
+//-----------------------------------------------------------------------------
+std::string formatValidationReport(const BenchOptions& options, const lycl::device& in_device, const lycl::ValidationReport& report)
+{
+    char buffer[256];
+    std::string json("{\n");
+    json += "  \"revision\": " + jsonString(LYCL_STRINGIFY(LYCL_REVISION)) + ",\n";
+    json += "  \"algorithm\": " + jsonString(options.algorithm) + ",\n";
+    json += "  \"device\": " + jsonString(getDeviceInfoString(in_device.clId, CL_DEVICE_NAME)) + ",\n";
+    json += "  \"driver\": " + jsonString(getDeviceInfoString(in_device.clId, CL_DRIVER_VERSION)) + ",\n";
+    snprintf(buffer, sizeof(buffer),
+             "  \"workSize\": %zu,\n"
+             "  \"passed\": %s,\n"
+             "  \"blake32\": { \"checked\": %zu, \"mismatches\": %zu },\n"
+             "  \"bmwHtarg\": { \"checked\": %zu, \"mismatches\": %zu },\n",
+             report.workSize, report.passed() ? "true" : "false",
+             report.blake32.numChecked, report.blake32.numMismatches,
+             report.bmwHtarg.numChecked, report.bmwHtarg.numMismatches);
+    json += buffer;
+
+    snprintf(buffer, sizeof(buffer), "  \"hostChain\": { \"checked\": %zu, \"firstDivergentLaunch\": %d",
+             report.hostChain.numChecked, report.hostChain.firstDivergentLaunch);
+    json += buffer;
+    if (report.hostChain.firstDivergentLaunch >= 0)
+    {
+        snprintf(buffer, sizeof(buffer), ", \"firstDivergentIndex\": %zu", report.hostChain.firstDivergentIndex);
+        json += buffer;
+        json += ", \"firstDivergentStage\": " + jsonString(report.hostChain.firstDivergentStage);
+    }
+    json += " },\n";
+
+    json += "  \"reference\": [";
+    for (size_t i = 0; i < report.referenceVariants.size(); ++i)
+        json += (i ? ", " : "") + jsonString(report.referenceVariants[i]);
+    json += "],\n";
+
+    json += "  \"variants\": [";
+    for (size_t i = 0; i < report.variants.size(); ++i)
+    {
+        const lycl::VariantCheckResult& variant = report.variants[i];
+        json += (i ? ",\n    " : "\n    ");
+        json += "{ \"stage\": " + jsonString(variant.stage) + ", \"variant\": " + jsonString(variant.variant) +
+                ", \"status\": " + jsonString(variant.status);
+        if (variant.firstDivergentLaunch >= 0)
+        {
+            snprintf(buffer, sizeof(buffer), ", \"firstDivergentLaunch\": %d, \"firstDivergentIndex\": %zu",
+                     variant.firstDivergentLaunch, variant.firstDivergentIndex);
+            json += buffer;
+            json += ", \"firstDivergentStage\": " + jsonString(variant.firstDivergentStage);
+        }
+        json += " }";
+    }
+    json += "\n  ]\n}\n";
+
+    return json;
+}
+//-----------------------------------------------------------------------------
+void printUsage()
+{
+    std::cerr << "Usage: lyclBench [options]\n"
+                 "  -l              list all OpenCL devices(including CPU runtimes)\n"
+                 "  -a <algorithm>  Lyra2REv2 or Lyra2REv3. Default: Lyra2REv3\n"
+                 "  -p <index>      platform index. Default: 0\n"
+                 "  -d <index>      device index inside a platform. Default: 0\n"
+                 "  -w <size>       WorkSize, multiple of 256. Default: 1048576\n"
+                 "  -n <batches>    number of timed batches. Default: 32\n"
+                 "  -latency <ms>   TargetBatchLatency. Default: 0(every batch uses WorkSize)\n"
+                 "  -asm <isa>      AsmProgram, e.g. gfx9. Default: none(OpenCL only)\n"
+                 "  -bf <format>    BinaryFormat: amdcl2 or ROCm. Default: none\n"
+                 "  -race           race all kernel variants(see KernelRace)\n"
+                 "  -wait <mode>    WaitMode: finish or sleep. Default: finish\n"
+                 "  -lws <list>     LocalWorkSize of OpenCL kernels, e.g. \"lyra441p2:128\"\n"
+                 "  -build <opts>   BuildOptions of OpenCL kernels, e.g. \"lyra441p1:-DLYRA_UNROLL=4\"\n"
+                 "  -validate       run known-answer tests instead of a benchmark. Exit code 2 on mismatch\n"
+              << std::endl;
+}
+//-----------------------------------------------------------------------------
+bool parseOptions(int argc, char** argv, BenchOptions& out_options)
+{
+    out_options.algorithm = "Lyra2REv3";
+    out_options.platformIndex = 0;
+    out_options.deviceIndex = 0;
+    out_options.workSize = 1048576;
+    out_options.numBatches = 32;
+    out_options.targetBatchLatency = 0;
+    out_options.waitMode = "finish";
+    out_options.kernelRace = false;
+    out_options.listDevices = false;
+    out_options.validate = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        const bool hasValue = (i + 1) < argc;
+        if (arg == "-l")
+            out_options.listDevices = true;
+        else if (arg == "-race")
+            out_options.kernelRace = true;
+        else if (arg == "-validate")
+            out_options.validate = true;
+        else if (arg == "-a" && hasValue)
+            out_options.algorithm = argv[++i];
+        else if (arg == "-p" && hasValue)
+            out_options.platformIndex = (size_t)strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-d" && hasValue)
+            out_options.deviceIndex = (size_t)strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-w" && hasValue)
+            out_options.workSize = (size_t)strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-n" && hasValue)
+            out_options.numBatches = (size_t)strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-latency" && hasValue)
+            out_options.targetBatchLatency = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-asm" && hasValue)
+            out_options.asmProgram = argv[++i];
+        else if (arg == "-bf" && hasValue)
+            out_options.binaryFormat = argv[++i];
+        else if (arg == "-wait" && hasValue)
+            out_options.waitMode = argv[++i];
+        else if (arg == "-lws" && hasValue)
+            out_options.localWorkSizes = argv[++i];
+        else if (arg == "-build" && hasValue)
+            out_options.buildOptions = argv[++i];
+        else
+            return false;
+    }
+
+    if (!out_options.workSize || (out_options.workSize % 256) || !out_options.numBatches)
+        return false;
+
+    return true;
+}
+//-----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    const lycl::EAlgorithm algorithm = lycl::getAlgorithmFromName(options.algorithm);
+    if (algorithm == lycl::A_None)
+    {
+        std::cerr << "Unknown algorithm: " << options.algorithm << std::endl;
+        return 1;
+    }
+
+    //-------------------------------------
+    // all platforms and devices. Vendor is not checked.
+    cl_uint numPlatformIds = 0;
+    if (clGetPlatformIDs(0, nullptr, &numPlatformIds) != CL_SUCCESS || !numPlatformIds)
+    {
+        std::cerr << "Failed to find any OpenCL platforms." << std::endl;
+        return 1;
+    }
+    std::vector<cl_platform_id> platformIds(numPlatformIds);
+    clGetPlatformIDs(numPlatformIds, platformIds.data(), nullptr);
+
+    std::vector<std::vector<cl_device_id> > deviceIds(numPlatformIds);
+    for (size_t i = 0; i < platformIds.size(); ++i)
+    {
+        cl_uint numDeviceIds = 0;
+        if (clGetDeviceIDs(platformIds[i], CL_DEVICE_TYPE_ALL, 0, nullptr, &numDeviceIds) != CL_SUCCESS)
+            continue;
+        deviceIds[i].resize(numDeviceIds);
+        clGetDeviceIDs(platformIds[i], CL_DEVICE_TYPE_ALL, numDeviceIds, deviceIds[i].data(), nullptr);
+
+        if (options.listDevices)
+        {
+            std::cout << "Platform " << i << ": " << getPlatformInfoString(platformIds[i], CL_PLATFORM_NAME) << std::endl;
+            for (size_t j = 0; j < deviceIds[i].size(); ++j)
+                std::cout << "    Device " << j << ": " << getDeviceInfoString(deviceIds[i][j], CL_DEVICE_NAME) << std::endl;
+        }
+    }
+
+    if (options.listDevices)
+        return 0;
+
+    if (options.platformIndex >= platformIds.size() || options.deviceIndex >= deviceIds[options.platformIndex].size())
+    {
+        std::cerr << "Invalid platform/device index. Use -l to list all devices." << std::endl;
+        return 1;
+    }
+
+    //-------------------------------------
+    // setup a device
+    bool success;
+    lycl::device clDevice;
+    memset(&clDevice, 0, sizeof(clDevice));
+    clDevice.clPlatformId = platformIds[options.platformIndex];
+    clDevice.clId = deviceIds[options.platformIndex][options.deviceIndex];
+    clDevice.pcieBusId = -1;
+    clDevice.platformIndex = (int32_t)options.platformIndex;
+    clDevice.workSize = options.workSize;
+    clDevice.asmProgram = options.asmProgram.size() ? lycl::getAsmProgramName(options.asmProgram) : lycl::AP_None;
+    clDevice.binaryFormat = options.binaryFormat.size() ? lycl::getBinaryFormatFromName(options.binaryFormat) : lycl::BF_None;
+    clDevice.kernelRace = options.kernelRace;
+    clDevice.profiling = true;
+    clDevice.numStreams = 1;
+    clDevice.waitMode = lycl::getWaitModeFromName(options.waitMode);
+    clDevice.targetBatchLatency = options.targetBatchLatency;
+    strncpy(clDevice.localWorkSizes, options.localWorkSizes.c_str(), sizeof(clDevice.localWorkSizes) - 1);
+    strncpy(clDevice.buildOptions, options.buildOptions.c_str(), sizeof(clDevice.buildOptions) - 1);
+
+    // applet messages go to stderr. stdout is reserved for JSON.
+    std::streambuf* coutBuffer = std::cout.rdbuf(std::cerr.rdbuf());
+
+    if (options.validate)
+    {
+        lycl::KernelData kernelData;
+        getSyntheticKernelData(kernelData);
+
+        lycl::ValidationReport report;
+        if (algorithm == lycl::A_Lyra2REv3)
+            success = lycl::validateKernelVariants<lycl::AppLyra2REv3>(clDevice, "Lyra2REv3", kernelData, options.workSize, report);
+        else
+            success = lycl::validateKernelVariants<lycl::AppLyra2REv2>(clDevice, "Lyra2REv2", kernelData, options.workSize, report);
+
+        std::cout.rdbuf(coutBuffer);
+
+        if (!success)
+        {
+            std::cerr << "Failed to initialize a device." << std::endl;
+            return 1;
+        }
+
+        std::cout << formatValidationReport(options, clDevice, report);
+
+        return report.passed() ? 0 : 2;
+    }
+
+    BenchResult result;
+    if (algorithm == lycl::A_Lyra2REv3)
+        success = runBench<lycl::AppLyra2REv3>(clDevice, options.numBatches, result);
+    else
+        success = runBench<lycl::AppLyra2REv2>(clDevice, options.numBatches, result);
+
+    std::cout.rdbuf(coutBuffer);
+
+    if (!success)
+    {
+        std::cerr << "Failed to initialize a device." << std::endl;
+        return 1;
+    }
+
+    //-------------------------------------
+    // batch time statistics
+    double meanMs = 0.0;
+    double minMs = result.batchTimesMs[0];
+    double maxMs = result.batchTimesMs[0];
+    for (size_t i = 0; i < result.batchTimesMs.size(); ++i)
+    {
+        meanMs += result.batchTimesMs[i];
+        minMs = std::min(minMs, result.batchTimesMs[i]);
+        maxMs = std::max(maxMs, result.batchTimesMs[i]);
+    }
+    meanMs /= (double)result.batchTimesMs.size();
+
+    double varianceMs = 0.0;
+    for (size_t i = 0; i < result.batchTimesMs.size(); ++i)
+        varianceMs += (result.batchTimesMs[i] - meanMs) * (result.batchTimesMs[i] - meanMs);
+    varianceMs /= (double)result.batchTimesMs.size();
+
+    const double totalMs = meanMs * (double)result.batchTimesMs.size();
+    const double nsPerHash = (totalMs * 1000000.0) / (double)result.numHashes;
+    const double hashrate = (double)result.numHashes / (totalMs * 0.001);
+    // host CPU time relative to wall time of all timed batches.
+    const double hostCpuPercent = (100.0 * (double)result.hostCpuNs) / (totalMs * 1000000.0);
+    // a new job arrives at a random point of a batch.
+    const double expectedRestartMs = meanMs * 0.5;
+
+    //-------------------------------------
+    // JSON output
+    char buffer[512];
+    std::string json("{\n");
+    json += "  \"revision\": " + jsonString(LYCL_STRINGIFY(LYCL_REVISION)) + ",\n";
+    json += "  \"algorithm\": " + jsonString(options.algorithm) + ",\n";
+    json += "  \"platform\": " + jsonString(getPlatformInfoString(clDevice.clPlatformId, CL_PLATFORM_NAME)) + ",\n";
+    json += "  \"device\": " + jsonString(getDeviceInfoString(clDevice.clId, CL_DEVICE_NAME)) + ",\n";
+    json += "  \"driver\": " + jsonString(getDeviceInfoString(clDevice.clId, CL_DRIVER_VERSION)) + ",\n";
+    json += "  \"localWorkSize\": " + jsonString(clDevice.localWorkSizes) + ",\n";
+    json += "  \"buildOptions\": " + jsonString(clDevice.buildOptions) + ",\n";
+    snprintf(buffer, sizeof(buffer),
+             "  \"workSize\": %zu,\n"
+             "  \"batchSize\": %zu,\n"
+             "  \"targetBatchMs\": %u,\n"
+             "  \"batches\": %zu,\n"
+             "  \"waitMode\": \"%s\",\n"
+             "  \"hashrate\": %.1f,\n"
+             "  \"nsPerHash\": %.4f,\n"
+             "  \"hostCpuPercent\": %.2f,\n"
+             "  \"expectedRestartMs\": %.2f,\n"
+             "  \"batchMs\": { \"mean\": %.4f, \"min\": %.4f, \"max\": %.4f, \"variance\": %.6f, \"stdDev\": %.4f },\n",
+             result.workSize, result.batchSize, clDevice.targetBatchLatency, result.batchTimesMs.size(),
+             (clDevice.waitMode == lycl::WM_Sleep) ? "sleep" : "finish",
+             hashrate, nsPerHash, hostCpuPercent, expectedRestartMs,
+             meanMs, minMs, maxMs, varianceMs, std::sqrt(varianceMs));
+    json += buffer;
+
+    json += "  \"stages\": [";
+    for (size_t i = 0; i < result.stages.size(); ++i)
+    {
+        const lycl::StageProfile& stage = result.stages[i];
+        const double stageNsPerHash = result.profiledHashes ? (double)stage.timeNs / (double)result.profiledHashes : 0.0;
+        snprintf(buffer, sizeof(buffer), ", \"calls\": %llu, \"nsPerHash\": %.4f }",
+                 (unsigned long long)stage.numCalls, stageNsPerHash);
+        json += (i ? ",\n    " : "\n    ");
+        json += "{ \"name\": " + jsonString(stage.name) + ", \"variant\": " + jsonString(stage.variantName) + buffer;
+    }
+    json += "\n  ]\n}\n";
+
+    std::cout << json;
+
+    return 0;
+}
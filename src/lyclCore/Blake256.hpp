@@ -43,7 +43,7 @@ const uint32_t c_u256[16] =
     0x3F84D5B5, 0xB5470917
 };
 
-uint32_t rotr32(uint32_t w, uint32_t c)
+inline uint32_t rotr32(uint32_t w, uint32_t c)
 {
     return (( w >> c ) | ( w << ( 32 - c ) ) );
 }
@@ -107,5 +107,72 @@ inline void blake256_compress(uint32_t* h, const uint32_t* block)
     h[7] ^= v[7] ^ v[15];
 }
 
+//! Compresses a block with a given bit counter. h must contain the chaining value.
+inline void blake256_compress_counter(uint32_t* h, const uint32_t* block, uint32_t counter)
+{
+    uint32_t m[16];
+    uint32_t v[16];
+
+    for (int i = 0; i < 8; ++i)
+    {
+        v[i] = h[i];
+        v[i + 8] = c_u256[i];
+    }
+    v[12] ^= counter;
+    v[13] ^= counter;
+
+    for (int i = 0; i < 16; ++i)
+    {
+        m[i] = block[i];
+    }
+
+    for (int r = 0; r < 14; ++r)
+    {
+        // column step
+        GS(0, 4, 0x8, 0xC, 0x0);
+        GS(1, 5, 0x9, 0xD, 0x2);
+        GS(2, 6, 0xA, 0xE, 0x4);
+        GS(3, 7, 0xB, 0xF, 0x6);
+        // diagonal step
+        GS(0, 5, 0xA, 0xF, 0x8);
+        GS(1, 6, 0xB, 0xC, 0xA);
+        GS(2, 7, 0x8, 0xD, 0xC);
+        GS(3, 4, 0x9, 0xE, 0xE);
+    }
+
+    for (int i = 0; i < 8; ++i)
+    {
+        h[i] ^= v[i] ^ v[i + 8];
+    }
+}
+
+//! Host version of the blake32 kernel. Finishes an 80 byte header from a midstate(blake256_compress).
+//! Output words are byte swapped like in the kernel.
+inline void blake256_final80(const uint32_t* midstate, uint32_t in16, uint32_t in17, uint32_t in18,
+                             uint32_t nonce, uint32_t* out_hash)
+{
+    const uint32_t block[16] =
+    {
+        in16, in17, in18, nonce,
+        0x80000000, 0, 0, 0,
+        0, 0, 0, 0,
+        0, 1, 0, 640
+    };
+
+    uint32_t h[8];
+    for (int i = 0; i < 8; ++i)
+    {
+        h[i] = midstate[i];
+    }
+
+    blake256_compress_counter(h, block, 640);
+
+    for (int i = 0; i < 8; ++i)
+    {
+        const uint32_t w = h[i];
+        out_hash[i] = (w >> 24) | ((w >> 8) & 0xFF00) | ((w << 8) & 0xFF0000) | (w << 24);
+    }
+}
+
 
 #endif // !Blake256_INCLUDE_ONCE
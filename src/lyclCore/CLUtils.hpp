@@ -25,6 +25,14 @@ typedef union
 } cl_device_topology_amd;
 #define CL_DEVICE_TOPOLOGY_TYPE_PCIE_AMD            1
 
+#endif
+//-----------------------------------------------------------------------------
+// cl_amd_device_attribute_query, cl_nv_device_attribute_query
+#ifndef CL_DEVICE_WAVEFRONT_WIDTH_AMD
+#define CL_DEVICE_WAVEFRONT_WIDTH_AMD               0x4043
+#endif
+#ifndef CL_DEVICE_WARP_SIZE_NV
+#define CL_DEVICE_WARP_SIZE_NV                      0x4003
 #endif
 //-----------------------------------------------------------------------------
 
@@ -52,6 +60,21 @@ namespace lycl
         BF_ROCm    = 2
     } EBinaryFormat;
     //-----------------------------------------------------------------------------
+    //! What to do with a device whose integrity error rate is too high.
+    typedef enum
+    {
+        IA_None             = 0,
+        IA_ShrinkWorkSize   = 1,
+        IA_Disable          = 2
+    } EIntegrityAction;
+    //-----------------------------------------------------------------------------
+    //! How a worker waits for a batch.
+    typedef enum
+    {
+        WM_Finish   = 0, // clFinish()
+        WM_Sleep    = 1  // predicted sleep, then event polling
+    } EWaitMode;
+    //-----------------------------------------------------------------------------
     //! OpenCL logical device
     struct device
     {
@@ -62,6 +85,32 @@ namespace lycl
         size_t workSize;
         EAsmProgram asmProgram;
         EBinaryFormat binaryFormat;
+        //! race all kernel variants on init and keep the fastest one.
+        bool kernelRace;
+        //! per-device kernel variant overrides: "stage:variant,stage:variant"
+        char kernelVariants[256];
+        //! work-group sizes of OpenCL source kernels: "stage:size,stage:size"
+        char localWorkSizes[128];
+        //! extra build options of OpenCL source kernels: "-DA=1; stage:-DB=2"
+        char buildOptions[256];
+        //! collect per-stage GPU time(CL_QUEUE_PROFILING_ENABLE).
+        bool profiling;
+        //! re-compute a sample of completed batches and compare with device output.
+        bool integrityCheck;
+        //! seconds between samples.
+        uint32_t integrityCheckInterval;
+        //! errors per checked hash which trigger (integrityAction).
+        double integrityMaxErrorRate;
+        EIntegrityAction integrityAction;
+        //! number of independent pipelines(worker threads, queues and buffers) on this device.
+        uint32_t numStreams;
+        //! index of this pipeline, [0, numStreams)
+        uint32_t streamIndex;
+        //! index inside the configured device list. Shared by all streams of a device.
+        int32_t deviceIndex;
+        EWaitMode waitMode;
+        //! batch latency in milliseconds, WorkSize is the upper bound. 0: every batch uses WorkSize.
+        uint32_t targetBatchLatency;
     };
     //-----------------------------------------------------------------------------
     //! Compare cl devices by PCIe bus id.
@@ -174,24 +223,32 @@ namespace lycl
         return result;
     }
     //-----------------------------------------------------------------------------
-    //! Create an OpenCL program from file.
-    inline cl_program cluCreateProgramFromFile(cl_context context, cl_device_id cldevice, const char* file_name)
+    inline EIntegrityAction getIntegrityActionFromName(const std::string& action_name)
+    {
+        EIntegrityAction result;
+        if (action_name.find("shrink") != std::string::npos)
+            result = IA_ShrinkWorkSize;
+        else if (action_name.find("disable") != std::string::npos)
+            result = IA_Disable;
+        else
+            result = IA_None;
+
+        return result;
+    }
+    //-----------------------------------------------------------------------------
+    inline EWaitMode getWaitModeFromName(const std::string& mode_name)
+    {
+        return (mode_name.find("sleep") != std::string::npos) ? WM_Sleep : WM_Finish;
+    }
+    //-----------------------------------------------------------------------------
+    //! Create an OpenCL program from source string.
+    inline cl_program cluCreateProgramFromSource(cl_context context, cl_device_id cldevice, const std::string& source,
+                                                 const char* build_options = NULL)
     {
         cl_int errNum;
         cl_program program;
 
-        std::ifstream kernelFile(file_name, std::ios::in);
-        if (!kernelFile.is_open())
-        {
-            std::cerr << "Failed to open file for reading: " << file_name << std::endl;
-            return NULL;
-        }
-
-        std::ostringstream oss;
-        oss << kernelFile.rdbuf();
-
-        std::string srcStdStr = oss.str();
-        const char *srcStr = srcStdStr.c_str();
+        const char *srcStr = source.c_str();
         program = clCreateProgramWithSource(context, 1, (const char**)&srcStr, nullptr, nullptr);
         if (program == nullptr)
         {
@@ -199,7 +256,7 @@ namespace lycl
             return NULL;
         }
 
-        errNum = clBuildProgram(program, 1, &cldevice, NULL, NULL, NULL);
+        errNum = clBuildProgram(program, 1, &cldevice, build_options, NULL, NULL);
         if (errNum != CL_SUCCESS)
         {
             // Determine the reason for the error
@@ -216,6 +273,42 @@ namespace lycl
         return program;
     }
     //-----------------------------------------------------------------------------
+    //! Create an OpenCL program from file.
+    inline cl_program cluCreateProgramFromFile(cl_context context, cl_device_id cldevice, const char* file_name)
+    {
+        std::ifstream kernelFile(file_name, std::ios::in);
+        if (!kernelFile.is_open())
+        {
+            std::cerr << "Failed to open file for reading: " << file_name << std::endl;
+            return NULL;
+        }
+
+        std::ostringstream oss;
+        oss << kernelFile.rdbuf();
+
+        return cluCreateProgramFromSource(context, cldevice, oss.str());
+    }
+    //-----------------------------------------------------------------------------
+    //! Create an OpenCL program from asm program binary.
+    inline cl_program cluCreateProgramWithBinary(cl_context context, cl_device_id cldevice, const unsigned char* binary, size_t size)
+    {
+        cl_int errorCode;
+        cl_program program;
+
+        program = clCreateProgramWithBinary(context, 1, &cldevice, &size, &binary, NULL, &errorCode);
+        if (errorCode != CL_SUCCESS)
+            return NULL;
+
+        errorCode = clBuildProgram(program, 1, &cldevice, NULL, NULL, NULL);
+        if (errorCode != CL_SUCCESS)
+        {
+            clReleaseProgram(program);
+            return NULL;
+        }
+        else
+            return program;
+    }
+    //-----------------------------------------------------------------------------
     inline int readFile(unsigned char **output, size_t *size, const char *name)
     {
         FILE* fp = fopen(name, "rb");
@@ -258,16 +351,10 @@ namespace lycl
             return NULL;
         }
 
-        cl_int errorCode;
-        cl_program program;
-
-        program = clCreateProgramWithBinary(context, 1, &cldevice, &sprogram_size, (const unsigned char **)&sprogram_file, NULL, &errorCode);
-        errorCode = clBuildProgram(program, 1, &cldevice, NULL, NULL, NULL);
+        cl_program program = cluCreateProgramWithBinary(context, cldevice, sprogram_file, sprogram_size);
         free(sprogram_file);
-        if (errorCode != CL_SUCCESS)
-            return NULL;
-        else
-            return program;
+
+        return program;
     }
     //-----------------------------------------------------------------------------
 
@@ -94,8 +94,10 @@ uint32_t ahash(const char* str)
     register size_t len = strlen(str);
     register uint32_t ret = 0;
     register size_t i = 0;
+    // multiplier must be larger than the alphabet of a single position.
+    // Otherwise numbered blocks collide, e.g. (Device16) and (Device20).
     for(; i < len; ++i)
-        ret += 5 * ret + (tolower(str[i]));
+        ret = 31 * ret + (tolower(str[i]));
 
     return ret;
 }
@@ -135,237 +137,253 @@ bool ConfigFile::setSource(const char *file, bool ignorecase)
 
         fclose(f);
 
-        // start parcing.
-        std::string line;
-        std::string::size_type end;
-        std::string::size_type offset;
-        bool in_multiline_comment = false;
-        bool in_multiline_quote = false;
-        bool in_block = false;
-        std::string current_setting = "";
-        std::string current_variable = "";
-        std::string current_block = "";
-        ConfigBlock current_block_map;
-        ConfigSetting current_setting_struct;
-
-        for(;;)
-        {
-            // grab a line.
-            end = buffer.find("\n");
-            if(end == std::string::npos)
-                break;
+        return parseBuffer(buffer);
+    }
+
+    return false;
+}
+//-----------------------------------------------------------------------------
+bool ConfigFile::setSourceFromMemory(const char* data, size_t size)
+{
+    m_settings.clear();
+
+    // prevent skipping last line
+    std::string buffer(data, size);
+    buffer += '\n';
+
+    return parseBuffer(buffer);
+}
+//-----------------------------------------------------------------------------
+bool ConfigFile::parseBuffer(std::string& buffer)
+{
+    // start parcing.
+    std::string line;
+    std::string::size_type end;
+    std::string::size_type offset;
+    bool in_multiline_comment = false;
+    bool in_multiline_quote = false;
+    bool in_block = false;
+    std::string current_setting = "";
+    std::string current_variable = "";
+    std::string current_block = "";
+    ConfigBlock current_block_map;
+    ConfigSetting current_setting_struct;
+
+    for(;;)
+    {
+        // grab a line.
+        end = buffer.find("\n");
+        if(end == std::string::npos)
+            break;
 
-            line = buffer.substr(0, end);
-            buffer.erase(0, end+1);
-            goto parse;
+        line = buffer.substr(0, end);
+        buffer.erase(0, end+1);
+        goto parse;
 
 parse:
-            if(!line.size())
+        if(!line.size())
+            continue;
+
+        // are we a comment?
+        if(!in_multiline_comment && is_comment(line, &in_multiline_comment))
+        {
+            // our line is a comment.
+            if(!in_multiline_comment)
+            {
+                // the entire line is a comment, skip it.
+                continue;
+            }
+        }
+
+        // handle our cases
+        if(in_multiline_comment)
+        {
+            offset = line.find("*/", 0);
+
+            // skip this entire line
+            if(offset == std::string::npos)
                 continue;
 
-            // are we a comment?
-            if(!in_multiline_comment && is_comment(line, &in_multiline_comment))
+            // remove up to the end of the comment block.
+            line.erase(0, offset + 2);
+            in_multiline_comment = false;
+        }
+
+        if(in_block)
+        {
+            // handle settings across multiple lines
+            if(in_multiline_quote)
             {
-                // our line is a comment.
-                if(!in_multiline_comment)
+                // attempt to find the end of the quote block.
+                offset = line.find("\"");
+
+                if(offset == std::string::npos)
                 {
-                    // the entire line is a comment, skip it.
+                    // append the whole line to the quote.
+                    current_setting += line;
+                    current_setting += "\n";
                     continue;
                 }
+
+                // only append part of the line to the setting.
+                current_setting.append(line.c_str(), offset+1);
+                line.erase(0, offset + 1);
+
+                // append the setting to the config block.
+                if(current_block == "" || current_variable == "")
+                {
+                    std::cerr << "Error: Quote without variable." << std::endl;
+                    return false;
+                }
+
+                // apply the setting
+                apply_setting(current_setting, current_setting_struct);
+
+                // the setting is done, append it to the current block.
+                current_block_map[ahash(current_variable)] = current_setting_struct;
+                #ifdef _CONFIG_DEBUG
+                printf("Block: '%s', Setting: '%s', Value: '%s'\n", current_block.c_str(), current_variable.c_str(), current_setting_struct.AsString.c_str());
+                #endif
+                // no longer doing this setting, or in a quote.
+                current_setting = "";
+                current_variable = "";
+                in_multiline_quote = false;                 
             }
 
-            // handle our cases
-            if(in_multiline_comment)
+            // remove any leading spaces
+            remove_spaces(line);
+
+            if(!line.size())
+                continue;
+
+            // our target is a *setting*. look for an '=' sign, this is our seperator.
+            offset = line.find("=");
+            if(offset != std::string::npos)
             {
-                offset = line.find("*/", 0);
+                assert(current_variable == "");
+                current_variable = line.substr(0, offset);
 
-                // skip this entire line
-                if(offset == std::string::npos)
-                    continue;
+                // remove any spaces from the end of the setting
+                remove_all_spaces(current_variable);
 
-                // remove up to the end of the comment block.
-                line.erase(0, offset + 2);
-                in_multiline_comment = false;
+                // remove the directive *and* the = from the line
+                line.erase(0, offset + 1);
             }
 
-            if(in_block)
+            // look for the opening quote. this signifies the start of a setting.
+            offset = line.find("\"");
+            if(offset != std::string::npos)
             {
-                // handle settings across multiple lines
-                if(in_multiline_quote)
+                assert(current_setting == "");
+                assert(current_variable != "");
+
+                // try and find the ending quote
+                end = line.find("\"", offset + 1);
+                if(end != std::string::npos)
                 {
-                    // attempt to find the end of the quote block.
-                    offset = line.find("\"");
-
-                    if(offset == std::string::npos)
-                    {
-                        // append the whole line to the quote.
-                        current_setting += line;
-                        current_setting += "\n";
-                        continue;
-                    }
-
-                    // only append part of the line to the setting.
-                    current_setting.append(line.c_str(), offset+1);
-                    line.erase(0, offset + 1);
+                    // the closing quote is on the same line.
+                    current_setting = line.substr(offset+1, end-offset-1);
 
-                    // append the setting to the config block.
-                    if(current_block == "" || current_variable == "")
-                    {
-                        std::cerr << "Error: Quote without variable." << std::endl;
-                        return false;
-                    }
+                    // erase up to the end
+                    line.erase(0, end + 1);
 
                     // apply the setting
                     apply_setting(current_setting, current_setting_struct);
 
                     // the setting is done, append it to the current block.
                     current_block_map[ahash(current_variable)] = current_setting_struct;
-                    #ifdef _CONFIG_DEBUG
+
+#ifdef _CONFIG_DEBUG
                     printf("Block: '%s', Setting: '%s', Value: '%s'\n", current_block.c_str(), current_variable.c_str(), current_setting_struct.AsString.c_str());
-                    #endif
+#endif
                     // no longer doing this setting, or in a quote.
                     current_setting = "";
                     current_variable = "";
-                    in_multiline_quote = false;                 
-                }
-
-                // remove any leading spaces
-                remove_spaces(line);
-
-                if(!line.size())
-                    continue;
-
-                // our target is a *setting*. look for an '=' sign, this is our seperator.
-                offset = line.find("=");
-                if(offset != std::string::npos)
-                {
-                    assert(current_variable == "");
-                    current_variable = line.substr(0, offset);
+                    in_multiline_quote = false;
 
-                    // remove any spaces from the end of the setting
-                    remove_all_spaces(current_variable);
-
-                    // remove the directive *and* the = from the line
-                    line.erase(0, offset + 1);
+                    // attempt to grab more settings from the same line.
+                    goto parse;
                 }
-
-                // look for the opening quote. this signifies the start of a setting.
-                offset = line.find("\"");
-                if(offset != std::string::npos)
+                else
                 {
-                    assert(current_setting == "");
-                    assert(current_variable != "");
-
-                    // try and find the ending quote
-                    end = line.find("\"", offset + 1);
-                    if(end != std::string::npos)
-                    {
-                        // the closing quote is on the same line.
-                        current_setting = line.substr(offset+1, end-offset-1);
+                    // the closing quote is not on the same line. means we'll try and find it on the next.
+                    current_setting.append(line.c_str(), offset);
 
-                        // erase up to the end
-                        line.erase(0, end + 1);
-
-                        // apply the setting
-                        apply_setting(current_setting, current_setting_struct);
-
-                        // the setting is done, append it to the current block.
-                        current_block_map[ahash(current_variable)] = current_setting_struct;
-
-#ifdef _CONFIG_DEBUG
-                        printf("Block: '%s', Setting: '%s', Value: '%s'\n", current_block.c_str(), current_variable.c_str(), current_setting_struct.AsString.c_str());
-#endif
-                        // no longer doing this setting, or in a quote.
-                        current_setting = "";
-                        current_variable = "";
-                        in_multiline_quote = false;
-
-                        // attempt to grab more settings from the same line.
-                        goto parse;
-                    }
-                    else
-                    {
-                        // the closing quote is not on the same line. means we'll try and find it on the next.
-                        current_setting.append(line.c_str(), offset);
-
-                        // skip to the next line. (after setting our condition first)
-                        in_multiline_quote = true;
-                        continue;
-                    }
+                    // skip to the next line. (after setting our condition first)
+                    in_multiline_quote = true;
+                    continue;
                 }
+            }
 
-                // are we at the end of the block yet?
-                offset = line.find(">");
-                if(offset != std::string::npos)
-                {
-                    line.erase(0, offset+1);
+            // are we at the end of the block yet?
+            offset = line.find(">");
+            if(offset != std::string::npos)
+            {
+                line.erase(0, offset+1);
 
-                    // free
-                    in_block = false;
+                // free
+                in_block = false;
 
-                    // assign this block to the main "big" map.
-                    m_settings[ahash(current_block)] = current_block_map;
+                // assign this block to the main "big" map.
+                m_settings[ahash(current_block)] = current_block_map;
 
-                    // erase all data for this so it doesn't seep through
-                    current_block_map.clear();
-                    current_setting = "";
-                    current_variable = "";
-                    current_block = "";
-                }
+                // erase all data for this so it doesn't seep through
+                current_block_map.clear();
+                current_setting = "";
+                current_variable = "";
+                current_block = "";
             }
-            else
+        }
+        else
+        {
+            // we're not in a block. look for the start of one.
+            offset = line.find("<");
+
+            if(offset != std::string::npos)
             {
-                // we're not in a block. look for the start of one.
-                offset = line.find("<");
+                in_block = true;
+
+                line.erase(0, offset + 1);
 
+                // find the name of the block first.
+                offset = line.find(" ");
                 if(offset != std::string::npos)
                 {
-                    in_block = true;
-
+                    current_block = line.substr(0, offset);
                     line.erase(0, offset + 1);
-
-                    // find the name of the block first.
-                    offset = line.find(" ");
-                    if(offset != std::string::npos)
-                    {
-                        current_block = line.substr(0, offset);
-                        line.erase(0, offset + 1);
-                    }
-                    else
-                    {
-                        std::cerr << "Error: Block without name." << std::endl;
-                        return false;
-                    }
-
-                    // skip back
-                    goto parse;
                 }
-            }
-        }
+                else
+                {
+                    std::cerr << "Error: Block without name." << std::endl;
+                    return false;
+                }
 
-        // handle any errors
-        if(in_block)
-        {
-            std::cerr << "Error: Unterminated block." << std::endl;
-            return false;
+                // skip back
+                goto parse;
+            }
         }
+    }
 
-        if(in_multiline_comment)
-        {
-            std::cerr << "Error: Unterminated comment." << std::endl;
-            return false;
-        }
+    // handle any errors
+    if(in_block)
+    {
+        std::cerr << "Error: Unterminated block." << std::endl;
+        return false;
+    }
 
-        if(in_multiline_quote)
-        {
-            std::cerr << "Error: Unterminated quote." << std::endl;
-            return false;
-        }
+    if(in_multiline_comment)
+    {
+        std::cerr << "Error: Unterminated comment." << std::endl;
+        return false;
+    }
 
-        return true;
+    if(in_multiline_quote)
+    {
+        std::cerr << "Error: Unterminated quote." << std::endl;
+        return false;
     }
 
-    return false;
+    return true;
 }
 //-----------------------------------------------------------------------------
 ConfigSetting * ConfigFile::getSetting(const char * Block, const char * Setting)
@@ -11,8 +11,10 @@
 #define ConfigFile_INCLUDE_ONCE
 
 #include <string.h>
+#include <string>
 #include <map>
 #include <stdarg.h>
+#include <stdint.h>
 
 namespace lycl
 {
@@ -33,6 +35,7 @@ namespace lycl
         ~ConfigFile();
 
         bool setSource(const char *file, bool ignorecase = true);
+        bool setSourceFromMemory(const char* data, size_t size);
         ConfigSetting * getSetting(const char * Block, const char * Setting);
 
         bool getString(const char * block, const char* name, std::string *value);
@@ -52,6 +55,8 @@ namespace lycl
         float getFloatVA(const char* block, float def, const char* name, ...);
 
     private:
+        bool parseBuffer(std::string& buffer);
+
         std::map<uint32_t, ConfigBlock> m_settings;
     };
 }
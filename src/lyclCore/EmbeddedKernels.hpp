@@ -0,0 +1,109 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef EmbeddedKernels_INCLUDE_ONCE
+#define EmbeddedKernels_INCLUDE_ONCE
+
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+namespace lycl
+{
+    //-----------------------------------------------------------------------------
+    //! Content of a file from the kernels directory.
+    struct EmbeddedFile
+    {
+        //! path relative to the miner directory, e.g. "kernels/blake32/blake32.cl"
+        const char* name;
+        const unsigned char* data;
+        size_t size;
+    };
+    //-----------------------------------------------------------------------------
+    //! Generated by premake(embedKernels()) into build/generated/EmbeddedKernels.cpp
+    extern const EmbeddedFile g_embeddedKernelFiles[];
+    extern const size_t g_numEmbeddedKernelFiles;
+    //-----------------------------------------------------------------------------
+    //! Directory with the same layout as "kernels". Files found there are used instead of embedded ones.
+    inline std::string& getKernelOverrideDir()
+    {
+        static std::string kernelOverrideDir;
+        return kernelOverrideDir;
+    }
+    //-----------------------------------------------------------------------------
+    //! Must be set before the first device init.
+    inline void setKernelOverrideDir(const std::string& dir)
+    {
+        getKernelOverrideDir() = dir;
+        if (dir.size() && (dir.back() != '/') && (dir.back() != '\\'))
+            getKernelOverrideDir() += '/';
+    }
+    //-----------------------------------------------------------------------------
+    inline const EmbeddedFile* findEmbeddedKernelFile(const std::string& file_name)
+    {
+        for (size_t i = 0; i < g_numEmbeddedKernelFiles; ++i)
+        {
+            if (!file_name.compare(g_embeddedKernelFiles[i].name))
+                return &g_embeddedKernelFiles[i];
+        }
+
+        return nullptr;
+    }
+    //-----------------------------------------------------------------------------
+    inline bool readWholeFile(const std::string& file_name, std::string& out_data)
+    {
+        std::ifstream file(file_name, std::ios::in | std::ios::binary);
+        if (!file.is_open())
+            return false;
+
+        std::ostringstream oss;
+        oss << file.rdbuf();
+        out_data = oss.str();
+
+        return true;
+    }
+    //-----------------------------------------------------------------------------
+    //! Loads a file from the kernels directory.
+    //! Order: override directory, embedded files, working directory.
+    inline bool loadKernelFile(const std::string& file_name, std::string& out_data)
+    {
+        const std::string& overrideDir = getKernelOverrideDir();
+        if (overrideDir.size())
+        {
+            // "kernels/blake32/blake32.cl" -> "<override dir>/blake32/blake32.cl"
+            const char* const prefix = "kernels/";
+            std::string overrideName = overrideDir;
+            if (!file_name.compare(0, strlen(prefix), prefix))
+                overrideName += file_name.substr(strlen(prefix));
+            else
+                overrideName += file_name;
+
+            if (readWholeFile(overrideName, out_data))
+                return true;
+        }
+
+        const EmbeddedFile* embeddedFile = findEmbeddedKernelFile(file_name);
+        if (embeddedFile)
+        {
+            out_data.assign((const char*)embeddedFile->data, embeddedFile->size);
+            return true;
+        }
+
+        if (readWholeFile(file_name, out_data))
+            return true;
+
+        std::cerr << "Failed to find a kernel file: " << file_name << std::endl;
+        return false;
+    }
+    //-----------------------------------------------------------------------------
+}
+
+#endif // !EmbeddedKernels_INCLUDE_ONCE
@@ -13,8 +13,12 @@ namespace global
 {
     //! number of worker threads(number of Devices/GPUs)
     int numWorkerThreads = 0;
-    //! stratum connection info
+    //! number of scheduler threads driving all workers. 0: one thread per worker.
+    int numSchedulerThreads = 0;
+    //! stratum connection info of the active pool
     ConnectionInfo connectionInfo;
+    //! pools in failover order
+    std::vector<ConnectionInfo> poolConnectionInfo;
     //! Report statistics to the pool.
     bool opt_stratumStats = false;
     //! enable terminal colors for logging
@@ -11,6 +11,7 @@
 #define Global_INCLUDE_ONCE
 
 #include <string>
+#include <vector>
 
 // Define to the full name of this package.
 #define PACKAGE_NAME "lyclMiner"
@@ -54,6 +55,8 @@ struct work
     char *job_id;
     size_t xnonce2_len;
     unsigned char *xnonce2;
+    //! submit template of the job, see share_template_build()
+    uint32_t job_ref;
 };
 
 // TODO: sort these.
@@ -61,8 +64,12 @@ namespace global
 {
     //! number of worker threads(number of Devices/GPUs)
     extern int numWorkerThreads;
-    //! stratum connection info
+    //! number of scheduler threads driving all workers. 0: one thread per worker.
+    extern int numSchedulerThreads;
+    //! stratum connection info of the active pool
     extern ConnectionInfo connectionInfo;
+    //! pools in failover order. [0] is <Connection>, followed by <Connection1>...
+    extern std::vector<ConnectionInfo> poolConnectionInfo;
     //! Report statistics to the pool. Currently hardcoded. Needs to be properly implemented.
     extern bool opt_stratumStats;
     //! number of retries -1, infinite
@@ -105,7 +112,9 @@ extern int work_thr_id;
 struct work_restart
 {
     volatile uint8_t restart;
-    char padding[128 - sizeof(uint8_t)];
+    //! steady clock time of the latest restart in microseconds. See getSteadyTimeUs().
+    volatile uint64_t timeUs;
+    char padding[128 - 2 * sizeof(uint64_t)];
 };
 extern struct work_restart *gwork_restart;
 extern struct thr_info *thr;
@@ -0,0 +1,261 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef HexCodec_INCLUDE_ONCE
+#define HexCodec_INCLUDE_ONCE
+
+#include <cstddef>
+#include <cstdint>
+
+// SSSE3/AVX2 paths are compiled with target attributes and selected at runtime,
+// so the rest of the miner does not need -mssse3/-mavx2.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LYCL_HEX_SIMD 1
+#include <immintrin.h>
+#else
+#define LYCL_HEX_SIMD 0
+#endif
+
+//-----------------------------------------------------------------------------
+// Hex codec used by stratum(notify fields, extranonce, submits).
+// Decoding accepts both cases and rejects anything else, including '\0'.
+// Encoding produces lower case digits.
+//-----------------------------------------------------------------------------
+enum EHexCodecPath
+{
+    HCP_Table = 0,
+    HCP_SSSE3,
+    HCP_AVX2
+};
+//-----------------------------------------------------------------------------
+//! Nibble value of a hex digit or 0xFF.
+struct HexDecodeTable
+{
+    unsigned char values[256];
+
+    HexDecodeTable()
+    {
+        for (int i = 0; i < 256; ++i)
+            values[i] = 0xFF;
+        for (int i = 0; i < 10; ++i)
+            values['0' + i] = (unsigned char)i;
+        for (int i = 0; i < 6; ++i)
+        {
+            values['a' + i] = (unsigned char)(10 + i);
+            values['A' + i] = (unsigned char)(10 + i);
+        }
+    }
+};
+//-----------------------------------------------------------------------------
+inline const unsigned char* hexDecodeTable()
+{
+    static const HexDecodeTable table;
+    return table.values;
+}
+//-----------------------------------------------------------------------------
+inline const char* hexDigits() { return "0123456789abcdef"; }
+//-----------------------------------------------------------------------------
+inline bool hexIsValid(const char *hex, size_t size)
+{
+    const unsigned char *table = hexDecodeTable();
+    unsigned char invalid = 0;
+    for (size_t i = 0; i < size; ++i)
+        invalid |= table[(unsigned char)hex[i]];
+    return !(invalid & 0xF0);
+}
+//-----------------------------------------------------------------------------
+//! Decodes (2 * size) hex digits. Returns false on an invalid digit, (out_bin) is partially written then.
+inline bool hexDecodeTableScalar(unsigned char *out_bin, const char *hex, size_t size)
+{
+    const unsigned char *table = hexDecodeTable();
+    unsigned char invalid = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        const unsigned char hi = table[(unsigned char)hex[2 * i]];
+        const unsigned char lo = table[(unsigned char)hex[2 * i + 1]];
+        invalid |= hi | lo;
+        out_bin[i] = (unsigned char)((hi << 4) | (lo & 0x0F));
+    }
+    return !(invalid & 0xF0);
+}
+//-----------------------------------------------------------------------------
+//! Writes (2 * size) hex digits, without a terminating '\0'.
+inline void hexEncodeTableScalar(char *out_hex, const unsigned char *bin, size_t size)
+{
+    const char *digits = hexDigits();
+    for (size_t i = 0; i < size; ++i)
+    {
+        out_hex[2 * i] = digits[bin[i] >> 4];
+        out_hex[2 * i + 1] = digits[bin[i] & 0x0F];
+    }
+}
+//-----------------------------------------------------------------------------
+#if LYCL_HEX_SIMD
+//-----------------------------------------------------------------------------
+// SSSE3: 32 hex digits <-> 16 bytes per iteration.
+//-----------------------------------------------------------------------------
+//! Nibble values of 16 hex digits. Invalid digits clear bits in (valid).
+__attribute__((target("ssse3")))
+inline __m128i hexNibblesSSSE3(__m128i chars, __m128i& valid)
+{
+    // signed compares: bytes >= 0x80 are negative and fail both ranges
+    const __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+    const __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+    const __m128i isAlpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    valid = _mm_and_si128(valid, _mm_or_si128(isDigit, isAlpha));
+    return _mm_or_si128(_mm_and_si128(isDigit, _mm_sub_epi8(chars, _mm_set1_epi8('0'))),
+                        _mm_and_si128(isAlpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+}
+//-----------------------------------------------------------------------------
+__attribute__((target("ssse3")))
+inline bool hexDecodeSSSE3(unsigned char *out_bin, const char *hex, size_t size)
+{
+    // (hi, lo) nibble pairs -> hi * 16 + lo
+    const __m128i weights = _mm_set1_epi16(0x0110);
+    __m128i valid = _mm_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        const __m128i a = hexNibblesSSSE3(_mm_loadu_si128((const __m128i*)(hex + 2 * i)), valid);
+        const __m128i b = hexNibblesSSSE3(_mm_loadu_si128((const __m128i*)(hex + 2 * i + 16)), valid);
+        _mm_storeu_si128((__m128i*)(out_bin + i),
+                         _mm_packus_epi16(_mm_maddubs_epi16(a, weights), _mm_maddubs_epi16(b, weights)));
+    }
+    if (_mm_movemask_epi8(valid) != 0xFFFF)
+        return false;
+    return hexDecodeTableScalar(out_bin + i, hex + 2 * i, size - i);
+}
+//-----------------------------------------------------------------------------
+__attribute__((target("ssse3")))
+inline void hexEncodeSSSE3(char *out_hex, const unsigned char *bin, size_t size)
+{
+    const __m128i digits = _mm_loadu_si128((const __m128i*)hexDigits());
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        const __m128i bytes = _mm_loadu_si128((const __m128i*)(bin + i));
+        const __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+        const __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, mask));
+        _mm_storeu_si128((__m128i*)(out_hex + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i*)(out_hex + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    hexEncodeTableScalar(out_hex + 2 * i, bin + i, size - i);
+}
+//-----------------------------------------------------------------------------
+// AVX2: 64 hex digits <-> 32 bytes per iteration.
+//-----------------------------------------------------------------------------
+__attribute__((target("avx2")))
+inline __m256i hexNibblesAVX2(__m256i chars, __m256i& valid)
+{
+    const __m256i lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+    const __m256i isDigit = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('0' - 1)),
+                                             _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chars));
+    const __m256i isAlpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                             _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+    valid = _mm256_and_si256(valid, _mm256_or_si256(isDigit, isAlpha));
+    return _mm256_or_si256(_mm256_and_si256(isDigit, _mm256_sub_epi8(chars, _mm256_set1_epi8('0'))),
+                           _mm256_and_si256(isAlpha, _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10))));
+}
+//-----------------------------------------------------------------------------
+__attribute__((target("avx2")))
+inline bool hexDecodeAVX2(unsigned char *out_bin, const char *hex, size_t size)
+{
+    const __m256i weights = _mm256_set1_epi16(0x0110);
+    __m256i valid = _mm256_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        const __m256i a = hexNibblesAVX2(_mm256_loadu_si256((const __m256i*)(hex + 2 * i)), valid);
+        const __m256i b = hexNibblesAVX2(_mm256_loadu_si256((const __m256i*)(hex + 2 * i + 32)), valid);
+        // packus works per 128-bit lane: [a0 b0 a1 b1] -> [a0 a1 b0 b1]
+        const __m256i packed = _mm256_packus_epi16(_mm256_maddubs_epi16(a, weights), _mm256_maddubs_epi16(b, weights));
+        _mm256_storeu_si256((__m256i*)(out_bin + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    if (_mm256_movemask_epi8(valid) != -1)
+        return false;
+    return hexDecodeSSSE3(out_bin + i, hex + 2 * i, size - i);
+}
+//-----------------------------------------------------------------------------
+__attribute__((target("avx2")))
+inline void hexEncodeAVX2(char *out_hex, const unsigned char *bin, size_t size)
+{
+    const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)hexDigits()));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        const __m256i bytes = _mm256_loadu_si256((const __m256i*)(bin + i));
+        const __m256i hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), mask));
+        const __m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(bytes, mask));
+        // unpack works per 128-bit lane: [0-7 16-23] and [8-15 24-31]
+        const __m256i first = _mm256_unpacklo_epi8(hi, lo);
+        const __m256i second = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i*)(out_hex + 2 * i), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i*)(out_hex + 2 * i + 32), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+    hexEncodeSSSE3(out_hex + 2 * i, bin + i, size - i);
+}
+//-----------------------------------------------------------------------------
+#endif // LYCL_HEX_SIMD
+//-----------------------------------------------------------------------------
+//! Fastest path supported by the CPU. Detected once.
+inline EHexCodecPath hexCodecPath()
+{
+#if LYCL_HEX_SIMD
+    static const EHexCodecPath path = __builtin_cpu_supports("avx2") ? HCP_AVX2 :
+                                      (__builtin_cpu_supports("ssse3") ? HCP_SSSE3 : HCP_Table);
+    return path;
+#else
+    return HCP_Table;
+#endif
+}
+//-----------------------------------------------------------------------------
+inline const char* hexCodecPathName(EHexCodecPath path)
+{
+    switch (path)
+    {
+    case HCP_AVX2: return "AVX2";
+    case HCP_SSSE3: return "SSSE3";
+    default: return "table";
+    }
+}
+//-----------------------------------------------------------------------------
+//! Decodes (2 * size) hex digits into (size) bytes. Returns false on an invalid digit.
+//! (hex) must contain at least (2 * size) readable characters.
+inline bool hexDecode(unsigned char *out_bin, const char *hex, size_t size, EHexCodecPath path = hexCodecPath())
+{
+#if LYCL_HEX_SIMD
+    // short fields(version, nbits, ntime) stay on the table path
+    if (path == HCP_AVX2 && size >= 32)
+        return hexDecodeAVX2(out_bin, hex, size);
+    if (path != HCP_Table && size >= 16)
+        return hexDecodeSSSE3(out_bin, hex, size);
+#else
+    (void)path;
+#endif
+    return hexDecodeTableScalar(out_bin, hex, size);
+}
+//-----------------------------------------------------------------------------
+//! Encodes (size) bytes into (2 * size) hex digits, without a terminating '\0'.
+inline void hexEncode(char *out_hex, const unsigned char *bin, size_t size, EHexCodecPath path = hexCodecPath())
+{
+#if LYCL_HEX_SIMD
+    if (path == HCP_AVX2 && size >= 32)
+        return hexEncodeAVX2(out_hex, bin, size);
+    if (path != HCP_Table && size >= 16)
+        return hexEncodeSSSE3(out_hex, bin, size);
+#else
+    (void)path;
+#endif
+    hexEncodeTableScalar(out_hex, bin, size);
+}
+//-----------------------------------------------------------------------------
+
+#endif // !HexCodec_INCLUDE_ONCE
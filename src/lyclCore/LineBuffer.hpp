@@ -0,0 +1,100 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef LineBuffer_INCLUDE_ONCE
+#define LineBuffer_INCLUDE_ONCE
+
+#include <vector>
+#include <cstring>
+
+//-----------------------------------------------------------------------------
+// LineBuffer class.
+// Receive buffer of a newline-delimited protocol(stratum).
+// Data is received directly into the free space at the end of the buffer.
+// Complete lines are returned as (pointer, size) views into the buffer and only
+// newly received bytes are scanned for '\n'. A partial line is moved to the
+// front only when the free space runs out, so every byte is copied at most once
+// per buffer wrap instead of once per line.
+// Not thread safe.
+//-----------------------------------------------------------------------------
+class LineBuffer
+{
+public:
+    inline LineBuffer() : m_start(0), m_end(0), m_scan(0) { }
+
+    //! Returns free space for at least (min_size) bytes at the end of the buffer.
+    //! Invalidates lines returned by nextLine(). Call commit() with the number of bytes written.
+    inline char* prepare(size_t min_size)
+    {
+        if (m_start == m_end)
+        {
+            m_start = 0;
+            m_end = 0;
+            m_scan = 0;
+        }
+        else if (m_data.size() - m_end < min_size && m_start)
+        {
+            memmove(m_data.data(), m_data.data() + m_start, m_end - m_start);
+            m_end -= m_start;
+            m_scan -= m_start;
+            m_start = 0;
+        }
+
+        if (m_data.size() - m_end < min_size)
+            m_data.resize(m_end + min_size);
+
+        return m_data.data() + m_end;
+    }
+    inline void commit(size_t size) { m_end += size; }
+
+    //! Returns the next complete line without "\n"("\r\n"). Empty lines are returned too.
+    //! The line is valid until the next prepare() or clear(). Returns false if no complete line is buffered.
+    inline bool nextLine(const char*& out_line, size_t& out_size)
+    {
+        if (m_scan == m_end)
+            return false;
+
+        const char* data = m_data.data();
+        const char* newline = (const char*)memchr(data + m_scan, '\n', m_end - m_scan);
+        if (!newline)
+        {
+            m_scan = m_end;
+            return false;
+        }
+
+        const size_t end = (size_t)(newline - data);
+        out_line = data + m_start;
+        out_size = end - m_start;
+        if (out_size && out_line[out_size - 1] == '\r')
+            --out_size;
+
+        m_start = end + 1;
+        m_scan = m_start;
+        return true;
+    }
+
+    //! true if no bytes(complete or partial lines) are buffered.
+    inline bool empty() const { return m_start == m_end; }
+    inline void clear()
+    {
+        m_start = 0;
+        m_end = 0;
+        m_scan = 0;
+    }
+
+private:
+    std::vector<char> m_data;
+    // unread data is [m_start, m_end). [m_start, m_scan) contains no '\n'.
+    size_t m_start;
+    size_t m_end;
+    size_t m_scan;
+};
+//-----------------------------------------------------------------------------
+
+#endif // !LineBuffer_INCLUDE_ONCE
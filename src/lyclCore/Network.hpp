@@ -15,13 +15,80 @@
 
 #ifdef _WIN32
 #include <winsock2.h>
+#include <ws2tcpip.h> // getaddrinfo
 #include <windows.h>
 #else
 #include <netinet/tcp.h> // SOL_TCP
+#include <netdb.h> // getaddrinfo
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h> // close
 #endif
 
+#include <errno.h>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
 #include <curl/curl.h> // CURL
 
+//-----------------------------------------------------------------------------
+// Non-blocking socket helpers.
+// poll()(WSAPoll on Windows) is used instead of epoll. The miner keeps a single
+// pool connection, so there is no set of descriptors to scale over, and epoll
+// would be Linux only.
+//-----------------------------------------------------------------------------
+#ifdef _WIN32
+#define socket_poll WSAPoll
+#define socket_in_progress() (WSAGetLastError() == WSAEWOULDBLOCK)
+#else
+#define socket_poll poll
+#define socket_in_progress() (errno == EINPROGRESS)
+#endif
+//-----------------------------------------------------------------------------
+inline uint64_t getSteadyTimeMs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+//-----------------------------------------------------------------------------
+inline uint64_t getSteadyTimeUs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+//-----------------------------------------------------------------------------
+inline bool socket_set_nonblocking(curl_socket_t sock)
+{
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(sock, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    return (flags != -1) && (fcntl(sock, F_SETFL, flags | O_NONBLOCK) != -1);
+#endif
+}
+//-----------------------------------------------------------------------------
+inline void socket_close(curl_socket_t sock)
+{
+#ifdef _WIN32
+    closesocket(sock);
+#else
+    close(sock);
+#endif
+}
+//-----------------------------------------------------------------------------
+//! Waits up to (timeout_ms) for (events) on a socket. Returns revents, 0 on timeout or -1 on error.
+inline int socket_wait(curl_socket_t sock, short events, int timeout_ms)
+{
+    struct pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = events;
+    pfd.revents = 0;
+
+    int rc = socket_poll(&pfd, 1, (timeout_ms > 0) ? timeout_ms : 0);
+    if (rc < 0)
+        return (errno == EINTR) ? 0 : -1;
+    return rc ? pfd.revents : 0;
+}
+
 //-----------------------------------------------------------------------------
 #if LIBCURL_VERSION_NUM >= 0x070f06
 inline int sockopt_keepalive_cb(void *userdata, curl_socket_t fd, curlsocktype purpose)
@@ -61,6 +128,65 @@ inline int sockopt_keepalive_cb(void *userdata, curl_socket_t fd, curlsocktype p
 }
 #endif
 //-----------------------------------------------------------------------------
+//! Connects to (host):(port) without blocking the socket. All resolved addresses are tried in order.
+//! Returns a non-blocking socket with TCP_NODELAY and keepalive set, or CURL_SOCKET_BAD.
+inline curl_socket_t socket_connect_nonblocking(const char *host, const char *port, int timeout_ms,
+                                                char *err_str, size_t err_size)
+{
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    int rc = getaddrinfo(host, port, &hints, &res);
+    if (rc)
+    {
+        snprintf(err_str, err_size, "Could not resolve host: %s", host);
+        return CURL_SOCKET_BAD;
+    }
+
+    const uint64_t deadline = getSteadyTimeMs() + (uint64_t)timeout_ms;
+    curl_socket_t sock = CURL_SOCKET_BAD;
+    snprintf(err_str, err_size, "Failed to connect to %s port %s", host, port);
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next)
+    {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock == CURL_SOCKET_BAD)
+            continue;
+
+        int nodelay = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(nodelay));
+#if LIBCURL_VERSION_NUM >= 0x070f06
+        sockopt_keepalive_cb(NULL, sock, CURLSOCKTYPE_IPCXN);
+#endif
+        if (socket_set_nonblocking(sock))
+        {
+            if (connect(sock, ai->ai_addr, (int)ai->ai_addrlen) == 0)
+                break;
+
+            if (socket_in_progress())
+            {
+                const uint64_t now = getSteadyTimeMs();
+                int revents = (now < deadline) ? socket_wait(sock, POLLOUT, (int)(deadline - now)) : 0;
+                int soError = 0;
+                socklen_t soErrorSize = sizeof(soError);
+                if (revents > 0 && !getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&soError, &soErrorSize) && !soError)
+                    break;
+                if (!revents)
+                    snprintf(err_str, err_size, "Connection to %s port %s timed out", host, port);
+            }
+        }
+
+        socket_close(sock);
+        sock = CURL_SOCKET_BAD;
+    }
+
+    freeaddrinfo(res);
+    return sock;
+}
+//-----------------------------------------------------------------------------
 #if LIBCURL_VERSION_NUM >= 0x071101
 inline curl_socket_t opensocket_grab_cb(void *clientp, curlsocktype purpose, struct curl_sockaddr *addr)
 {
@@ -13,6 +13,9 @@
 #ifndef OtherThreads_INCLUDE_ONCE
 #define OtherThreads_INCLUDE_ONCE
 
+#include <chrono>
+#include <thread>
+
 #ifndef _WIN32
 #include <signal.h>
 #endif
@@ -84,7 +87,11 @@ inline double calcNetworkDiff(work* work_info)
 //-----------------------------------------------------------------------------
 inline void stratumGenWork(stratum_ctx *sctx, work *g_work)
 {
+    // sock_lock is taken before work_lock, see stratum_swap()
+    const uint32_t sessionGen = stratum_get_session_gen( sctx );
     pthread_mutex_lock( &sctx->work_lock );
+    const bool newJob = !g_work->job_id || strcmp( g_work->job_id, sctx->job.job_id ) ||
+                        g_work->xnonce2_len != sctx->xnonce2_size;
     free( g_work->job_id );
     g_work->job_id = strdup( sctx->job.job_id );
     g_work->xnonce2_len = sctx->xnonce2_size;
@@ -92,6 +99,8 @@ inline void stratumGenWork(stratum_ctx *sctx, work *g_work)
     memcpy( g_work->xnonce2, sctx->job.xnonce2, sctx->xnonce2_size );
 
     buildExtraHeader( g_work, sctx );
+    if ( newJob )
+        g_work->job_ref = share_template_build( g_work, sessionGen );
 
     global::net_diff = calcNetworkDiff( g_work );
     pthread_mutex_unlock( &sctx->work_lock );
@@ -120,10 +129,163 @@ inline void stratumGenWork(stratum_ctx *sctx, work *g_work)
     }
 }
 //-----------------------------------------------------------------------------
+// Failover pools.
+// Backup pools(<Connection1>...) stay connected, subscribed and authorized in standby
+// slots and receive jobs like the active pool. When the active pool fails, the highest
+// priority ready backup is swapped in and its job is handed to the devices at once.
+// The failed pool takes the freed slot and is reconnected in the background. Once a
+// higher priority pool has been ready for STRATUM_FAILBACK_SEC, the miner switches back.
+//-----------------------------------------------------------------------------
+//! Drops work of the previous session or pool. Called with g_work_lock held.
+inline void stratum_drop_session_work()
+{
+    // shares of the previous session must not be sent, even if job ids match
+    share_templates_invalidate();
+    free( global::g_work.job_id );
+    global::g_work.job_id = NULL;
+}
+//-----------------------------------------------------------------------------
+//! Makes the highest priority ready backup the active pool. With (failback), only pools with
+//! a higher priority than the active one are considered. Returns false if none is ready.
+inline bool stratum_switch_pool(bool failback)
+{
+    const uint64_t nowUs = getSteadyTimeUs();
+    const int numPools = (int) global::poolConnectionInfo.size();
+    for (int pool = 0; pool < numPools && !(failback && pool >= stratum.pool_index); ++pool)
+    {
+        // pool_index is changed by this thread only, so slots can be searched without locks
+        stratum_standby *slot = NULL;
+        for (int i = 0; i < stratum_num_standbys; ++i)
+        {
+            if (stratum_standbys[i].ctx.pool_index == pool)
+                slot = &stratum_standbys[i];
+        }
+        if (!slot)
+            continue;
+
+        // ready_time_us is written by the standby thread, read it with the slot locked only
+        pthread_mutex_lock( &slot->lock );
+        const uint64_t readyTimeUs = slot->ctx.ready_time_us;
+        if ( !slot->ctx.connected || !readyTimeUs || !slot->ctx.job.job_id[0] ||
+             (failback && nowUs - readyTimeUs < (uint64_t) STRATUM_FAILBACK_SEC * 1000000) )
+        {
+            pthread_mutex_unlock( &slot->lock );
+            continue;
+        }
+
+        const bool wasConnected = stratum.connected;
+        pthread_mutex_lock( &g_work_lock );
+        stratum_swap( &stratum, &slot->ctx );
+        global::connectionInfo = global::poolConnectionInfo[stratum.pool_index];
+        stratum_drop_session_work();
+        stratumGenWork( &stratum, &global::g_work );
+        time( &g_work_time );
+        pthread_mutex_unlock( &g_work_lock );
+
+        // after a fail-back the previous pool is still connected and stays ready
+        slot->ctx.ready_time_us = wasConnected ? nowUs : 0;
+        slot->next_attempt_ms = getSteadyTimeMs() + (uint64_t) global::opt_failPause * 1000;
+        pthread_mutex_unlock( &slot->lock );
+
+        Log::print(Log::LT_Blue, "Switched to %s pool %s", pool ? "backup" : "primary", stratum.url);
+        stratum_signal_ready( &stratum );
+        restart_threads();
+        return true;
+    }
+    return false;
+}
+//-----------------------------------------------------------------------------
+//! Disconnects a backup pool and schedules a reconnection. Called with the slot locked.
+inline void stratum_standby_drop(stratum_standby *slot, const char *reason)
+{
+    Log::print(Log::LT_Error, "Backup pool %s %s, retry after %d seconds", slot->ctx.url, reason, global::opt_failPause);
+    stratum_disconnect( &slot->ctx );
+    slot->ctx.ready_time_us = 0;
+    slot->next_attempt_ms = getSteadyTimeMs() + (uint64_t) global::opt_failPause * 1000;
+}
+//-----------------------------------------------------------------------------
+//! Connects, subscribes and authorizes a backup pool. Called with the slot locked.
+inline void stratum_standby_connect(stratum_standby *slot)
+{
+    stratum_ctx *sctx = &slot->ctx;
+    const ConnectionInfo& pool = global::poolConnectionInfo[sctx->pool_index];
+
+    // the job of a previous connection is not valid anymore
+    sctx->job.job_id[0] = '\0';
+    if ( !stratum_connect( sctx, sctx->url )
+         || !stratum_subscribe( sctx )
+         || !stratum_authorize( sctx, pool.rpc_user.c_str(), pool.rpc_pass.c_str() ) )
+    {
+        stratum_standby_drop( slot, "is not available" );
+        return;
+    }
+    sctx->ready_time_us = getSteadyTimeUs();
+    Log::print(Log::LT_Info, "Backup pool %s is ready", sctx->url);
+}
+//-----------------------------------------------------------------------------
+//! Handles lines received from a backup pool, without waiting for new data. Called with the slot locked.
+inline void stratum_standby_poll(stratum_standby *slot)
+{
+    stratum_ctx *sctx = &slot->ctx;
+    while ( !sctx->sockbuf.empty() || stratum_wait_line( sctx, 1 ) )
+    {
+        const char *line = NULL;
+        size_t lineSize = 0;
+        if ( !stratum_recv_line_view( sctx, &line, &lineSize ) )
+        {
+            stratum_standby_drop( slot, "connection interrupted" );
+            return;
+        }
+        stratum_handle_line( sctx, line, lineSize );
+    }
+
+    if ( !stratum_check_alive( sctx ) )
+        stratum_standby_drop( slot, "is not responding" );
+}
+//-----------------------------------------------------------------------------
+static void *stratum_standby_thread(void *userdata)
+{
+    while (1)
+    {
+        for (int i = 0; i < stratum_num_standbys; ++i)
+        {
+            stratum_standby *slot = &stratum_standbys[i];
+            pthread_mutex_lock( &slot->lock );
+            if ( slot->ctx.connected )
+                stratum_standby_poll( slot );
+            else if ( getSteadyTimeMs() >= slot->next_attempt_ms )
+                stratum_standby_connect( slot );
+            pthread_mutex_unlock( &slot->lock );
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( STRATUM_STANDBY_POLL_MS ) );
+    }
+    return NULL;
+}
+//-----------------------------------------------------------------------------
+//! Logs the result of a session resumption. Devices kept hashing from (disconnectUs) on.
+inline void stratum_log_resume(bool resumed, uint64_t disconnectUs)
+{
+    static uint32_t numAttempts = 0;
+    static uint32_t numResumed = 0;
+    static double savedIdleSec = 0.0;
+
+    ++numAttempts;
+    if (resumed)
+    {
+        const double idleMs = (double)(getSteadyTimeUs() - disconnectUs) * 0.001;
+        ++numResumed;
+        savedIdleSec += idleMs * 0.001;
+        Log::print(Log::LT_Info, "Stratum session resumed, devices kept hashing for %.1f ms. "
+                   "Resumed %u of %u reconnects, %.1f s of idle time saved",
+                   idleMs, numResumed, numAttempts, savedIdleSec);
+    }
+    else
+        Log::print(Log::LT_Warning, "Stratum session not resumed. Resumed %u of %u reconnects", numResumed, numAttempts);
+}
+//-----------------------------------------------------------------------------
 static void *stratum_thread(void *userdata )
 {
     struct thr_info *mythr = (struct thr_info *) userdata;
-    char *s;
 
     stratum.url = (char*) tq_pop(mythr->q, NULL);
     if (!stratum.url)
@@ -134,6 +296,7 @@ static void *stratum_thread(void *userdata )
     while (1)
     {
         int failures = 0;
+        static uint64_t failbackCheckUs = 0;
 
         if ( stratum_need_reset )
         {
@@ -149,18 +312,40 @@ static void *stratum_thread(void *userdata )
                 Log::print(Log::LT_Debug, "Stratum connection reset");
         }
 
-        while ( !stratum.curl )
+        // devices keep hashing the current job, while the previous session is being resumed
+        bool resuming = !stratum.connected && stratum.session_id && g_work_time;
+        const uint64_t disconnectUs = resuming ? getSteadyTimeUs() : 0;
+        while ( !stratum.connected )
         {
-            pthread_mutex_lock( &g_work_lock );
-            g_work_time = 0;
-            pthread_mutex_unlock( &g_work_lock );
-            restart_threads();
-            if ( !stratum_connect( &stratum, stratum.url )
-                 || !stratum_subscribe( &stratum )
-                 || !stratum_authorize(&stratum, global::connectionInfo.rpc_user.c_str(),
-                                       global::connectionInfo.rpc_pass.c_str())) 
+            // a ready backup takes over without an idle gap
+            if ( stratum_switch_pool( false ) )
+                break;
+
+            if ( !resuming )
+            {
+                pthread_mutex_lock( &g_work_lock );
+                g_work_time = 0;
+                pthread_mutex_unlock( &g_work_lock );
+                restart_threads();
+            }
+            const uint64_t connectUs = getSteadyTimeUs();
+            // devices hash the old job meanwhile, a pool which does not answer quickly is not waited for
+            stratum.handshake_deadline_ms = resuming ? getSteadyTimeMs() + (uint64_t) STRATUM_RESUME_TIMEOUT_SEC * 1000 : 0;
+            const bool ready = stratum_connect( &stratum, stratum.url )
+                               && stratum_subscribe( &stratum )
+                               && stratum_authorize(&stratum, global::connectionInfo.rpc_user.c_str(),
+                                                    global::connectionInfo.rpc_pass.c_str());
+            stratum.handshake_deadline_ms = 0;
+            if ( !ready )
             {
                 stratum_disconnect( &stratum );
+                if ( resuming )
+                {
+                    // stop devices, then retry without a pause
+                    stratum_log_resume( false, disconnectUs );
+                    resuming = false;
+                    continue;
+                }
                 if (global::opt_retries >= 0 && ++failures > global::opt_retries)
                 {
                     Log::print(Log::LT_Error, "...terminating workio thread");
@@ -168,11 +353,40 @@ static void *stratum_thread(void *userdata )
                     goto out;
                 }
                 Log::print(Log::LT_Error, "...retry after %d seconds", global::opt_failPause);
-                sleep(global::opt_failPause);
+                // a backup may become ready meanwhile
+                for (int s = 0; s < global::opt_failPause && !stratum_switch_pool( false ); ++s)
+                    sleep(1);
             }
+            else
+            {
+                if ( resuming )
+                    stratum_log_resume( stratum.session_resumed, disconnectUs );
+                if ( !stratum.session_resumed )
+                {
+                    // extranonce1 changed. Wait for a job of the new session, unless it arrived already.
+                    pthread_mutex_lock( &g_work_lock );
+                    pthread_mutex_lock( &stratum.work_lock );
+                    if ( stratum.job.recv_time_us < connectUs )
+                        stratum.job.job_id[0] = '\0';
+                    pthread_mutex_unlock( &stratum.work_lock );
+                    g_work_time = 0;
+                    stratum_drop_session_work();
+                    pthread_mutex_unlock( &g_work_lock );
+                    if ( resuming )
+                        restart_threads();
+                }
+                stratum_signal_ready( &stratum );
+            }
+        }
+
+        // switch back to a higher priority pool, checked at most once a second
+        if ( stratum.pool_index && getSteadyTimeUs() >= failbackCheckUs )
+        {
+            failbackCheckUs = getSteadyTimeUs() + 1000000;
+            stratum_switch_pool( true );
         }
 
-        if ( stratum.job.job_id && ( !g_work_time || strcmp( stratum.job.job_id, global::g_work.job_id ) ) )
+        if ( stratum.job.job_id[0] && ( !g_work_time || strcmp( stratum.job.job_id, global::g_work.job_id ) ) )
         {
             pthread_mutex_lock(&g_work_lock);
             stratumGenWork( &stratum, &global::g_work );
@@ -180,6 +394,13 @@ static void *stratum_thread(void *userdata )
             pthread_mutex_unlock(&g_work_lock);
             //           restart_threads();
 
+            if (global::opt_debug)
+            {
+                Log::print(Log::LT_Debug, "job %s ready %.1f us after notify(%s)", global::g_work.job_id,
+                           (double)(getSteadyTimeUs() - stratum.job.recv_time_us),
+                           stratum.job.fast_parsed ? "fast parser" : "jansson");
+            }
+
             if (stratum.job.clean)
             {
                 static uint32_t last_block_height;
@@ -200,25 +421,28 @@ static void *stratum_thread(void *userdata )
             }
         }  // stratum.job.job_id
 
-        if ( !stratum_socket_full( &stratum, global::opt_timeout ) )
+        // line is parsed in place, without a copy
+        const char *line = NULL;
+        size_t lineSize = 0;
+        bool received = false;
+        // the wait ends once a second for liveness and fail-back checks. An earlier end is an error.
+        const uint64_t waitStartMs = getSteadyTimeMs();
+        if ( !stratum_socket_full( &stratum, 1 ) )
         {
-            Log::print(Log::LT_Error, "Stratum connection timeout");
-            s = NULL;
+            if ( getSteadyTimeMs() - waitStartMs >= 1000 && stratum_check_alive( &stratum ) )
+                continue;
         }
         else
-            s = stratum_recv_line(&stratum);
+            received = stratum_recv_line_view(&stratum, &line, &lineSize);
 
-        if ( !s )
+        if ( !received )
         {
             stratum_disconnect(&stratum);
             Log::print(Log::LT_Error, "Stratum connection interrupted");
             continue;
         }
 
-        if (!stratum_handle_method(&stratum, s))
-            stratum_handle_response(s);
-
-        free(s);
+        stratum_handle_line(&stratum, line, lineSize);
     }  // loop
 out:
     return NULL;
@@ -239,19 +463,18 @@ static void *workio_thread(void *userdata)
 
     while (ok)
     {
-        workio_cmd *wc;
+        share_record *share;
 
-        // wait for workio_cmd sent to us, on our queue
-        wc = (workio_cmd*) tq_pop(mythr->q, NULL);
-        if (!wc)
+        // wait for a share sent to us, on our queue
+        share = (share_record*) tq_pop(mythr->q, NULL);
+        if (!share)
         {
             ok = false;
             break;
         }
 
-        // process workio_cmd
-        ok = workio_submit_work(wc, curl);
-        workio_cmd_free(wc);
+        ok = workio_submit_work(share, curl);
+        share_record_release(share);
     }
     tq_freeze(mythr->q);
     curl_easy_cleanup(curl);
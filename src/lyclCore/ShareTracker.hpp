@@ -0,0 +1,264 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef ShareTracker_INCLUDE_ONCE
+#define ShareTracker_INCLUDE_ONCE
+
+#include <cstdint>
+#include <cstring>
+#include <strings.h> // strncasecmp
+
+#include <lyclCore/Global.hpp>
+#include <lyclCore/Log.hpp>
+#include <lyclCore/Network.hpp> // getSteadyTimeUs
+#include <lyclCore/Threading.hpp>
+#include <lyclCore/Utils.hpp>
+
+//-----------------------------------------------------------------------------
+// Share tracker.
+// Every mining.submit gets a unique JSON-RPC id. Ids are always 10 digits wide,
+// so they can be patched into a preformatted submit line. Submitted shares wait in
+// an in-flight table until the pool answers. Results are attributed to the device
+// and job, with the submit->ack latency.
+//-----------------------------------------------------------------------------
+//! first share id. Ids 1-3 are used by subscribe, authorize and extranonce.subscribe.
+#define SHARE_ID_FIRST 1000000000u
+#define SHARE_ID_DIGITS 10
+#define SHARE_INFLIGHT 256
+#define SHARE_LATENCY_BUCKETS 8
+#define SHARE_STATS_INTERVAL_SEC 60
+//-----------------------------------------------------------------------------
+enum EShareReject
+{
+    SRJ_Other = 0,
+    SRJ_Stale,
+    SRJ_Duplicate,
+    SRJ_LowDifficulty,
+    SRJ_Count
+};
+//-----------------------------------------------------------------------------
+struct share_inflight
+{
+    //! 0: empty
+    uint32_t id;
+    int thr_id;
+    uint32_t job_ref;
+    uint32_t nonce;
+    uint64_t submit_time_us;
+};
+//-----------------------------------------------------------------------------
+struct share_device_stats
+{
+    uint32_t accepted;
+    uint32_t rejected[SRJ_Count];
+    double latency_sum_ms;
+    double latency_max_ms;
+};
+//-----------------------------------------------------------------------------
+struct share_tracker
+{
+    pthread_mutex_t lock;
+    uint32_t next_id;
+    struct share_inflight inflight[SHARE_INFLIGHT];
+    //! per worker thread
+    struct share_device_stats *device_stats;
+    //! submit->ack latency, see share_latency_bucket_ms()
+    uint32_t latency_histogram[SHARE_LATENCY_BUCKETS];
+    //! responses to shares no longer in the in-flight table
+    uint32_t num_unmatched;
+    uint64_t last_summary_us;
+};
+
+extern share_tracker g_share_tracker;
+//-----------------------------------------------------------------------------
+//! Upper bound of a latency histogram bucket. The last bucket is unbounded.
+inline double share_latency_bucket_ms(int bucket)
+{
+    static const double bounds[SHARE_LATENCY_BUCKETS - 1] = { 10.0, 25.0, 50.0, 100.0, 250.0, 500.0, 1000.0 };
+    return (bucket < SHARE_LATENCY_BUCKETS - 1) ? bounds[bucket] : 0.0;
+}
+//-----------------------------------------------------------------------------
+inline const char *share_reject_name(EShareReject reject)
+{
+    switch (reject)
+    {
+    case SRJ_Stale: return "stale";
+    case SRJ_Duplicate: return "duplicate";
+    case SRJ_LowDifficulty: return "low difficulty";
+    default: return "other";
+    }
+}
+//-----------------------------------------------------------------------------
+inline bool share_reason_contains(const char *reason, const char *word)
+{
+    const size_t size = strlen(word);
+    for (const char *p = reason; *p; ++p)
+    {
+        if (!strncasecmp(p, word, size))
+            return true;
+    }
+    return false;
+}
+//-----------------------------------------------------------------------------
+//! Stratum error codes: 21 job not found, 22 duplicate share, 23 low difficulty share.
+//! Pools disagree on codes, so the reason text is checked too.
+inline EShareReject share_classify_reject(int64_t code, const char *reason)
+{
+    if (code == 21 || (reason && (share_reason_contains(reason, "stale") || share_reason_contains(reason, "job not found"))))
+        return SRJ_Stale;
+    if (code == 22 || (reason && share_reason_contains(reason, "duplicate")))
+        return SRJ_Duplicate;
+    if (code == 23 || (reason && (share_reason_contains(reason, "low diff") || share_reason_contains(reason, "above target"))))
+        return SRJ_LowDifficulty;
+    return SRJ_Other;
+}
+//-----------------------------------------------------------------------------
+inline void share_device_label(int thr_id, char *out_label, size_t size)
+{
+    const lycl::device& clDevice = gthr_info[thr_id].clDevice;
+    if (clDevice.numStreams > 1)
+        snprintf(out_label, size, "#%d.%u", clDevice.deviceIndex, clDevice.streamIndex);
+    else
+        snprintf(out_label, size, "#%d", clDevice.deviceIndex);
+}
+//-----------------------------------------------------------------------------
+inline void share_tracker_init()
+{
+    pthread_mutex_init(&g_share_tracker.lock, NULL);
+    g_share_tracker.next_id = SHARE_ID_FIRST;
+    g_share_tracker.device_stats = (share_device_stats*) calloc(global::numWorkerThreads, sizeof(share_device_stats));
+    g_share_tracker.last_summary_us = getSteadyTimeUs();
+}
+//-----------------------------------------------------------------------------
+//! Writes the id as SHARE_ID_DIGITS decimal digits.
+inline void share_id_format(char *out_digits, uint32_t id)
+{
+    for (int i = SHARE_ID_DIGITS - 1; i >= 0; --i)
+    {
+        out_digits[i] = (char)('0' + id % 10);
+        id /= 10;
+    }
+}
+//-----------------------------------------------------------------------------
+//! Registers a submit and returns its id. An unanswered share SHARE_INFLIGHT submits ago is dropped.
+inline uint32_t share_tracker_submit(int thr_id, uint32_t job_ref, uint32_t nonce)
+{
+    pthread_mutex_lock(&g_share_tracker.lock);
+    const uint32_t id = g_share_tracker.next_id;
+    g_share_tracker.next_id = (id == UINT32_MAX) ? SHARE_ID_FIRST : id + 1;
+
+    share_inflight& share = g_share_tracker.inflight[id % SHARE_INFLIGHT];
+    share.id = id;
+    share.thr_id = thr_id;
+    share.job_ref = job_ref;
+    share.nonce = nonce;
+    share.submit_time_us = getSteadyTimeUs();
+    pthread_mutex_unlock(&g_share_tracker.lock);
+    return id;
+}
+//-----------------------------------------------------------------------------
+//! Removes a share that was not sent.
+inline void share_tracker_cancel(uint32_t id)
+{
+    pthread_mutex_lock(&g_share_tracker.lock);
+    share_inflight& share = g_share_tracker.inflight[id % SHARE_INFLIGHT];
+    if (share.id == id)
+        share.id = 0;
+    pthread_mutex_unlock(&g_share_tracker.lock);
+}
+//-----------------------------------------------------------------------------
+//! Prints per-device results, reject reasons and the latency histogram. Called with the tracker locked.
+inline void share_tracker_log_summary()
+{
+    for (int i = 0; i < global::numWorkerThreads; ++i)
+    {
+        const share_device_stats& stats = g_share_tracker.device_stats[i];
+        uint32_t rejected = 0;
+        for (int r = 0; r < SRJ_Count; ++r)
+            rejected += stats.rejected[r];
+        if (!stats.accepted && !rejected)
+            continue;
+
+        char label[32];
+        share_device_label(i, label, sizeof(label));
+        const uint32_t answered = stats.accepted + rejected;
+        Log::print(Log::LT_Info, "Device %s shares: %u accepted, %u rejected(stale %u, duplicate %u, low difficulty %u, other %u). "
+                   "Latency avg %.1f ms, max %.1f ms",
+                   label, stats.accepted, rejected, stats.rejected[SRJ_Stale], stats.rejected[SRJ_Duplicate],
+                   stats.rejected[SRJ_LowDifficulty], stats.rejected[SRJ_Other],
+                   stats.latency_sum_ms / (double)answered, stats.latency_max_ms);
+    }
+
+    char histogram[256];
+    int size = 0;
+    for (int b = 0; b < SHARE_LATENCY_BUCKETS && size < (int)sizeof(histogram); ++b)
+    {
+        if (b < SHARE_LATENCY_BUCKETS - 1)
+            size += snprintf(histogram + size, sizeof(histogram) - size, "%s<%.0f:%u", b ? " " : "",
+                             share_latency_bucket_ms(b), g_share_tracker.latency_histogram[b]);
+        else
+            size += snprintf(histogram + size, sizeof(histogram) - size, " >=%.0f:%u",
+                             share_latency_bucket_ms(b - 1), g_share_tracker.latency_histogram[b]);
+    }
+    Log::print(Log::LT_Info, "Share latency(ms): %s. Unmatched responses: %u", histogram, g_share_tracker.num_unmatched);
+}
+//-----------------------------------------------------------------------------
+//! Handles a response to a share id. Returns false if (id) is not a share id.
+inline bool share_response(int64_t id, bool accepted, int64_t error_code, const char *reason)
+{
+    if (id < SHARE_ID_FIRST || id > UINT32_MAX)
+        return false;
+
+    const uint64_t nowUs = getSteadyTimeUs();
+    char attribution[96] = { 0 };
+    EShareReject reject = SRJ_Other;
+
+    pthread_mutex_lock(&g_share_tracker.lock);
+    share_inflight& share = g_share_tracker.inflight[id % SHARE_INFLIGHT];
+    if (share.id == (uint32_t)id)
+    {
+        share.id = 0;
+        const double latencyMs = (double)(nowUs - share.submit_time_us) * 0.001;
+        share_device_stats& stats = g_share_tracker.device_stats[share.thr_id];
+        if (accepted)
+            ++stats.accepted;
+        else
+        {
+            reject = share_classify_reject(error_code, reason);
+            ++stats.rejected[reject];
+        }
+        stats.latency_sum_ms += latencyMs;
+        if (latencyMs > stats.latency_max_ms)
+            stats.latency_max_ms = latencyMs;
+
+        int bucket = 0;
+        while (bucket < SHARE_LATENCY_BUCKETS - 1 && latencyMs >= share_latency_bucket_ms(bucket))
+            ++bucket;
+        ++g_share_tracker.latency_histogram[bucket];
+
+        char label[32];
+        share_device_label(share.thr_id, label, sizeof(label));
+        snprintf(attribution, sizeof(attribution), "device %s, nonce %08x, %.1f ms", label, share.nonce, latencyMs);
+    }
+    else
+        ++g_share_tracker.num_unmatched;
+
+    if (nowUs - g_share_tracker.last_summary_us >= (uint64_t)SHARE_STATS_INTERVAL_SEC * 1000000)
+    {
+        share_tracker_log_summary();
+        g_share_tracker.last_summary_us = nowUs;
+    }
+    pthread_mutex_unlock(&g_share_tracker.lock);
+
+    share_result(accepted, attribution[0] ? attribution : NULL, reason, share_reject_name(reject));
+    return true;
+}
+//-----------------------------------------------------------------------------
+
+#endif // !ShareTracker_INCLUDE_ONCE
@@ -10,7 +10,11 @@
  * any later version. See LICENSE for more details.
  */
 
+#include <algorithm>
+#include <string>
+
 #include <lyclCore/Stratum.hpp>
+#include <lyclCore/StratumCapture.hpp>
 
 //-----------------------------------------------------------------------------
 #ifdef _WIN32
@@ -20,163 +24,313 @@
 #endif
 //-----------------------------------------------------------------------------
 stratum_ctx stratum;
+stratum_standby stratum_standbys[STRATUM_MAX_BACKUPS];
+int stratum_num_standbys = 0;
+stratum_capture g_stratum_capture;
+static pthread_mutex_t stratum_ready_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stratum_ready_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t stratum_num_ready = 0;
 //-----------------------------------------------------------------------------
-bool send_line(curl_socket_t sock, char *s)
+//! Timeout of a connect/subscribe/authorize step, capped by stratum_ctx::handshake_deadline_ms.
+static int stratum_handshake_timeout_ms(const struct stratum_ctx *sctx, int default_ms)
+{
+    if (!sctx->handshake_deadline_ms)
+        return default_ms;
+    const uint64_t now = getSteadyTimeMs();
+    if (now >= sctx->handshake_deadline_ms)
+        return 0;
+    return (int) std::min<uint64_t>((uint64_t) default_ms, sctx->handshake_deadline_ms - now);
+}
+//-----------------------------------------------------------------------------
+// Outbox. Lines are never dropped because the socket send buffer is full.
+// They are queued and written as soon as the socket is writable, either by the
+// sending thread or by the stratum thread while it waits for incoming data.
+// A line which was not written within opt_timeout closes the connection.
+//-----------------------------------------------------------------------------
+#define OUTBOX_CHUNK 4096
+//! Time the sending thread waits for write readiness, before leaving the rest to the stratum thread.
+#define SEND_WAIT_MS 1000
+//-----------------------------------------------------------------------------
+// sock_lock must be held
+static void outbox_append(struct stratum_ctx *sctx, const char *s, size_t len)
+{
+    size_t n = sctx->outbox_len + len + 1;
+    if (n > sctx->outbox_size)
+    {
+        sctx->outbox_size = n + (OUTBOX_CHUNK - (n % OUTBOX_CHUNK));
+        sctx->outbox = (char*) realloc(sctx->outbox, sctx->outbox_size);
+    }
+    if (!sctx->outbox_len)
+        sctx->outbox_since_ms = getSteadyTimeMs();
+    memcpy(sctx->outbox + sctx->outbox_len, s, len);
+    sctx->outbox[sctx->outbox_len + len] = '\n';
+    sctx->outbox_len += len + 1;
+}
+//-----------------------------------------------------------------------------
+// sock_lock must be held. Writes as much as the socket accepts without blocking.
+// Returns false on a socket error.
+static bool outbox_flush(struct stratum_ctx *sctx)
 {
     size_t sent = 0;
-    int len;
-
-    len = (int) strlen(s);
-    s[len++] = '\n';
-
-    while (len > 0)
+    while (sent < sctx->outbox_len)
     {
-        struct timeval timeout = {0, 0};
-        int n;
-        fd_set wd;
-
-        FD_ZERO(&wd);
-        FD_SET(sock, &wd);
-        if (select((int) (sock + 1), NULL, &wd, NULL, &timeout) < 1)
-            return false;
-        n = send(sock, s + sent, len, 0);
-        if (n < 0) {
+        int n = send(sctx->sock, sctx->outbox + sent, (int) (sctx->outbox_len - sent), 0);
+        if (n < 0)
+        {
             if (!socket_blocks())
                 return false;
-            n = 0;
+            break;
         }
         sent += n;
-        len -= n;
     }
 
+    if (sent)
+    {
+        memmove(sctx->outbox, sctx->outbox + sent, sctx->outbox_len - sent);
+        sctx->outbox_len -= sent;
+        sctx->outbox_since_ms = getSteadyTimeMs();
+    }
     return true;
 }
 //-----------------------------------------------------------------------------
-bool stratum_send_line(struct stratum_ctx *sctx, char *s)
+//! Called with sock_lock held. Queues the line and writes what the socket accepts without blocking.
+static bool stratum_send_line_locked(struct stratum_ctx *sctx, char *s)
 {
-    bool ret = false;
-
     if (global::opt_protocol)
         Log::print(Log::LT_Debug, "> %s", s);
+    if (g_stratum_capture.file && !sctx->standby)
+        stratum_capture_line('>', s, strlen(s), getSteadyTimeUs());
+
+    if (!sctx->connected)
+        return false;
+
+    outbox_append(sctx, s, strlen(s));
+    return outbox_flush(sctx);
+}
+//-----------------------------------------------------------------------------
+//! Called without sock_lock, so the stratum thread and other senders are not blocked during the wait.
+//! Waits for write readiness until the outbox is empty. Anything left is written by the stratum thread.
+static bool stratum_send_wait(struct stratum_ctx *sctx)
+{
+    const uint64_t deadline = getSteadyTimeMs() + SEND_WAIT_MS;
+    while (1)
+    {
+        pthread_mutex_lock(&sctx->sock_lock);
+        const bool pending = sctx->connected && sctx->outbox_len != 0;
+        const curl_socket_t sock = sctx->sock;
+        pthread_mutex_unlock(&sctx->sock_lock);
+
+        const uint64_t now = getSteadyTimeMs();
+        if (!pending || now >= deadline)
+            return true;
+
+        int revents = socket_wait(sock, POLLOUT, (int) (deadline - now));
+        if (revents < 0 || (revents & (POLLERR | POLLHUP | POLLNVAL)))
+            return false;
+        if (revents)
+        {
+            pthread_mutex_lock(&sctx->sock_lock);
+            // the socket may have been reconnected during the wait
+            const bool ok = sctx->sock != sock || outbox_flush(sctx);
+            pthread_mutex_unlock(&sctx->sock_lock);
+            if (!ok)
+                return false;
+        }
+    }
+}
+//-----------------------------------------------------------------------------
+bool stratum_send_line(struct stratum_ctx *sctx, char *s)
+{
+    pthread_mutex_lock(&sctx->sock_lock);
+    const bool ret = stratum_send_line_locked(sctx, s);
+    pthread_mutex_unlock(&sctx->sock_lock);
 
+    return ret && stratum_send_wait(sctx);
+}
+//-----------------------------------------------------------------------------
+bool stratum_send_share(struct stratum_ctx *sctx, char *s, uint32_t session_gen, bool *out_stale)
+{
     pthread_mutex_lock(&sctx->sock_lock);
-    ret = send_line(sctx->sock, s);
+    // the pool or session may have been swapped after the line was built
+    *out_stale = session_gen != sctx->session_gen;
+    const bool sent = !*out_stale && sctx->session_ready && stratum_send_line_locked(sctx, s);
+    const bool ret = *out_stale || sent;
     pthread_mutex_unlock(&sctx->sock_lock);
 
-    return ret;
+    return ret && (!sent || stratum_send_wait(sctx));
 }
 //-----------------------------------------------------------------------------
-#define RBUFSIZE 2048
-#define RECVSIZE (RBUFSIZE - 4)
-void stratum_buffer_append(struct stratum_ctx *sctx, const char *s)
+bool stratum_wait_line(struct stratum_ctx *sctx, int timeout_ms)
 {
-    size_t old, n;
+    const uint64_t deadline = getSteadyTimeMs() + (uint64_t) timeout_ms;
+    while (1)
+    {
+        pthread_mutex_lock(&sctx->sock_lock);
+        const bool pending = sctx->outbox_len != 0;
+        const uint64_t pendingSince = sctx->outbox_since_ms;
+        const curl_socket_t sock = sctx->sock;
+        pthread_mutex_unlock(&sctx->sock_lock);
+
+        const uint64_t now = getSteadyTimeMs();
+        if (pending && now - pendingSince >= (uint64_t) global::opt_timeout * 1000)
+        {
+            Log::print(Log::LT_Error, "Stratum send timed out");
+            return false;
+        }
+        if (now >= deadline)
+            return false;
+
+        // wake up for the send timeout too
+        int waitMs = (int) (deadline - now);
+        if (pending)
+            waitMs = std::min<int>(waitMs, (int) (pendingSince + (uint64_t) global::opt_timeout * 1000 - now));
 
-    old = strlen(sctx->sockbuf);
-    n = old + strlen(s) + 1;
-    if (n >= sctx->sockbuf_size) {
-        sctx->sockbuf_size = n + (RBUFSIZE - (n % RBUFSIZE));
-        sctx->sockbuf = (char*) realloc(sctx->sockbuf, sctx->sockbuf_size);
+        int revents = socket_wait(sock, POLLIN | (pending ? POLLOUT : 0), waitMs);
+        if (revents < 0)
+            return false;
+        if (revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL))
+            return true;
+        if (revents & POLLOUT)
+        {
+            pthread_mutex_lock(&sctx->sock_lock);
+            bool ok = outbox_flush(sctx);
+            pthread_mutex_unlock(&sctx->sock_lock);
+            if (!ok)
+                return false;
+        }
     }
-    strcpy(sctx->sockbuf + old, s);
 }
 //-----------------------------------------------------------------------------
-char *stratum_recv_line(struct stratum_ctx *sctx)
+// bytes requested from a socket per recv()
+#define RECVSIZE 16384
+//-----------------------------------------------------------------------------
+bool stratum_recv_line_view(struct stratum_ctx *sctx, const char **out_line, size_t *out_size)
 {
-    ssize_t len, buflen;
-    char *tok, *sret = NULL;
+    time_t rstart;
+    time(&rstart);
+    const int timeoutMs = stratum_handshake_timeout_ms(sctx, 60000);
 
-    if (!strstr(sctx->sockbuf, "\n"))
+    while (1)
     {
-        bool ret = true;
-        time_t rstart;
+        if (sctx->sockbuf.nextLine(*out_line, *out_size))
+        {
+            if (!*out_size)
+                continue;
+            if (global::opt_protocol)
+                Log::print(Log::LT_Debug, "< %.*s", (int) *out_size, *out_line);
+            sctx->line_time_us = getSteadyTimeUs();
+            if (g_stratum_capture.file && !sctx->standby)
+                stratum_capture_line('<', *out_line, *out_size, sctx->line_time_us);
+            return true;
+        }
 
-        time(&rstart);
-        if (!socket_full(sctx->sock, 60))
+        const int elapsedMs = (int) (time(NULL) - rstart) * 1000;
+        if (elapsedMs >= timeoutMs || !stratum_wait_line(sctx, timeoutMs - elapsedMs))
         {
             Log::print(Log::LT_Error, "stratum_recv_line timed out");
-            goto out;
+            return false;
         }
-        do
-        {
-            char s[RBUFSIZE];
-            ssize_t n;
-
-            memset(s, 0, RBUFSIZE);
-            n = recv(sctx->sock, s, RECVSIZE, 0);
-            if (!n) {
-                ret = false;
-                break;
-            }
-            if (n < 0)
-            {
-                if (!socket_blocks() || !socket_full(sctx->sock, 1))
-                {
-                    ret = false;
-                    break;
-                }
-            }
-            else
-                stratum_buffer_append(sctx, s);
-
-        } while (time(NULL) - rstart < 60 && !strstr(sctx->sockbuf, "\n"));
 
-        if (!ret)
+        // receive directly into the line buffer
+        ssize_t n = recv(sctx->sock, sctx->sockbuf.prepare(RECVSIZE), RECVSIZE, 0);
+        if (n > 0)
+            sctx->sockbuf.commit((size_t) n);
+        else if (!n || !socket_blocks())
         {
             Log::print(Log::LT_Error, "stratum_recv_line failed");
-            goto out;
+            return false;
         }
     }
+}
+//-----------------------------------------------------------------------------
+char *stratum_recv_line(struct stratum_ctx *sctx)
+{
+    const char *line;
+    size_t size;
+    if (!stratum_recv_line_view(sctx, &line, &size))
+        return NULL;
 
-    buflen = (ssize_t) strlen(sctx->sockbuf);
-    tok = strtok(sctx->sockbuf, "\n");
-    if (!tok)
-    {
-        Log::print(Log::LT_Error, "stratum_recv_line failed to parse a newline-terminated string");
-        goto out;
-    }
-    sret = strdup(tok);
-    len = (ssize_t) strlen(sret);
+    char *sret = (char*) malloc(size + 1);
+    memcpy(sret, line, size);
+    sret[size] = '\0';
+    return sret;
+}
+//-----------------------------------------------------------------------------
+// Splits "stratum+tcp://host:port" or "stratum+tcp://[ipv6]:port".
+static bool stratum_parse_url(const char *url, std::string& out_host, std::string& out_port)
+{
+    const char *p = strstr(url, "://");
+    std::string hostPort = p ? p + 3 : url;
+    hostPort = hostPort.substr(0, hostPort.find('/'));
 
-    if (buflen > len + 1)
-        memmove(sctx->sockbuf, sctx->sockbuf + len + 1, buflen - len + 1);
-    else
-        sctx->sockbuf[0] = '\0';
+    size_t portSeparator = hostPort.rfind(':');
+    if (portSeparator == std::string::npos || portSeparator + 1 == hostPort.size())
+        return false;
+    if (hostPort[0] == '[' && hostPort.find(']') > portSeparator)
+        return false;
 
-out:
-    if (sret && global::opt_protocol)
-        Log::print(Log::LT_Debug, "< %s", sret);
-    return sret;
+    out_port = hostPort.substr(portSeparator + 1);
+    out_host = hostPort.substr(0, portSeparator);
+    if (out_host.size() > 1 && out_host[0] == '[')
+        out_host = out_host.substr(1, out_host.size() - 2);
+    return !out_host.empty();
 }
 //-----------------------------------------------------------------------------
+// Direct connections use a non-blocking connect. Proxied connections are opened
+// by curl(CONNECT_ONLY), which implements HTTP and SOCKS proxies.
+// The socket is non-blocking in both cases.
 bool stratum_connect(struct stratum_ctx *sctx, const char *url)
 {
     CURL *curl;
     int rc;
 
+    stratum_disconnect(sctx);
+
     pthread_mutex_lock(&sctx->sock_lock);
-    if (sctx->curl)
-        curl_easy_cleanup(sctx->curl);
-    sctx->curl = curl_easy_init();
-    if (!sctx->curl)
-    {
-        Log::print(Log::LT_Error, "CURL initialization failed");
-        pthread_mutex_unlock(&sctx->sock_lock);
-        return false;
-    }
-    curl = sctx->curl;
-    if (!sctx->sockbuf)
-    {
-        sctx->sockbuf = (char*) calloc(RBUFSIZE, 1);
-        sctx->sockbuf_size = RBUFSIZE;
-    }
-    sctx->sockbuf[0] = '\0';
+    sctx->sockbuf.clear();
+    sctx->outbox_len = 0;
+    // liveness is measured from the connection
+    sctx->line_time_us = getSteadyTimeUs();
+    sctx->probe_sent_us = 0;
+    sctx->probe_support = 0;
+    sctx->session_ready = false;
     pthread_mutex_unlock(&sctx->sock_lock);
     if (url != sctx->url)
     {
         free(sctx->url);
         sctx->url = strdup(url);
     }
+
+    if (!opt_proxy)
+    {
+        std::string host, port;
+        if (!stratum_parse_url(url, host, port))
+        {
+            Log::print(Log::LT_Error, "Stratum connection failed: invalid url %s", url);
+            return false;
+        }
+
+        curl_socket_t sock = socket_connect_nonblocking(host.c_str(), port.c_str(), stratum_handshake_timeout_ms(sctx, 30000),
+                                                        sctx->curl_err_str, sizeof(sctx->curl_err_str));
+        if (sock == CURL_SOCKET_BAD)
+        {
+            Log::print(Log::LT_Error, "Stratum connection failed: %s", sctx->curl_err_str);
+            return false;
+        }
+
+        pthread_mutex_lock(&sctx->sock_lock);
+        sctx->sock = sock;
+        sctx->connected = true;
+        pthread_mutex_unlock(&sctx->sock_lock);
+        return true;
+    }
+
+    curl = curl_easy_init();
+    if (!curl)
+    {
+        Log::print(Log::LT_Error, "CURL initialization failed");
+        return false;
+    }
     free(sctx->curl_url);
     sctx->curl_url = (char*) malloc(strlen(url));
     sprintf(sctx->curl_url, "http%s", strstr(url, "://"));
@@ -185,7 +339,7 @@ bool stratum_connect(struct stratum_ctx *sctx, const char *url)
         curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
     curl_easy_setopt(curl, CURLOPT_URL, sctx->curl_url);
     curl_easy_setopt(curl, CURLOPT_FRESH_CONNECT, 1);
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long) std::max(stratum_handshake_timeout_ms(sctx, 30000), 1));
     curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, sctx->curl_err_str);
     curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
     curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1);
@@ -198,9 +352,10 @@ bool stratum_connect(struct stratum_ctx *sctx, const char *url)
 #if LIBCURL_VERSION_NUM >= 0x070f06
     curl_easy_setopt(curl, CURLOPT_SOCKOPTFUNCTION, sockopt_keepalive_cb);
 #endif
+    curl_socket_t sock = CURL_SOCKET_BAD;
 #if LIBCURL_VERSION_NUM >= 0x071101
     curl_easy_setopt(curl, CURLOPT_OPENSOCKETFUNCTION, opensocket_grab_cb);
-    curl_easy_setopt(curl, CURLOPT_OPENSOCKETDATA, &sctx->sock);
+    curl_easy_setopt(curl, CURLOPT_OPENSOCKETDATA, &sock);
 #endif
     curl_easy_setopt(curl, CURLOPT_CONNECT_ONLY, 1);
 
@@ -209,18 +364,113 @@ bool stratum_connect(struct stratum_ctx *sctx, const char *url)
     {
         Log::print(Log::LT_Error, "Stratum connection failed: %s", sctx->curl_err_str);
         curl_easy_cleanup(curl);
-        sctx->curl = NULL;
         return false;
     }
 
 #if LIBCURL_VERSION_NUM < 0x071101
     // CURLINFO_LASTSOCKET is broken on Win64; only use it as a last resort
-    curl_easy_getinfo(curl, CURLINFO_LASTSOCKET, (long *)&sctx->sock);
+    curl_easy_getinfo(curl, CURLINFO_LASTSOCKET, (long *)&sock);
 #endif
+    socket_set_nonblocking(sock);
+
+    pthread_mutex_lock(&sctx->sock_lock);
+    sctx->curl = curl;
+    sctx->sock = sock;
+    sctx->connected = true;
+    pthread_mutex_unlock(&sctx->sock_lock);
 
     return true;
 }
 //-----------------------------------------------------------------------------
+uint32_t stratum_get_num_ready()
+{
+    pthread_mutex_lock(&stratum_ready_lock);
+    const uint32_t num_ready = stratum_num_ready;
+    pthread_mutex_unlock(&stratum_ready_lock);
+    return num_ready;
+}
+//-----------------------------------------------------------------------------
+void stratum_signal_ready(struct stratum_ctx *sctx)
+{
+    pthread_mutex_lock(&sctx->sock_lock);
+    sctx->session_ready = true;
+    pthread_mutex_unlock(&sctx->sock_lock);
+
+    pthread_mutex_lock(&stratum_ready_lock);
+    ++stratum_num_ready;
+    pthread_cond_broadcast(&stratum_ready_cond);
+    pthread_mutex_unlock(&stratum_ready_lock);
+}
+//-----------------------------------------------------------------------------
+bool stratum_wait_ready(uint32_t num_ready, int timeout_ms)
+{
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&stratum_ready_lock);
+    while (stratum_num_ready == num_ready)
+    {
+        if (pthread_cond_timedwait(&stratum_ready_cond, &stratum_ready_lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+    const bool ready = stratum_num_ready != num_ready;
+    pthread_mutex_unlock(&stratum_ready_lock);
+    return ready;
+}
+//-----------------------------------------------------------------------------
+void stratum_swap(struct stratum_ctx *a, struct stratum_ctx *b)
+{
+    pthread_mutex_lock(&a->sock_lock);
+    pthread_mutex_lock(&b->sock_lock);
+    pthread_mutex_lock(&a->work_lock);
+    pthread_mutex_lock(&b->work_lock);
+
+    std::swap(a->url, b->url);
+    std::swap(a->curl, b->curl);
+    std::swap(a->curl_url, b->curl_url);
+    std::swap(a->curl_err_str, b->curl_err_str);
+    std::swap(a->sock, b->sock);
+    std::swap(a->connected, b->connected);
+    std::swap(a->sockbuf, b->sockbuf);
+    std::swap(a->outbox_size, b->outbox_size);
+    std::swap(a->outbox_len, b->outbox_len);
+    std::swap(a->outbox, b->outbox);
+    std::swap(a->outbox_since_ms, b->outbox_since_ms);
+    std::swap(a->line_time_us, b->line_time_us);
+    std::swap(a->probe_sent_us, b->probe_sent_us);
+    std::swap(a->probe_support, b->probe_support);
+    std::swap(a->next_diff, b->next_diff);
+    std::swap(a->sharediff, b->sharediff);
+    std::swap(a->session_id, b->session_id);
+    std::swap(a->session_resumed, b->session_resumed);
+    std::swap(a->session_ready, b->session_ready);
+    std::swap(a->xnonce1_size, b->xnonce1_size);
+    std::swap(a->xnonce1, b->xnonce1);
+    std::swap(a->xnonce2_size, b->xnonce2_size);
+    std::swap(a->job, b->job);
+    std::swap(a->work, b->work);
+    std::swap(a->block_height, b->block_height);
+    std::swap(a->pool_index, b->pool_index);
+    // lines built for the previous connection of either context must not be sent
+    ++a->session_gen;
+    ++b->session_gen;
+    const uint64_t readyTimeUs = a->ready_time_us;
+    a->ready_time_us = b->ready_time_us;
+    b->ready_time_us = readyTimeUs;
+
+    pthread_mutex_unlock(&b->work_lock);
+    pthread_mutex_unlock(&a->work_lock);
+    pthread_mutex_unlock(&b->sock_lock);
+    pthread_mutex_unlock(&a->sock_lock);
+}
+//-----------------------------------------------------------------------------
 const char *get_stratum_session_id(json_t *val)
 {
     json_t *arr_val;
@@ -298,7 +548,7 @@ bool stratum_subscribe(struct stratum_ctx *sctx)
     const char *sid;
     json_t *val = NULL, *res_val, *err_val;
     json_error_t err;
-    bool ret = false, retry = false;
+    bool ret = false, retry = false, resumed = false;
 
 start:
     s = (char*) malloc(128 + (sctx->session_id ? strlen(sctx->session_id) : 0));
@@ -315,7 +565,7 @@ start:
         goto out;
     }
 
-    if (!socket_full(sctx->sock, 30))
+    if (socket_wait(sctx->sock, POLLIN, stratum_handshake_timeout_ms(sctx, 30000)) <= 0)
     {
         Log::print(Log::LT_Error, "stratum_subscribe timed out");
         goto out;
@@ -355,13 +605,26 @@ start:
     if (global::opt_debug && sid)
         Log::print(Log::LT_Debug, "Stratum session id: %s", sid);
 
+    // the session is resumed, if the pool confirmed the previous id and kept the extranonce
+    resumed = false;
+    if (!retry && sid && sctx->session_id && !strcmp(sid, sctx->session_id) && sctx->xnonce1)
+    {
+        const char *xnonce1 = json_string_value(json_array_get(res_val, 1));
+        char *prev_xnonce1 = abin2hex(sctx->xnonce1, sctx->xnonce1_size);
+        resumed = xnonce1 && prev_xnonce1 && !strcasecmp(xnonce1, prev_xnonce1) &&
+                  json_integer_value(json_array_get(res_val, 2)) == (json_int_t) sctx->xnonce2_size;
+        free(prev_xnonce1);
+    }
+
     pthread_mutex_lock(&sctx->work_lock);
 
     if (sctx->session_id)
         free(sctx->session_id);
 
     sctx->session_id = sid ? strdup(sid) : NULL;
-    sctx->next_diff = 1.0;
+    // a resumed session keeps its difficulty
+    if (!resumed)
+        sctx->next_diff = 1.0;
     pthread_mutex_unlock(&sctx->work_lock);
 
     // sid is param 1, extranonce params are 2 and 3
@@ -376,6 +639,9 @@ out:
     free(s);
     if (val)
         json_decref(val);
+    sctx->session_resumed = ret && resumed;
+    if (!sctx->session_resumed)
+        stratum_new_session(sctx);
 
     if (!ret)
     {
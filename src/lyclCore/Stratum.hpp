@@ -19,22 +19,48 @@
 #include <jansson.h> // JSON
 #include <lyclCore/Threading.hpp>
 #include <lyclCore/Network.hpp>
+#include <lyclCore/LineBuffer.hpp>
+#include <lyclCore/ShareTracker.hpp>
+#include <lyclCore/StratumParser.hpp>
 #include <lyclCore/Utils.hpp>
 
+#define STRATUM_MAX_JOB_ID 128
+//! max number of backup pools, <Connection1>...<Connection4>
+#define STRATUM_MAX_BACKUPS 4
+//! a higher priority pool must stay ready for this long, before the miner switches back to it
+#define STRATUM_FAILBACK_SEC 60
+//! time the standby thread sleeps between polls of backup connections
+#define STRATUM_STANDBY_POLL_MS 250
+//! id of keepalive probes. 1-3 are used by subscribe, authorize and extranonce.subscribe.
+#define STRATUM_PROBE_ID 4
+//! a pool is probed after this many seconds without a line
+#define STRATUM_PROBE_IDLE_SEC 15
+//! a pool which answers probes is considered dead, if it stays silent this long after a probe
+#define STRATUM_PROBE_TIMEOUT_SEC 5
+//! a session resumption(connect, subscribe and authorize) gives up after this long. Devices hash meanwhile.
+#define STRATUM_RESUME_TIMEOUT_SEC 5
+
+// Buffers are reused by every notify. coinbase only grows.
 struct stratum_job
 {
-    char *job_id;
+    // empty until the first notify
+    char job_id[STRATUM_MAX_JOB_ID];
     unsigned char prevhash[32];
     size_t coinbase_size;
+    size_t coinbase_capacity;
     unsigned char *coinbase;
     unsigned char *xnonce2;
     int merkle_count;
-    unsigned char **merkle;
+    unsigned char merkle[STRATUM_MAX_MERKLE][32];
     unsigned char version[4];
     unsigned char nbits[4];
     unsigned char ntime[4];
     bool clean;
     double diff;
+    // time the notify line was received, see getSteadyTimeUs()
+    uint64_t recv_time_us;
+    // parsed by parseStratumMessage(), otherwise by jansson
+    bool fast_parsed;
 };
 
 struct stratum_ctx
@@ -45,14 +71,36 @@ struct stratum_ctx
     char *curl_url;
     char curl_err_str[CURL_ERROR_SIZE];
     curl_socket_t sock;
-    size_t sockbuf_size;
-    char *sockbuf;
+    bool connected;
+    // received data. Lines are parsed in place, see stratum_recv_line_view().
+    LineBuffer sockbuf;
+    // outgoing lines not accepted by the socket yet. Written when the socket becomes writable.
+    size_t outbox_size;
+    size_t outbox_len;
+    char *outbox;
+    // time of the oldest unsent byte in the outbox
+    uint64_t outbox_since_ms;
+    // time the last line was returned by stratum_recv_line_view(), see getSteadyTimeUs()
+    uint64_t line_time_us;
+    // time the outstanding keepalive probe was sent, 0 if there is none. See stratum_check_alive().
+    uint64_t probe_sent_us;
+    // 1: the pool answers probes, -1: it ignores them, 0: not known yet
+    int probe_support;
+    // subscribed and authorized, see stratum_signal_ready(). Shares wait for it. Protected by sock_lock.
+    bool session_ready;
+    // changed by stratum_swap() and by every session which is not resumed. Protected by sock_lock, not swapped.
+    // Shares are sent only to the session their job came from, see stratum_send_share().
+    uint32_t session_gen;
     pthread_mutex_t sock_lock;
 
     double next_diff;
     double sharediff;
 
     char *session_id;
+    // the last mining.subscribe resumed the previous session, see stratum_subscribe()
+    bool session_resumed;
+    // connect, subscribe and authorize give up at this time, see getSteadyTimeMs(). 0: default timeouts.
+    uint64_t handshake_deadline_ms;
     size_t xnonce1_size;
     unsigned char *xnonce1;
     size_t xnonce2_size;
@@ -61,17 +109,45 @@ struct stratum_ctx
     pthread_mutex_t work_lock;
 
     uint32_t block_height;
+
+    // index into global::poolConnectionInfo
+    int pool_index;
+    // backup connection maintained by stratum_standby_thread(). Does not touch global state.
+    bool standby;
+    // time the backup connection was subscribed and authorized, 0 if it is not ready. See getSteadyTimeUs().
+    volatile uint64_t ready_time_us;
 };
 
 extern stratum_ctx stratum;
 
+// Hot-standby backup pool. Connections are moved between the active context(stratum)
+// and standby slots by stratum_swap(), slots stay in place.
+struct stratum_standby
+{
+    // held by the standby thread while it works on the connection
+    pthread_mutex_t lock;
+    struct stratum_ctx ctx;
+    // next connection attempt, see getSteadyTimeMs()
+    uint64_t next_attempt_ms;
+};
+
+extern stratum_standby stratum_standbys[STRATUM_MAX_BACKUPS];
+extern int stratum_num_standbys;
+
 
 #define RBUFSIZE 2048
 
 
+//-----------------------------------------------------------------------------
+// Any answer to a probe, an error too, proves the session is alive.
+inline void stratum_probe_answered(struct stratum_ctx *sctx)
+{
+    sctx->probe_sent_us = 0;
+    sctx->probe_support = 1;
+}
 //-----------------------------------------------------------------------------
 // helper method
-inline bool stratumHandleResponse(json_t* val)
+inline bool stratumHandleResponse(struct stratum_ctx *sctx, json_t* val)
 {
     bool valid = false;
     json_t *err_val, *res_val, *id_val;
@@ -79,21 +155,25 @@ inline bool stratumHandleResponse(json_t* val)
     err_val = json_object_get( val, "error" );
     id_val  = json_object_get( val, "id" );
 
-    if ( !res_val || json_integer_value(id_val) < 4 )
+    if ( json_integer_value(id_val) == STRATUM_PROBE_ID )
+    {
+        stratum_probe_answered( sctx );
+        return true;
+    }
+    if ( !res_val )
          return false;
     valid = json_is_true( res_val );
-    share_result(valid, NULL, err_val ?
-                 json_string_value( json_array_get(err_val, 1) ) : NULL );
-    return true;
+    return share_response( json_integer_value(id_val), valid, json_integer_value( json_array_get(err_val, 0) ),
+                           err_val ? json_string_value( json_array_get(err_val, 1) ) : NULL );
 }
 //-----------------------------------------------------------------------------
-inline bool stratum_handle_response( char *buf )
+inline bool stratum_handle_response( struct stratum_ctx *sctx, const char *buf, size_t size )
 {
     json_t *val, *id_val;
     json_error_t err;
     bool ret = false;
 
-    val = json_loads(buf, 0, &err);
+    val = json_loadb(buf, size, 0, &err);
     if (!val)
     {
         Log::print(Log::LT_Info, "JSON decode failed(%d): %s", err.line, err.text);
@@ -104,7 +184,7 @@ inline bool stratum_handle_response( char *buf )
     if ( !id_val || json_is_null(id_val) )
         goto out;
 
-    if ( !stratumHandleResponse( val ) )
+    if ( !stratumHandleResponse( sctx, val ) )
         goto out;
 
     ret = true;
@@ -116,37 +196,114 @@ out:
 //-----------------------------------------------------------------------------
 bool stratum_send_line(struct stratum_ctx *sctx, char *s);
 //-----------------------------------------------------------------------------
-static bool socket_full(curl_socket_t sock, int timeout)
+//! Sends a share line, if the active session is still (session_gen). Otherwise sets (out_stale)
+//! and returns true without sending. Checked under sock_lock, so a pool swap can't come in between.
+//! Returns false while the session is not ready, see stratum_wait_ready().
+bool stratum_send_share(struct stratum_ctx *sctx, char *s, uint32_t session_gen, bool *out_stale);
+//-----------------------------------------------------------------------------
+//! Shares built for the previous session are not sent after this.
+inline void stratum_new_session(struct stratum_ctx *sctx)
 {
-    struct timeval tv;
-    fd_set rd;
-
-    FD_ZERO(&rd);
-    FD_SET(sock, &rd);
-    tv.tv_sec = timeout;
-    tv.tv_usec = 0;
-    if (select((int)(sock + 1), &rd, NULL, NULL, &tv) > 0)
-        return true;
-    return false;
+    pthread_mutex_lock(&sctx->sock_lock);
+    ++sctx->session_gen;
+    pthread_mutex_unlock(&sctx->sock_lock);
+}
+//-----------------------------------------------------------------------------
+inline uint32_t stratum_get_session_gen(struct stratum_ctx *sctx)
+{
+    pthread_mutex_lock(&sctx->sock_lock);
+    const uint32_t session_gen = sctx->session_gen;
+    pthread_mutex_unlock(&sctx->sock_lock);
+    return session_gen;
 }
 //-----------------------------------------------------------------------------
+bool stratum_wait_line(struct stratum_ctx *sctx, int timeout_ms);
+//-----------------------------------------------------------------------------
 inline bool stratum_socket_full(struct stratum_ctx *sctx, int timeout)
 {
-    return strlen(sctx->sockbuf) || socket_full(sctx->sock, timeout);
+    return !sctx->sockbuf.empty() || stratum_wait_line(sctx, timeout * 1000);
 }
 //-----------------------------------------------------------------------------
+// Application level liveness check. Called about once a second while the pool is silent.
+// A pool silent for STRATUM_PROBE_IDLE_SEC gets a probe. Pools which answered a probe before
+// and stay silent after a new one are dead. Pools which ignore probes are only dropped
+// after opt_timeout without a line. Returns false if the session looks dead.
+inline bool stratum_check_alive(struct stratum_ctx *sctx)
+{
+    const uint64_t nowUs = getSteadyTimeUs();
+    if (sctx->probe_sent_us && nowUs - sctx->probe_sent_us >= (uint64_t) STRATUM_PROBE_TIMEOUT_SEC * 1000000)
+    {
+        const bool silent = sctx->line_time_us < sctx->probe_sent_us;
+        sctx->probe_sent_us = 0;
+        if (silent && sctx->probe_support > 0)
+        {
+            Log::print(Log::LT_Error, "Stratum keepalive probe of %s not answered in %d seconds",
+                       sctx->url, STRATUM_PROBE_TIMEOUT_SEC);
+            return false;
+        }
+        if (!sctx->probe_support)
+        {
+            sctx->probe_support = -1;
+            if (global::opt_debug)
+                Log::print(Log::LT_Debug, "%s does not answer keepalive probes", sctx->url);
+        }
+    }
+    else if (!sctx->probe_sent_us && sctx->probe_support >= 0 &&
+             nowUs - sctx->line_time_us >= (uint64_t) STRATUM_PROBE_IDLE_SEC * 1000000)
+    {
+        // an unknown method is fine, an error answer proves liveness too
+        char probe[64];
+        snprintf(probe, sizeof(probe), "{\"id\": %d, \"method\": \"mining.ping\", \"params\": []}", STRATUM_PROBE_ID);
+        sctx->probe_sent_us = nowUs;
+        if (!stratum_send_line(sctx, probe))
+            return false;
+    }
+
+    if (nowUs - sctx->line_time_us >= (uint64_t) global::opt_timeout * 1000000)
+    {
+        Log::print(Log::LT_Error, "Stratum connection timeout");
+        return false;
+    }
+    return true;
+}
+//-----------------------------------------------------------------------------
+//! Receives the next non-empty line. (out_line) points into the receive buffer
+//! and is valid until the next call. Not zero terminated.
+bool stratum_recv_line_view(struct stratum_ctx *sctx, const char **out_line, size_t *out_size);
+//-----------------------------------------------------------------------------
+//! Same as stratum_recv_line_view(), but returns a malloc'd copy.
 char *stratum_recv_line(struct stratum_ctx *sctx);
 //-----------------------------------------------------------------------------
 bool stratum_connect(struct stratum_ctx *sctx, const char *url);
 //-----------------------------------------------------------------------------
+// Session readiness. Threads which could not send a line wait for the next
+// subscribed and authorized session of the active pool, instead of a fixed pause.
+//-----------------------------------------------------------------------------
+//! Number of sessions which became ready so far. Pass it to stratum_wait_ready().
+uint32_t stratum_get_num_ready();
+//! Called by the stratum thread when the active pool(sctx) is ready, after a (re)connect or a switch.
+void stratum_signal_ready(struct stratum_ctx *sctx);
+//! Waits until a session after (num_ready) is ready, at most (timeout_ms). Returns false on timeout.
+bool stratum_wait_ready(uint32_t num_ready, int timeout_ms);
+//-----------------------------------------------------------------------------
+//! Exchanges connections and jobs of two contexts. Locks and the standby flag stay in place.
+void stratum_swap(struct stratum_ctx *a, struct stratum_ctx *b);
+//-----------------------------------------------------------------------------
 inline void stratum_disconnect(struct stratum_ctx *sctx)
 {
     pthread_mutex_lock(&sctx->sock_lock);
-    if (sctx->curl)
+    if (sctx->connected)
     {
-        curl_easy_cleanup(sctx->curl);
+        // curl owns the socket of a proxied connection
+        if (sctx->curl)
+            curl_easy_cleanup(sctx->curl);
+        else
+            socket_close(sctx->sock);
         sctx->curl = NULL;
-        sctx->sockbuf[0] = '\0';
+        sctx->sock = CURL_SOCKET_BAD;
+        sctx->connected = false;
+        sctx->sockbuf.clear();
+        sctx->outbox_len = 0;
     }
     pthread_mutex_unlock(&sctx->sock_lock);
 }
@@ -187,101 +344,114 @@ static uint32_t getBlockHeight(struct stratum_ctx *sctx)
     return height;
 }
 //-----------------------------------------------------------------------------
-static bool stratum_notify(struct stratum_ctx *sctx, json_t *params)
+inline bool stratum_is_hex(const StratumStringView& view)
 {
-    const char *job_id, *prevhash, *coinb1, *coinb2, *version, *nbits, *stime;
-    size_t coinb1_size, coinb2_size;
-    bool clean, ret = false;
-    int merkle_count, i, p = 0;
-    json_t *merkle_arr;
-    unsigned char **merkle = NULL;
-
-
-    job_id = json_string_value(json_array_get(params, p++));
-    prevhash = json_string_value(json_array_get(params, p++));
-    coinb1 = json_string_value(json_array_get(params, p++));
-    coinb2 = json_string_value(json_array_get(params, p++));
-    merkle_arr = json_array_get(params, p++);
-    if (!merkle_arr || !json_is_array(merkle_arr))
-    goto out;
-    merkle_count = (int) json_array_size(merkle_arr);
-    version = json_string_value(json_array_get(params, p++));
-    nbits = json_string_value(json_array_get(params, p++));
-    stime = json_string_value(json_array_get(params, p++));
-    clean = json_is_true(json_array_get(params, p)); p++;
-
-    if (!job_id || !prevhash || !coinb1 || !coinb2 || !version || !nbits || !stime ||
-        strlen(prevhash) != 64 || strlen(version) != 8 ||
-        strlen(nbits) != 8 || strlen(stime) != 8)
+    return hexIsValid(view.data, view.size);
+}
+//-----------------------------------------------------------------------------
+// Validates and decodes notify parameters straight into sctx->job. Shared by the fast parser and jansson.
+inline bool stratum_apply_notify(struct stratum_ctx *sctx, const StratumNotifyParams& params, bool fast_parsed)
+{
+    if (!params.jobId.size || params.jobId.size >= STRATUM_MAX_JOB_ID ||
+        params.prevhash.size != 64 || params.version.size != 8 ||
+        params.nbits.size != 8 || params.ntime.size != 8 ||
+        (params.coinb1.size & 1) || (params.coinb2.size & 1) ||
+        !stratum_is_hex(params.prevhash) || !stratum_is_hex(params.coinb1) || !stratum_is_hex(params.coinb2) ||
+        !stratum_is_hex(params.version) || !stratum_is_hex(params.nbits) || !stratum_is_hex(params.ntime))
     {
         Log::print(Log::LT_Error, "Stratum notify: invalid parameters");
-        goto out;
+        return false;
     }
-
-    merkle = (unsigned char**) malloc(merkle_count * sizeof(char *));
-    for (i = 0; i < merkle_count; i++)
+    for (int i = 0; i < params.merkleCount; i++)
     {
-        const char *s = json_string_value(json_array_get(merkle_arr, i));
-        if (!s || strlen(s) != 64)
+        if (params.merkle[i].size != 64 || !stratum_is_hex(params.merkle[i]))
         {
-            while (i--)
-                free(merkle[i]);
-            free(merkle);
             Log::print(Log::LT_Error, "Stratum notify: invalid Merkle branch");
-            goto out;
+            return false;
         }
-        merkle[i] = (unsigned char*) malloc(32);
-        hex2bin(merkle[i], s, 32);
     }
 
+    const uint64_t recvTimeUs = sctx->line_time_us ? sctx->line_time_us : getSteadyTimeUs();
     pthread_mutex_lock(&sctx->work_lock);
 
-    coinb1_size = strlen(coinb1) / 2;
-    coinb2_size = strlen(coinb2) / 2;
+    size_t coinb1_size = params.coinb1.size / 2;
+    size_t coinb2_size = params.coinb2.size / 2;
     sctx->job.coinbase_size = coinb1_size + sctx->xnonce1_size +
               sctx->xnonce2_size + coinb2_size;
-    sctx->job.coinbase = (unsigned char*) realloc(sctx->job.coinbase, sctx->job.coinbase_size);
+    if (sctx->job.coinbase_size > sctx->job.coinbase_capacity)
+    {
+        sctx->job.coinbase = (unsigned char*) realloc(sctx->job.coinbase, sctx->job.coinbase_size);
+        sctx->job.coinbase_capacity = sctx->job.coinbase_size;
+    }
     sctx->job.xnonce2 = sctx->job.coinbase + coinb1_size + sctx->xnonce1_size;
-    hex2bin(sctx->job.coinbase, coinb1, coinb1_size);
+    hexDecode(sctx->job.coinbase, params.coinb1.data, coinb1_size);
     memcpy(sctx->job.coinbase + coinb1_size, sctx->xnonce1, sctx->xnonce1_size);
 
-    if (!sctx->job.job_id || strcmp(sctx->job.job_id, job_id))
+    if (strlen(sctx->job.job_id) != params.jobId.size || memcmp(sctx->job.job_id, params.jobId.data, params.jobId.size))
         memset(sctx->job.xnonce2, 0, sctx->xnonce2_size);
 
-    hex2bin(sctx->job.xnonce2 + sctx->xnonce2_size, coinb2, coinb2_size);
-    free(sctx->job.job_id);
-    sctx->job.job_id = strdup(job_id);
-    hex2bin(sctx->job.prevhash, prevhash, 32);
+    hexDecode(sctx->job.xnonce2 + sctx->xnonce2_size, params.coinb2.data, coinb2_size);
+    memcpy(sctx->job.job_id, params.jobId.data, params.jobId.size);
+    sctx->job.job_id[params.jobId.size] = '\0';
+    hexDecode(sctx->job.prevhash, params.prevhash.data, 32);
 
     sctx->block_height = getBlockHeight(sctx);
 
-    for (i = 0; i < sctx->job.merkle_count; i++)
-        free(sctx->job.merkle[i]);
+    for (int i = 0; i < params.merkleCount; i++)
+        hexDecode(sctx->job.merkle[i], params.merkle[i].data, 32);
+    sctx->job.merkle_count = params.merkleCount;
 
-    free(sctx->job.merkle);
-    sctx->job.merkle = merkle;
-    sctx->job.merkle_count = merkle_count;
-
-    hex2bin(sctx->job.version, version, 4);
-    hex2bin(sctx->job.nbits, nbits, 4);
-    hex2bin(sctx->job.ntime, stime, 4);
-    sctx->job.clean = clean;
+    hexDecode(sctx->job.version, params.version.data, 4);
+    hexDecode(sctx->job.nbits, params.nbits.data, 4);
+    hexDecode(sctx->job.ntime, params.ntime.data, 4);
+    sctx->job.clean = params.clean;
 
     sctx->job.diff = sctx->next_diff;
+    sctx->job.recv_time_us = recvTimeUs;
+    sctx->job.fast_parsed = fast_parsed;
 
     pthread_mutex_unlock(&sctx->work_lock);
 
-    ret = true;
-
-out:
-    return ret;
+    return true;
 }
 //-----------------------------------------------------------------------------
-static bool stratum_set_difficulty(struct stratum_ctx *sctx, json_t *params)
+inline void stratum_json_string_view(json_t *val, StratumStringView& out_view)
 {
-    double diff;
+    out_view.data = json_string_value(val);
+    out_view.size = out_view.data ? strlen(out_view.data) : 0;
+}
+//-----------------------------------------------------------------------------
+static bool stratum_notify(struct stratum_ctx *sctx, json_t *params)
+{
+    StratumNotifyParams notify;
+    json_t *merkle_arr;
+    int p = 0;
 
-    diff = json_number_value(json_array_get(params, 0));
+    stratum_json_string_view(json_array_get(params, p++), notify.jobId);
+    stratum_json_string_view(json_array_get(params, p++), notify.prevhash);
+    stratum_json_string_view(json_array_get(params, p++), notify.coinb1);
+    stratum_json_string_view(json_array_get(params, p++), notify.coinb2);
+    merkle_arr = json_array_get(params, p++);
+    if (!merkle_arr || !json_is_array(merkle_arr))
+        return false;
+    if (json_array_size(merkle_arr) > STRATUM_MAX_MERKLE)
+    {
+        Log::print(Log::LT_Error, "Stratum notify: invalid Merkle branch");
+        return false;
+    }
+    notify.merkleCount = (int) json_array_size(merkle_arr);
+    for (int i = 0; i < notify.merkleCount; i++)
+        stratum_json_string_view(json_array_get(merkle_arr, i), notify.merkle[i]);
+    stratum_json_string_view(json_array_get(params, p++), notify.version);
+    stratum_json_string_view(json_array_get(params, p++), notify.nbits);
+    stratum_json_string_view(json_array_get(params, p++), notify.ntime);
+    notify.clean = json_is_true(json_array_get(params, p)); p++;
+
+    return stratum_apply_notify(sctx, notify, false);
+}
+//-----------------------------------------------------------------------------
+inline bool stratum_apply_difficulty(struct stratum_ctx *sctx, double diff)
+{
     if (diff == 0)
         return false;
 
@@ -289,6 +459,10 @@ static bool stratum_set_difficulty(struct stratum_ctx *sctx, json_t *params)
     sctx->next_diff = diff;
     pthread_mutex_unlock(&sctx->work_lock);
 
+    // applied to the global state when the backup becomes active, see stratumGenWork()
+    if (sctx->standby)
+        return true;
+
     // store for api stats
     stratum_diff = diff;
 
@@ -297,6 +471,11 @@ static bool stratum_set_difficulty(struct stratum_ctx *sctx, json_t *params)
     return true;
 }
 //-----------------------------------------------------------------------------
+static bool stratum_set_difficulty(struct stratum_ctx *sctx, json_t *params)
+{
+    return stratum_apply_difficulty(sctx, json_number_value(json_array_get(params, 0)));
+}
+//-----------------------------------------------------------------------------
 static bool stratum_reconnect(struct stratum_ctx *sctx, json_t *params)
 {
     json_t *port_val;
@@ -534,7 +713,7 @@ static bool stratum_show_message(struct stratum_ctx *sctx, json_t *id, json_t *p
     return ret;
 }
 //-----------------------------------------------------------------------------
-inline bool stratum_handle_method(struct stratum_ctx *sctx, const char *s)
+inline bool stratum_handle_method(struct stratum_ctx *sctx, const char *s, size_t size)
 {
     json_t *val, *id, *params;
     json_error_t err;
@@ -542,7 +721,7 @@ inline bool stratum_handle_method(struct stratum_ctx *sctx, const char *s)
     bool ret = false;
 
     //val = JSON_LOADS(s, &err);
-    val = json_loads(s, 0, &err);
+    val = json_loadb(s, size, 0, &err);
     if (!val)
     {
         Log::print(Log::LT_Error, "JSON decode failed(%d): %s", err.line, err.text);
@@ -618,6 +797,52 @@ out:
     return ret;
 }
 //-----------------------------------------------------------------------------
+inline bool stratum_handle_method(struct stratum_ctx *sctx, const char *s)
+{
+    return stratum_handle_method(sctx, s, strlen(s));
+}
+//-----------------------------------------------------------------------------
+// Handles a received line. Hot messages(mining.notify, mining.set_difficulty, submit responses)
+// are parsed in place by parseStratumMessage(), anything else falls back to jansson.
+inline bool stratum_handle_line(struct stratum_ctx *sctx, const char *line, size_t size)
+{
+    StratumMessage message;
+    if (parseStratumMessage(line, size, message))
+    {
+        switch (message.type)
+        {
+        case SM_Notify:
+            return stratum_apply_notify(sctx, message.notify, true);
+        case SM_SetDifficulty:
+            return stratum_apply_difficulty(sctx, message.difficulty);
+        case SM_Response:
+        {
+            if (message.id == STRATUM_PROBE_ID)
+            {
+                stratum_probe_answered(sctx);
+                return true;
+            }
+            // share_response() expects a zero terminated string
+            char reason[256];
+            const size_t reasonSize = (message.errorReason.size < sizeof(reason)) ? message.errorReason.size : sizeof(reason) - 1;
+            if (message.errorReason.data)
+            {
+                memcpy(reason, message.errorReason.data, reasonSize);
+                reason[reasonSize] = '\0';
+            }
+            return share_response(message.id, message.resultTrue, message.errorCode,
+                                  message.errorReason.data ? reason : NULL);
+        }
+        default:
+            break;
+        }
+    }
+
+    if (!stratum_handle_method(sctx, line, size))
+        return stratum_handle_response(sctx, line, size);
+    return true;
+}
+//-----------------------------------------------------------------------------
 inline bool stratum_authorize(struct stratum_ctx *sctx, const char *user, const char *pass)
 {
     json_t *val = NULL, *res_val, *err_val;
@@ -670,7 +895,7 @@ inline bool stratum_authorize(struct stratum_ctx *sctx, const char *user, const
     if (!stratum_send_line(sctx, s))
         goto out;
 
-    if (!socket_full(sctx->sock, 3))
+    if (!stratum_socket_full(sctx, 3))
     {
         if (global::opt_debug)
             Log::print(Log::LT_Debug, "stratum extranonce subscribe timed out");
@@ -718,12 +943,11 @@ inline bool std_stratum_handle_response( json_t *val )
     err_val = json_object_get( val, "error" );
     id_val  = json_object_get( val, "id" );
 
-    if ( !res_val || json_integer_value(id_val) < 4 )
+    if ( !res_val )
          return false;
     valid = json_is_true( res_val );
-    share_result( valid, NULL, err_val ?
-                  json_string_value( json_array_get(err_val, 1) ) : NULL );
-    return true;
+    return share_response( json_integer_value(id_val), valid, json_integer_value( json_array_get(err_val, 0) ),
+                           err_val ? json_string_value( json_array_get(err_val, 1) ) : NULL );
 }
 //-----------------------------------------------------------------------------
 
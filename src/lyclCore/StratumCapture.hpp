@@ -0,0 +1,87 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef StratumCapture_INCLUDE_ONCE
+#define StratumCapture_INCLUDE_ONCE
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+
+//-----------------------------------------------------------------------------
+// Stratum traffic capture(lyclMiner --capture <file>).
+// Every line of the active pool connection is written with its time and direction:
+//     <microseconds since the capture started> <'<' received or '>' sent> <line>
+// The first line is STRATUM_CAPTURE_HEADER. lyclNetBench replays received lines
+// from memory, lyclMockPool serves them to a miner with the original timing.
+//-----------------------------------------------------------------------------
+#define STRATUM_CAPTURE_HEADER "# lyclMiner stratum capture v1"
+//-----------------------------------------------------------------------------
+struct stratum_capture
+{
+    pthread_mutex_t lock;
+    //! NULL if capturing is disabled
+    FILE *file;
+    uint64_t start_us;
+};
+
+extern stratum_capture g_stratum_capture;
+//-----------------------------------------------------------------------------
+//! (now_us) is the steady clock time, see getSteadyTimeUs().
+inline bool stratum_capture_open(const char *file_name, uint64_t now_us)
+{
+    pthread_mutex_init(&g_stratum_capture.lock, NULL);
+    g_stratum_capture.file = fopen(file_name, "wb");
+    if (!g_stratum_capture.file)
+        return false;
+    g_stratum_capture.start_us = now_us;
+    fprintf(g_stratum_capture.file, "%s\n", STRATUM_CAPTURE_HEADER);
+    return true;
+}
+//-----------------------------------------------------------------------------
+//! (direction) is '<' for received and '>' for sent lines. Check g_stratum_capture.file first.
+inline void stratum_capture_line(char direction, const char *line, size_t size, uint64_t now_us)
+{
+    pthread_mutex_lock(&g_stratum_capture.lock);
+    fprintf(g_stratum_capture.file, "%llu %c %.*s\n", (unsigned long long)(now_us - g_stratum_capture.start_us),
+            direction, (int)size, line);
+    // a benchmark run is usually ended with a signal
+    fflush(g_stratum_capture.file);
+    pthread_mutex_unlock(&g_stratum_capture.lock);
+}
+//-----------------------------------------------------------------------------
+inline bool isStratumCapture(const char *data, size_t size)
+{
+    const size_t headerSize = sizeof(STRATUM_CAPTURE_HEADER) - 1;
+    return size >= headerSize && !memcmp(data, STRATUM_CAPTURE_HEADER, headerSize);
+}
+//-----------------------------------------------------------------------------
+//! Splits a capture line. Returns false for the header, comments and malformed lines.
+inline bool parseStratumCaptureLine(const char *line, size_t size, uint64_t& out_time_us, char& out_direction,
+                                    const char*& out_payload, size_t& out_payload_size)
+{
+    const char *end = line + size;
+    const char *p = line;
+    uint64_t timeUs = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        timeUs = timeUs * 10 + (uint64_t)(*p++ - '0');
+    if (p == line || end - p < 3 || p[0] != ' ' || (p[1] != '<' && p[1] != '>') || p[2] != ' ')
+        return false;
+
+    out_time_us = timeUs;
+    out_direction = p[1];
+    out_payload = p + 3;
+    out_payload_size = (size_t)(end - out_payload);
+    return true;
+}
+//-----------------------------------------------------------------------------
+
+#endif // !StratumCapture_INCLUDE_ONCE
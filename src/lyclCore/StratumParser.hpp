@@ -0,0 +1,370 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef StratumParser_INCLUDE_ONCE
+#define StratumParser_INCLUDE_ONCE
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+//-----------------------------------------------------------------------------
+// Fast path parser of hot stratum messages: mining.notify, mining.set_difficulty
+// and submit responses. Works in place on a received line, without allocations.
+// Fields are returned as views into the line, hex fields are decoded by the caller
+// straight into stratum_job.
+// Anything else(other methods, escaped strings, unexpected types) is rejected and
+// must be parsed by jansson. The fast path never accepts a message jansson would
+// interpret differently.
+//-----------------------------------------------------------------------------
+//! Max number of Merkle branches in mining.notify. 2^32 transactions.
+#define STRATUM_MAX_MERKLE 32
+//-----------------------------------------------------------------------------
+struct StratumStringView
+{
+    const char *data;
+    size_t size;
+};
+//-----------------------------------------------------------------------------
+struct StratumNotifyParams
+{
+    StratumStringView jobId;
+    StratumStringView prevhash;
+    StratumStringView coinb1;
+    StratumStringView coinb2;
+    StratumStringView merkle[STRATUM_MAX_MERKLE];
+    int merkleCount;
+    StratumStringView version;
+    StratumStringView nbits;
+    StratumStringView ntime;
+    bool clean;
+};
+//-----------------------------------------------------------------------------
+enum EStratumMessage
+{
+    SM_Unknown = 0,
+    SM_Notify,
+    SM_SetDifficulty,
+    //! response with an integer id, e.g. a submit result
+    SM_Response
+};
+//-----------------------------------------------------------------------------
+struct StratumMessage
+{
+    EStratumMessage type;
+    // SM_Notify
+    StratumNotifyParams notify;
+    // SM_SetDifficulty
+    double difficulty;
+    // SM_Response
+    int64_t id;
+    //! "result": true
+    bool resultTrue;
+    //! "error": [code, "reason", ...]. Empty if there is no reason.
+    StratumStringView errorReason;
+    //! 0 if there is no error or the code is not an integer
+    int64_t errorCode;
+};
+//-----------------------------------------------------------------------------
+// JsonCursor class.
+// Minimal JSON reader. Strings with escape sequences are not supported.
+//-----------------------------------------------------------------------------
+class JsonCursor
+{
+public:
+    inline JsonCursor(const char *begin, const char *end) : m_p(begin), m_end(end) { }
+
+    inline const char* position() const { return m_p; }
+    inline void skipSpaces()
+    {
+        while (m_p < m_end && (*m_p == ' ' || *m_p == '\t' || *m_p == '\r' || *m_p == '\n'))
+            ++m_p;
+    }
+    inline bool atEnd() { skipSpaces(); return m_p == m_end; }
+    inline bool peek(char c) { skipSpaces(); return m_p < m_end && *m_p == c; }
+    inline bool consume(char c)
+    {
+        if (!peek(c))
+            return false;
+        ++m_p;
+        return true;
+    }
+    inline bool consumeLiteral(const char *literal, size_t size)
+    {
+        skipSpaces();
+        if ((size_t)(m_end - m_p) < size || memcmp(m_p, literal, size))
+            return false;
+        m_p += size;
+        return true;
+    }
+    //! Fails on escape sequences and control characters.
+    inline bool readString(StratumStringView& out_string)
+    {
+        if (!consume('"'))
+            return false;
+        const char *begin = m_p;
+        while (m_p < m_end && *m_p != '"')
+        {
+            if (*m_p == '\\' || (unsigned char)*m_p < 0x20)
+                return false;
+            ++m_p;
+        }
+        if (m_p == m_end)
+            return false;
+        out_string.data = begin;
+        out_string.size = (size_t)(m_p - begin);
+        ++m_p;
+        return true;
+    }
+    inline bool readNumber(double& out_number)
+    {
+        skipSpaces();
+        const char *begin = m_p;
+        if (m_p < m_end && (*m_p == '-' || *m_p == '+'))
+            ++m_p;
+        while (m_p < m_end && ((*m_p >= '0' && *m_p <= '9') || *m_p == '.' || *m_p == 'e' || *m_p == 'E' || *m_p == '-' || *m_p == '+'))
+            ++m_p;
+        if (m_p == begin || (size_t)(m_p - begin) >= 64)
+            return false;
+
+        char number[64];
+        memcpy(number, begin, m_p - begin);
+        number[m_p - begin] = '\0';
+        char *numberEnd = nullptr;
+        out_number = strtod(number, &numberEnd);
+        return *numberEnd == '\0';
+    }
+    inline bool readInteger(int64_t& out_number)
+    {
+        skipSpaces();
+        const char *begin = m_p;
+        bool negative = (m_p < m_end && *m_p == '-');
+        if (negative)
+            ++m_p;
+        int64_t value = 0;
+        const char *digits = m_p;
+        while (m_p < m_end && *m_p >= '0' && *m_p <= '9' && (m_p - digits) < 18)
+            value = value * 10 + (*m_p++ - '0');
+        if (m_p == digits || (m_p < m_end && (*m_p == '.' || *m_p == 'e' || *m_p == 'E' || (*m_p >= '0' && *m_p <= '9'))))
+        {
+            m_p = begin;
+            return false;
+        }
+        out_number = negative ? -value : value;
+        return true;
+    }
+    //! Skips any value. Escape sequences inside strings are allowed here.
+    inline bool skipValue(int depth = 0)
+    {
+        skipSpaces();
+        if (m_p == m_end || depth > 16)
+            return false;
+
+        if (*m_p == '"')
+        {
+            for (++m_p; m_p < m_end && *m_p != '"'; ++m_p)
+            {
+                if (*m_p == '\\')
+                    ++m_p;
+            }
+            if (m_p >= m_end)
+                return false;
+            ++m_p;
+            return true;
+        }
+        if (*m_p == '[' || *m_p == '{')
+        {
+            const char close = (*m_p == '[') ? ']' : '}';
+            ++m_p;
+            if (consume(close))
+                return true;
+            do
+            {
+                // object key
+                if (close == '}' && (!skipValue(depth + 1) || !consume(':')))
+                    return false;
+                if (!skipValue(depth + 1))
+                    return false;
+            } while (consume(','));
+            return consume(close);
+        }
+        // number or literal
+        const char *begin = m_p;
+        while (m_p < m_end && *m_p != ',' && *m_p != ']' && *m_p != '}' && *m_p != ' ')
+            ++m_p;
+        return m_p != begin;
+    }
+
+private:
+    const char *m_p;
+    const char *m_end;
+};
+//-----------------------------------------------------------------------------
+inline bool stratumViewEquals(const StratumStringView& view, const char *str, size_t size)
+{
+    return view.size == size && !memcmp(view.data, str, size);
+}
+//-----------------------------------------------------------------------------
+inline bool parseStratumNotifyParams(JsonCursor& cursor, StratumNotifyParams& out_params)
+{
+    if (!cursor.consume('[') ||
+        !cursor.readString(out_params.jobId) || !cursor.consume(',') ||
+        !cursor.readString(out_params.prevhash) || !cursor.consume(',') ||
+        !cursor.readString(out_params.coinb1) || !cursor.consume(',') ||
+        !cursor.readString(out_params.coinb2) || !cursor.consume(',') ||
+        !cursor.consume('['))
+        return false;
+
+    out_params.merkleCount = 0;
+    if (!cursor.consume(']'))
+    {
+        do
+        {
+            if (out_params.merkleCount == STRATUM_MAX_MERKLE ||
+                !cursor.readString(out_params.merkle[out_params.merkleCount++]))
+                return false;
+        } while (cursor.consume(','));
+        if (!cursor.consume(']'))
+            return false;
+    }
+
+    if (!cursor.consume(',') ||
+        !cursor.readString(out_params.version) || !cursor.consume(',') ||
+        !cursor.readString(out_params.nbits) || !cursor.consume(',') ||
+        !cursor.readString(out_params.ntime) || !cursor.consume(','))
+        return false;
+
+    if (cursor.consumeLiteral("true", 4))
+        out_params.clean = true;
+    else if (cursor.consumeLiteral("false", 5))
+        out_params.clean = false;
+    else
+        return false;
+
+    // optional trailing parameters are ignored, as with jansson
+    while (cursor.consume(','))
+    {
+        if (!cursor.skipValue())
+            return false;
+    }
+    return cursor.consume(']');
+}
+//-----------------------------------------------------------------------------
+//! Returns false if the message must be parsed by jansson.
+inline bool parseStratumMessage(const char *line, size_t size, StratumMessage& out_message)
+{
+    out_message.type = SM_Unknown;
+
+    JsonCursor cursor(line, line + size);
+    if (!cursor.consume('{'))
+        return false;
+
+    // values are located first, keys may come in any order.
+    StratumStringView method = { nullptr, 0 };
+    const char *params = nullptr;
+    const char *id = nullptr;
+    const char *result = nullptr;
+    const char *error = nullptr;
+    if (!cursor.consume('}'))
+    {
+        do
+        {
+            StratumStringView key;
+            if (!cursor.readString(key) || !cursor.consume(':'))
+                return false;
+
+            cursor.skipSpaces();
+            const char *value = cursor.position();
+            if (stratumViewEquals(key, "method", 6))
+            {
+                if (!cursor.readString(method))
+                    return false;
+                continue;
+            }
+            if (stratumViewEquals(key, "params", 6))
+                params = value;
+            else if (stratumViewEquals(key, "id", 2))
+                id = value;
+            else if (stratumViewEquals(key, "result", 6))
+                result = value;
+            else if (stratumViewEquals(key, "error", 5))
+                error = value;
+            if (!cursor.skipValue())
+                return false;
+        } while (cursor.consume(','));
+        if (!cursor.consume('}') || !cursor.atEnd())
+            return false;
+    }
+
+    const char *end = line + size;
+    if (method.data)
+    {
+        if (!params)
+            return false;
+
+        JsonCursor paramsCursor(params, end);
+        if (stratumViewEquals(method, "mining.notify", 13))
+        {
+            if (!parseStratumNotifyParams(paramsCursor, out_message.notify))
+                return false;
+            out_message.type = SM_Notify;
+            return true;
+        }
+        if (stratumViewEquals(method, "mining.set_difficulty", 21))
+        {
+            if (!paramsCursor.consume('[') || !paramsCursor.readNumber(out_message.difficulty))
+                return false;
+            out_message.type = SM_SetDifficulty;
+            return true;
+        }
+        return false;
+    }
+
+    // response: {"id": 4, "result": true|false|null, "error": null|[code, "reason", ...]}
+    if (!id || !result)
+        return false;
+
+    JsonCursor idCursor(id, end);
+    if (!idCursor.readInteger(out_message.id))
+        return false;
+
+    JsonCursor resultCursor(result, end);
+    if (resultCursor.consumeLiteral("true", 4))
+        out_message.resultTrue = true;
+    else if (resultCursor.consumeLiteral("false", 5) || resultCursor.consumeLiteral("null", 4))
+        out_message.resultTrue = false;
+    else
+        return false;
+
+    out_message.errorReason.data = nullptr;
+    out_message.errorReason.size = 0;
+    out_message.errorCode = 0;
+    if (error)
+    {
+        JsonCursor errorCursor(error, end);
+        if (!errorCursor.consumeLiteral("null", 4))
+        {
+            if (!errorCursor.consume('['))
+                return false;
+            // the code may be a string or null
+            if (!errorCursor.readInteger(out_message.errorCode) && !errorCursor.skipValue())
+                return false;
+            if (!errorCursor.consume(','))
+                return false;
+            if (!errorCursor.consumeLiteral("null", 4) && !errorCursor.readString(out_message.errorReason))
+                return false;
+        }
+    }
+
+    out_message.type = SM_Response;
+    return true;
+}
+//-----------------------------------------------------------------------------
+
+#endif // !StratumParser_INCLUDE_ONCE
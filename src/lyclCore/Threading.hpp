@@ -22,6 +22,8 @@ struct tq_ent
 {
     void *data;
     struct list_head q_node;
+    //! entry is embedded in (data) and owned by the caller. See tq_push_entry().
+    bool embedded;
 };
 
 struct thread_q
@@ -67,26 +69,20 @@ inline static thread_q *tq_new()
     return tq;
 }
 
-inline static bool tq_push(struct thread_q *tq, void *data)
+// Pushes a caller owned entry, without an allocation. (ent) must stay valid until popped.
+inline static bool tq_push_entry(struct thread_q *tq, struct tq_ent *ent, void *data)
 {
-    struct tq_ent *ent;
     bool rc = true;
 
-    ent = (struct tq_ent*) calloc(1, sizeof(*ent));
-    if (!ent)
-        return false;
-
     ent->data = data;
     INIT_LIST_HEAD(&ent->q_node);
 
     pthread_mutex_lock(&tq->mutex);
 
-    if (!tq->frozen) {
+    if (!tq->frozen)
         list_add_tail(&ent->q_node, &tq->q);
-    } else {
-        free(ent);
+    else
         rc = false;
-    }
 
     pthread_cond_signal(&tq->cond);
     pthread_mutex_unlock(&tq->mutex);
@@ -94,6 +90,22 @@ inline static bool tq_push(struct thread_q *tq, void *data)
     return rc;
 }
 
+inline static bool tq_push(struct thread_q *tq, void *data)
+{
+    struct tq_ent *ent;
+
+    ent = (struct tq_ent*) calloc(1, sizeof(*ent));
+    if (!ent)
+        return false;
+
+    if (!tq_push_entry(tq, ent, data)) {
+        free(ent);
+        return false;
+    }
+
+    return true;
+}
+
 inline static void* tq_pop(struct thread_q *tq, const struct timespec *abstime)
 {
     struct tq_ent *ent;
@@ -119,7 +131,8 @@ pop:
     rval = ent->data;
 
     list_del(&ent->q_node);
-    free(ent);
+    if (!ent->embedded)
+        free(ent);
 
 out:
     pthread_mutex_unlock(&tq->mutex);
@@ -14,6 +14,7 @@
 #define Utils_INCLUDE_ONCE
 
 #include <jansson.h> // JSON
+#include <lyclCore/HexCodec.hpp>
 #include <lyclCore/Log.hpp>
 
 #include <sys/stat.h>
@@ -32,41 +33,27 @@ namespace lycl
     }
 }
 
+// Decodes exactly (2 * len) hex digits. Fails on a shorter string or an invalid digit.
 inline bool hex2bin(unsigned char *p, const char *hexstr, size_t len)
 {
-    char hex_byte[3];
-    char *ep;
-
-    hex_byte[2] = '\0';
-
-    while (*hexstr && len)
+    // never reads past the terminating '\0'
+    if (strnlen(hexstr, 2 * len) < 2 * len)
     {
-        if (!hexstr[1])
-        {
-            Log::print(Log::LT_Error, "hex2bin str truncated");
-            return false;
-        }
-        hex_byte[0] = hexstr[0];
-        hex_byte[1] = hexstr[1];
-        *p = (unsigned char) strtol(hex_byte, &ep, 16);
-        if (*ep)
-        {
-            Log::print(Log::LT_Error, "hex2bin failed on '%s'", hex_byte);
-            return false;
-        }
-        p++;
-        hexstr += 2;
-        len--;
+        Log::print(Log::LT_Error, "hex2bin str truncated");
+        return false;
     }
-
-    return(!len) ? true : false;
-    //  return (len == 0 && *hexstr == 0) ? true : false;
+    if (!hexDecode(p, hexstr, len))
+    {
+        Log::print(Log::LT_Error, "hex2bin failed on '%.*s'", (int) (2 * len), hexstr);
+        return false;
+    }
+    return true;
 }
 //----------------------------------------------------------------------------
 inline void bin2hex(char *s, const unsigned char *p, size_t len)
 {
-    for (size_t i = 0; i < len; i++)
-        sprintf(s + (i * 2), "%02x", (unsigned int) p[i]);
+    hexEncode(s, p, len);
+    s[len * 2] = '\0';
 }
 //-----------------------------------------------------------------------------
 inline char *abin2hex(const unsigned char *p, size_t len)
@@ -132,7 +119,8 @@ inline void scale_hash_for_display ( double* hashrate, char* units )
     }
 }
 //-----------------------------------------------------------------------------
-inline int share_result( int result, struct work *work, const char *reason )
+//! (attribution): device, nonce and latency of the share if known. (reject_class): see share_classify_reject().
+inline int share_result( int result, const char *attribution, const char *reason, const char *reject_class = NULL )
 {
     char hc[16];
     char hr[16];
@@ -201,13 +189,17 @@ inline int share_result( int result, struct work *work, const char *reason )
         sprintf(hr, "%.2f", hashrate );
     }
 
-    Log::print( Log::LT_Notice, "%s %lu/%lu (%s%%), %s %sH, %s %sH/s",
+    Log::print( Log::LT_Notice, "%s %lu/%lu (%s%%), %s %sH, %s %sH/s%s%s",
                 sres, ( result ? accepted_count : rejected_count ),
-                total_submits, rate_s, hc, hc_units, hr, hr_units );
+                total_submits, rate_s, hc, hc_units, hr, hr_units,
+                attribution ? ", " : "", attribution ? attribution : "" );
 
     if (reason)
     {
-        Log::print(Log::LT_Warning, "reject reason: %s", reason);
+        if (reject_class)
+            Log::print(Log::LT_Warning, "reject reason(%s): %s", reject_class, reason);
+        else
+            Log::print(Log::LT_Warning, "reject reason: %s", reason);
         if (strncmp(reason, "low difficulty share", 20) == 0)
         {
             opt_diff_factor = (opt_diff_factor * 2.0) / 3.0;
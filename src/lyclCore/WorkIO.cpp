@@ -12,60 +12,163 @@
 
 #include <lyclCore/WorkIO.hpp>
 
+share_pool g_share_pool;
+share_tracker g_share_tracker;
 //-----------------------------------------------------------------------------
-void buildStratumRequest(char* req, work* work_info)
+void share_pool_init()
 {
-    // should be char* instead of unsigned char*
-    char *xnonce2str;
-    uint32_t ntime,       nonce;
-    char     ntimestr[9], noncestr[9];
-    le32enc( &ntime, work_info->data[NTimeIndex] );
-    le32enc( &nonce, work_info->data[NonceIndex] );
-    bin2hex( ntimestr, (unsigned char*)(&ntime), sizeof(uint32_t) );
-    bin2hex( noncestr, (unsigned char*)(&nonce), sizeof(uint32_t) );
-    xnonce2str = abin2hex( work_info->xnonce2, work_info->xnonce2_len );
-    snprintf(req, JSON_BUF_LEN,
-             "{\"method\": \"mining.submit\", \"params\": [\"%s\", \"%s\", \"%s\", \"%s\", \"%s\"], \"id\":4}",
-             global::connectionInfo.rpc_user.c_str(), work_info->job_id, xnonce2str, ntimestr, noncestr); 
-    free( xnonce2str );
+    pthread_mutex_init(&g_share_pool.lock, NULL);
+    g_share_pool.free_list = NULL;
+    for (int i = SHARE_POOL_SIZE - 1; i >= 0; --i)
+    {
+        share_record *share = &g_share_pool.records[i];
+        share->ent.embedded = true;
+        share->pooled = true;
+        share->next_free = g_share_pool.free_list;
+        g_share_pool.free_list = share;
+    }
+}
+//-----------------------------------------------------------------------------
+uint32_t share_template_build(const work *work_info, uint32_t session_gen)
+{
+    pthread_mutex_lock(&g_share_pool.lock);
+    // 0 is reserved for work without a template
+    if (!++g_share_pool.last_job_ref)
+        ++g_share_pool.last_job_ref;
+    const uint32_t job_ref = g_share_pool.last_job_ref;
+    share_template *tmpl = &g_share_pool.templates[job_ref % SHARE_TEMPLATES];
+
+    tmpl->job_ref = job_ref;
+    tmpl->session_gen = session_gen;
+    memcpy(tmpl->prevhash, &work_info->data[1], sizeof(tmpl->prevhash));
+    tmpl->xnonce2_len = work_info->xnonce2_len;
+
+    // extranonce2, ntime and nonce are patched per share
+    int prefix = snprintf(tmpl->line, JSON_BUF_LEN, "{\"method\": \"mining.submit\", \"params\": [\"%s\", \"%s\", \"",
+                          global::connectionInfo.rpc_user.c_str(), work_info->job_id ? work_info->job_id : "");
+    static const char ntimeField[] = "\", \"00000000";
+    static const char nonceField[] = "\", \"00000000";
+    static const char idField[] = "\"], \"id\":0000000000";
+    static const char suffix[] = "}";
+    const size_t size = (size_t) prefix + work_info->xnonce2_len * 2 + (sizeof(ntimeField) - 1) +
+                        (sizeof(nonceField) - 1) + (sizeof(idField) - 1) + (sizeof(suffix) - 1);
+    tmpl->size = 0;
+    if (prefix > 0 && size < JSON_BUF_LEN)
+    {
+        char *p = tmpl->line + prefix;
+        tmpl->xnonce2_offset = (size_t) prefix;
+        memset(p, '0', work_info->xnonce2_len * 2);
+        p += work_info->xnonce2_len * 2;
+        memcpy(p, ntimeField, sizeof(ntimeField) - 1);
+        p += sizeof(ntimeField) - 1;
+        tmpl->ntime_offset = (size_t) (p - 8 - tmpl->line);
+        memcpy(p, nonceField, sizeof(nonceField) - 1);
+        p += sizeof(nonceField) - 1;
+        tmpl->nonce_offset = (size_t) (p - 8 - tmpl->line);
+        memcpy(p, idField, sizeof(idField) - 1);
+        p += sizeof(idField) - 1;
+        tmpl->id_offset = (size_t) (p - SHARE_ID_DIGITS - tmpl->line);
+        memcpy(p, suffix, sizeof(suffix));
+        tmpl->size = size;
+    }
+    else
+        Log::print(Log::LT_Error, "Submit template of job %s does not fit in %d bytes", work_info->job_id, JSON_BUF_LEN);
+
+    pthread_mutex_unlock(&g_share_pool.lock);
+    return job_ref;
+}
+//-----------------------------------------------------------------------------
+void share_templates_invalidate()
+{
+    pthread_mutex_lock(&g_share_pool.lock);
+    for (int i = 0; i < SHARE_TEMPLATES; ++i)
+        g_share_pool.templates[i].job_ref = 0;
+    pthread_mutex_unlock(&g_share_pool.lock);
+}
+//-----------------------------------------------------------------------------
+//! Copies the job template into (req) and patches share fields in place. Returns false if the job template was replaced.
+//! (out_id_offset) is where the share id goes. (out_session_gen) is the session the job came from.
+static bool buildStratumRequest(char* req, const share_record* share, bool* out_stale, size_t* out_id_offset,
+                                uint32_t* out_session_gen)
+{
+    size_t xnonce2_offset = 0, ntime_offset = 0, nonce_offset = 0;
+    pthread_mutex_lock(&g_share_pool.lock);
+    const share_template *tmpl = &g_share_pool.templates[share->job_ref % SHARE_TEMPLATES];
+    const bool found = share->job_ref && tmpl->job_ref == share->job_ref && tmpl->size &&
+                       tmpl->xnonce2_len == share->xnonce2_len;
+    if (found)
+    {
+        memcpy(req, tmpl->line, tmpl->size + 1);
+        xnonce2_offset = tmpl->xnonce2_offset;
+        ntime_offset = tmpl->ntime_offset;
+        nonce_offset = tmpl->nonce_offset;
+        *out_id_offset = tmpl->id_offset;
+        *out_session_gen = tmpl->session_gen;
+        // pass if the previous hash is not the current previous hash
+        *out_stale = memcmp(tmpl->prevhash, &global::g_work.data[1], 32) != 0;
+    }
+    pthread_mutex_unlock(&g_share_pool.lock);
+    if (!found)
+        return false;
+
+    uint32_t ntime, nonce;
+    le32enc( &ntime, share->ntime );
+    le32enc( &nonce, share->nonce );
+    hexEncode( req + xnonce2_offset, share->xnonce2, share->xnonce2_len );
+    hexEncode( req + ntime_offset, (unsigned char*)(&ntime), sizeof(uint32_t) );
+    hexEncode( req + nonce_offset, (unsigned char*)(&nonce), sizeof(uint32_t) );
+    return true;
 }
 //-----------------------------------------------------------------------------
-bool submit_upstream_work( CURL *curl, work *work_info )
+bool submit_upstream_work( CURL *curl, share_record *share )
 {
     char req[JSON_BUF_LEN];
+    bool stale = false;
+    size_t id_offset = 0;
+    uint32_t session_gen = 0;
 
-    // pass if the previous hash is not the current previous hash
-    if ( memcmp( &work_info->data[1], &global::g_work.data[1], 32 ) )
+    if ( !buildStratumRequest( req, share, &stale, &id_offset, &session_gen ) || stale )
     {
         if (global::opt_debug)
             Log::print(Log::LT_Debug, "DEBUG: stale work detected, discarding");
         return true;
     }
 
-    buildStratumRequest( req, work_info);
-    if ( !stratum_send_line( &stratum, req ) )
+    const uint32_t id = share_tracker_submit( share->thr->id, share->job_ref, share->nonce );
+    share_id_format( req + id_offset, id );
+    if ( !stratum_send_share( &stratum, req, session_gen, &stale ) )
     {
+        share_tracker_cancel( id );
         Log::print(Log::LT_Error, "submit_upstream_work stratum_send_line failed");
         return false;
     }
+    if ( stale )
+    {
+        // the job belongs to a previous pool or session
+        share_tracker_cancel( id );
+        if (global::opt_debug)
+            Log::print(Log::LT_Debug, "DEBUG: share of a previous session discarded");
+    }
     return true;
 }
 //-----------------------------------------------------------------------------
-bool workio_submit_work(struct workio_cmd *wc, CURL *curl)
+bool workio_submit_work(struct share_record *share, CURL *curl)
 {
     int failures = 0;
+    uint32_t numReady = stratum_get_num_ready();
 
     // submit solution to bitcoin via JSON-RPC
-    while (!submit_upstream_work(curl, wc->u.work))
+    while (!submit_upstream_work(curl, share))
     {
         if ((global::opt_retries >= 0) && (++failures > global::opt_retries))
         {
             Log::print(Log::LT_Error, "...terminating workio thread");
             return false;
         }
-        // pause, then restart work-request loop
-        Log::print(Log::LT_Error, "...retry after %d seconds", global::opt_failPause);
-        sleep(global::opt_failPause);
+        // retry as soon as the stratum thread has a new session, e.g. a resumed one
+        Log::print(Log::LT_Error, "...retry after reconnect, at most %d seconds", global::opt_failPause);
+        stratum_wait_ready(numReady, global::opt_failPause * 1000);
+        numReady = stratum_get_num_ready();
     }
     return true;
 }
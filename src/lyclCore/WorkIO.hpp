@@ -14,6 +14,7 @@
 #define WorkIO_INCLUDE_ONCE
 
 #include <unistd.h> // sleep()
+#include <chrono>
 #include <curl/curl.h> // CURL, curl_global_init...
 #include <jansson.h> // JSON
 
@@ -31,21 +32,114 @@
 //-----------------------------------------------------------------------------
 inline void restart_threads()
 {
+    const uint64_t timeUs = getSteadyTimeUs();
     for ( int i = 0; i < global::numWorkerThreads; i++)
+    {
+        gwork_restart[i].timeUs = timeUs;
         gwork_restart[i].restart = 1;
+    }
 }
 //-----------------------------------------------------------------------------
 // Work IO
+// Found nonces are queued to the workio thread as fixed-size share records taken
+// from a pool. The workio thread submits them by patching a mining.submit line
+// preformatted once per job, so finding a share does no heap allocations.
+// Results are matched to shares by id, see ShareTracker.hpp.
+//-----------------------------------------------------------------------------
+#define SHARE_POOL_SIZE 256
+#define SHARE_TEMPLATES 8
+#define SHARE_MAX_XNONCE2 32
+//-----------------------------------------------------------------------------
+struct share_template
+{
+    //! see work::job_ref. 0: unused.
+    uint32_t job_ref;
+    //! stratum_ctx::session_gen of the pool which sent the job
+    uint32_t session_gen;
+    //! previous block hash of the job, as in work::data[1..8]
+    uint32_t prevhash[8];
+    //! 0 if the line did not fit
+    size_t size;
+    size_t xnonce2_len;
+    size_t xnonce2_offset;
+    size_t ntime_offset;
+    size_t nonce_offset;
+    //! SHARE_ID_DIGITS wide, see share_tracker_submit()
+    size_t id_offset;
+    char line[JSON_BUF_LEN];
+};
 //-----------------------------------------------------------------------------
-struct workio_cmd
+struct share_record
 {
+    //! queue entry, see tq_push_entry()
+    struct tq_ent ent;
+    struct share_record *next_free;
     struct thr_info *thr;
-    union
-    {
-        struct work *work;
-    } u;
+    uint32_t job_ref;
+    uint32_t ntime;
+    uint32_t nonce;
+    //! not submitted, version rolling is not supported
+    uint32_t version;
+    size_t xnonce2_len;
+    unsigned char xnonce2[SHARE_MAX_XNONCE2];
+    //! false if allocated because the pool was empty
+    bool pooled;
 };
 //-----------------------------------------------------------------------------
+struct share_pool
+{
+    pthread_mutex_t lock;
+    struct share_record records[SHARE_POOL_SIZE];
+    struct share_record *free_list;
+    //! ring of the latest jobs, indexed by job_ref % SHARE_TEMPLATES
+    struct share_template templates[SHARE_TEMPLATES];
+    uint32_t last_job_ref;
+};
+
+extern share_pool g_share_pool;
+//-----------------------------------------------------------------------------
+void share_pool_init();
+//-----------------------------------------------------------------------------
+//! Formats the submit line of a new job. Returns its job_ref. Called with g_work_lock held.
+uint32_t share_template_build(const work *work_info, uint32_t session_gen);
+//-----------------------------------------------------------------------------
+//! Drops all job templates. Shares of earlier jobs are discarded, e.g. after a pool switch.
+void share_templates_invalidate();
+//-----------------------------------------------------------------------------
+inline share_record *share_record_acquire()
+{
+    pthread_mutex_lock(&g_share_pool.lock);
+    share_record *share = g_share_pool.free_list;
+    if (share)
+        g_share_pool.free_list = share->next_free;
+    pthread_mutex_unlock(&g_share_pool.lock);
+
+    // workio thread fell behind
+    if (!share)
+    {
+        share = (share_record*) calloc(1, sizeof(*share));
+        if (share)
+            share->ent.embedded = true;
+    }
+    return share;
+}
+//-----------------------------------------------------------------------------
+inline void share_record_release(share_record *share)
+{
+    if (!share)
+        return;
+    if (!share->pooled)
+    {
+        free(share);
+        return;
+    }
+
+    pthread_mutex_lock(&g_share_pool.lock);
+    share->next_free = g_share_pool.free_list;
+    g_share_pool.free_list = share;
+    pthread_mutex_unlock(&g_share_pool.lock);
+}
+//-----------------------------------------------------------------------------
 inline void format_hashrate(double hashrate, char *output)
 {
     char prefix = '\0';
@@ -80,11 +174,11 @@ inline void format_hashrate(double hashrate, char *output)
             hashrate, prefix);
 }
 //-----------------------------------------------------------------------------
-bool submit_upstream_work( CURL *curl, work *work_info );
+bool submit_upstream_work( CURL *curl, share_record *share );
 //-----------------------------------------------------------------------------
 bool work_decode( const json_t *val, struct work *work );
 //-----------------------------------------------------------------------------
-bool workio_submit_work(struct workio_cmd *wc, CURL *curl);
+bool workio_submit_work(struct share_record *share, CURL *curl);
 //-----------------------------------------------------------------------------
 inline void workFree(work *w)
 {
@@ -105,38 +199,32 @@ inline void workCopy(work *dest, const work *src)
     }
 }
 //-----------------------------------------------------------------------------
-inline void workio_cmd_free(struct workio_cmd *wc)
-{
-    if (!wc)
-        return;
-
-    workFree(wc->u.work);
-    free(wc->u.work);
-
-    memset(wc, 0, sizeof(*wc)); // poison
-    free(wc);
-}
-//-----------------------------------------------------------------------------
 inline bool submit_work(struct thr_info *thr, const work* work_info)
 {
-    workio_cmd *wc;
-    // fill out work request message
-    wc = (workio_cmd *)calloc(1, sizeof(*wc));
-    if (!wc)
+    if (work_info->xnonce2_len > SHARE_MAX_XNONCE2)
+    {
+        Log::print(Log::LT_Error, "extranonce2 size %d is not supported", (int) work_info->xnonce2_len);
+        return false;
+    }
+
+    share_record *share = share_record_acquire();
+    if (!share)
         return false;
-    wc->u.work = (work*)malloc(sizeof(*work_info));
-    if (!wc->u.work)
-        goto err_out;
-    wc->thr = thr;
-    workCopy(wc->u.work, work_info);
+    share->thr = thr;
+    share->job_ref = work_info->job_ref;
+    share->ntime = work_info->data[NTimeIndex];
+    share->nonce = work_info->data[NonceIndex];
+    share->version = work_info->data[0];
+    share->xnonce2_len = work_info->xnonce2_len;
+    memcpy(share->xnonce2, work_info->xnonce2, work_info->xnonce2_len);
 
     // send solution to workio thread
-    if (!tq_push(gthr_info[work_thr_id].q, wc))
-        goto err_out;
+    if (!tq_push_entry(gthr_info[work_thr_id].q, &share->ent, share))
+    {
+        share_record_release(share);
+        return false;
+    }
     return true;
-err_out:
-    workio_cmd_free(wc);
-    return false;
 }
 //-----------------------------------------------------------------------------
 
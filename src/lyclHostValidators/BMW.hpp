@@ -10,7 +10,7 @@
 #ifndef BMW_INCLUDE_ONCE
 #define BMW_INCLUDE_ONCE
 
-#include <lyclApplets/AppCommon.hpp>
+#include <lyclHostValidators/HashTypes.hpp>
 
 namespace lycl
 {
@@ -34,7 +34,7 @@ namespace lycl
     #define rs7(x) SPH_ROTL32((x), 27)
     //-----------------------------------------------------------------------------
     // Message expansion function 1
-    uint32_t expand32_1(size_t i, uint32_t* M32, uint32_t* H, uint32_t* Q)
+    inline uint32_t expand32_1(size_t i, uint32_t* M32, uint32_t* H, uint32_t* Q)
     {
         return (ss1(Q[i - 16]) + ss2(Q[i - 15]) + ss3(Q[i - 14]) + ss0(Q[i - 13])
                 + ss1(Q[i - 12]) + ss2(Q[i - 11]) + ss3(Q[i - 10]) + ss0(Q[i - 9])
@@ -44,7 +44,7 @@ namespace lycl
     }
     //-----------------------------------------------------------------------------
     // Message expansion function 2
-    uint32_t expand32_2(size_t i, uint32_t* M32, uint32_t* H, uint32_t* Q)
+    inline uint32_t expand32_2(size_t i, uint32_t* M32, uint32_t* H, uint32_t* Q)
     {
         return (Q[i - 16] + rs1(Q[i - 15]) + Q[i - 14] + rs2(Q[i - 13])
                 + Q[i - 12] + rs3(Q[i - 11]) + Q[i - 10] + rs4(Q[i - 9])
@@ -53,7 +53,7 @@ namespace lycl
                 + ((i*(0x05555555ul) + SPH_ROTL32(M32[(i - 16) % 16], ((i - 16) % 16) + 1) + SPH_ROTL32(M32[(i - 13) % 16], ((i - 13) % 16) + 1) - SPH_ROTL32(M32[(i - 6) % 16], ((i - 6) % 16) + 1)) ^ H[(i - 16 + 7) % 16]));
     }
     //-----------------------------------------------------------------------------
-    void compression256(uint32_t* M32, uint32_t* H)
+    inline void compression256(uint32_t* M32, uint32_t* H)
     {
         uint32_t XL32, XH32, Q[32];
 
@@ -133,7 +133,7 @@ namespace lycl
         H[15] = SPH_ROTL32(H[3], 16) + (XH32 ^ Q[31] ^ M32[15]) + (shr(XL32, 2) ^ Q[22] ^ Q[15]);
     }
     //-----------------------------------------------------------------------------
-    void bmwHash(const uint32x8& hash_input, uint32x8& hash_output)
+    inline void bmwHash(const uint32x8& hash_input, uint32x8& hash_output)
     {
         uint32_t dh[16] = {
             0x40414243U, 0x44454647U,
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef CubeHash_INCLUDE_ONCE
+#define CubeHash_INCLUDE_ONCE
+
+#include <lyclHostValidators/HashTypes.hpp>
+
+namespace lycl
+{
+    //-----------------------------------------------------------------------------
+    //! CubeHash16/32-256 state after the 160 initialization rounds.
+    const uint32_t c_cubeHashIV[32] =
+    {
+        0xEA2BD4B4, 0xCCD6F29F, 0x63117E71, 0x35481EAE, 0x22512D5B, 0xE5D94E63, 0x7E624131, 0xF4CC12BE,
+        0xC2D0B696, 0x42AF2070, 0xD0720C35, 0x3361DA8C, 0x28CCECA4, 0x8EF8AD83, 0x4680AC00, 0x40E5FBAB,
+        0xD89041C3, 0x6107FBD5, 0x6C859D41, 0xF0B26679, 0x09392549, 0x5FA25603, 0x65C892FD, 0x93CB6285,
+        0x2AF2B5AE, 0x9E4B4E60, 0x774ABFDD, 0x85254725, 0x15815AEB, 0x4AB6AAD6, 0x9CDAF8AF, 0xD6032C0A
+    };
+    //-----------------------------------------------------------------------------
+    inline void cubeHashRounds(uint32_t* x, int num_rounds)
+    {
+        for (int r = 0; r < num_rounds; ++r)
+        {
+            for (int i = 0; i < 16; ++i) x[i + 16] += x[i];
+            for (int i = 0; i < 16; ++i) x[i] = rotl32(x[i], 7);
+            for (int i = 0; i < 8; ++i) { const uint32_t t = x[i]; x[i] = x[i + 8]; x[i + 8] = t; }
+            for (int i = 0; i < 16; ++i) x[i] ^= x[i + 16];
+            for (int i = 16; i < 32; ++i) { if (!(i & 2)) { const uint32_t t = x[i]; x[i] = x[i + 2]; x[i + 2] = t; } }
+            for (int i = 0; i < 16; ++i) x[i + 16] += x[i];
+            for (int i = 0; i < 16; ++i) x[i] = rotl32(x[i], 11);
+            for (int i = 0; i < 16; ++i) { if (!(i & 4)) { const uint32_t t = x[i]; x[i] = x[i + 4]; x[i + 4] = t; } }
+            for (int i = 0; i < 16; ++i) x[i] ^= x[i + 16];
+            for (int i = 16; i < 32; i += 2) { const uint32_t t = x[i]; x[i] = x[i + 1]; x[i + 1] = t; }
+        }
+    }
+    //-----------------------------------------------------------------------------
+    //! Host version of the cubeHash256 kernel: CubeHash16/32-256 of a 32 byte message.
+    inline void cubeHash(const uint32x8& in, uint32x8& out)
+    {
+        uint32_t x[32];
+        for (int i = 0; i < 32; ++i)
+            x[i] = c_cubeHashIV[i];
+        for (int i = 0; i < 8; ++i)
+            x[i] ^= in.h[i];
+
+        cubeHashRounds(x, 16);
+        // padding block
+        x[0] ^= 0x80;
+        cubeHashRounds(x, 16);
+        // finalization
+        x[31] ^= 1;
+        cubeHashRounds(x, 160);
+
+        for (int i = 0; i < 8; ++i)
+            out.h[i] = x[i];
+    }
+    //-----------------------------------------------------------------------------
+}
+
+#endif // !CubeHash_INCLUDE_ONCE
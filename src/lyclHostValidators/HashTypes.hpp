@@ -0,0 +1,61 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef HashTypes_INCLUDE_ONCE
+#define HashTypes_INCLUDE_ONCE
+
+#include <cstddef>
+#include <cstdint>
+
+//-----------------------------------------------------------------------------
+// Buffer layouts shared by the kernels and the host validators. No OpenCL.
+//-----------------------------------------------------------------------------
+namespace lycl
+{
+    //-----------------------------------------------------------------------------
+    //! Element of the hash storage buffer: 256 bit digest, little endian words.
+    struct uint32x8 { uint32_t h[8]; };
+    //-----------------------------------------------------------------------------
+    //! Lyra2 sponge state passed from lyra441p1 to lyra441p3. 4 uint32x8 in the lyraStates buffer.
+    struct LyraState { uint64_t s[16]; };
+    //-----------------------------------------------------------------------------
+    inline uint64_t rotl64(uint64_t x, uint32_t n)
+    {
+        return (x << n) | (x >> ((64 - n) & 63));
+    }
+    //-----------------------------------------------------------------------------
+    inline uint64_t rotr64(uint64_t x, uint32_t n)
+    {
+        return (x >> n) | (x << ((64 - n) & 63));
+    }
+    //-----------------------------------------------------------------------------
+    inline uint32_t rotl32(uint32_t x, uint32_t n)
+    {
+        return (x << n) | (x >> ((32 - n) & 31));
+    }
+    //-----------------------------------------------------------------------------
+    //! uint32x8 <-> 4 little endian 64 bit words(ulong view of the kernels).
+    inline void toWords64(const uint32x8& in, uint64_t* out_words)
+    {
+        for (int i = 0; i < 4; ++i)
+            out_words[i] = (uint64_t)in.h[2 * i] | ((uint64_t)in.h[2 * i + 1] << 32);
+    }
+    //-----------------------------------------------------------------------------
+    inline void fromWords64(const uint64_t* words, uint32x8& out)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            out.h[2 * i] = (uint32_t)words[i];
+            out.h[2 * i + 1] = (uint32_t)(words[i] >> 32);
+        }
+    }
+    //-----------------------------------------------------------------------------
+}
+
+#endif // !HashTypes_INCLUDE_ONCE
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef Keccak_INCLUDE_ONCE
+#define Keccak_INCLUDE_ONCE
+
+#include <lyclHostValidators/HashTypes.hpp>
+
+namespace lycl
+{
+    //-----------------------------------------------------------------------------
+    const uint64_t c_keccakRoundConstants[24] =
+    {
+        0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808AULL, 0x8000000080008000ULL,
+        0x000000000000808BULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+        0x000000000000008AULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000AULL,
+        0x000000008000808BULL, 0x800000000000008BULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+        0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800AULL, 0x800000008000000AULL,
+        0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
+    };
+    //! rho offsets and pi lane order, walked from lane 1.
+    const uint32_t c_keccakRho[24] = { 1, 3, 6, 10, 15, 21, 28, 36, 45, 55, 2, 14, 27, 41, 56, 8, 25, 43, 62, 18, 39, 61, 20, 44 };
+    const uint32_t c_keccakPi[24] = { 10, 7, 11, 17, 18, 3, 5, 16, 8, 21, 24, 4, 15, 23, 19, 13, 12, 2, 20, 14, 22, 9, 6, 1 };
+    //-----------------------------------------------------------------------------
+    inline void keccakF1600(uint64_t* a)
+    {
+        for (int r = 0; r < 24; ++r)
+        {
+            // theta
+            uint64_t c[5];
+            for (int x = 0; x < 5; ++x)
+                c[x] = a[x] ^ a[x + 5] ^ a[x + 10] ^ a[x + 15] ^ a[x + 20];
+            for (int x = 0; x < 5; ++x)
+            {
+                const uint64_t d = c[(x + 4) % 5] ^ rotl64(c[(x + 1) % 5], 1);
+                for (int y = 0; y < 25; y += 5)
+                    a[y + x] ^= d;
+            }
+            // rho, pi
+            uint64_t t = a[1];
+            for (int i = 0; i < 24; ++i)
+            {
+                const uint64_t lane = a[c_keccakPi[i]];
+                a[c_keccakPi[i]] = rotl64(t, c_keccakRho[i]);
+                t = lane;
+            }
+            // chi
+            for (int y = 0; y < 25; y += 5)
+            {
+                for (int x = 0; x < 5; ++x)
+                    c[x] = a[y + x];
+                for (int x = 0; x < 5; ++x)
+                    a[y + x] = c[x] ^ (~c[(x + 1) % 5] & c[(x + 2) % 5]);
+            }
+            // iota
+            a[0] ^= c_keccakRoundConstants[r];
+        }
+    }
+    //-----------------------------------------------------------------------------
+    //! Host version of the keccakF1600 kernel: Keccak-256(original padding) of a 32 byte message.
+    inline void keccakHash(const uint32x8& in, uint32x8& out)
+    {
+        uint64_t a[25] = { 0 };
+        toWords64(in, a);
+        a[4] = 0x0000000000000001ULL;
+        a[16] = 0x8000000000000000ULL;
+        keccakF1600(a);
+        fromWords64(a, out);
+    }
+    //-----------------------------------------------------------------------------
+}
+
+#endif // !Keccak_INCLUDE_ONCE
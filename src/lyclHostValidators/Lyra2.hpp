@@ -0,0 +1,170 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef Lyra2_INCLUDE_ONCE
+#define Lyra2_INCLUDE_ONCE
+
+//-----------------------------------------------------------------------------
+// Host Lyra2(timeCost 1, 4 rows, 4 columns, 12 word blocks) split like the kernels:
+// lyra441p1(absorb), lyra441p2(setup and wandering phases), lyra441p3(squeeze).
+// lyra441p2 of Lyra2REv3 picks the wandering row through an instance word.
+//-----------------------------------------------------------------------------
+
+#include <lyclHostValidators/HashTypes.hpp>
+
+namespace lycl
+{
+    //-----------------------------------------------------------------------------
+    const int c_lyraRows = 4;
+    const int c_lyraColumns = 4;
+    //! words per block
+    const int c_lyraBlockWords = 12;
+    //-----------------------------------------------------------------------------
+    inline void lyraG(uint64_t* v, int a, int b, int c, int d)
+    {
+        v[a] += v[b]; v[d] = rotr64(v[d] ^ v[a], 32);
+        v[c] += v[d]; v[b] = rotr64(v[b] ^ v[c], 24);
+        v[a] += v[b]; v[d] = rotr64(v[d] ^ v[a], 16);
+        v[c] += v[d]; v[b] = rotr64(v[b] ^ v[c], 63);
+    }
+    //-----------------------------------------------------------------------------
+    //! Blake2b round without a message.
+    inline void lyraRound(uint64_t* v)
+    {
+        lyraG(v, 0, 4,  8, 12);
+        lyraG(v, 1, 5,  9, 13);
+        lyraG(v, 2, 6, 10, 14);
+        lyraG(v, 3, 7, 11, 15);
+        lyraG(v, 0, 5, 10, 15);
+        lyraG(v, 1, 6, 11, 12);
+        lyraG(v, 2, 7,  8, 13);
+        lyraG(v, 3, 4,  9, 14);
+    }
+    //-----------------------------------------------------------------------------
+    //! Host version of the lyra441p1 kernel. Absorbs (in) as password and salt.
+    inline void lyra441p1(const uint32x8& in, LyraState& out_state)
+    {
+        static const uint64_t blake2bIV[8] =
+        {
+            0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+            0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+        };
+        uint64_t* v = out_state.s;
+        toWords64(in, v);
+        toWords64(in, v + 4);
+        for (int i = 0; i < 8; ++i)
+            v[8 + i] = blake2bIV[i];
+
+        for (int i = 0; i < 12; ++i)
+            lyraRound(v);
+
+        // basil: key and salt length, output length, timeCost, nRows, nCols, padding
+        v[0] ^= 0x20; v[1] ^= 0x20; v[2] ^= 0x20; v[3] ^= 0x01;
+        v[4] ^= 0x04; v[5] ^= 0x04; v[6] ^= 0x80; v[7] ^= 0x0100000000000000ULL;
+
+        for (int i = 0; i < 12; ++i)
+            lyraRound(v);
+    }
+    //-----------------------------------------------------------------------------
+    //! One duplexing of a row pair: s ^= in + inout, then a round.
+    //! (inout) takes the state rotated by one word.
+    inline void lyraDuplexBlock(uint64_t* s, const uint64_t* in, uint64_t* inout)
+    {
+        for (int j = 0; j < c_lyraBlockWords; ++j)
+            s[j] ^= in[j] + inout[j];
+        lyraRound(s);
+    }
+    //-----------------------------------------------------------------------------
+    inline void lyraRotateInto(const uint64_t* s, uint64_t* inout)
+    {
+        inout[0] ^= s[c_lyraBlockWords - 1];
+        for (int j = 1; j < c_lyraBlockWords; ++j)
+            inout[j] ^= s[j - 1];
+    }
+    //-----------------------------------------------------------------------------
+    //! Host version of the lyra441p2 kernels. (rev3): Lyra2REv3 wandering.
+    inline void lyra441p2(LyraState& state, bool rev3)
+    {
+        uint64_t* s = state.s;
+        uint64_t m[c_lyraRows][c_lyraColumns][c_lyraBlockWords];
+
+        // squeeze row 0, stored in reverse column order
+        for (int i = 0; i < c_lyraColumns; ++i)
+        {
+            for (int j = 0; j < c_lyraBlockWords; ++j)
+                m[0][c_lyraColumns - 1 - i][j] = s[j];
+            lyraRound(s);
+        }
+        // duplex row 0 into row 1
+        for (int i = 0; i < c_lyraColumns; ++i)
+        {
+            for (int j = 0; j < c_lyraBlockWords; ++j)
+                s[j] ^= m[0][i][j];
+            lyraRound(s);
+            for (int j = 0; j < c_lyraBlockWords; ++j)
+                m[1][c_lyraColumns - 1 - i][j] = m[0][i][j] ^ s[j];
+        }
+        // setup rows 2 and 3
+        for (int row = 2; row < c_lyraRows; ++row)
+        {
+            const int prev = row - 1;
+            const int rowa = row - 2;
+            for (int i = 0; i < c_lyraColumns; ++i)
+            {
+                lyraDuplexBlock(s, m[prev][i], m[rowa][i]);
+                for (int j = 0; j < c_lyraBlockWords; ++j)
+                    m[row][c_lyraColumns - 1 - i][j] = m[prev][i][j] ^ s[j];
+                lyraRotateInto(s, m[rowa][i]);
+            }
+        }
+
+        // wandering
+        int prev = c_lyraRows - 1;
+        int row = 0;
+        int rowa = 0;
+        uint64_t instance = 0;
+        do
+        {
+            if (rev3)
+            {
+                instance = s[instance & 15];
+                rowa = (int)(s[instance & 15] & 3);
+            }
+            else
+                rowa = (int)(s[0] & 3);
+
+            for (int i = 0; i < c_lyraColumns; ++i)
+            {
+                lyraDuplexBlock(s, m[prev][i], m[rowa][i]);
+                // (rowa) may be (row)
+                for (int j = 0; j < c_lyraBlockWords; ++j)
+                    m[row][i][j] ^= s[j];
+                lyraRotateInto(s, m[rowa][i]);
+            }
+            prev = row;
+            row = (row + 1) & (c_lyraRows - 1);
+        } while (row != 0);
+
+        // wrap-up absorb
+        for (int j = 0; j < c_lyraBlockWords; ++j)
+            s[j] ^= m[rowa][0][j];
+    }
+    //-----------------------------------------------------------------------------
+    //! Host version of the lyra441p3 kernel. Squeezes the 256 bit digest.
+    inline void lyra441p3(const LyraState& state, uint32x8& out)
+    {
+        LyraState v = state;
+        for (int i = 0; i < 12; ++i)
+            lyraRound(v.s);
+        fromWords64(v.s, out);
+    }
+    //-----------------------------------------------------------------------------
+}
+
+#endif // !Lyra2_INCLUDE_ONCE
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef Lyra2RE_INCLUDE_ONCE
+#define Lyra2RE_INCLUDE_ONCE
+
+//-----------------------------------------------------------------------------
+// Host Lyra2REv2/v3 chains. Stages work on the buffers of the kernels with the
+// same name, so results can be compared with a pipeline after any launch.
+// Lyra2REv2: blake32, keccakF1600, cubeHash256, lyra441p1-3, skein, cubeHash256, bmw
+// Lyra2REv3: blake32, lyra441p1-3, cubeHash256, lyra441p1-3, bmw
+//-----------------------------------------------------------------------------
+
+#include <string>
+#include <cstring>
+
+#include <lyclCore/Blake256.hpp>
+#include <lyclHostValidators/HashTypes.hpp>
+#include <lyclHostValidators/Keccak.hpp>
+#include <lyclHostValidators/CubeHash.hpp>
+#include <lyclHostValidators/Skein.hpp>
+#include <lyclHostValidators/Lyra2.hpp>
+#include <lyclHostValidators/BMW.hpp>
+
+namespace lycl
+{
+    //-----------------------------------------------------------------------------
+    //! Stages between blake32 and bmw.
+    const char* const c_lyra2REv2HostStages[] =
+    {
+        "keccakF1600", "cubeHash256", "lyra441p1", "lyra441p2", "lyra441p3", "skein", "cubeHash256"
+    };
+    const char* const c_lyra2REv3HostStages[] =
+    {
+        "lyra441p1", "lyra441p2", "lyra441p3", "cubeHash256", "lyra441p1", "lyra441p2", "lyra441p3"
+    };
+    //-----------------------------------------------------------------------------
+    //! Host version of a middle stage of (algorithm)("Lyra2REv2" or "Lyra2REv3").
+    //! Returns false for blake32, bmw stages and unknown names.
+    inline bool runHostStage(const std::string& algorithm, const std::string& stage, uint32x8& hash, LyraState& lyra_state)
+    {
+        if (stage == "keccakF1600")
+            keccakHash(hash, hash);
+        else if (stage == "cubeHash256")
+            cubeHash(hash, hash);
+        else if (stage == "skein")
+            skeinHash(hash, hash);
+        else if (stage == "lyra441p1")
+            lyra441p1(hash, lyra_state);
+        else if (stage == "lyra441p2")
+            lyra441p2(lyra_state, algorithm == "Lyra2REv3");
+        else if (stage == "lyra441p3")
+            lyra441p3(lyra_state, hash);
+        else
+            return false;
+        return true;
+    }
+    //-----------------------------------------------------------------------------
+    //! Host hash of a nonce. Header words 0-15 are compressed into (midstate) like for the blake32 kernel.
+    //! (out_bmw_input) is the hash buffer content the bmwHtarg kernel reads, (out_hash) the final hash.
+    inline bool lyra2REHash(const std::string& algorithm, const uint32_t* midstate, uint32_t in16, uint32_t in17,
+                            uint32_t in18, uint32_t nonce, uint32x8& out_bmw_input, uint32x8& out_hash)
+    {
+        const bool rev3 = (algorithm == "Lyra2REv3");
+        if (!rev3 && algorithm != "Lyra2REv2")
+            return false;
+        const char* const* stages = rev3 ? c_lyra2REv3HostStages : c_lyra2REv2HostStages;
+        const size_t numStages = rev3 ? sizeof(c_lyra2REv3HostStages) / sizeof(c_lyra2REv3HostStages[0]) :
+                                        sizeof(c_lyra2REv2HostStages) / sizeof(c_lyra2REv2HostStages[0]);
+
+        uint32x8 hash;
+        LyraState lyraState;
+        blake256_final80(midstate, in16, in17, in18, nonce, hash.h);
+        for (size_t i = 0; i < numStages; ++i)
+            runHostStage(algorithm, stages[i], hash, lyraState);
+
+        out_bmw_input = hash;
+        bmwHash(hash, out_hash);
+        return true;
+    }
+    //-----------------------------------------------------------------------------
+    //! Blake256 midstate of header words 0-15.
+    inline void lyra2REMidstate(const uint32_t* header, uint32_t* out_midstate)
+    {
+        static const uint32_t blake256IV[8] =
+        {
+            0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+            0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+        };
+        memcpy(out_midstate, blake256IV, sizeof(blake256IV));
+        blake256_compress(out_midstate, header);
+    }
+    //-----------------------------------------------------------------------------
+}
+
+#endif // !Lyra2RE_INCLUDE_ONCE
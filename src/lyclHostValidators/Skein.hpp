@@ -0,0 +1,106 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+#ifndef Skein_INCLUDE_ONCE
+#define Skein_INCLUDE_ONCE
+
+#include <lyclHostValidators/HashTypes.hpp>
+
+namespace lycl
+{
+    //-----------------------------------------------------------------------------
+    //! Skein-512-256 chaining value after the configuration block.
+    const uint64_t c_skein256IV[8] =
+    {
+        0xCCD044A12FDB3E13ULL, 0xE83590301A79A9EBULL, 0x55AEA0614F816E6FULL, 0x2A2767A4AE9B94DBULL,
+        0xEC06025E74DD7683ULL, 0xE7A436CDC4746251ULL, 0xC36FBAF9393AD185ULL, 0x3EEDBA1833EDFC13ULL
+    };
+    const uint32_t c_threefish512Rotations[8][4] =
+    {
+        { 46, 36, 19, 37 }, { 33, 27, 14, 42 }, { 17, 49, 36, 39 }, { 44,  9, 54, 56 },
+        { 39, 30, 34, 24 }, { 13, 50, 10, 17 }, { 25, 29, 39, 43 }, {  8, 35, 56, 22 }
+    };
+    //! word order after each round
+    const uint32_t c_threefish512Permutation[8] = { 2, 1, 4, 7, 6, 5, 0, 3 };
+    const uint64_t c_threefishKeyParity = 0x1BD11BDAA9FC1A22ULL;
+    // tweak flags
+    const uint64_t c_skeinTweakFirst = 1ULL << 62;
+    const uint64_t c_skeinTweakFinal = 1ULL << 63;
+    const uint64_t c_skeinTypeMessage = 48ULL << 56;
+    const uint64_t c_skeinTypeOutput = 63ULL << 56;
+    //-----------------------------------------------------------------------------
+    //! Unique Block Iteration of a single block: h = Threefish-512(key: h, tweak)(m) ^ m.
+    inline void skeinUBI512(uint64_t* h, const uint64_t* m, uint64_t t0, uint64_t t1)
+    {
+        uint64_t k[9];
+        k[8] = c_threefishKeyParity;
+        for (int i = 0; i < 8; ++i)
+        {
+            k[i] = h[i];
+            k[8] ^= h[i];
+        }
+        const uint64_t t[3] = { t0, t1, t0 ^ t1 };
+
+        uint64_t v[8];
+        for (int i = 0; i < 8; ++i)
+            v[i] = m[i];
+
+        for (int s = 0; s <= 18; ++s)
+        {
+            // subkey injection
+            for (int i = 0; i < 8; ++i)
+                v[i] += k[(s + i) % 9];
+            v[5] += t[s % 3];
+            v[6] += t[(s + 1) % 3];
+            v[7] += (uint64_t)s;
+            if (s == 18)
+                break;
+
+            for (int r = 0; r < 4; ++r)
+            {
+                const uint32_t* rotations = c_threefish512Rotations[(s * 4 + r) & 7];
+                for (int j = 0; j < 4; ++j)
+                {
+                    v[2 * j] += v[2 * j + 1];
+                    v[2 * j + 1] = rotl64(v[2 * j + 1], rotations[j]) ^ v[2 * j];
+                }
+                uint64_t p[8];
+                for (int i = 0; i < 8; ++i)
+                    p[i] = v[c_threefish512Permutation[i]];
+                for (int i = 0; i < 8; ++i)
+                    v[i] = p[i];
+            }
+        }
+
+        for (int i = 0; i < 8; ++i)
+            h[i] = v[i] ^ m[i];
+    }
+    //-----------------------------------------------------------------------------
+    //! Host version of the skein kernel: Skein-512-256 of a 32 byte message.
+    inline void skeinHash(const uint32x8& in, uint32x8& out)
+    {
+        uint64_t h[8];
+        for (int i = 0; i < 8; ++i)
+            h[i] = c_skein256IV[i];
+
+        uint64_t m[8] = { 0 };
+        toWords64(in, m);
+        skeinUBI512(h, m, 32, c_skeinTypeMessage | c_skeinTweakFirst | c_skeinTweakFinal);
+
+        // output block: 64 bit counter 0
+        for (int i = 0; i < 8; ++i)
+            m[i] = 0;
+        skeinUBI512(h, m, 8, c_skeinTypeOutput | c_skeinTweakFirst | c_skeinTweakFinal);
+
+        fromWords64(h, out);
+    }
+    //-----------------------------------------------------------------------------
+}
+
+#endif // !Skein_INCLUDE_ONCE
@@ -0,0 +1,917 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+//-----------------------------------------------------------------------------
+// lyclMockPool. Local stratum server for reproducible miner tests without a pool.
+// Jobs come either from a capture file(lyclMiner --capture), replayed with the
+// original timing, or from a synthetic generator(job and difficulty storms).
+// Submitted shares are checked against the jobs that were sent: job id, staleness,
+// duplicates, field formats and ntime range. The block header is rebuilt and hashed
+// with the host Lyra2REv2/v3 chain, shares above the job's target are rejected.
+// One miner is served at a time.
+// When it disconnects, share counts and notify->first share latency are printed in JSON.
+//-----------------------------------------------------------------------------
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <set>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include <jansson.h>
+
+#include <lyclCore/HexCodec.hpp>
+#include <lyclCore/LineBuffer.hpp>
+#include <lyclCore/Network.hpp>
+#include <lyclCore/StratumCapture.hpp>
+#include <lyclCore/StratumParser.hpp>
+#include <lyclCore/Sha256.hpp>
+#include <lyclHostValidators/Lyra2RE.hpp>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#endif
+
+#ifdef MSG_NOSIGNAL
+#define MOCK_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define MOCK_SEND_FLAGS 0
+#endif
+
+//-----------------------------------------------------------------------------
+//! Number of recent jobs a share may refer to.
+#define MOCK_MAX_JOBS 64
+//! A share's ntime may be ahead of the job's ntime by this many seconds.
+#define MOCK_NTIME_WINDOW_SEC 7200
+#define MOCK_RECV_SIZE 4096
+//-----------------------------------------------------------------------------
+struct MockOptions
+{
+    std::string bindAddress;
+    int port;
+    //! capture file, empty for synthetic jobs
+    std::string replayFileName;
+    double speed;
+    // synthetic jobs
+    uint32_t intervalMs;
+    uint32_t cleanEvery;
+    double difficulty;
+    uint32_t diffStorm;
+    uint32_t merkleCount;
+    //! every n-th valid share is rejected as low difficulty
+    uint32_t lowDiffEvery;
+    uint32_t xnonce2Size;
+    //! Lyra2REv2 or Lyra2REv3
+    std::string algorithm;
+    bool once;
+};
+//-----------------------------------------------------------------------------
+struct MockJob
+{
+    std::string id;
+    uint32_t ntime;
+    //! header words 0-8 and 18(version, previous hash, nbits). The rest comes from the share.
+    uint32_t header[20];
+    std::vector<unsigned char> coinb1;
+    std::vector<unsigned char> coinb2;
+    std::vector<std::vector<unsigned char> > merkle;
+    //! difficulty when the job was sent
+    double difficulty;
+    //! shares of jobs older than the last clean job are stale
+    uint32_t generation;
+    uint64_t sentUs;
+    bool hasShare;
+};
+//-----------------------------------------------------------------------------
+//! Server message of a capture file, relative to the first one.
+struct ReplayEvent
+{
+    uint64_t timeUs;
+    std::string line;
+};
+//-----------------------------------------------------------------------------
+struct MockStats
+{
+    size_t numNotify;
+    size_t numDifficulty;
+    size_t numSubmits;
+    size_t numAccepted;
+    size_t numStale;
+    size_t numDuplicate;
+    size_t numLowDifficulty;
+    size_t numMalformed;
+    size_t numPings;
+    size_t numFirstShares;
+    double firstShareMsSum;
+    double firstShareMsMax;
+};
+//-----------------------------------------------------------------------------
+//! Pool state. Survives disconnects, so sessions can be resumed.
+struct MockPool
+{
+    MockOptions options;
+    std::vector<ReplayEvent> replay;
+    //! extranonce1 and extranonce2 size of the captured session
+    std::string replayXnonce1;
+    uint32_t replayXnonce2Size;
+
+    //! session id -> extranonce1
+    std::map<std::string, std::string> sessions;
+    uint32_t nextSession;
+
+    std::vector<MockJob> jobs;
+    std::set<std::string> submitted;
+    uint32_t generation;
+    uint32_t jobCounter;
+    uint32_t height;
+    std::string prevhash;
+    double difficulty;
+    uint32_t numValidShares;
+    size_t replayPosition;
+    uint64_t replayStartUs;
+    uint64_t nextJobUs;
+};
+//-----------------------------------------------------------------------------
+struct MockSession
+{
+    curl_socket_t sock;
+    LineBuffer recvBuffer;
+    std::string sessionId;
+    std::string xnonce1;
+    bool resumed;
+    bool authorized;
+    MockStats stats;
+    uint64_t startUs;
+};
+//-----------------------------------------------------------------------------
+inline uint32_t mockRandom(uint32_t& x)
+{
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    return x;
+}
+//-----------------------------------------------------------------------------
+std::string randomHex(uint32_t& x, size_t num_chars)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string s(num_chars, '0');
+    for (size_t i = 0; i < num_chars; ++i)
+        s[i] = digits[mockRandom(x) & 15];
+    return s;
+}
+//-----------------------------------------------------------------------------
+std::string hex32(uint32_t value)
+{
+    char buffer[9];
+    snprintf(buffer, sizeof(buffer), "%08x", value);
+    return buffer;
+}
+//-----------------------------------------------------------------------------
+//! Little endian hex, as in a serialized transaction.
+std::string hexLE(uint32_t value, size_t num_bytes)
+{
+    std::string s;
+    for (size_t i = 0; i < num_bytes; ++i)
+    {
+        char buffer[3];
+        snprintf(buffer, sizeof(buffer), "%02x", (value >> (i * 8)) & 0xFF);
+        s += buffer;
+    }
+    return s;
+}
+//-----------------------------------------------------------------------------
+bool sendLine(MockSession& session, const std::string& line)
+{
+    const std::string data = line + "\n";
+    size_t offset = 0;
+    while (offset < data.size())
+    {
+        const ssize_t n = send(session.sock, data.data() + offset, data.size() - offset, MOCK_SEND_FLAGS);
+        if (n <= 0)
+            return false;
+        offset += (size_t)n;
+    }
+    return true;
+}
+//-----------------------------------------------------------------------------
+bool sendResult(MockSession& session, json_t* id, json_t* result)
+{
+    json_t* val = json_object();
+    json_object_set(val, "id", id ? id : json_null());
+    json_object_set_new(val, "result", result);
+    json_object_set_new(val, "error", json_null());
+    char* s = json_dumps(val, 0);
+    const bool ret = sendLine(session, s);
+    free(s);
+    json_decref(val);
+    return ret;
+}
+//-----------------------------------------------------------------------------
+//! Response up to the "id" value, for responses jansson is not needed for: {"id": <id>
+std::string responsePrefix(json_t* id)
+{
+    json_t* val = json_object();
+    json_object_set(val, "id", id ? id : json_null());
+    char* s = json_dumps(val, 0);
+    const std::string prefix(s, strlen(s) - 1);
+    free(s);
+    json_decref(val);
+    return prefix;
+}
+//-----------------------------------------------------------------------------
+//! Stratum error codes: 20 other, 21 job not found, 22 duplicate share, 23 low difficulty share.
+bool sendError(MockSession& session, json_t* id, int code, const char* reason)
+{
+    char error[128];
+    snprintf(error, sizeof(error), "[%d,\"%s\",null]", code, reason);
+    return sendLine(session, responsePrefix(id) + ",\"result\":null,\"error\":" + error + "}");
+}
+//-----------------------------------------------------------------------------
+std::vector<unsigned char> hexBytes(const StratumStringView& hex)
+{
+    std::vector<unsigned char> bytes(hex.size / 2);
+    if (!hexDecode(bytes.data(), hex.data, bytes.size()))
+        bytes.clear();
+    return bytes;
+}
+//-----------------------------------------------------------------------------
+//! Registers a job sent to the miner. (line) is a server message, other than mining.notify
+//! only mining.set_difficulty is tracked.
+void trackJob(MockPool& pool, MockSession& session, const std::string& line)
+{
+    StratumMessage message;
+    if (!parseStratumMessage(line.data(), line.size(), message))
+        return;
+    if (message.type == SM_SetDifficulty)
+        pool.difficulty = message.difficulty;
+    if (message.type != SM_Notify)
+        return;
+
+    const StratumNotifyParams& notify = message.notify;
+    if (notify.clean)
+        ++pool.generation;
+    MockJob job;
+    job.id.assign(notify.jobId.data, notify.jobId.size);
+    job.ntime = (uint32_t)strtoul(std::string(notify.ntime.data, notify.ntime.size).c_str(), nullptr, 16);
+    // same layout as the miner's work data(buildExtraHeader)
+    memset(job.header, 0, sizeof(job.header));
+    const std::vector<unsigned char> version = hexBytes(notify.version);
+    const std::vector<unsigned char> prevhash = hexBytes(notify.prevhash);
+    const std::vector<unsigned char> nbits = hexBytes(notify.nbits);
+    if (version.size() == 4 && prevhash.size() == 32 && nbits.size() == 4)
+    {
+        job.header[0] = le32dec(version.data());
+        for (int i = 0; i < 8; ++i)
+            job.header[1 + i] = le32dec(prevhash.data() + i * 4);
+        job.header[18] = le32dec(nbits.data());
+    }
+    job.coinb1 = hexBytes(notify.coinb1);
+    job.coinb2 = hexBytes(notify.coinb2);
+    for (int m = 0; m < notify.merkleCount; ++m)
+        job.merkle.push_back(hexBytes(notify.merkle[m]));
+    job.difficulty = pool.difficulty;
+    job.generation = pool.generation;
+    job.sentUs = getSteadyTimeUs();
+    job.hasShare = false;
+    pool.jobs.push_back(job);
+    if (pool.jobs.size() > MOCK_MAX_JOBS)
+        pool.jobs.erase(pool.jobs.begin());
+    ++session.stats.numNotify;
+}
+//-----------------------------------------------------------------------------
+bool sendDifficulty(MockPool& pool, MockSession& session)
+{
+    char line[128];
+    snprintf(line, sizeof(line), "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[%.10g]}", pool.difficulty);
+    ++session.stats.numDifficulty;
+    return sendLine(session, line);
+}
+//-----------------------------------------------------------------------------
+//! Synthetic job with a coinbase the miner can take apart(BIP34 height after the input).
+bool sendSyntheticJob(MockPool& pool, MockSession& session, bool force_clean)
+{
+    const MockOptions& options = pool.options;
+    uint32_t x = 0x6A09E667 ^ (pool.jobCounter * 0x9E3779B9u);
+    mockRandom(x);
+
+    const bool clean = force_clean || pool.prevhash.empty() || (options.cleanEvery && (pool.jobCounter % options.cleanEvery) == 0);
+    if (clean)
+    {
+        ++pool.height;
+        pool.prevhash = randomHex(x, 64);
+    }
+    if (options.diffStorm && pool.jobCounter && (pool.jobCounter % options.diffStorm) == 0)
+    {
+        // cycles through 1x, 2x, 4x and 8x of the configured difficulty
+        pool.difficulty = options.difficulty * (double)(1u << ((pool.jobCounter / options.diffStorm) & 3));
+        if (!sendDifficulty(pool, session))
+            return false;
+    }
+
+    static const char tag[] = "/lyclMockPool/";
+    const size_t tagSize = sizeof(tag) - 1;
+    const size_t scriptSize = 4 + 1 + tagSize + session.xnonce1.size() / 2 + options.xnonce2Size;
+    std::string tagHex;
+    for (size_t i = 0; i < tagSize; ++i)
+        tagHex += hexLE((unsigned char)tag[i], 1);
+
+    const std::string coinb1 = "01000000" "01" + std::string(64, '0') + "ffffffff" + hexLE((uint32_t)scriptSize, 1) +
+                               "03" + hexLE(pool.height, 3) + hexLE((uint32_t)tagSize, 1) + tagHex;
+    const std::string coinb2 = "ffffffff" "01" "00f2052a01000000" "19" "76a914" + randomHex(x, 40) + "88ac" "00000000";
+
+    const std::string jobId = hex32(++pool.jobCounter);
+    std::string line = "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"" + jobId + "\",\"" + pool.prevhash + "\",\"" +
+                       coinb1 + "\",\"" + coinb2 + "\",[";
+    for (uint32_t m = 0; m < options.merkleCount; ++m)
+        line += (m ? ",\"" : "\"") + randomHex(x, 64) + "\"";
+    line += "],\"20000000\",\"1b0404cb\",\"" + hex32((uint32_t)time(NULL)) + "\"," + (clean ? "true" : "false") + "]}";
+
+    trackJob(pool, session, line);
+    return sendLine(session, line);
+}
+//-----------------------------------------------------------------------------
+//! Sends the first job of a session and schedules the following ones.
+bool startJobs(MockPool& pool, MockSession& session)
+{
+    const uint64_t nowUs = getSteadyTimeUs();
+    if (pool.replay.size())
+    {
+        // a resumed session continues the replay
+        if (!session.resumed || pool.replayPosition >= pool.replay.size())
+            pool.replayPosition = 0;
+        pool.replayStartUs = nowUs - (uint64_t)((double)pool.replay[pool.replayPosition].timeUs / pool.options.speed);
+        return true;
+    }
+
+    pool.nextJobUs = nowUs + (uint64_t)pool.options.intervalMs * 1000;
+    if (session.resumed && pool.jobs.size())
+        return true;
+    return sendDifficulty(pool, session) && sendSyntheticJob(pool, session, true);
+}
+//-----------------------------------------------------------------------------
+//! Sends due jobs. Returns the time of the next one.
+bool pushJobs(MockPool& pool, MockSession& session, uint64_t& out_next_us)
+{
+    const uint64_t nowUs = getSteadyTimeUs();
+    if (pool.replay.size())
+    {
+        while (pool.replayPosition < pool.replay.size())
+        {
+            const ReplayEvent& event = pool.replay[pool.replayPosition];
+            const uint64_t eventUs = pool.replayStartUs + (uint64_t)((double)event.timeUs / pool.options.speed);
+            if (eventUs > nowUs)
+            {
+                out_next_us = eventUs;
+                return true;
+            }
+            trackJob(pool, session, event.line);
+            if (event.line.find("mining.set_difficulty") != std::string::npos)
+                ++session.stats.numDifficulty;
+            if (!sendLine(session, event.line))
+                return false;
+            ++pool.replayPosition;
+        }
+        out_next_us = nowUs + 1000000;
+        return true;
+    }
+
+    if (nowUs >= pool.nextJobUs)
+    {
+        if (!sendSyntheticJob(pool, session, false))
+            return false;
+        pool.nextJobUs = nowUs + (uint64_t)pool.options.intervalMs * 1000;
+    }
+    out_next_us = pool.nextJobUs;
+    return true;
+}
+//-----------------------------------------------------------------------------
+inline bool isHexField(const char* s, size_t num_chars)
+{
+    return s && strlen(s) == num_chars && hexIsValid(s, num_chars);
+}
+//-----------------------------------------------------------------------------
+//! Share target of a job, as the miner computes it(setTarget): diff / 256 for Lyra2REv2/v3.
+void shareTarget(double difficulty, uint32_t* out_target)
+{
+    double diff = difficulty / 256.0;
+    int k;
+    for (k = 6; k > 0 && diff > 1.0; k--)
+        diff /= 4294967296.0;
+    const uint64_t m = (uint64_t)(4294901760.0 / diff);
+    memset(out_target, 0, 32);
+    if (m == 0 && k == 6)
+        memset(out_target, 0xff, 32);
+    else
+    {
+        out_target[k] = (uint32_t)m;
+        out_target[k + 1] = (uint32_t)(m >> 32);
+    }
+}
+//-----------------------------------------------------------------------------
+//! Rebuilds the block header of a share and hashes it. Strings are validated hex.
+//! Returns false if the header could not be built.
+bool hashShare(const MockPool& pool, const MockSession& session, const MockJob& job, const char* xnonce2,
+               const char* ntime, const char* nonce, lycl::uint32x8& out_hash)
+{
+    const size_t xnonce1Size = session.xnonce1.size() / 2;
+    const size_t xnonce2Size = strlen(xnonce2) / 2;
+    std::vector<unsigned char> coinbase(job.coinb1);
+    const size_t xnonceOffset = coinbase.size();
+    coinbase.resize(xnonceOffset + xnonce1Size + xnonce2Size);
+    if (!hexDecode(coinbase.data() + xnonceOffset, session.xnonce1.data(), xnonce1Size) ||
+        !hexDecode(coinbase.data() + xnonceOffset + xnonce1Size, xnonce2, xnonce2Size))
+        return false;
+    coinbase.insert(coinbase.end(), job.coinb2.begin(), job.coinb2.end());
+
+    unsigned char merkleRoot[64];
+    sha256d(merkleRoot, coinbase.data(), (int)coinbase.size());
+    for (size_t i = 0; i < job.merkle.size(); ++i)
+    {
+        if (job.merkle[i].size() != 32)
+            return false;
+        memcpy(merkleRoot + 32, job.merkle[i].data(), 32);
+        sha256d(merkleRoot, merkleRoot, 64);
+    }
+
+    unsigned char ntimeBytes[4];
+    unsigned char nonceBytes[4];
+    hexDecode(ntimeBytes, ntime, 4);
+    hexDecode(nonceBytes, nonce, 4);
+
+    uint32_t header[20];
+    memcpy(header, job.header, sizeof(header));
+    for (int i = 0; i < 8; ++i)
+        header[9 + i] = be32dec(merkleRoot + i * 4);
+    header[17] = le32dec(ntimeBytes);
+    header[19] = le32dec(nonceBytes);
+
+    uint32_t midstate[8];
+    lycl::lyra2REMidstate(header, midstate);
+    lycl::uint32x8 bmwInput;
+    return lycl::lyra2REHash(pool.options.algorithm, midstate, header[16], header[17], header[18], header[19],
+                             bmwInput, out_hash);
+}
+//-----------------------------------------------------------------------------
+//! (hash) <= (target), both little endian words.
+bool isBelowTarget(const lycl::uint32x8& hash, const uint32_t* target)
+{
+    for (int i = 7; i >= 0; --i)
+    {
+        if (hash.h[i] != target[i])
+            return hash.h[i] < target[i];
+    }
+    return true;
+}
+//-----------------------------------------------------------------------------
+bool handleSubmit(MockPool& pool, MockSession& session, json_t* id, json_t* params)
+{
+    ++session.stats.numSubmits;
+    const char* jobId = json_string_value(json_array_get(params, 1));
+    const char* xnonce2 = json_string_value(json_array_get(params, 2));
+    const char* ntime = json_string_value(json_array_get(params, 3));
+    const char* nonce = json_string_value(json_array_get(params, 4));
+    const uint32_t xnonce2Size = pool.replay.size() ? pool.replayXnonce2Size : pool.options.xnonce2Size;
+    if (!session.authorized || !jobId || !isHexField(xnonce2, xnonce2Size * 2) || !isHexField(ntime, 8) || !isHexField(nonce, 8))
+    {
+        ++session.stats.numMalformed;
+        return sendError(session, id, 20, "Malformed share");
+    }
+
+    MockJob* job = nullptr;
+    for (size_t i = pool.jobs.size(); i-- > 0;)
+    {
+        if (pool.jobs[i].id == jobId)
+        {
+            job = &pool.jobs[i];
+            break;
+        }
+    }
+    if (!job)
+    {
+        ++session.stats.numStale;
+        return sendError(session, id, 21, "Job not found");
+    }
+    if (job->generation != pool.generation)
+    {
+        ++session.stats.numStale;
+        return sendError(session, id, 21, "Stale share");
+    }
+
+    const uint32_t shareTime = (uint32_t)strtoul(ntime, nullptr, 16);
+    if (shareTime < job->ntime || shareTime > job->ntime + MOCK_NTIME_WINDOW_SEC)
+    {
+        ++session.stats.numMalformed;
+        return sendError(session, id, 20, "ntime out of range");
+    }
+
+    const std::string key = std::string(jobId) + ":" + session.xnonce1 + xnonce2 + ntime + nonce;
+    if (!pool.submitted.insert(key).second)
+    {
+        ++session.stats.numDuplicate;
+        return sendError(session, id, 22, "Duplicate share");
+    }
+
+    lycl::uint32x8 hash;
+    if (!hashShare(pool, session, *job, xnonce2, ntime, nonce, hash))
+    {
+        ++session.stats.numMalformed;
+        return sendError(session, id, 20, "Malformed job");
+    }
+    uint32_t target[8];
+    shareTarget(job->difficulty, target);
+    if (!isBelowTarget(hash, target))
+    {
+        ++session.stats.numLowDifficulty;
+        return sendError(session, id, 23, "Low difficulty share");
+    }
+
+    if (!job->hasShare)
+    {
+        job->hasShare = true;
+        const double latencyMs = (double)(getSteadyTimeUs() - job->sentUs) * 0.001;
+        ++session.stats.numFirstShares;
+        session.stats.firstShareMsSum += latencyMs;
+        if (latencyMs > session.stats.firstShareMsMax)
+            session.stats.firstShareMsMax = latencyMs;
+    }
+
+    ++pool.numValidShares;
+    // fault injection
+    if (pool.options.lowDiffEvery && (pool.numValidShares % pool.options.lowDiffEvery) == 0)
+    {
+        ++session.stats.numLowDifficulty;
+        return sendError(session, id, 23, "Low difficulty share");
+    }
+
+    ++session.stats.numAccepted;
+    return sendResult(session, id, json_true());
+}
+//-----------------------------------------------------------------------------
+bool handleSubscribe(MockPool& pool, MockSession& session, json_t* id, json_t* params)
+{
+    const char* previousId = json_string_value(json_array_get(params, 1));
+    std::map<std::string, std::string>::const_iterator known = previousId ? pool.sessions.find(previousId) : pool.sessions.end();
+    if (known != pool.sessions.end())
+    {
+        session.sessionId = known->first;
+        session.xnonce1 = known->second;
+        session.resumed = true;
+    }
+    else
+    {
+        session.sessionId = hex32(0x5E550000u + pool.nextSession);
+        session.xnonce1 = pool.replay.size() ? pool.replayXnonce1 : hex32(0x10000000u + pool.nextSession);
+        ++pool.nextSession;
+        pool.sessions[session.sessionId] = session.xnonce1;
+        // shares of another session can not be valid
+        pool.jobs.clear();
+        pool.submitted.clear();
+    }
+
+    const uint32_t xnonce2Size = pool.replay.size() ? pool.replayXnonce2Size : pool.options.xnonce2Size;
+    const std::string result = "[[[\"mining.set_difficulty\",\"" + session.sessionId + "\"],[\"mining.notify\",\"" +
+                               session.sessionId + "\"]],\"" + session.xnonce1 + "\"," + std::to_string(xnonce2Size) + "]";
+    std::cerr << "Session " << session.sessionId << (session.resumed ? " resumed" : " started") << std::endl;
+    return sendLine(session, responsePrefix(id) + ",\"result\":" + result + ",\"error\":null}");
+}
+//-----------------------------------------------------------------------------
+bool handleRequest(MockPool& pool, MockSession& session, const char* line, size_t size)
+{
+    json_error_t err;
+    json_t* val = json_loadb(line, size, 0, &err);
+    if (!val)
+    {
+        std::cerr << "Invalid JSON from the miner: " << std::string(line, size) << std::endl;
+        return true;
+    }
+
+    bool ret = true;
+    json_t* id = json_object_get(val, "id");
+    json_t* params = json_object_get(val, "params");
+    const char* method = json_string_value(json_object_get(val, "method"));
+    if (!method)
+        ; // response to a server request
+    else if (!strcmp(method, "mining.submit"))
+        ret = handleSubmit(pool, session, id, params);
+    else if (!strcmp(method, "mining.subscribe"))
+        ret = handleSubscribe(pool, session, id, params);
+    else if (!strcmp(method, "mining.authorize"))
+    {
+        ret = sendResult(session, id, json_true());
+        if (ret && !session.authorized)
+        {
+            session.authorized = true;
+            ret = startJobs(pool, session);
+        }
+    }
+    else if (!strcmp(method, "mining.extranonce.subscribe"))
+        ret = sendResult(session, id, json_true());
+    else if (!strcmp(method, "mining.ping"))
+    {
+        ++session.stats.numPings;
+        ret = sendResult(session, id, json_string("pong"));
+    }
+    else
+        ret = sendError(session, id, 20, "Unknown method");
+
+    json_decref(val);
+    return ret;
+}
+//-----------------------------------------------------------------------------
+void printSummary(const MockPool& pool, const MockSession& session)
+{
+    const MockStats& stats = session.stats;
+    const uint64_t durationUs = getSteadyTimeUs() - session.startUs;
+    char buffer[1024];
+    snprintf(buffer, sizeof(buffer),
+             "{\n"
+             "  \"source\": \"%s\",\n"
+             "  \"session\": \"%s\",\n"
+             "  \"resumed\": %s,\n"
+             "  \"seconds\": %.3f,\n"
+             "  \"notify\": %zu,\n"
+             "  \"setDifficulty\": %zu,\n"
+             "  \"pings\": %zu,\n"
+             "  \"shares\": { \"submitted\": %zu, \"accepted\": %zu, \"stale\": %zu, \"duplicate\": %zu, \"lowDifficulty\": %zu, \"malformed\": %zu },\n"
+             "  \"notifyToFirstShareMs\": { \"jobs\": %zu, \"avg\": %.2f, \"max\": %.2f }\n"
+             "}\n",
+             pool.replay.size() ? "replay" : "synthetic", session.sessionId.c_str(), session.resumed ? "true" : "false",
+             (double)durationUs * 1e-6, stats.numNotify, stats.numDifficulty, stats.numPings,
+             stats.numSubmits, stats.numAccepted, stats.numStale, stats.numDuplicate, stats.numLowDifficulty, stats.numMalformed,
+             stats.numFirstShares, stats.numFirstShares ? stats.firstShareMsSum / (double)stats.numFirstShares : 0.0,
+             stats.firstShareMsMax);
+    std::cout << buffer << std::flush;
+}
+//-----------------------------------------------------------------------------
+void runSession(MockPool& pool, curl_socket_t sock)
+{
+    MockSession session;
+    session.sock = sock;
+    session.resumed = false;
+    session.authorized = false;
+    memset(&session.stats, 0, sizeof(session.stats));
+    session.startUs = getSteadyTimeUs();
+
+    bool connected = true;
+    while (connected)
+    {
+        uint64_t nextUs = getSteadyTimeUs() + 1000000;
+        if (session.authorized && !pushJobs(pool, session, nextUs))
+            break;
+
+        const uint64_t nowUs = getSteadyTimeUs();
+        const int waitMs = (nextUs > nowUs) ? (int)std::min<uint64_t>((nextUs - nowUs + 999) / 1000, 1000) : 0;
+        const int revents = socket_wait(sock, POLLIN, waitMs);
+        if (revents < 0)
+            break;
+        if (!revents)
+            continue;
+
+        const ssize_t n = recv(sock, session.recvBuffer.prepare(MOCK_RECV_SIZE), MOCK_RECV_SIZE, 0);
+        if (n <= 0)
+            break;
+        session.recvBuffer.commit((size_t)n);
+
+        const char* line;
+        size_t size;
+        while (connected && session.recvBuffer.nextLine(line, size))
+        {
+            if (size)
+                connected = handleRequest(pool, session, line, size);
+        }
+    }
+
+    std::cerr << "Session " << session.sessionId << " closed" << std::endl;
+    printSummary(pool, session);
+}
+//-----------------------------------------------------------------------------
+//! Loads server messages and the subscribe result of a capture file.
+bool loadReplay(const std::string& file_name, MockPool& out_pool)
+{
+    std::ifstream captureFile(file_name, std::ios::binary);
+    if (!captureFile)
+    {
+        std::cerr << "Failed to open a capture file: " << file_name << std::endl;
+        return false;
+    }
+    std::ostringstream data;
+    data << captureFile.rdbuf();
+    const std::string text = data.str();
+    if (!isStratumCapture(text.data(), text.size()))
+    {
+        std::cerr << "Not a capture file(lyclMiner --capture): " << file_name << std::endl;
+        return false;
+    }
+
+    LineBuffer buffer;
+    memcpy(buffer.prepare(text.size()), text.data(), text.size());
+    buffer.commit(text.size());
+
+    const char* line;
+    size_t size;
+    uint64_t firstUs = 0;
+    while (buffer.nextLine(line, size))
+    {
+        uint64_t timeUs;
+        char direction;
+        const char* payload;
+        size_t payloadSize;
+        if (!parseStratumCaptureLine(line, size, timeUs, direction, payload, payloadSize) || direction != '<')
+            continue;
+
+        json_error_t err;
+        json_t* val = json_loadb(payload, payloadSize, 0, &err);
+        if (!val)
+            continue;
+        json_t* result = json_object_get(val, "result");
+        if (json_string_value(json_object_get(val, "method")))
+        {
+            if (out_pool.replay.empty())
+                firstUs = timeUs;
+            ReplayEvent event = { timeUs - firstUs, std::string(payload, payloadSize) };
+            out_pool.replay.push_back(event);
+        }
+        else if (out_pool.replayXnonce1.empty() && json_is_array(result) && json_is_string(json_array_get(result, 1)))
+        {
+            // subscribe result: [subscriptions, extranonce1, extranonce2 size]
+            out_pool.replayXnonce1 = json_string_value(json_array_get(result, 1));
+            out_pool.replayXnonce2Size = (uint32_t)json_integer_value(json_array_get(result, 2));
+        }
+        json_decref(val);
+    }
+
+    if (out_pool.replay.empty() || out_pool.replayXnonce1.empty() || !out_pool.replayXnonce2Size)
+    {
+        std::cerr << "Capture file has no subscribe result or server messages: " << file_name << std::endl;
+        return false;
+    }
+    return true;
+}
+//-----------------------------------------------------------------------------
+curl_socket_t listenSocket(const MockOptions& options)
+{
+    curl_socket_t sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == CURL_SOCKET_BAD)
+        return sock;
+
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t)options.port);
+    if (inet_pton(AF_INET, options.bindAddress.c_str(), &address.sin_addr) != 1 ||
+        bind(sock, (const sockaddr*)&address, sizeof(address)) || listen(sock, 4))
+    {
+        socket_close(sock);
+        return CURL_SOCKET_BAD;
+    }
+    return sock;
+}
+//-----------------------------------------------------------------------------
+void printUsage()
+{
+    std::cerr << "Usage: lyclMockPool [options]\n"
+                 "  -p <port>         listening port. Default: 3333\n"
+                 "  -a <algorithm>    share hash: Lyra2REv2 or Lyra2REv3. Default: Lyra2REv3\n"
+                 "  -bind <address>   IPv4 address to listen on. Default: 127.0.0.1\n"
+                 "  -replay <file>    replay server messages of a capture file(lyclMiner --capture) with the original timing\n"
+                 "  -speed <factor>   replay speed. Default: 1\n"
+                 "  -interval <ms>    time between synthetic jobs. Default: 30000\n"
+                 "  -clean <n>        every n-th synthetic job is a new block(clean jobs). Default: 4\n"
+                 "  -diff <d>         share difficulty. Default: 1\n"
+                 "  -diffstorm <n>    change difficulty every n jobs. Default: 0(never)\n"
+                 "  -merkle <n>       Merkle branches per synthetic job. Default: 12\n"
+                 "  -xn2 <bytes>      extranonce2 size of synthetic sessions. Default: 4\n"
+                 "  -lowdiff <n>      also reject every n-th valid share as low difficulty. Default: 0(never)\n"
+                 "  -once             exit after the first session\n"
+              << std::endl;
+}
+//-----------------------------------------------------------------------------
+bool parseOptions(int argc, char** argv, MockOptions& out_options)
+{
+    out_options.bindAddress = "127.0.0.1";
+    out_options.port = 3333;
+    out_options.speed = 1.0;
+    out_options.intervalMs = 30000;
+    out_options.cleanEvery = 4;
+    out_options.difficulty = 1.0;
+    out_options.diffStorm = 0;
+    out_options.merkleCount = 12;
+    out_options.lowDiffEvery = 0;
+    out_options.xnonce2Size = 4;
+    out_options.algorithm = "Lyra2REv3";
+    out_options.once = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        const bool hasValue = (i + 1) < argc;
+        if (arg == "-p" && hasValue)
+            out_options.port = atoi(argv[++i]);
+        else if (arg == "-a" && hasValue)
+            out_options.algorithm = argv[++i];
+        else if (arg == "-bind" && hasValue)
+            out_options.bindAddress = argv[++i];
+        else if (arg == "-replay" && hasValue)
+            out_options.replayFileName = argv[++i];
+        else if (arg == "-speed" && hasValue)
+            out_options.speed = atof(argv[++i]);
+        else if (arg == "-interval" && hasValue)
+            out_options.intervalMs = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-clean" && hasValue)
+            out_options.cleanEvery = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-diff" && hasValue)
+            out_options.difficulty = atof(argv[++i]);
+        else if (arg == "-diffstorm" && hasValue)
+            out_options.diffStorm = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-merkle" && hasValue)
+            out_options.merkleCount = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-xn2" && hasValue)
+            out_options.xnonce2Size = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-lowdiff" && hasValue)
+            out_options.lowDiffEvery = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-once")
+            out_options.once = true;
+        else
+            return false;
+    }
+
+    return out_options.port > 0 && out_options.port < 65536 && out_options.speed > 0.0 && out_options.intervalMs &&
+           out_options.difficulty > 0.0 && out_options.merkleCount <= STRATUM_MAX_MERKLE &&
+           out_options.xnonce2Size >= 2 && out_options.xnonce2Size <= 16 &&
+           (out_options.algorithm == "Lyra2REv2" || out_options.algorithm == "Lyra2REv3");
+}
+//-----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    MockPool pool;
+    if (!parseOptions(argc, argv, pool.options))
+    {
+        printUsage();
+        return 1;
+    }
+    pool.replayXnonce2Size = 0;
+    pool.nextSession = 1;
+    pool.generation = 0;
+    pool.jobCounter = 0;
+    pool.height = 1000000;
+    pool.difficulty = pool.options.difficulty;
+    pool.numValidShares = 0;
+    pool.replayPosition = 0;
+    pool.replayStartUs = 0;
+    pool.nextJobUs = 0;
+    if (pool.options.replayFileName.size() && !loadReplay(pool.options.replayFileName, pool))
+        return 1;
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData))
+    {
+        std::cerr << "WSAStartup failed" << std::endl;
+        return 1;
+    }
+#endif
+
+    curl_socket_t server = listenSocket(pool.options);
+    if (server == CURL_SOCKET_BAD)
+    {
+        std::cerr << "Failed to listen on " << pool.options.bindAddress << ":" << pool.options.port << std::endl;
+        return 1;
+    }
+    std::cerr << "Listening on stratum+tcp://" << pool.options.bindAddress << ":" << pool.options.port
+              << (pool.replay.size() ? ", replaying " + std::to_string(pool.replay.size()) + " messages" : std::string(", synthetic jobs"))
+              << std::endl;
+
+    while (true)
+    {
+        curl_socket_t client = accept(server, NULL, NULL);
+        if (client == CURL_SOCKET_BAD)
+            continue;
+        // responses are small and latency is measured
+        int noDelay = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+        runSession(pool, client);
+        socket_close(client);
+        if (pool.options.once)
+            break;
+    }
+
+    socket_close(server);
+    return 0;
+}
@@ -0,0 +1,627 @@
+/*
+ * Copyright 2018-2019 CryptoGraphics <CrGr@protonmail.com>.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. See LICENSE for more details.
+ */
+
+//-----------------------------------------------------------------------------
+// lyclNetBench. Measures host-side stratum processing without a pool connection.
+// Received data(a capture file or a synthetic notify storm) is replayed from
+// memory in fixed-size chunks, as recv() would return it. Framed lines are then
+// parsed by the fast stratum parser and by jansson. Hex codec paths are compared
+// on stratum field sizes. Results are printed in JSON.
+//-----------------------------------------------------------------------------
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+
+#include <jansson.h>
+
+#include <lyclCore/HexCodec.hpp>
+#include <lyclCore/LineBuffer.hpp>
+#include <lyclCore/StratumCapture.hpp>
+#include <lyclCore/StratumParser.hpp>
+
+//-----------------------------------------------------------------------------
+struct BenchOptions
+{
+    std::string captureFileName;
+    size_t numLines;
+    size_t chunkSize;
+    size_t numPasses;
+};
+//-----------------------------------------------------------------------------
+//! Line handler result. Both framings must produce the same values.
+struct FramingResult
+{
+    size_t numLines;
+    uint64_t checksum;
+    double seconds;
+};
+//-----------------------------------------------------------------------------
+inline void consumeLine(const char* line, size_t size, FramingResult& result)
+{
+    ++result.numLines;
+    result.checksum = result.checksum * 31 + size + (size ? (unsigned char)line[size / 2] : 0);
+}
+//-----------------------------------------------------------------------------
+// Previous stratum_recv_line() framing: 2KB stack chunk, strcpy append,
+// strstr/strtok/strdup per line and memmove of the remaining buffer.
+//-----------------------------------------------------------------------------
+#define LEGACY_RBUFSIZE 2048
+#define LEGACY_RECVSIZE (LEGACY_RBUFSIZE - 4)
+struct LegacyFraming
+{
+    char* sockbuf;
+    size_t sockbuf_size;
+};
+//-----------------------------------------------------------------------------
+inline void legacyBufferAppend(LegacyFraming& f, const char* s)
+{
+    size_t old = strlen(f.sockbuf);
+    size_t n = old + strlen(s) + 1;
+    if (n >= f.sockbuf_size)
+    {
+        f.sockbuf_size = n + (LEGACY_RBUFSIZE - (n % LEGACY_RBUFSIZE));
+        f.sockbuf = (char*)realloc(f.sockbuf, f.sockbuf_size);
+    }
+    strcpy(f.sockbuf + old, s);
+}
+//-----------------------------------------------------------------------------
+inline char* legacyRecvLine(LegacyFraming& f, const std::string& stream, size_t chunk_size, size_t& offset)
+{
+    while (!strstr(f.sockbuf, "\n"))
+    {
+        if (offset >= stream.size())
+            return NULL;
+
+        char s[LEGACY_RBUFSIZE];
+        memset(s, 0, LEGACY_RBUFSIZE);
+        size_t n = std::min(std::min(chunk_size, (size_t)LEGACY_RECVSIZE), stream.size() - offset);
+        memcpy(s, stream.data() + offset, n);
+        offset += n;
+        legacyBufferAppend(f, s);
+    }
+
+    size_t buflen = strlen(f.sockbuf);
+    char* tok = strtok(f.sockbuf, "\n");
+    if (!tok)
+        return NULL;
+    char* sret = strdup(tok);
+    size_t len = strlen(sret);
+
+    if (buflen > len + 1)
+        memmove(f.sockbuf, f.sockbuf + len + 1, buflen - len + 1);
+    else
+        f.sockbuf[0] = '\0';
+
+    return sret;
+}
+//-----------------------------------------------------------------------------
+FramingResult runLegacyFraming(const std::string& stream, size_t chunk_size, size_t num_passes)
+{
+    FramingResult result = { 0, 0, 0.0 };
+    LegacyFraming f;
+    f.sockbuf = (char*)calloc(LEGACY_RBUFSIZE, 1);
+    f.sockbuf_size = LEGACY_RBUFSIZE;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t pass = 0; pass < num_passes; ++pass)
+    {
+        size_t offset = 0;
+        f.sockbuf[0] = '\0';
+        while (char* line = legacyRecvLine(f, stream, chunk_size, offset))
+        {
+            size_t size = strlen(line);
+            if (size && line[size - 1] == '\r')
+                --size;
+            consumeLine(line, size, result);
+            free(line);
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    free(f.sockbuf);
+    return result;
+}
+//-----------------------------------------------------------------------------
+FramingResult runLineBufferFraming(const std::string& stream, size_t chunk_size, size_t num_passes)
+{
+    FramingResult result = { 0, 0, 0.0 };
+    LineBuffer buffer;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t pass = 0; pass < num_passes; ++pass)
+    {
+        buffer.clear();
+        size_t offset = 0;
+        while (offset < stream.size())
+        {
+            // recv() replacement
+            size_t n = std::min(chunk_size, stream.size() - offset);
+            memcpy(buffer.prepare(n), stream.data() + offset, n);
+            buffer.commit(n);
+            offset += n;
+
+            const char* line;
+            size_t size;
+            while (buffer.nextLine(line, size))
+            {
+                if (size)
+                    consumeLine(line, size, result);
+            }
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+//-----------------------------------------------------------------------------
+//! Parser result. Both parsers must extract the same fields.
+struct ParseResult
+{
+    size_t numNotify;
+    size_t numDifficulty;
+    size_t numResponse;
+    //! lines rejected by the fast parser(handled by jansson in the miner)
+    size_t numFallback;
+    uint64_t checksum;
+    double seconds;
+};
+//-----------------------------------------------------------------------------
+inline void hashView(const char* data, size_t size, uint64_t& checksum)
+{
+    checksum = checksum * 31 + size;
+    for (size_t i = 0; i < size; i += 7)
+        checksum = checksum * 31 + (unsigned char)data[i];
+}
+//-----------------------------------------------------------------------------
+inline void hashNotify(const StratumNotifyParams& notify, uint64_t& checksum)
+{
+    hashView(notify.jobId.data, notify.jobId.size, checksum);
+    hashView(notify.prevhash.data, notify.prevhash.size, checksum);
+    hashView(notify.coinb1.data, notify.coinb1.size, checksum);
+    hashView(notify.coinb2.data, notify.coinb2.size, checksum);
+    for (int i = 0; i < notify.merkleCount; ++i)
+        hashView(notify.merkle[i].data, notify.merkle[i].size, checksum);
+    hashView(notify.version.data, notify.version.size, checksum);
+    hashView(notify.nbits.data, notify.nbits.size, checksum);
+    hashView(notify.ntime.data, notify.ntime.size, checksum);
+    checksum = checksum * 31 + (notify.clean ? 1 : 0);
+}
+//-----------------------------------------------------------------------------
+std::vector<std::string> splitLines(const std::string& stream)
+{
+    std::vector<std::string> lines;
+    LineBuffer buffer;
+    memcpy(buffer.prepare(stream.size()), stream.data(), stream.size());
+    buffer.commit(stream.size());
+
+    const char* line;
+    size_t size;
+    while (buffer.nextLine(line, size))
+    {
+        if (size)
+            lines.push_back(std::string(line, size));
+    }
+    return lines;
+}
+//-----------------------------------------------------------------------------
+ParseResult runFastParser(const std::vector<std::string>& lines, size_t num_passes)
+{
+    ParseResult result = { 0, 0, 0, 0, 0, 0.0 };
+    StratumMessage message;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t pass = 0; pass < num_passes; ++pass)
+    {
+        for (const std::string& line : lines)
+        {
+            if (!parseStratumMessage(line.data(), line.size(), message))
+            {
+                ++result.numFallback;
+                continue;
+            }
+
+            switch (message.type)
+            {
+            case SM_Notify:
+                ++result.numNotify;
+                hashNotify(message.notify, result.checksum);
+                break;
+            case SM_SetDifficulty:
+                ++result.numDifficulty;
+                result.checksum = result.checksum * 31 + (uint64_t)message.difficulty;
+                break;
+            case SM_Response:
+                ++result.numResponse;
+                result.checksum = result.checksum * 31 + (uint64_t)message.id + (message.resultTrue ? 1 : 0);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+//-----------------------------------------------------------------------------
+inline void jsonStringView(json_t* val, StratumStringView& out_view)
+{
+    out_view.data = json_string_value(val);
+    out_view.size = out_view.data ? strlen(out_view.data) : 0;
+}
+//-----------------------------------------------------------------------------
+//! jansson path of the miner: json_loadb and field lookup. Lines rejected by the fast parser are skipped.
+ParseResult runJanssonParser(const std::vector<std::string>& lines, size_t num_passes)
+{
+    ParseResult result = { 0, 0, 0, 0, 0, 0.0 };
+    StratumMessage message;
+    StratumNotifyParams notify;
+
+    // same message set for both parsers
+    std::vector<char> fastParsed(lines.size());
+    for (size_t i = 0; i < lines.size(); ++i)
+        fastParsed[i] = parseStratumMessage(lines[i].data(), lines[i].size(), message);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t pass = 0; pass < num_passes; ++pass)
+    {
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            if (!fastParsed[i])
+            {
+                ++result.numFallback;
+                continue;
+            }
+
+            json_error_t err;
+            json_t* val = json_loadb(lines[i].data(), lines[i].size(), 0, &err);
+            if (!val)
+                continue;
+
+            const char* method = json_string_value(json_object_get(val, "method"));
+            json_t* params = json_object_get(val, "params");
+            if (method && !strcmp(method, "mining.notify"))
+            {
+                ++result.numNotify;
+                int p = 0;
+                jsonStringView(json_array_get(params, p++), notify.jobId);
+                jsonStringView(json_array_get(params, p++), notify.prevhash);
+                jsonStringView(json_array_get(params, p++), notify.coinb1);
+                jsonStringView(json_array_get(params, p++), notify.coinb2);
+                json_t* merkle = json_array_get(params, p++);
+                notify.merkleCount = (int)json_array_size(merkle);
+                for (int m = 0; m < notify.merkleCount && m < STRATUM_MAX_MERKLE; ++m)
+                    jsonStringView(json_array_get(merkle, m), notify.merkle[m]);
+                jsonStringView(json_array_get(params, p++), notify.version);
+                jsonStringView(json_array_get(params, p++), notify.nbits);
+                jsonStringView(json_array_get(params, p++), notify.ntime);
+                notify.clean = json_is_true(json_array_get(params, p));
+                hashNotify(notify, result.checksum);
+            }
+            else if (method)
+            {
+                ++result.numDifficulty;
+                result.checksum = result.checksum * 31 + (uint64_t)json_number_value(json_array_get(params, 0));
+            }
+            else
+            {
+                ++result.numResponse;
+                result.checksum = result.checksum * 31 + (uint64_t)json_integer_value(json_object_get(val, "id")) +
+                                  (json_is_true(json_object_get(val, "result")) ? 1 : 0);
+            }
+            json_decref(val);
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+//-----------------------------------------------------------------------------
+// Previous hex2bin()/bin2hex(): strtol and sprintf("%02x") per byte.
+//-----------------------------------------------------------------------------
+inline bool legacyHex2bin(unsigned char* p, const char* hexstr, size_t len)
+{
+    char hex_byte[3];
+    char* ep;
+
+    hex_byte[2] = '\0';
+    while (*hexstr && len)
+    {
+        if (!hexstr[1])
+            return false;
+        hex_byte[0] = hexstr[0];
+        hex_byte[1] = hexstr[1];
+        *p = (unsigned char)strtol(hex_byte, &ep, 16);
+        if (*ep)
+            return false;
+        p++;
+        hexstr += 2;
+        len--;
+    }
+    return !len;
+}
+//-----------------------------------------------------------------------------
+inline void legacyBin2hex(char* s, const unsigned char* p, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        sprintf(s + (i * 2), "%02x", (unsigned int)p[i]);
+}
+//-----------------------------------------------------------------------------
+//! Codec result. All paths must produce the same bytes and digits.
+struct HexResult
+{
+    double decodeSeconds;
+    double encodeSeconds;
+    uint64_t checksum;
+    bool valid;
+};
+//-----------------------------------------------------------------------------
+//! (path) < 0 selects the legacy functions. Fields of (field_size) bytes are decoded and encoded (num_fields) times.
+HexResult runHexCodec(int path, size_t field_size, size_t num_fields)
+{
+    HexResult result = { 0.0, 0.0, 0, true };
+
+    // 64 fields of random data, as hex
+    std::vector<unsigned char> bin(field_size * 64);
+    uint32_t x = 0xBB67AE85;
+    for (size_t i = 0; i < bin.size(); ++i)
+    {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        bin[i] = (unsigned char)x;
+    }
+    std::string hex(bin.size() * 2, '0');
+    hexEncodeTableScalar(&hex[0], bin.data(), bin.size());
+
+    std::vector<unsigned char> decoded(field_size);
+    std::vector<char> encoded(field_size * 2 + 1);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < num_fields; ++i)
+    {
+        const size_t field = i & 63;
+        const char* fieldHex = hex.c_str() + field * field_size * 2;
+        const bool ok = (path < 0) ? legacyHex2bin(decoded.data(), fieldHex, field_size)
+                                   : hexDecode(decoded.data(), fieldHex, field_size, (EHexCodecPath)path);
+        result.valid = result.valid && ok;
+        result.checksum = result.checksum * 31 + decoded[i % field_size];
+        if (i < 64 && memcmp(decoded.data(), bin.data() + field * field_size, field_size))
+            result.valid = false;
+    }
+    result.decodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < num_fields; ++i)
+    {
+        const size_t field = i & 63;
+        if (path < 0)
+            legacyBin2hex(encoded.data(), bin.data() + field * field_size, field_size);
+        else
+            hexEncode(encoded.data(), bin.data() + field * field_size, field_size, (EHexCodecPath)path);
+        result.checksum = result.checksum * 31 + (unsigned char)encoded[i % (field_size * 2)];
+        if (i < 64 && memcmp(encoded.data(), hex.data() + field * field_size * 2, field_size * 2))
+            result.valid = false;
+    }
+    result.encodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+//-----------------------------------------------------------------------------
+//! Received lines of a capture file(lyclMiner --capture), as they came from the socket.
+std::string captureReceivedStream(const std::string& capture)
+{
+    std::string stream;
+    for (const std::string& line : splitLines(capture))
+    {
+        uint64_t timeUs;
+        char direction;
+        const char* payload;
+        size_t payloadSize;
+        if (parseStratumCaptureLine(line.data(), line.size(), timeUs, direction, payload, payloadSize) && direction == '<')
+        {
+            stream.append(payload, payloadSize);
+            stream += '\n';
+        }
+    }
+    return stream;
+}
+//-----------------------------------------------------------------------------
+//! Notify storm: mining.notify with 12 Merkle branches, mixed with set_difficulty and submit responses.
+std::string generateNotifyStorm(size_t num_lines)
+{
+    uint32_t x = 0x6A09E667;
+    auto hex = [&x](size_t num_chars)
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string s(num_chars, '0');
+        for (size_t i = 0; i < num_chars; ++i)
+        {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            s[i] = digits[x & 15];
+        }
+        return s;
+    };
+
+    std::string stream;
+    for (size_t i = 0; i < num_lines; ++i)
+    {
+        if ((i % 8) == 7)
+            stream += "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[" + std::to_string(16 + (i % 5)) + "]}\n";
+        else if ((i % 8) == 3)
+            stream += "{\"id\":" + std::to_string(4 + i) + ",\"result\":true,\"error\":null}\n";
+        else
+        {
+            stream += "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"" + hex(8) + "\",\"" + hex(64) + "\",\"" + hex(116) +
+                      "\",\"" + hex(120) + "\",[";
+            for (int m = 0; m < 12; ++m)
+                stream += (m ? ",\"" : "\"") + hex(64) + "\"";
+            stream += "],\"20000000\",\"1b0404cb\",\"" + hex(8) + "\"," + ((i % 16) ? "false" : "true") + "]}\n";
+        }
+    }
+    return stream;
+}
+//-----------------------------------------------------------------------------
+void printUsage()
+{
+    std::cerr << "Usage: lyclNetBench [options]\n"
+                 "  -f <file>       replay received stratum data from a capture file(e.g. lyclMiner --capture)\n"
+                 "  -lines <n>      number of lines in the synthetic notify storm. Default: 100000\n"
+                 "  -chunk <bytes>  bytes returned by each recv(). Default: 1448(one TCP segment)\n"
+                 "  -n <passes>     number of replays. Default: 10\n"
+              << std::endl;
+}
+//-----------------------------------------------------------------------------
+bool parseOptions(int argc, char** argv, BenchOptions& out_options)
+{
+    out_options.numLines = 100000;
+    out_options.chunkSize = 1448;
+    out_options.numPasses = 10;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        const bool hasValue = (i + 1) < argc;
+        if (arg == "-f" && hasValue)
+            out_options.captureFileName = argv[++i];
+        else if (arg == "-lines" && hasValue)
+            out_options.numLines = (size_t)strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-chunk" && hasValue)
+            out_options.chunkSize = (size_t)strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-n" && hasValue)
+            out_options.numPasses = (size_t)strtoul(argv[++i], nullptr, 10);
+        else
+            return false;
+    }
+
+    return out_options.numLines && out_options.chunkSize && out_options.numPasses;
+}
+//-----------------------------------------------------------------------------
+std::string formatFramingResult(const char* name, const FramingResult& result, size_t num_bytes)
+{
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "    \"%s\": { \"seconds\": %.4f, \"nsPerLine\": %.2f, \"MBps\": %.1f }",
+             name, result.seconds, result.numLines ? result.seconds * 1e9 / (double)result.numLines : 0.0,
+             result.seconds > 0.0 ? (double)num_bytes / result.seconds / 1e6 : 0.0);
+    return buffer;
+}
+//-----------------------------------------------------------------------------
+std::string formatParseResult(const char* name, const ParseResult& result)
+{
+    const size_t numParsed = result.numNotify + result.numDifficulty + result.numResponse;
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "    \"%s\": { \"seconds\": %.4f, \"nsPerMessage\": %.2f }",
+             name, result.seconds, numParsed ? result.seconds * 1e9 / (double)numParsed : 0.0);
+    return buffer;
+}
+//-----------------------------------------------------------------------------
+std::string formatHexResult(const char* name, const HexResult& result, size_t num_bytes)
+{
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "      \"%s\": { \"decodeNsPerByte\": %.3f, \"encodeNsPerByte\": %.3f }",
+             name, result.decodeSeconds * 1e9 / (double)num_bytes, result.encodeSeconds * 1e9 / (double)num_bytes);
+    return buffer;
+}
+//-----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    std::string stream;
+    if (options.captureFileName.size())
+    {
+        std::ifstream captureFile(options.captureFileName, std::ios::binary);
+        if (!captureFile)
+        {
+            std::cerr << "Failed to open a capture file: " << options.captureFileName << std::endl;
+            return 1;
+        }
+        std::ostringstream data;
+        data << captureFile.rdbuf();
+        stream = data.str();
+        if (isStratumCapture(stream.data(), stream.size()))
+            stream = captureReceivedStream(stream);
+    }
+    else
+        stream = generateNotifyStorm(options.numLines);
+
+    // legacy framing works on zero terminated strings
+    stream.erase(std::remove(stream.begin(), stream.end(), '\0'), stream.end());
+
+    const FramingResult legacy = runLegacyFraming(stream, options.chunkSize, options.numPasses);
+    const FramingResult lineBuffer = runLineBufferFraming(stream, options.chunkSize, options.numPasses);
+    const size_t numBytes = stream.size() * options.numPasses;
+
+    const std::vector<std::string> lines = splitLines(stream);
+    const ParseResult fastParser = runFastParser(lines, options.numPasses);
+    const ParseResult jansson = runJanssonParser(lines, options.numPasses);
+
+    // nbits/ntime, prevhash/Merkle branch, coinbase
+    const size_t hexFieldSizes[] = { 4, 32, 128 };
+    const EHexCodecPath hexPath = hexCodecPath();
+    bool hexMatch = true;
+    std::string hexJson = "  \"hex\": {\n    \"path\": \"" + std::string(hexCodecPathName(hexPath)) + "\"";
+    for (size_t fieldSize : hexFieldSizes)
+    {
+        const size_t numFields = (options.numPasses << 20) / fieldSize / 4;
+        const size_t hexBytes = numFields * fieldSize;
+        const HexResult legacyHex = runHexCodec(-1, fieldSize, numFields);
+        hexJson += ",\n    \"" + std::to_string(fieldSize) + "\": {\n";
+        hexJson += formatHexResult("legacy", legacyHex, hexBytes);
+        for (int path = HCP_Table; path <= (int)hexPath; ++path)
+        {
+            const HexResult hexResult = runHexCodec(path, fieldSize, numFields);
+            hexMatch = hexMatch && legacyHex.valid && hexResult.valid && hexResult.checksum == legacyHex.checksum;
+            hexJson += ",\n" + formatHexResult(hexCodecPathName((EHexCodecPath)path), hexResult, hexBytes);
+        }
+        hexJson += "\n    }";
+    }
+    hexJson += "\n  },\n";
+
+    const bool framingMatch = legacy.numLines == lineBuffer.numLines && legacy.checksum == lineBuffer.checksum;
+    const bool parseMatch = fastParser.numNotify == jansson.numNotify && fastParser.numDifficulty == jansson.numDifficulty &&
+                            fastParser.numResponse == jansson.numResponse && fastParser.checksum == jansson.checksum;
+
+    std::string json = "{\n";
+    json += "  \"source\": \"" + (options.captureFileName.size() ? std::string("capture") : std::string("synthetic")) + "\",\n";
+    json += "  \"bytes\": " + std::to_string(stream.size()) + ",\n";
+    json += "  \"lines\": " + std::to_string(lineBuffer.numLines / options.numPasses) + ",\n";
+    json += "  \"chunkSize\": " + std::to_string(options.chunkSize) + ",\n";
+    json += "  \"passes\": " + std::to_string(options.numPasses) + ",\n";
+    json += "  \"framing\": {\n";
+    json += formatFramingResult("legacy", legacy, numBytes) + ",\n";
+    json += formatFramingResult("lineBuffer", lineBuffer, numBytes) + "\n";
+    json += "  },\n";
+    json += "  \"parse\": {\n";
+    json += "    \"notify\": " + std::to_string(fastParser.numNotify / options.numPasses) + ",\n";
+    json += "    \"setDifficulty\": " + std::to_string(fastParser.numDifficulty / options.numPasses) + ",\n";
+    json += "    \"responses\": " + std::to_string(fastParser.numResponse / options.numPasses) + ",\n";
+    json += "    \"fallback\": " + std::to_string(fastParser.numFallback / options.numPasses) + ",\n";
+    json += formatParseResult("fastParser", fastParser) + ",\n";
+    json += formatParseResult("jansson", jansson) + "\n";
+    json += "  },\n";
+    json += hexJson;
+    json += std::string("  \"match\": ") + ((framingMatch && parseMatch && hexMatch) ? "true" : "false") + "\n";
+    json += "}\n";
+    std::cout << json;
+
+    return (framingMatch && parseMatch && hexMatch) ? 0 : 2;
+}
@@ -10,6 +10,7 @@
 #include <iostream>
 
 #include <lyclCore/OtherThreads.hpp>
+#include <lyclCore/StratumCapture.hpp>
 #include <lyclCore/Global.hpp>
 #include <lyclCore/Blake256.hpp>
 #include <lyclCore/Uint256.hpp>
@@ -19,12 +20,42 @@
 // Applets
 #include <lyclApplets/AppLyra2REv2.hpp>
 #include <lyclApplets/AppLyra2REv3.hpp>
+#include <lyclApplets/IntegritySampler.hpp>
+#include <lyclApplets/BatchWaiter.hpp>
+#include <lyclApplets/BatchSizeController.hpp>
 
 #include <lyclHostValidators/BMW.hpp>
 
 #include <chrono> // timing
 #include <algorithm> // sort
 
+//! Interval between per-stage GPU time reports, if profiling is enabled.
+const int c_profilingLogIntervalSec = 30;
+//! Upper bound for "Streams" per device.
+const int c_maxStreamsPerDevice = 8;
+//! IntegrityAction = "shrink" does not reduce WorkSize below this value.
+const size_t c_integrityMinWorkSize = 65536;
+//! Scheduler wait timeout while batches are in flight. Event callbacks normally wake it up earlier.
+const int c_schedulerPollIntervalMs = 10;
+//! Scheduler wait timeout while all devices are waiting for work.
+const int c_schedulerIdleIntervalMs = 250;
+//! Integrity counters per physical device(lycl::device::deviceIndex). Shared by its streams.
+lycl::DeviceIntegrity* g_deviceIntegrity = NULL;
+
+//-----------------------------------------------------------------------------
+//! Number of batches in the nonce range of a worker thread.
+inline uint32_t getMaxRuns(int thr_id, size_t work_size)
+{
+    // 4294967295 max nonce
+    const uint64_t numNonces = 4294967296ULL / (uint64_t)global::numWorkerThreads;
+    uint32_t maxRuns = (uint32_t)(numNonces / (uint32_t)work_size);
+    // last device
+    if (thr_id == (global::numWorkerThreads-1))
+        maxRuns += (uint32_t)(numNonces % global::numWorkerThreads);
+
+    return maxRuns;
+}
+
 //-----------------------------------------------------------------------------
 // compute the diff ratio between a found hash and the target
 inline double hash_target_ratio(const uint32_t* hash, uint32_t* target)
@@ -96,640 +127,849 @@ bool fulltestU32x8(const lycl::uint32x8& hash, const uint32_t *target)
 }
 
 //-----------------------------------------------------------------------------
-// Lyra2REv2 worker
+// Worker class. TApplet: AppLyra2REv2 or AppLyra2REv3.
+// Mines a nonce range on a single device stream. Driven either by its own
+// thread(workerThread) or by a scheduler thread shared by several devices
+// (schedulerThread). Not thread safe.
 //-----------------------------------------------------------------------------
-void* workerThread_lyra2REv2( void *userdata )
+template <typename TApplet>
+class Worker
 {
-    thr_info *mythr = (thr_info *) userdata;
-    int thr_id = mythr->id;
-
-    // Init device context.
-    lycl::AppLyra2REv2 deviceCtx;
-    lycl::device clDevice = mythr->clDevice;
-    if (!deviceCtx.onInit(mythr->clDevice))
+public:
+    enum EState
     {
-        Log::print(Log::LT_Error, "Failed to initialize device(%d)! Skipping...", thr_id);
-        // exit
-        deviceCtx.onDestroy();
-        tq_freeze(mythr->q);
-        return NULL;
-    }
-
-    work workInfo;
-    memset(&workInfo, 0, sizeof(work));
-    time_t firstwork_time = 0;
+        WS_Idle = 0,   // waiting for work
+        WS_Ready,      // scan is active, the next batch can be launched
+        WS_Running,    // a batch is in flight(scheduler only)
+        WS_ScanDone,   // scan is finished, results must be submitted
+        WS_Exit
+    };
+
+    Worker()
+        : m_thr(nullptr)
+        , m_thrId(0)
+        , m_state(WS_Idle)
+    { }
+
+    //! returns false if the device failed to initialize.
+    bool init(thr_info* thr);
+    //! releases the device. Worker must not be used afterwards.
+    void destroy();
+    //! thread per device: runs the current state to completion, may block.
+    void step();
+    //! scheduler: advances without waiting for the device.
+    //! Returns true if a batch is in flight. (callback) is called when it's finished.
+    bool poll(void (CL_CALLBACK* callback)(cl_event, cl_int, void*), void* user_data);
+
+    EState getState() const { return m_state; }
+    const char* getLabel() const { return m_deviceLabel; }
+
+private:
+    //! gets work and sets up a nonce range. Returns false if work is not available yet.
+    bool beginScan();
+    //! selects the number of hashes for the next batch.
+    void beginBatch();
+    bool isRangeDone() const { return m_rangeOffset >= m_rangeSize; }
+    //! processes hTarg results of the latest batch and advances the nonce.
+    void completeBatch(uint32_t single_nonce, uint32_t num_potential_nonces);
+    //! updates statistics and submits found nonces.
+    void endScan();
+
+    thr_info* m_thr;
+    int m_thrId;
+    EState m_state;
+    TApplet m_deviceCtx;
+    lycl::device m_clDevice;
+    // "#0", or "#0.1" if a device runs multiple streams.
+    char m_deviceLabel[32];
+
+    work m_workInfo;
+    time_t m_firstworkTime;
+    // do not poll for new work more often than once per second.
+    time_t m_nextScanAttempt;
+    uint32_t m_maxRuns;
+    // nonce range of this worker: (m_maxRuns * WorkSize) hashes. Batch sizes may vary.
+    uint64_t m_rangeSize;
+    uint64_t m_rangeOffset;
+
+    // current scan
+    uint64_t m_scanStartOffset;
+    uint32_t m_nonce;
+    // hashes in the current batch
+    size_t m_batchSize;
+    std::chrono::steady_clock::time_point m_batchStart;
+    bool m_nonceFound;
+    bool m_isMultiNonce; // numNonces > 1
+    uint32_t m_singleNonce;
+    uint32_t m_numPotentialNonces;
 
     std::chrono::steady_clock::time_point m_start;
     std::chrono::steady_clock::time_point m_end;
-
-    //-------------------------------------
-    // compute max runs
-    // 4294967295 max nonce
-    const uint64_t numNonces = 4294967296ULL / (uint64_t)global::numWorkerThreads;
-    uint32_t maxRuns = (uint32_t)(numNonces / (uint32_t)clDevice.workSize);
-    // last device
-    if (thr_id == (global::numWorkerThreads-1))
-        maxRuns += (uint32_t)(numNonces % global::numWorkerThreads);
+    std::chrono::steady_clock::time_point m_lastProfilingLog;
+    std::vector<lycl::StageProfile> m_stageProfiles;
+    //! per-stage GPU time of the last profiling interval, part of the hashrate line.
+    std::string m_stageProfilesText;
+    // hTarg candidates emitted by the device / passed a full target test on the host
+    uint64_t m_numCandidates;
+    uint64_t m_numAcceptedCandidates;
+    uint64_t m_numReportedCandidates;
+    // hardware error detection
+    lycl::IntegritySampler m_integritySampler;
+    lycl::DeviceIntegrity* m_deviceIntegrity;
+    // IntegrityActions of the device applied to this stream
+    uint32_t m_numIntegrityActions;
+    std::chrono::steady_clock::time_point m_lastIntegrityCheck;
+    // host CPU time spent on this device since the last hashrate report
+    uint64_t m_cpuTimeNs;
+    // WaitMode = "sleep"
+    lycl::BatchWaiter m_batchWaiter;
+    // TargetBatchLatency
+    lycl::BatchSizeController m_batchSizeController;
+    double m_lastBatchMs;
+    // time from a new job to the first batch on it. Only scans ended by a restart are counted.
+    bool m_endedByRestart;
+    uint32_t m_numRestarts;
+    double m_restartLatencySumMs;
+    double m_restartLatencyMaxMs;
+    std::chrono::steady_clock::time_point m_lastLatencyLog;
+    std::chrono::steady_clock::time_point m_lastCpuReport;
 
     // Host side validation
-    //std::vector<lycl::lyraHash> m_hashes(clDevice.workSize);
     std::vector<uint32_t> m_potentialNonces;
+    std::vector<lycl::uint32x8> m_gatheredHashes;
     std::vector<uint32_t> m_nonces;
+};
+//-----------------------------------------------------------------------------
+template <typename TApplet>
+bool Worker<TApplet>::init(thr_info* thr)
+{
+    m_thr = thr;
+    m_thrId = thr->id;
+    m_clDevice = thr->clDevice;
 
-    Log::print(Log::LT_Debug, "Device: %d max runs: %u", thr_id, maxRuns);
+    // Init device context.
+    if (!m_deviceCtx.onInit(m_clDevice))
+    {
+        Log::print(Log::LT_Error, "Failed to initialize device(%d)! Skipping...", m_thrId);
+        m_deviceCtx.onDestroy();
+        return false;
+    }
+    // WorkSize may be clamped to the device memory budget.
+    m_clDevice.workSize = m_deviceCtx.getMaxWorkSize();
 
-    uint32_t numRuns = 0;
+    if (m_clDevice.numStreams > 1)
+        snprintf(m_deviceLabel, sizeof(m_deviceLabel), "#%d.%u", m_clDevice.deviceIndex, m_clDevice.streamIndex);
+    else
+        snprintf(m_deviceLabel, sizeof(m_deviceLabel), "#%d", m_clDevice.deviceIndex);
+
+    memset(&m_workInfo, 0, sizeof(work));
+    m_firstworkTime = 0;
+    m_nextScanAttempt = 0;
+    m_state = WS_Idle;
+
+    m_lastProfilingLog = std::chrono::steady_clock::now();
+    m_numCandidates = 0;
+    m_numAcceptedCandidates = 0;
+    m_numReportedCandidates = 0;
+    m_integritySampler.setSeed((uint32_t)time(NULL) ^ ((uint32_t)(m_thrId + 1) * 0x9E3779B9u));
+    m_deviceIntegrity = &g_deviceIntegrity[m_clDevice.deviceIndex];
+    m_numIntegrityActions = m_deviceIntegrity->getNumActions();
+    m_lastIntegrityCheck = std::chrono::steady_clock::now();
+    m_cpuTimeNs = 0;
+    m_lastCpuReport = std::chrono::steady_clock::now();
 
-    for (;;)
-    {
-        uint64_t hashes_done;
+    //-------------------------------------
+    // compute max runs
+    m_maxRuns = getMaxRuns(m_thrId, m_clDevice.workSize);
+    m_rangeSize = (uint64_t)m_maxRuns * m_clDevice.workSize;
+    m_rangeOffset = 0;
+    m_batchSize = m_clDevice.workSize;
+
+    m_batchSizeController.setup(m_clDevice.targetBatchLatency, m_clDevice.workSize);
+    m_lastBatchMs = 0.0;
+    m_endedByRestart = false;
+    m_numRestarts = 0;
+    m_restartLatencySumMs = 0.0;
+    m_restartLatencyMaxMs = 0.0;
+    m_lastLatencyLog = std::chrono::steady_clock::now();
+
+    Log::print(Log::LT_Debug, "Device: %d max runs: %u", m_thrId, m_maxRuns);
+
+    return true;
+}
+//-----------------------------------------------------------------------------
+template <typename TApplet>
+void Worker<TApplet>::destroy()
+{
+    m_deviceCtx.onDestroy();
+    tq_freeze(m_thr->q);
+    m_state = WS_Exit;
+}
+//-----------------------------------------------------------------------------
+template <typename TApplet>
+void Worker<TApplet>::step()
+{
+    const uint64_t cpuStart = lycl::getThreadCpuTimeNs();
 
-        //-------------------------------------
-        // wait for diff
-        while(time(NULL) >= g_work_time + 120)
+    switch (m_state)
+    {
+    case WS_Idle:
+        if (beginScan())
+            m_state = WS_Ready;
+        else if (m_state != WS_Exit)
             sleep(1);
-
-        pthread_mutex_lock( &g_work_lock );
-        //-------------------------------------
-        // get new work from stratum.
-        if (numRuns >= maxRuns)
+        break;
+    case WS_Ready:
+    {
+        // assume only 1 potential nonce was found.
+        uint32_t singleNonce = 0;
+        uint32_t numPotentialNonces = 0;
+        beginBatch();
+        if (m_clDevice.waitMode == lycl::WM_Sleep)
+            m_batchWaiter.runBatch(m_deviceCtx, m_nonce, m_batchSize, singleNonce, numPotentialNonces);
+        else
         {
-            // generate new work
-            stratumGenWork(&stratum, &global::g_work);
+            m_deviceCtx.onRun(m_nonce, m_batchSize);
+            m_deviceCtx.getHtArgTestResultAndSize(singleNonce, numPotentialNonces);
         }
-        //-------------------------------------
-        // setup a nonce range for each worker thread
-        const int32_t workCmpSize = WorkCmpSize;
-        if ( memcmp( workInfo.data, global::g_work.data, workCmpSize)
-             && (stratum.job.clean || (numRuns >= maxRuns) || (workInfo.job_id != global::g_work.job_id)) )
-        {
-            Log::print(Log::LT_Debug, "Device: %d has completed its nonce range", thr_id);
+        completeBatch(singleNonce, numPotentialNonces);
+        break;
+    }
+    case WS_ScanDone:
+        endScan();
+        break;
+    default:
+        break;
+    }
 
-            // get new work
-            workFree(&workInfo );
-            workCopy(&workInfo, &global::g_work);
-            // reset run counter
-            numRuns = 0;
-        }
+    m_cpuTimeNs += lycl::getThreadCpuTimeNs() - cpuStart;
+}
+//-----------------------------------------------------------------------------
+template <typename TApplet>
+bool Worker<TApplet>::poll(void (CL_CALLBACK* callback)(cl_event, cl_int, void*), void* user_data)
+{
+    const uint64_t cpuStart = lycl::getThreadCpuTimeNs();
+    bool inFlight = false;
 
-        pthread_mutex_unlock( &g_work_lock );
-        //-------------------------------------
-        // if work is not available
-        if (!workInfo.data[0])
-        {
-            sleep(1);
-            continue;
-        }
-        //-------------------------------------
-        // time limit
-        if ( global::opt_timeLimit && firstwork_time )
+    for (bool progress = true; progress && !inFlight; )
+    {
+        switch (m_state)
         {
-            int passed = (int)( time(NULL) - firstwork_time );
-            int remain = (int)( global::opt_timeLimit - passed );
-            if ( remain < 0 )
+        case WS_Idle:
+            if ((time(NULL) >= m_nextScanAttempt) && beginScan())
+                m_state = WS_Ready;
+            else
             {
-                if ( thr_id != 0 )
-                {
-                    sleep(1);
-                    continue;
-                }
-                Log::print(Log::LT_Notice, "Mining timeout of %ds reached, exiting...", global::opt_timeLimit);
-                
-                // exit
-                deviceCtx.onDestroy();
-                tq_freeze(mythr->q);
-                return NULL;
+                m_nextScanAttempt = time(NULL) + 1;
+                progress = false;
+            }
+            break;
+        case WS_Ready:
+            beginBatch();
+            if (m_deviceCtx.onRunAsync(m_nonce, m_batchSize, callback, user_data))
+            {
+                m_state = WS_Running;
+                inFlight = true;
             }
+            else
+                m_state = WS_ScanDone;
+            break;
+        case WS_Running:
+            if (m_deviceCtx.isRunComplete())
+            {
+                uint32_t singleNonce = 0;
+                uint32_t numPotentialNonces = 0;
+                m_deviceCtx.finishRunAsync(singleNonce, numPotentialNonces);
+                m_state = WS_Ready;
+                completeBatch(singleNonce, numPotentialNonces);
+            }
+            else
+                inFlight = true;
+            break;
+        case WS_ScanDone:
+            endScan();
+            break;
+        default:
+            progress = false;
+            break;
         }
-        // init time
-        if (firstwork_time == 0)
-            firstwork_time = time(NULL);
-        gwork_restart[thr_id].restart = 0;
-        hashes_done = 0;
-        m_start = std::chrono::steady_clock::now();
+    }
 
+    m_cpuTimeNs += lycl::getThreadCpuTimeNs() - cpuStart;
+    return inFlight;
+}
 //-----------------------------------------------------------------------------
-        // Scan for nonce
-        uint32_t* pdata = workInfo.data;
-        uint32_t* ptarget = workInfo.target;
-        const uint32_t Htarg = ptarget[7];
-        const uint32_t offsetN = (maxRuns * clDevice.workSize)*thr_id;
-        const uint32_t first_nonce = offsetN + (numRuns * clDevice.workSize);
-        uint32_t nonce = first_nonce;
+template <typename TApplet>
+bool Worker<TApplet>::beginScan()
+{
+    //-------------------------------------
+    // wait for diff
+    if (time(NULL) >= g_work_time + 120)
+        return false;
 
-        //-------------------------------------
-        // compute a midstate
-        if (!numRuns)
+    pthread_mutex_lock( &g_work_lock );
+    //-------------------------------------
+    // get new work from stratum.
+    if (isRangeDone())
+    {
+        // generate new work
+        stratumGenWork(&stratum, &global::g_work);
+    }
+    //-------------------------------------
+    // setup a nonce range for each worker thread
+    const int32_t workCmpSize = WorkCmpSize;
+    if ( memcmp( m_workInfo.data, global::g_work.data, workCmpSize)
+         && (stratum.job.clean || isRangeDone() || (m_workInfo.job_id != global::g_work.job_id)) )
+    {
+        Log::print(Log::LT_Debug, "Device: %d has completed its nonce range", m_thrId);
+
+        // get new work
+        workFree(&m_workInfo );
+        workCopy(&m_workInfo, &global::g_work);
+        // reset run counter
+        m_rangeOffset = 0;
+    }
+
+    pthread_mutex_unlock( &g_work_lock );
+    //-------------------------------------
+    // if work is not available
+    if (!m_workInfo.data[0])
+        return false;
+    //-------------------------------------
+    // time limit
+    if ( global::opt_timeLimit && m_firstworkTime )
+    {
+        int passed = (int)( time(NULL) - m_firstworkTime );
+        int remain = (int)( global::opt_timeLimit - passed );
+        if ( remain < 0 )
         {
-            lycl::KernelData kernelData;
-            memset(&kernelData, 0, sizeof(kernelData));
-            
-            uint32_t h[8] =
-            {
-                0x6A09E667, 0xBB67AE85,
-                0x3C6EF372, 0xA54FF53A,
-                0x510E527F, 0x9B05688C,
-                0x1F83D9AB, 0x5BE0CD19
-            };
-            
-            kernelData.in16 = pdata[16];
-            kernelData.in17 = pdata[17];
-            kernelData.in18 = pdata[18];
-
-            blake256_compress(h, pdata);
-
-            kernelData.uH0 = h[0];
-            kernelData.uH1 = h[1];
-            kernelData.uH2 = h[2];
-            kernelData.uH3 = h[3];
-            kernelData.uH4 = h[4];
-            kernelData.uH5 = h[5];
-            kernelData.uH6 = h[6];
-            kernelData.uH7 = h[7];
-            kernelData.htArg = Htarg;
-            //Log::print(Log::LT_Notice, "Device:%d block:%u,%u,%u,%u,%u,%u,%u,%u", thr_id, h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7]);
-            //-------------------------------------
-            // upload data
-            deviceCtx.setKernelData(kernelData);
+            if ( m_thrId != 0 )
+                return false;
+
+            Log::print(Log::LT_Notice, "Mining timeout of %ds reached, exiting...", global::opt_timeLimit);
+            m_state = WS_Exit;
+            return false;
         }
+    }
+    // init time
+    if (m_firstworkTime == 0)
+        m_firstworkTime = time(NULL);
+    // the previous scan was stopped by a new job
+    if (m_endedByRestart && gwork_restart[m_thrId].restart)
+    {
+        const double latencyMs = (double)(getSteadyTimeUs() - gwork_restart[m_thrId].timeUs) * 0.001;
+        ++m_numRestarts;
+        m_restartLatencySumMs += latencyMs;
+        m_restartLatencyMaxMs = std::max(m_restartLatencyMaxMs, latencyMs);
+    }
+    m_endedByRestart = false;
+    gwork_restart[m_thrId].restart = 0;
+    m_start = std::chrono::steady_clock::now();
 
-        bool nonceFound = false;
-        bool isMultiNonce = false; // numNonces > 1
+//-----------------------------------------------------------------------------
+    // Scan for nonce
+    const uint32_t* pdata = m_workInfo.data;
+    const uint32_t* ptarget = m_workInfo.target;
+    const uint32_t offsetN = (m_maxRuns * m_clDevice.workSize)*m_thrId;
+    m_scanStartOffset = m_rangeOffset;
+    m_nonce = offsetN + (uint32_t)m_rangeOffset;
 
-        uint32_t numPotentialNonces = 0;
-        uint32_t singleNonce;
-        do
+    //-------------------------------------
+    // compute a midstate
+    if (!m_rangeOffset)
+    {
+        lycl::KernelData kernelData;
+        memset(&kernelData, 0, sizeof(kernelData));
+        
+        uint32_t h[8] =
         {
-            deviceCtx.onRun(nonce, clDevice.workSize);
+            0x6A09E667, 0xBB67AE85,
+            0x3C6EF372, 0xA54FF53A,
+            0x510E527F, 0x9B05688C,
+            0x1F83D9AB, 0x5BE0CD19
+        };
+        
+        kernelData.in16 = pdata[16];
+        kernelData.in17 = pdata[17];
+        kernelData.in18 = pdata[18];
+
+        blake256_compress(h, pdata);
+
+        kernelData.uH0 = h[0];
+        kernelData.uH1 = h[1];
+        kernelData.uH2 = h[2];
+        kernelData.uH3 = h[3];
+        kernelData.uH4 = h[4];
+        kernelData.uH5 = h[5];
+        kernelData.uH6 = h[6];
+        kernelData.uH7 = h[7];
+        kernelData.htArg = ptarget[7];
+        kernelData.htArgLow = ptarget[6];
+        //Log::print(Log::LT_Notice, "Device:%d block:%u,%u,%u,%u,%u,%u,%u,%u", m_thrId, h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7]);
+        //-------------------------------------
+        // upload data
+        m_deviceCtx.setKernelData(kernelData);
+    }
+
+    m_nonceFound = false;
+    m_isMultiNonce = false;
+    m_numPotentialNonces = 0;
+
+    return true;
+}
+//-----------------------------------------------------------------------------
+template <typename TApplet>
+void Worker<TApplet>::beginBatch()
+{
+    m_batchSize = (size_t)std::min((uint64_t)m_batchSizeController.getBatchSize(), m_rangeSize - m_rangeOffset);
+    m_batchStart = std::chrono::steady_clock::now();
+}
+//-----------------------------------------------------------------------------
+template <typename TApplet>
+void Worker<TApplet>::completeBatch(uint32_t single_nonce, uint32_t num_potential_nonces)
+{
+    m_lastBatchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_batchStart).count();
+    m_batchSizeController.update(m_batchSize, m_lastBatchMs);
 
-            // assume only 1 potential nonce was found.
-            deviceCtx.getHtArgTestResultAndSize(singleNonce, numPotentialNonces);
+    const uint32_t* ptarget = m_workInfo.target;
 
-            // check if nonce was found
-            if (numPotentialNonces != 0)
+    m_singleNonce = single_nonce;
+    m_numPotentialNonces = num_potential_nonces;
+
+    // check if nonce was found
+    if (m_numPotentialNonces != 0)
+    {
+        m_numCandidates += m_numPotentialNonces;
+        //Log::print(Log::LT_Notice, "Num potential nonces found: %u", m_numPotentialNonces);
+        lycl::uint32x8 clhash;
+        m_deviceCtx.getLatestHashResultForIndex(m_singleNonce, clhash);
+        // compute bmw hash
+        lycl::uint32x8 lhash;
+        lycl::bmwHash(clhash, lhash);
+        if (m_clDevice.integrityCheck)
+            m_integritySampler.recordCandidate(TApplet::getAlgorithmName(), m_workInfo.data, m_nonce + m_singleNonce, clhash);
+
+        if (fulltestU32x8(lhash, ptarget))
+        {
+            ++m_numAcceptedCandidates;
+            // add nonce local offset
+            m_singleNonce += m_nonce;
+            work_set_target_ratio(&m_workInfo, &lhash.h[0]);
+            m_nonceFound = true;
+            if (m_numPotentialNonces == 1)
+            {
+                m_rangeOffset += m_batchSize; // run completed
+                m_state = WS_ScanDone;
+                return;
+            }
+            else
+                m_nonces.push_back(m_singleNonce);
+        }
+
+        // continue with remaining potential nonces if they were found
+        if (m_numPotentialNonces > 1)
+        {
+            size_t numRemainingNonces = m_numPotentialNonces-1; // skip first nonce
+            m_deviceCtx.getHtArgTestResults(m_potentialNonces, numRemainingNonces, 2);
+            // read back only candidate hashes
+            if (!m_deviceCtx.gatherHashes(m_potentialNonces.data(), numRemainingNonces, m_gatheredHashes))
+                numRemainingNonces = 0;
+            
+            for (size_t g = 0; g < numRemainingNonces; ++g)
             {
-                //Log::print(Log::LT_Notice, "Num potential nonces found: %u", numPotentialNonces);
-                lycl::uint32x8 clhash;
-                deviceCtx.getLatestHashResultForIndex(singleNonce, clhash);
                 // compute bmw hash
-                lycl::uint32x8 lhash;
-                lycl::bmwHash(clhash, lhash);
+                lycl::bmwHash(m_gatheredHashes[g], lhash);
+                if (m_clDevice.integrityCheck)
+                    m_integritySampler.recordCandidate(TApplet::getAlgorithmName(), m_workInfo.data,
+                                                       m_nonce + m_potentialNonces[g], m_gatheredHashes[g]);
 
                 if (fulltestU32x8(lhash, ptarget))
                 {
+                    ++m_numAcceptedCandidates;
+                    m_isMultiNonce = true;
                     // add nonce local offset
-                    singleNonce += nonce;
-                    work_set_target_ratio(&workInfo, &lhash.h[0]);
-                    nonceFound = true;
-                    if (numPotentialNonces == 1)
-                    {
-                        ++numRuns; // run completed
-                        break;
-                    }
-                    else
-                        m_nonces.push_back(singleNonce);
-                }
+                    m_nonces.push_back(m_potentialNonces[g] + m_nonce); 
 
-                // continue with remaining potential nonces if they were found
-                if (numPotentialNonces > 1)
-                {
-                    size_t numRemainingNonces = numPotentialNonces-1; // skip first nonce
-                    deviceCtx.getHtArgTestResults(m_potentialNonces, numRemainingNonces, 2);
-                    
-                    for (size_t g = 0; g < numRemainingNonces; ++g)
-                    {
-                        deviceCtx.getLatestHashResultForIndex(m_potentialNonces[g], clhash);
-                        // compute bmw hash
-                        lycl::bmwHash(clhash, lhash);
-
-                        if (fulltestU32x8(lhash, ptarget))
-                        {
-                            isMultiNonce = true;
-                            // add nonce local offset
-                            m_nonces.push_back(m_potentialNonces[g] + nonce); 
-
-                            work_set_target_ratio(&workInfo, &lhash.h[0]);
-                        }
-                    }
+                    work_set_target_ratio(&m_workInfo, &lhash.h[0]);
                 }
+            }
+        }
 
-                if (isMultiNonce)
-                {
-                    ++numRuns; // run completed
-                    break;
-                }
+        if (m_isMultiNonce)
+        {
+            m_rangeOffset += m_batchSize; // run completed
+            m_state = WS_ScanDone;
+            return;
+        }
 
-                // all nonces are invalid.
-                // clear result to prevent duplicate shares
-                deviceCtx.clearResult(numPotentialNonces);
-            }
+        // all nonces are invalid.
+        // clear result to prevent duplicate shares
+        m_deviceCtx.clearResult(m_numPotentialNonces);
+    }
 
-            // prepare for the next run
-            nonce += clDevice.workSize;
-            ++numRuns;
+    // re-compute a random sample of this batch
+    if (m_clDevice.integrityCheck &&
+        (std::chrono::steady_clock::now() - m_lastIntegrityCheck >= std::chrono::seconds(m_clDevice.integrityCheckInterval)))
+    {
+        const lycl::IntegritySample sample = m_integritySampler.sampleBatch(m_deviceCtx, m_workInfo.data, m_nonce, m_batchSize);
+        if (sample.numHostErrors || sample.numRerunErrors)
+        {
+            m_deviceIntegrity->merge(m_integritySampler);
+            Log::print(Log::LT_Warning, "Device %s: integrity check failed, %u of %u hashes differ from the host, %u of %u from a re-run. Device error rate: %.6f",
+                       m_deviceLabel, (uint32_t)sample.numHostErrors, (uint32_t)lycl::c_integrityHostSamples,
+                       (uint32_t)sample.numRerunErrors, (uint32_t)lycl::c_integritySampleSize, m_deviceIntegrity->getErrorRate());
+        }
+        m_lastIntegrityCheck = std::chrono::steady_clock::now();
+    }
 
-        } while (numRuns < maxRuns && !gwork_restart[thr_id].restart);
+    // prepare for the next run
+    m_nonce += (uint32_t)m_batchSize;
+    m_rangeOffset += m_batchSize;
 
-        hashes_done = uint64_t(offsetN + (numRuns * clDevice.workSize)) - uint64_t(first_nonce);
+    if (gwork_restart[m_thrId].restart)
+    {
+        m_endedByRestart = true;
+        m_state = WS_ScanDone;
+    }
+    else if (isRangeDone())
+        m_state = WS_ScanDone;
+}
+//-----------------------------------------------------------------------------
+template <typename TApplet>
+void Worker<TApplet>::endScan()
+{
+    m_state = WS_Idle;
+
+    uint32_t* pdata = m_workInfo.data;
+    const uint64_t hashes_done = m_rangeOffset - m_scanStartOffset;
 
-        //-----------------------------------------------------------------------------
+    // record scanhash elapsed time
+    m_end = std::chrono::steady_clock::now();
+    auto diff = m_end - m_start;
+    double elapsedTimeMs = std::chrono::duration<double, std::milli>(diff).count();
+    if (elapsedTimeMs)
+    {
+        pthread_mutex_lock( &stats_lock );
+        thr_hashcount[m_thrId] = hashes_done;
+        thr_hashrates[m_thrId] = hashes_done / (elapsedTimeMs * 0.001);
+        pthread_mutex_unlock( &stats_lock );
+    }
 
-        // record scanhash elapsed time
-        m_end = std::chrono::steady_clock::now();
-        auto diff = m_end - m_start;
-        double elapsedTimeMs = std::chrono::duration<double, std::milli>(diff).count();
-        if (elapsedTimeMs)
+    // if nonce(s) found submit work 
+    if (m_nonceFound)
+    {
+        if (!m_isMultiNonce) // nonces == 1
         {
-            pthread_mutex_lock( &stats_lock );
-            thr_hashcount[thr_id] = hashes_done;
-            thr_hashrates[thr_id] = hashes_done / (elapsedTimeMs * 0.001);
-            pthread_mutex_unlock( &stats_lock );
-        }
+            pdata[19] = m_singleNonce;
+            if ( !submit_work( m_thr, &m_workInfo ) )
+            {
+                Log::print(Log::LT_Warning, "Failed to submit share.");
+                m_state = WS_Exit;
+                return;
+            }
+            else
+                Log::print(Log::LT_Notice, "Share submitted.");
 
-        // if nonce(s) found submit work 
-        if (nonceFound)
+            // clear result to prevent duplicate shares
+            m_deviceCtx.clearResult(1);
+        }
+        else
         {
-            if (!isMultiNonce) // nonces == 1
+            for (size_t i = 0; i < m_nonces.size(); ++i)
             {
-                pdata[19] = singleNonce;
-                if ( !submit_work( mythr, &workInfo ) )
+                pdata[19] = m_nonces[i];
+                if ( !submit_work( m_thr, &m_workInfo ) )
                 {
                     Log::print(Log::LT_Warning, "Failed to submit share.");
                     break;
                 }
                 else
                     Log::print(Log::LT_Notice, "Share submitted.");
-
-                // clear result to prevent duplicate shares
-                deviceCtx.clearResult(1);
-            }
-            else
-            {
-                for (size_t i = 0; i < m_nonces.size(); ++i)
-                {
-                    pdata[19] = m_nonces[i];
-                    if ( !submit_work( mythr, &workInfo ) )
-                    {
-                        Log::print(Log::LT_Warning, "Failed to submit share.");
-                        break;
-                    }
-                    else
-                        Log::print(Log::LT_Notice, "Share submitted.");
-                }
-                // no longer needed.
-                m_nonces.clear();
-                // clear result to prevent duplicate shares
-                deviceCtx.clearResult(numPotentialNonces);
             }
+            // no longer needed.
+            m_nonces.clear();
+            // clear result to prevent duplicate shares
+            m_deviceCtx.clearResult(m_numPotentialNonces);
         }
+    }
 
-        // display hashrate
-        char hc[16];
-        char hr[16];
-        char hc_units[2] = {0,0};
-        char hr_units[2] = {0,0};
-        double hashcount = thr_hashcount[thr_id];
-        double hashrate  = thr_hashrates[thr_id];
-        if ( hashcount )
-        {
-            scale_hash_for_display( &hashcount, hc_units );
-            scale_hash_for_display( &hashrate,  hr_units );
-            if ( hc_units[0] )
-                sprintf( hc, "%.2f", hashcount );
-            else // no fractions of a hash
-                sprintf( hc, "%.0f", hashcount );
-            sprintf( hr, "%.2f", hashrate );
-            Log::print( Log::LT_Info, "Device #%d: %s %sH, %s %sH/s", thr_id, hc, hc_units, hr, hr_units );
-        }
-    }  // worker_thread loop
-
-    deviceCtx.onDestroy();
-
-    tq_freeze(mythr->q);
-    return NULL;
-}
+    // host CPU time per device. Thread per device mode includes the time spent in clFinish().
+    const double cpuWallNs = std::chrono::duration<double, std::nano>(m_end - m_lastCpuReport).count();
+    const double hostCpuPercent = (cpuWallNs > 0.0) ? (100.0 * (double)m_cpuTimeNs / cpuWallNs) : 0.0;
+    m_cpuTimeNs = 0;
+    m_lastCpuReport = m_end;
 
-//-----------------------------------------------------------------------------
-// Lyra2REv3 worker.
-//-----------------------------------------------------------------------------
-void* workerThread_lyra2REv3( void *userdata )
-{
-    thr_info *mythr = (thr_info *) userdata;
-    int thr_id = mythr->id;
-
-    // Init device context.
-    lycl::AppLyra2REv3 deviceCtx;
-    lycl::device clDevice = mythr->clDevice;
-    if (!deviceCtx.onInit(mythr->clDevice))
+    // per-stage GPU time
+    if (m_clDevice.profiling && (m_end - m_lastProfilingLog >= std::chrono::seconds(c_profilingLogIntervalSec)))
     {
-        Log::print(Log::LT_Error, "Failed to initialize device(%d)! Skipping...", thr_id);
-        // exit
-        deviceCtx.onDestroy();
-        tq_freeze(mythr->q);
-        return NULL;
+        uint64_t profiledHashes = 0;
+        m_deviceCtx.getProfiler().takeProfiles(m_stageProfiles, profiledHashes);
+        if (profiledHashes)
+            m_stageProfilesText = ", stages(ns/H): " + lycl::formatStageProfiles(m_stageProfiles, profiledHashes);
+        m_lastProfilingLog = m_end;
     }
 
-    work workInfo;
-    memset(&workInfo, 0, sizeof(work));
-    time_t firstwork_time = 0;
-
-    std::chrono::steady_clock::time_point m_start;
-    std::chrono::steady_clock::time_point m_end;
-
-    //-------------------------------------
-    // compute max runs
-    // 4294967295 max nonce
-    const uint64_t numNonces = 4294967296ULL / (uint64_t)global::numWorkerThreads;
-    uint32_t maxRuns = (uint32_t)(numNonces / (uint32_t)clDevice.workSize);
-    // last device
-    if (thr_id == (global::numWorkerThreads-1))
-        maxRuns += (uint32_t)(numNonces % global::numWorkerThreads);
-
-    // Host side validation
-    //std::vector<lycl::lyraHash> m_hashes(clDevice.workSize);
-    std::vector<uint32_t> m_potentialNonces;
-    std::vector<uint32_t> m_nonces;
-
-    Log::print(Log::LT_Debug, "Device: %d max runs: %u", thr_id, maxRuns);
+    // display hashrate
+    char hc[16];
+    char hr[16];
+    char hc_units[2] = {0,0};
+    char hr_units[2] = {0,0};
+    double hashcount = thr_hashcount[m_thrId];
+    double hashrate  = thr_hashrates[m_thrId];
+    if ( hashcount )
+    {
+        scale_hash_for_display( &hashcount, hc_units );
+        scale_hash_for_display( &hashrate,  hr_units );
+        if ( hc_units[0] )
+            sprintf( hc, "%.2f", hashcount );
+        else // no fractions of a hash
+            sprintf( hc, "%.0f", hashcount );
+        sprintf( hr, "%.2f", hashrate );
+        Log::print( Log::LT_Info, "Device %s: %s %sH, %s %sH/s, host CPU %.1f%%%s", m_deviceLabel, hc, hc_units, hr, hr_units, hostCpuPercent,
+                    m_stageProfilesText.c_str() );
+    }
 
-    uint32_t numRuns = 0;
+    // display candidate statistics
+    if (m_numCandidates != m_numReportedCandidates)
+    {
+        Log::print( Log::LT_Info, "Device %s candidates: %llu emitted, %llu passed the full target test", m_deviceLabel,
+                    (unsigned long long)m_numCandidates, (unsigned long long)m_numAcceptedCandidates );
+        m_numReportedCandidates = m_numCandidates;
+    }
 
-    for (;;)
+    // batch size and job switch latency
+    if ((m_batchSizeController.isEnabled() || m_numRestarts) &&
+        (m_end - m_lastLatencyLog >= std::chrono::seconds(c_profilingLogIntervalSec)))
     {
-        uint64_t hashes_done;
+        Log::print( Log::LT_Info, "Device %s: batch %u hashes, %.1f ms. Restart latency avg %.1f ms, max %.1f ms(%u restarts)",
+                    m_deviceLabel, (uint32_t)m_batchSize, m_lastBatchMs,
+                    m_numRestarts ? (m_restartLatencySumMs / (double)m_numRestarts) : 0.0, m_restartLatencyMaxMs, m_numRestarts );
+        m_numRestarts = 0;
+        m_restartLatencySumMs = 0.0;
+        m_restartLatencyMaxMs = 0.0;
+        m_lastLatencyLog = m_end;
+    }
 
-        //-------------------------------------
-        // wait for diff
-        while(time(NULL) >= g_work_time + 120)
-            sleep(1);
+    // hardware errors. Streams of a device share the error rate and the action.
+    if (m_clDevice.integrityCheck)
+    {
+        m_deviceIntegrity->merge(m_integritySampler);
 
-        pthread_mutex_lock( &g_work_lock );
-        //-------------------------------------
-        // get new work from stratum.
-        if (numRuns >= maxRuns)
-        {
-            // generate new work
-            stratumGenWork(&stratum, &global::g_work);
-        }
-        //-------------------------------------
-        // setup a nonce range for each worker thread
-        const int32_t workCmpSize = WorkCmpSize;
-        if ( memcmp( workInfo.data, global::g_work.data, workCmpSize)
-             && (stratum.job.clean || (numRuns >= maxRuns) || (workInfo.job_id != global::g_work.job_id)) )
+        uint64_t numChecked = 0;
+        uint64_t numErrors = 0;
+        if (m_deviceIntegrity->triggerAction(m_clDevice.integrityMaxErrorRate, numChecked, numErrors))
         {
-            Log::print(Log::LT_Debug, "Device: %d has completed its nonce range", thr_id);
-
-            // get new work
-            workFree(&workInfo );
-            workCopy(&workInfo, &global::g_work);
-            // reset run counter
-            numRuns = 0;
+            Log::print(Log::LT_Error, "Device #%d: integrity error rate %.6f(%llu errors in %llu hashes) is above %.6f.",
+                       m_clDevice.deviceIndex, (double)numErrors / (double)numChecked, (unsigned long long)numErrors,
+                       (unsigned long long)numChecked, m_clDevice.integrityMaxErrorRate);
         }
 
-        pthread_mutex_unlock( &g_work_lock );
-        //-------------------------------------
-        // if work is not available
-        if (!workInfo.data[0])
+        // every stream applies the actions triggered by any stream of the device
+        const uint32_t numActions = m_deviceIntegrity->getNumActions();
+        for (; m_numIntegrityActions < numActions; ++m_numIntegrityActions)
         {
-            sleep(1);
-            continue;
-        }
-        //-------------------------------------
-        // time limit
-        if ( global::opt_timeLimit && firstwork_time )
-        {
-            int passed = (int)( time(NULL) - firstwork_time );
-            int remain = (int)( global::opt_timeLimit - passed );
-            if ( remain < 0 )
+            if (m_clDevice.integrityAction == lycl::IA_Disable)
+            {
+                Log::print(Log::LT_Error, "Device %s is disabled.", m_deviceLabel);
+                pthread_mutex_lock( &stats_lock );
+                thr_hashrates[m_thrId] = 0;
+                pthread_mutex_unlock( &stats_lock );
+
+                m_state = WS_Exit;
+                return;
+            }
+            else if (m_clDevice.integrityAction == lycl::IA_ShrinkWorkSize)
             {
-                if ( thr_id != 0 )
+                const size_t workSize = ((m_clDevice.workSize / 2) / lycl::c_workSizeGranularity) * lycl::c_workSizeGranularity;
+                if (workSize >= c_integrityMinWorkSize)
                 {
-                    sleep(1);
-                    continue;
+                    m_clDevice.workSize = workSize;
+                    m_maxRuns = getMaxRuns(m_thrId, m_clDevice.workSize);
+                    m_batchSizeController.setMaxBatchSize(m_clDevice.workSize);
+                    // nonce range depends on WorkSize. Start a new one.
+                    m_rangeSize = (uint64_t)m_maxRuns * m_clDevice.workSize;
+                    m_rangeOffset = m_rangeSize;
+                    Log::print(Log::LT_Warning, "Device %s: WorkSize reduced to %u.", m_deviceLabel, (uint32_t)m_clDevice.workSize);
                 }
-                Log::print(Log::LT_Notice, "Mining timeout of %ds reached, exiting...", global::opt_timeLimit);
-                
-                // exit
-                deviceCtx.onDestroy();
-                tq_freeze(mythr->q);
-                return NULL;
             }
         }
-        // init time
-        if (firstwork_time == 0)
-            firstwork_time = time(NULL);
-        gwork_restart[thr_id].restart = 0;
-        hashes_done = 0;
-        m_start = std::chrono::steady_clock::now();
+    }
+}
 
 //-----------------------------------------------------------------------------
-        // Scan for nonce
-        uint32_t* pdata = workInfo.data;
-        uint32_t* ptarget = workInfo.target;
-        const uint32_t Htarg = ptarget[7];
-        const uint32_t offsetN = (maxRuns * clDevice.workSize)*thr_id;
-        const uint32_t first_nonce = offsetN + (numRuns * clDevice.workSize);
-        uint32_t nonce = first_nonce;
-
-        //-------------------------------------
-        // compute a midstate
-        if (!numRuns)
-        {
-            lycl::KernelData kernelData;
-            memset(&kernelData, 0, sizeof(kernelData));
-            
-            uint32_t h[8] =
-            {
-                0x6A09E667, 0xBB67AE85,
-                0x3C6EF372, 0xA54FF53A,
-                0x510E527F, 0x9B05688C,
-                0x1F83D9AB, 0x5BE0CD19
-            };
-            
-            kernelData.in16 = pdata[16];
-            kernelData.in17 = pdata[17];
-            kernelData.in18 = pdata[18];
-
-            blake256_compress(h, pdata);
-
-            kernelData.uH0 = h[0];
-            kernelData.uH1 = h[1];
-            kernelData.uH2 = h[2];
-            kernelData.uH3 = h[3];
-            kernelData.uH4 = h[4];
-            kernelData.uH5 = h[5];
-            kernelData.uH6 = h[6];
-            kernelData.uH7 = h[7];
-            kernelData.htArg = Htarg;
-            //Log::print(Log::LT_Notice, "Device:%d block:%u,%u,%u,%u,%u,%u,%u,%u", thr_id, h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7]);
-            //-------------------------------------
-            // upload data
-            deviceCtx.setKernelData(kernelData);
-        }
-
-        bool nonceFound = false;
-        bool isMultiNonce = false; // numNonces > 1
-
-        uint32_t numPotentialNonces = 0;
-        uint32_t singleNonce;
-        do
-        {
-            deviceCtx.onRun(nonce, clDevice.workSize);
+// Thread per device stream. TApplet: AppLyra2REv2 or AppLyra2REv3.
+//-----------------------------------------------------------------------------
+template <typename TApplet>
+void* workerThread( void *userdata )
+{
+    thr_info *mythr = (thr_info *) userdata;
 
-            // assume only 1 potential nonce was found.
-            deviceCtx.getHtArgTestResultAndSize(singleNonce, numPotentialNonces);
+    Worker<TApplet>* worker = new Worker<TApplet>();
+    if (!worker->init(mythr))
+    {
+        // exit
+        tq_freeze(mythr->q);
+        delete worker;
+        return NULL;
+    }
 
-            // check if nonce was found
-            if (numPotentialNonces != 0)
-            {
-                //Log::print(Log::LT_Notice, "Num potential nonces found: %u", numPotentialNonces);
-                lycl::uint32x8 clhash;
-                deviceCtx.getLatestHashResultForIndex(singleNonce, clhash);
-                // compute bmw hash
-                lycl::uint32x8 lhash;
-                lycl::bmwHash(clhash, lhash);
+    while (worker->getState() != Worker<TApplet>::WS_Exit)
+        worker->step();
 
-                if (fulltestU32x8(lhash, ptarget))
-                {
-                    // add nonce local offset
-                    singleNonce += nonce;
-                    work_set_target_ratio(&workInfo, &lhash.h[0]);
-                    nonceFound = true;
-                    if (numPotentialNonces == 1)
-                    {
-                        ++numRuns; // run completed
-                        break;
-                    }
-                    else
-                        m_nonces.push_back(singleNonce);
-                }
+    worker->destroy();
+    delete worker;
+    return NULL;
+}
 
-                // continue with remaining potential nonces if they were found
-                if (numPotentialNonces > 1)
-                {
-                    size_t numRemainingNonces = numPotentialNonces-1; // skip first nonce
-                    deviceCtx.getHtArgTestResults(m_potentialNonces, numRemainingNonces, 2);
-                    
-                    for (size_t g = 0; g < numRemainingNonces; ++g)
-                    {
-                        deviceCtx.getLatestHashResultForIndex(m_potentialNonces[g], clhash);
-                        // compute bmw hash
-                        lycl::bmwHash(clhash, lhash);
-
-                        if (fulltestU32x8(lhash, ptarget))
-                        {
-                            isMultiNonce = true;
-                            // add nonce local offset
-                            m_nonces.push_back(m_potentialNonces[g] + nonce); 
-
-                            work_set_target_ratio(&workInfo, &lhash.h[0]);
-                        }
-                    }
-                }
+//-----------------------------------------------------------------------------
+// Scheduler. A single host thread drives several device streams.
+//-----------------------------------------------------------------------------
+struct SchedulerSignal
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool signaled;
+};
+//-----------------------------------------------------------------------------
+//! called by the OpenCL runtime thread, when a batch is finished.
+void CL_CALLBACK onBatchComplete(cl_event /*event*/, cl_int /*status*/, void* user_data)
+{
+    SchedulerSignal* signal = (SchedulerSignal*)user_data;
+    pthread_mutex_lock(&signal->lock);
+    signal->signaled = true;
+    pthread_cond_signal(&signal->cond);
+    pthread_mutex_unlock(&signal->lock);
+}
+//-----------------------------------------------------------------------------
+//! waits for onBatchComplete() or (timeout_ms).
+inline void waitForSignal(SchedulerSignal& signal, int timeout_ms)
+{
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        ++deadline.tv_sec;
+        deadline.tv_nsec -= 1000000000L;
+    }
 
-                if (isMultiNonce)
-                {
-                    ++numRuns; // run completed
-                    break;
-                }
+    pthread_mutex_lock(&signal.lock);
+    if (!signal.signaled)
+        pthread_cond_timedwait(&signal.cond, &signal.lock, &deadline);
+    signal.signaled = false;
+    pthread_mutex_unlock(&signal.lock);
+}
+//-----------------------------------------------------------------------------
+// TApplet: AppLyra2REv2 or AppLyra2REv3.
+// Scheduler (k) drives worker ids k, k + numSchedulerThreads, ...
+// Batches are flushed without waiting. The thread sleeps until an event callback
+// reports a finished batch. The timeout covers drivers with late callbacks.
+//-----------------------------------------------------------------------------
+template <typename TApplet>
+void* schedulerThread( void *userdata )
+{
+    thr_info *mythr = (thr_info *) userdata;
+    const int schedulerIndex = mythr->id - (global::numWorkerThreads + 2);
 
-                // all nonces are invalid.
-                // clear result to prevent duplicate shares
-                deviceCtx.clearResult(numPotentialNonces);
-            }
+    std::vector<Worker<TApplet>*> workers;
+    for (int i = schedulerIndex; i < global::numWorkerThreads; i += global::numSchedulerThreads)
+    {
+        Worker<TApplet>* worker = new Worker<TApplet>();
+        if (!worker->init(&gthr_info[i]))
+        {
+            tq_freeze(gthr_info[i].q);
+            delete worker;
+            continue;
+        }
+        workers.push_back(worker);
+    }
 
-            // prepare for the next run
-            nonce += clDevice.workSize;
-            ++numRuns;
+    if (!workers.empty())
+        Log::print(Log::LT_Notice, "Scheduler %d: driving %u device streams.", schedulerIndex, (uint32_t)workers.size());
 
-        } while (numRuns < maxRuns && !gwork_restart[thr_id].restart);
+    SchedulerSignal signal;
+    pthread_mutex_init(&signal.lock, NULL);
+    pthread_cond_init(&signal.cond, NULL);
+    signal.signaled = false;
 
-        hashes_done = uint64_t(offsetN + (numRuns * clDevice.workSize)) - uint64_t(first_nonce);
+    uint64_t lastCpuTimeNs = lycl::getThreadCpuTimeNs();
+    std::chrono::steady_clock::time_point lastCpuReport = std::chrono::steady_clock::now();
 
-        //-----------------------------------------------------------------------------
+    while (!workers.empty())
+    {
+        pthread_mutex_lock(&signal.lock);
+        signal.signaled = false;
+        pthread_mutex_unlock(&signal.lock);
 
-        // record scanhash elapsed time
-        m_end = std::chrono::steady_clock::now();
-        auto diff = m_end - m_start;
-        double elapsedTimeMs = std::chrono::duration<double, std::milli>(diff).count();
-        if (elapsedTimeMs)
+        bool inFlight = false;
+        for (size_t i = 0; i < workers.size(); )
         {
-            pthread_mutex_lock( &stats_lock );
-            thr_hashcount[thr_id] = hashes_done;
-            thr_hashrates[thr_id] = hashes_done / (elapsedTimeMs * 0.001);
-            pthread_mutex_unlock( &stats_lock );
-        }
+            if (workers[i]->poll(onBatchComplete, &signal))
+                inFlight = true;
 
-        // if nonce(s) found submit work 
-        if (nonceFound)
-        {
-            if (!isMultiNonce) // nonces == 1
+            if (workers[i]->getState() == Worker<TApplet>::WS_Exit)
             {
-                pdata[19] = singleNonce;
-                if ( !submit_work( mythr, &workInfo ) )
-                {
-                    Log::print(Log::LT_Warning, "Failed to submit share.");
-                    break;
-                }
-                else
-                    Log::print(Log::LT_Notice, "Share submitted.");
-
-                // clear result to prevent duplicate shares
-                deviceCtx.clearResult(1);
+                workers[i]->destroy();
+                delete workers[i];
+                workers.erase(workers.begin() + i);
             }
             else
-            {
-                for (size_t i = 0; i < m_nonces.size(); ++i)
-                {
-                    pdata[19] = m_nonces[i];
-                    if ( !submit_work( mythr, &workInfo ) )
-                    {
-                        Log::print(Log::LT_Warning, "Failed to submit share.");
-                        break;
-                    }
-                    else
-                        Log::print(Log::LT_Notice, "Share submitted.");
-                }
-                // no longer needed.
-                m_nonces.clear();
-                // clear result to prevent duplicate shares
-                deviceCtx.clearResult(numPotentialNonces);
-            }
+                ++i;
         }
 
-        // display hashrate
-        char hc[16];
-        char hr[16];
-        char hc_units[2] = {0,0};
-        char hr_units[2] = {0,0};
-        double hashcount = thr_hashcount[thr_id];
-        double hashrate  = thr_hashrates[thr_id];
-        if ( hashcount )
+        if (!workers.empty())
+            waitForSignal(signal, inFlight ? c_schedulerPollIntervalMs : c_schedulerIdleIntervalMs);
+
+        // total host CPU time of this scheduler, including time between device updates.
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now - lastCpuReport >= std::chrono::seconds(c_profilingLogIntervalSec))
         {
-            scale_hash_for_display( &hashcount, hc_units );
-            scale_hash_for_display( &hashrate,  hr_units );
-            if ( hc_units[0] )
-                sprintf( hc, "%.2f", hashcount );
-            else // no fractions of a hash
-                sprintf( hc, "%.0f", hashcount );
-            sprintf( hr, "%.2f", hashrate );
-            Log::print( Log::LT_Info, "Device #%d: %s %sH, %s %sH/s", thr_id, hc, hc_units, hr, hr_units );
+            const uint64_t cpuTimeNs = lycl::getThreadCpuTimeNs();
+            const double wallNs = std::chrono::duration<double, std::nano>(now - lastCpuReport).count();
+            Log::print(Log::LT_Info, "Scheduler %d: host CPU %.1f%% for %u device streams.", schedulerIndex,
+                       100.0 * (double)(cpuTimeNs - lastCpuTimeNs) / wallNs, (uint32_t)workers.size());
+            lastCpuTimeNs = cpuTimeNs;
+            lastCpuReport = now;
         }
-    }  // worker_thread loop
-
-    deviceCtx.onDestroy();
+    }
 
-    tq_freeze(mythr->q);
+    pthread_cond_destroy(&signal.cond);
+    pthread_mutex_destroy(&signal.lock);
     return NULL;
 }
 
 
 
+
 int main(int argc, char** argv)
 {
     Log::print(Log::LT_Notice, "*** lyclMiner beta %s. ***", PACKAGE_VERSION);
     Log::print(Log::LT_Notice, "Developer: CryptoGraphics.\n");
 
+    //-----------------------------------------------------------------------------
+    // Stratum traffic capture. "--capture <file>" may be combined with any other arguments.
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--capture"))
+            continue;
+        if (i + 1 == argc)
+        {
+            Log::print(Log::LT_Error, "--capture requires a file name");
+            return 1;
+        }
+        if (!stratum_capture_open(argv[i + 1], getSteadyTimeUs()))
+        {
+            Log::print(Log::LT_Error, "Failed to open a capture file. (%s)", argv[i + 1]);
+            return 1;
+        }
+        Log::print(Log::LT_Notice, "Capturing stratum traffic to %s", argv[i + 1]);
+        for (int j = i + 2; j < argc; ++j)
+            argv[j - 2] = argv[j];
+        argc -= 2;
+        break;
+    }
+
     //-----------------------------------------------------------------------------
     // Config file management
     lycl::ConfigFile cf;
@@ -760,6 +1000,10 @@ int main(int argc, char** argv)
     if (csetting) global::use_colors = csetting->AsBool;
     csetting = cf.getSetting("Global", "ExtraNonce");
     if (csetting) global::opt_extranonce = csetting->AsBool;
+    csetting = cf.getSetting("Global", "KernelDir");
+    if (csetting) lycl::setKernelOverrideDir(csetting->AsString);
+    csetting = cf.getSetting("Global", "SchedulerThreads");
+    if (csetting) global::numSchedulerThreads = std::max(csetting->AsInt, 0);
 
 
     cl_int errorCode = CL_SUCCESS;
@@ -823,6 +1067,20 @@ int main(int argc, char** argv)
             clDevice.binaryFormat = lycl::BF_None;
             clDevice.asmProgram = lycl::AP_None;
             clDevice.workSize = global::defaultWorkSize;
+            clDevice.kernelRace = true;
+            clDevice.kernelVariants[0] = '\0';
+            clDevice.localWorkSizes[0] = '\0';
+            clDevice.buildOptions[0] = '\0';
+            clDevice.profiling = false;
+            clDevice.integrityCheck = false;
+            clDevice.integrityCheckInterval = 60;
+            clDevice.integrityMaxErrorRate = 0.001;
+            clDevice.integrityAction = lycl::IA_None;
+            clDevice.numStreams = 1;
+            clDevice.streamIndex = 0;
+            clDevice.deviceIndex = 0;
+            clDevice.waitMode = lycl::WM_Finish;
+            clDevice.targetBatchLatency = 0;
         
             cl_int status = clGetDeviceInfo(deviceIds[j], CL_DEVICE_TOPOLOGY_AMD, 
                                             sizeof(cl_device_topology_amd), &topology, nullptr);
@@ -912,6 +1170,17 @@ int main(int argc, char** argv)
                                "#        Enable extranonce subscription.\n"
                                "#        Default: true\n"
                                "#\n"
+                               "#    KernelDir\n"
+                               "#        Optional. Directory with the same layout as \"kernels\".\n"
+                               "#        Files found there are used instead of the ones embedded into the executable.\n"
+                               "#        Default: not set\n"
+                               "#\n"
+                               "#    SchedulerThreads\n"
+                               "#        Number of host threads driving all devices. Each thread keeps several\n"
+                               "#        devices busy and sleeps until a batch is finished.\n"
+                               "#        0: one thread per device(or per stream).\n"
+                               "#        Default: 0\n"
+                               "#\n"
                                "#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#\n"
                                "\n"
                                "<Global TerminalColors = \"false\"\n"
@@ -926,6 +1195,13 @@ int main(int argc, char** argv)
                                "            Password = \"x\"\n"
                                "            Algorithm = \"Lyra2REv3\">\n"
                                "\n"
+                               "# Backup pools in failover order: <Connection1 ...> to <Connection4 ...>.\n"
+                               "# Username and Password are optional, Algorithm is inherited from <Connection>.\n"
+                               "#\n"
+                               "# <Connection1 Url = \"stratum+tcp://backup.example.com:port\"\n"
+                               "#              Username = \"user\"\n"
+                               "#              Password = \"x\">\n"
+                               "\n"
                                "#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#-#\n"
                                "# Device config:\n"
                                "#\n"
@@ -954,7 +1230,16 @@ int main(int argc, char** argv)
             platformListText += "\n";
         }
 
-        const std::string defaultWorkSizeString(std::to_string(global::defaultWorkSize));
+        // default WorkSize, clamped to the device memory budget if necessary.
+        auto getDefaultWorkSizeString = [](size_t max_work_size) -> std::string
+        {
+            size_t workSize = (size_t)global::defaultWorkSize;
+            if (max_work_size && (workSize > max_work_size))
+                workSize = max_work_size;
+            return std::to_string(workSize);
+        };
+        size_t maxWorkSize = 0;
+        std::string limitReason;
         std::string deviceConfText;
         std::string deviceListText;
         std::string deviceName;
@@ -1004,6 +1289,11 @@ int main(int argc, char** argv)
                     deviceListText += "\n#    PCIe bus id: ";
                     pcieBusIdString = std::to_string(prevPcieBusID);
                     deviceListText += pcieBusIdString;
+                    deviceListText += "\n#    Max WorkSize: ";
+                    if (lycl::getMaxWorkSizeForDevice(logicalDevices[i].clId, maxWorkSize, &limitReason))
+                        deviceListText += std::to_string(maxWorkSize) + " (limited by " + limitReason + ")";
+                    else
+                        deviceListText += "unknown";
                     deviceListText += availablePlatformIndices;
                     platformIndexString = std::to_string(logicalDevices[i].platformIndex);
                     deviceListText += platformIndexString;
@@ -1030,7 +1320,7 @@ int main(int argc, char** argv)
                     deviceConfText += "\"";
                 
                     deviceConfText += " WorkSize = \"";
-                    deviceConfText += defaultWorkSizeString;
+                    deviceConfText += getDefaultWorkSizeString(maxWorkSize);
                     deviceConfText += "\">\n";
                 }
                 else
@@ -1076,6 +1366,12 @@ int main(int argc, char** argv)
                 deviceListText += "\n#    Platform index: ";
                 deviceListText += std::to_string(logicalDevices[i].platformIndex);
 
+                deviceListText += "\n#    Max WorkSize: ";
+                if (lycl::getMaxWorkSizeForDevice(logicalDevices[i].clId, maxWorkSize, &limitReason))
+                    deviceListText += std::to_string(maxWorkSize) + " (limited by " + limitReason + ")";
+                else
+                    deviceListText += "unknown";
+
                 //  get device config
                 deviceConfText += "<Device";
                 deviceConfText += std::to_string(i);
@@ -1094,7 +1390,7 @@ int main(int argc, char** argv)
                 deviceConfText += "\"";
                 
                 deviceConfText += " WorkSize = \"";
-                deviceConfText += defaultWorkSizeString;
+                deviceConfText += getDefaultWorkSizeString(maxWorkSize);
                 deviceConfText += "\">\n";
             }
         }
@@ -1150,6 +1446,28 @@ int main(int argc, char** argv)
         Log::print(Log::LT_Error, "\"Algorithm\" parameter is not set or incorrect(%s).", csetting->AsString.c_str());
         return 1;
     }
+    global::poolConnectionInfo.push_back(global::connectionInfo);
+
+    //-------------------------------------
+    // setup backup pools, <Connection1>...<ConnectionN> in failover order.
+    for (int i = 1; i <= STRATUM_MAX_BACKUPS; ++i)
+    {
+        std::string connectionBlock = std::string("Connection") + std::to_string(i);
+        csetting = cf.getSetting(connectionBlock.c_str(), "Url");
+        if (!csetting)
+            break;
+
+        // credentials default to the primary pool, algorithm is always the same
+        ConnectionInfo backupInfo = global::connectionInfo;
+        backupInfo.rpc_url = csetting->AsString;
+        csetting = cf.getSetting(connectionBlock.c_str(), "Username");
+        if (csetting) backupInfo.rpc_user = csetting->AsString;
+        csetting = cf.getSetting(connectionBlock.c_str(), "Password");
+        if (csetting) backupInfo.rpc_pass = csetting->AsString;
+        backupInfo.rpc_userpass = backupInfo.rpc_user + ":" + backupInfo.rpc_pass;
+
+        global::poolConnectionInfo.push_back(backupInfo);
+    }
 
 
     //-------------------------------------
@@ -1177,6 +1495,18 @@ int main(int argc, char** argv)
             int workSize = 0;
             lycl::EBinaryFormat binaryFormat = lycl::BF_None;
             lycl::EAsmProgram asmProgram = lycl::AP_None; 
+            bool kernelRace = true;
+            std::string kernelVariants;
+            std::string localWorkSizes;
+            std::string buildOptions;
+            bool profiling = false;
+            bool integrityCheck = false;
+            int integrityCheckInterval = 60;
+            double integrityMaxErrorRate = 0.001;
+            lycl::EIntegrityAction integrityAction = lycl::IA_None;
+            int numStreams = 1;
+            lycl::EWaitMode waitMode = lycl::WM_Finish;
+            int targetBatchLatency = 0;
 
             // get platform index
             csetting = cf.getSetting(deviceBlock.c_str(), "PlatformIndex"); 
@@ -1202,6 +1532,46 @@ int main(int argc, char** argv)
             csetting = cf.getSetting(deviceBlock.c_str(), "WorkSize"); 
             if (csetting) workSize = csetting->AsInt;
 
+            // get kernel race flag
+            csetting = cf.getSetting(deviceBlock.c_str(), "KernelRace"); 
+            if (csetting) kernelRace = csetting->AsBool;
+
+            // get kernel variant overrides
+            csetting = cf.getSetting(deviceBlock.c_str(), "KernelVariants"); 
+            if (csetting) kernelVariants = csetting->AsString;
+
+            // get OpenCL kernel build settings
+            csetting = cf.getSetting(deviceBlock.c_str(), "LocalWorkSize"); 
+            if (csetting) localWorkSizes = csetting->AsString;
+            csetting = cf.getSetting(deviceBlock.c_str(), "BuildOptions"); 
+            if (csetting) buildOptions = csetting->AsString;
+
+            // get profiling flag
+            csetting = cf.getSetting(deviceBlock.c_str(), "Profiling"); 
+            if (csetting) profiling = csetting->AsBool;
+
+            // get integrity check settings
+            csetting = cf.getSetting(deviceBlock.c_str(), "IntegrityCheck"); 
+            if (csetting) integrityCheck = csetting->AsBool;
+            csetting = cf.getSetting(deviceBlock.c_str(), "IntegrityCheckInterval"); 
+            if (csetting) integrityCheckInterval = csetting->AsInt;
+            csetting = cf.getSetting(deviceBlock.c_str(), "IntegrityMaxErrorRate"); 
+            if (csetting) integrityMaxErrorRate = csetting->AsFloat;
+            csetting = cf.getSetting(deviceBlock.c_str(), "IntegrityAction"); 
+            if (csetting) integrityAction = lycl::getIntegrityActionFromName(csetting->AsString);
+
+            // get number of streams
+            csetting = cf.getSetting(deviceBlock.c_str(), "Streams"); 
+            if (csetting) numStreams = csetting->AsInt;
+
+            // get wait mode
+            csetting = cf.getSetting(deviceBlock.c_str(), "WaitMode"); 
+            if (csetting) waitMode = lycl::getWaitModeFromName(csetting->AsString);
+
+            // get target batch latency
+            csetting = cf.getSetting(deviceBlock.c_str(), "TargetBatchLatency"); 
+            if (csetting) targetBatchLatency = csetting->AsInt;
+
             // check if pcieBusID and platfromIndex are correct
             ptrdiff_t foundPCIeBusId = -1;
             ptrdiff_t foundPlatformIndex = -1;
@@ -1246,6 +1616,21 @@ int main(int argc, char** argv)
                 // AsmProgram will be detected on context init
                 configuredDevices[configuredDevices.size() - 1].binaryFormat = binaryFormat;
                 configuredDevices[configuredDevices.size() - 1].asmProgram = asmProgram;
+                configuredDevices[configuredDevices.size() - 1].kernelRace = kernelRace;
+                strncpy(configuredDevices[configuredDevices.size() - 1].kernelVariants, kernelVariants.c_str(), sizeof(lycl::device::kernelVariants) - 1);
+                configuredDevices[configuredDevices.size() - 1].kernelVariants[sizeof(lycl::device::kernelVariants) - 1] = '\0';
+                strncpy(configuredDevices[configuredDevices.size() - 1].localWorkSizes, localWorkSizes.c_str(), sizeof(lycl::device::localWorkSizes) - 1);
+                configuredDevices[configuredDevices.size() - 1].localWorkSizes[sizeof(lycl::device::localWorkSizes) - 1] = '\0';
+                strncpy(configuredDevices[configuredDevices.size() - 1].buildOptions, buildOptions.c_str(), sizeof(lycl::device::buildOptions) - 1);
+                configuredDevices[configuredDevices.size() - 1].buildOptions[sizeof(lycl::device::buildOptions) - 1] = '\0';
+                configuredDevices[configuredDevices.size() - 1].profiling = profiling;
+                configuredDevices[configuredDevices.size() - 1].integrityCheck = integrityCheck;
+                configuredDevices[configuredDevices.size() - 1].integrityCheckInterval = (integrityCheckInterval > 0) ? (uint32_t)integrityCheckInterval : 1;
+                configuredDevices[configuredDevices.size() - 1].integrityMaxErrorRate = integrityMaxErrorRate;
+                configuredDevices[configuredDevices.size() - 1].integrityAction = integrityAction;
+                configuredDevices[configuredDevices.size() - 1].numStreams = (uint32_t)std::min(std::max(numStreams, 1), c_maxStreamsPerDevice);
+                configuredDevices[configuredDevices.size() - 1].waitMode = waitMode;
+                configuredDevices[configuredDevices.size() - 1].targetBatchLatency = (uint32_t)std::max(targetBatchLatency, 0);
             }
             else
                 Log::print(Log::LT_Warning, "\"PCIeBusId\" is invalid inside \"%s\" section. Skipping device...", deviceBlock.c_str());
@@ -1263,6 +1648,18 @@ int main(int argc, char** argv)
             int workSize = 0;
             lycl::EBinaryFormat binaryFormat = lycl::BF_None;
             lycl::EAsmProgram asmProgram = lycl::AP_None; 
+            bool kernelRace = true;
+            std::string kernelVariants;
+            std::string localWorkSizes;
+            std::string buildOptions;
+            bool profiling = false;
+            bool integrityCheck = false;
+            int integrityCheckInterval = 60;
+            double integrityMaxErrorRate = 0.001;
+            lycl::EIntegrityAction integrityAction = lycl::IA_None;
+            int numStreams = 1;
+            lycl::EWaitMode waitMode = lycl::WM_Finish;
+            int targetBatchLatency = 0;
 
             // get program binary format
             csetting = cf.getSetting(deviceBlock.c_str(), "BinaryFormat"); 
@@ -1284,6 +1681,46 @@ int main(int argc, char** argv)
             csetting = cf.getSetting(deviceBlock.c_str(), "WorkSize"); 
             if (csetting) workSize = csetting->AsInt;
 
+            // get kernel race flag
+            csetting = cf.getSetting(deviceBlock.c_str(), "KernelRace"); 
+            if (csetting) kernelRace = csetting->AsBool;
+
+            // get kernel variant overrides
+            csetting = cf.getSetting(deviceBlock.c_str(), "KernelVariants"); 
+            if (csetting) kernelVariants = csetting->AsString;
+
+            // get OpenCL kernel build settings
+            csetting = cf.getSetting(deviceBlock.c_str(), "LocalWorkSize"); 
+            if (csetting) localWorkSizes = csetting->AsString;
+            csetting = cf.getSetting(deviceBlock.c_str(), "BuildOptions"); 
+            if (csetting) buildOptions = csetting->AsString;
+
+            // get profiling flag
+            csetting = cf.getSetting(deviceBlock.c_str(), "Profiling"); 
+            if (csetting) profiling = csetting->AsBool;
+
+            // get integrity check settings
+            csetting = cf.getSetting(deviceBlock.c_str(), "IntegrityCheck"); 
+            if (csetting) integrityCheck = csetting->AsBool;
+            csetting = cf.getSetting(deviceBlock.c_str(), "IntegrityCheckInterval"); 
+            if (csetting) integrityCheckInterval = csetting->AsInt;
+            csetting = cf.getSetting(deviceBlock.c_str(), "IntegrityMaxErrorRate"); 
+            if (csetting) integrityMaxErrorRate = csetting->AsFloat;
+            csetting = cf.getSetting(deviceBlock.c_str(), "IntegrityAction"); 
+            if (csetting) integrityAction = lycl::getIntegrityActionFromName(csetting->AsString);
+
+            // get number of streams
+            csetting = cf.getSetting(deviceBlock.c_str(), "Streams"); 
+            if (csetting) numStreams = csetting->AsInt;
+
+            // get wait mode
+            csetting = cf.getSetting(deviceBlock.c_str(), "WaitMode"); 
+            if (csetting) waitMode = lycl::getWaitModeFromName(csetting->AsString);
+
+            // get target batch latency
+            csetting = cf.getSetting(deviceBlock.c_str(), "TargetBatchLatency"); 
+            if (csetting) targetBatchLatency = csetting->AsInt;
+
             // check if pcieBusID and platfromIndex are correct
             if ((deviceIndex < logicalDevices.size()) && (deviceIndex >= 0))
             {
@@ -1302,6 +1739,21 @@ int main(int argc, char** argv)
                 // AsmProgram will be detected on context init
                 configuredDevices[configuredDevices.size()- 1].binaryFormat = binaryFormat;
                 configuredDevices[configuredDevices.size()- 1].asmProgram = asmProgram;
+                configuredDevices[configuredDevices.size()- 1].kernelRace = kernelRace;
+                strncpy(configuredDevices[configuredDevices.size()- 1].kernelVariants, kernelVariants.c_str(), sizeof(lycl::device::kernelVariants) - 1);
+                configuredDevices[configuredDevices.size()- 1].kernelVariants[sizeof(lycl::device::kernelVariants) - 1] = '\0';
+                strncpy(configuredDevices[configuredDevices.size()- 1].localWorkSizes, localWorkSizes.c_str(), sizeof(lycl::device::localWorkSizes) - 1);
+                configuredDevices[configuredDevices.size()- 1].localWorkSizes[sizeof(lycl::device::localWorkSizes) - 1] = '\0';
+                strncpy(configuredDevices[configuredDevices.size()- 1].buildOptions, buildOptions.c_str(), sizeof(lycl::device::buildOptions) - 1);
+                configuredDevices[configuredDevices.size()- 1].buildOptions[sizeof(lycl::device::buildOptions) - 1] = '\0';
+                configuredDevices[configuredDevices.size()- 1].profiling = profiling;
+                configuredDevices[configuredDevices.size()- 1].integrityCheck = integrityCheck;
+                configuredDevices[configuredDevices.size()- 1].integrityCheckInterval = (integrityCheckInterval > 0) ? (uint32_t)integrityCheckInterval : 1;
+                configuredDevices[configuredDevices.size()- 1].integrityMaxErrorRate = integrityMaxErrorRate;
+                configuredDevices[configuredDevices.size()- 1].integrityAction = integrityAction;
+                configuredDevices[configuredDevices.size()- 1].numStreams = (uint32_t)std::min(std::max(numStreams, 1), c_maxStreamsPerDevice);
+                configuredDevices[configuredDevices.size()- 1].waitMode = waitMode;
+                configuredDevices[configuredDevices.size()- 1].targetBatchLatency = (uint32_t)std::max(targetBatchLatency, 0);
             }
             else
                 Log::print(Log::LT_Warning, "\"DeviceIndex\" is invalid inside \"%s\" section. Skipping device...", deviceBlock.c_str());
@@ -1314,19 +1766,49 @@ int main(int argc, char** argv)
 //-----------------------------------------------------------------------------
     // Init miner
 
-    // 1 device per thread
+    // 1 stream per thread. Streams of the same device share its memory budget and integrity counters.
+    g_deviceIntegrity = new lycl::DeviceIntegrity[configuredDevices.size()];
+    std::vector<lycl::device> workerDevices;
+    for (size_t i = 0; i < configuredDevices.size(); ++i)
+    {
+        for (uint32_t j = 0; j < configuredDevices[i].numStreams; ++j)
+        {
+            workerDevices.push_back(configuredDevices[i]);
+            workerDevices.back().deviceIndex = (int32_t)i;
+            workerDevices.back().streamIndex = j;
+        }
+        if (configuredDevices[i].numStreams > 1)
+            Log::print(Log::LT_Info, "Device #%d: %u streams.", (int)i, configuredDevices[i].numStreams);
+    }
+    configuredDevices.swap(workerDevices);
+
     global::numWorkerThreads = configuredDevices.size();
     if (!global::numWorkerThreads)
     {
         Log::print(Log::LT_Warning, "Found 0 configured devices. Exiting...");
         return 0;
     }
+    if (global::numSchedulerThreads > global::numWorkerThreads)
+        global::numSchedulerThreads = global::numWorkerThreads;
 
     pthread_mutex_init(&Log::applog_lock, NULL);
     pthread_mutex_init(&stats_lock, NULL);
     pthread_mutex_init(&g_work_lock, NULL);
     pthread_mutex_init(&stratum.sock_lock, NULL);
     pthread_mutex_init(&stratum.work_lock, NULL);
+    stratum_num_standbys = (int)global::poolConnectionInfo.size() - 1;
+    for (int i = 0; i < stratum_num_standbys; ++i)
+    {
+        stratum_standby& slot = stratum_standbys[i];
+        pthread_mutex_init(&slot.lock, NULL);
+        pthread_mutex_init(&slot.ctx.sock_lock, NULL);
+        pthread_mutex_init(&slot.ctx.work_lock, NULL);
+        slot.ctx.standby = true;
+        slot.ctx.pool_index = i + 1;
+        slot.ctx.url = strdup(global::poolConnectionInfo[i + 1].rpc_url.c_str());
+    }
+    share_pool_init();
+    share_tracker_init();
 
     long flags = strncmp(global::connectionInfo.rpc_url.c_str(), "https:", 6) ? (CURL_GLOBAL_ALL & ~CURL_GLOBAL_SSL) : CURL_GLOBAL_ALL;
     if (curl_global_init(flags))
@@ -1345,7 +1827,7 @@ int main(int argc, char** argv)
     gwork_restart = (struct work_restart*) calloc(global::numWorkerThreads, sizeof(*gwork_restart));
     if (!gwork_restart)
         return 1;
-    gthr_info = (struct thr_info*) calloc(global::numWorkerThreads + 4, sizeof(*thr));
+    gthr_info = (struct thr_info*) calloc(global::numWorkerThreads + global::numSchedulerThreads + 4, sizeof(*thr));
     if (!gthr_info)
         return 1;
     thr_hashrates = (double *) calloc(global::numWorkerThreads, sizeof(double));
@@ -1356,7 +1838,7 @@ int main(int argc, char** argv)
         return 1;
 
     // Currect thread layout:
-    // [workIO,stratum,Device0...DeviceN]
+    // [Device0...DeviceN,workIO,stratum,Scheduler0...SchedulerM,standby]
 
     //-----------------------------------------------------------------------------
     // create work I/O thread
@@ -1390,6 +1872,21 @@ int main(int argc, char** argv)
 
     tq_push(gthr_info[stratum_thr_id].q, strdup(global::connectionInfo.rpc_url.c_str()));
 
+    //-----------------------------------------------------------------------------
+    // create backup pool thread
+    if (stratum_num_standbys)
+    {
+        const int standbyThrId = global::numWorkerThreads + global::numSchedulerThreads + 2;
+        thr = &gthr_info[standbyThrId];
+        thr->id = standbyThrId;
+        if (thread_create(thr, stratum_standby_thread))
+        {
+            Log::print(Log::LT_Error, "backup pool thread create failed");
+            return 1;
+        }
+        Log::print(Log::LT_Info, "%d backup pools configured.", stratum_num_standbys);
+    }
+
     //-----------------------------------------------------------------------------
     // create worker threads
     int numWorkerThreads = 0;
@@ -1402,12 +1899,19 @@ int main(int argc, char** argv)
         if (!thr->q)
             return 1;
 
+        // devices are driven by scheduler threads.
+        if (global::numSchedulerThreads)
+        {
+            ++numWorkerThreads;
+            continue;
+        }
+
         lycl::EAlgorithm selectedAlgo = global::connectionInfo.algo;
         int thrResult = 0;
         if (selectedAlgo == lycl::A_Lyra2REv3) 
-            thrResult = thread_create(thr, workerThread_lyra2REv3);
+            thrResult = thread_create(thr, workerThread<lycl::AppLyra2REv3>);
         else if (selectedAlgo == lycl::A_Lyra2REv2)
-            thrResult = thread_create(thr, workerThread_lyra2REv2);
+            thrResult = thread_create(thr, workerThread<lycl::AppLyra2REv2>);
         else // should never happen
         {
             Log::print(Log::LT_Error, "worker thread %d create failed. Algorithm is not set or incorrect!", i);
@@ -1423,6 +1927,32 @@ int main(int argc, char** argv)
         ++numWorkerThreads;
     }
 
+    //-----------------------------------------------------------------------------
+    // create scheduler threads
+    for (int i = 0; i < global::numSchedulerThreads; i++)
+    {
+        const int schedulerThrId = global::numWorkerThreads + 2 + i;
+        thr = &gthr_info[schedulerThrId];
+        thr->id = schedulerThrId;
+
+        lycl::EAlgorithm selectedAlgo = global::connectionInfo.algo;
+        int thrResult = 0;
+        if (selectedAlgo == lycl::A_Lyra2REv3) 
+            thrResult = thread_create(thr, schedulerThread<lycl::AppLyra2REv3>);
+        else if (selectedAlgo == lycl::A_Lyra2REv2)
+            thrResult = thread_create(thr, schedulerThread<lycl::AppLyra2REv2>);
+        else // should never happen
+            thrResult = 1;
+
+        if (thrResult)
+        {
+            Log::print(Log::LT_Error, "scheduler thread %d create failed", i);
+            return 1;
+        }
+    }
+    if (global::numSchedulerThreads)
+        Log::print(Log::LT_Info, "%d scheduler threads started.", global::numSchedulerThreads);
+
     if (numWorkerThreads > 0)
     {
         Log::print(Log::LT_Info, "%d worker threads started, using %s algorithm.",